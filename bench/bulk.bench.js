@@ -0,0 +1,101 @@
+/**
+ * Clipboard transfer over the bulk channel on loopback, with input latency
+ * measured at the same time: the sender streams key_raw events at a fixed
+ * rate, once alone and once while a large clipboard is sent. Both peers run
+ * in this process, so the sender's chunking and the receiver's reassembly
+ * share one event loop with the input, the worst case for latency.
+ *
+ *   bun bench/bulk.bench.js [megabytes] [keys/s]
+ */
+import { mkdtempSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { loadIdentity } from '../src/network/certs.js';
+import { Peer } from '../src/network/peer.js';
+
+const MEGABYTES = Number.parseFloat(process.argv[2]) || 10;
+const RATE = Number.parseInt(process.argv[3]) || 200;
+const BASELINE = 2000;
+const PORT = 24850;
+const TOKEN = 'bench';
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+const dir = mkdtempSync(join(tmpdir(), 'bzz-bench-'));
+const identity = await loadIdentity(dir);
+rmSync(dir, { recursive: true });
+
+// text that compresses about like source code or prose
+function clipboard(bytes) {
+  const words = ['const', 'return', 'peer', 'socket', 'frame', 'the', 'input', 'buffer', 'async', 'await'];
+  const parts = [];
+  let length = 0;
+  for (let i = 0, seed = 1; length < bytes; i++) {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    const word = `${words[seed % words.length]}${seed % 1000} `;
+    parts.push(word);
+    length += word.length;
+  }
+  return parts.join('').slice(0, bytes);
+}
+
+const receiver = new Peer({ port: PORT, authToken: TOKEN, identity, snapshot: 0 });
+const sender = new Peer({ port: PORT + 1, authToken: TOKEN, identity, snapshot: 0 });
+receiver.lockMouse = sender.lockMouse = () => {};
+await receiver.init();
+await sender.init();
+
+// the reliable lane delivers in order, the nth key received is the nth sent
+const sentAt = [];
+const latencies = [];
+receiver.on('key_raw', () => latencies.push(performance.now() - sentAt[latencies.length]));
+let pasted = null;
+receiver.on('clipboard', (data) => pasted?.(data));
+
+if (!(await sender.connect('127.0.0.1', PORT))) {
+  console.error('connect failed');
+  process.exit(1);
+}
+await sleep(100);
+
+let typing = null;
+function type() {
+  typing = setInterval(() => {
+    sentAt.push(performance.now());
+    sender.broadcast('key_raw', { keycode: 30, pressed: sentAt.length & 1 });
+  }, 1000 / RATE);
+}
+
+function report(label, from) {
+  const sorted = latencies.slice(from).sort((a, b) => a - b);
+  const at = (q) => sorted[Math.min(sorted.length - 1, Math.floor(q * sorted.length))].toFixed(2);
+  console.log(
+    `${label.padEnd(22)} ${String(sorted.length).padStart(5)} keys  p50 ${at(0.5)} ms  p99 ${at(0.99)} ms  max ${at(1)} ms`,
+  );
+}
+
+type();
+await sleep(BASELINE);
+report('input alone', 0);
+
+const text = clipboard(MEGABYTES * 1024 * 1024);
+const from = latencies.length;
+const received = new Promise((resolve) => {
+  pasted = resolve;
+});
+const start = performance.now();
+const ok = await sender.broadcast('clipboard', { primary: false, text });
+const data = await received;
+const elapsed = (performance.now() - start) / 1000;
+await sleep(100);
+clearInterval(typing);
+await sleep(100);
+
+report('input during transfer', from);
+const transfer = [...sender.peers][0];
+console.log(
+  `clipboard ${MEGABYTES} MB  ${ok && data.text === text ? 'ok' : 'CORRUPT'}  ${elapsed.toFixed(2)} s  ${(MEGABYTES / elapsed).toFixed(1)} MB/s  lane rto ${transfer.sendLane.rtt.rto.toFixed(1)} ms`,
+);
+
+sender.cleanup();
+receiver.cleanup();
+process.exit(0);
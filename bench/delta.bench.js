@@ -0,0 +1,60 @@
+/**
+ * Clipboard delta against a full transfer: a 5 MB text with a 1 KB edit in
+ * the middle, bytes on the wire after the bulk channel's compression and the
+ * CPU time to encode and apply the delta, with the native checksum kernel
+ * and the JS one.
+ *
+ *   bun bench/delta.bench.js [megabytes] [edit bytes]
+ */
+import { pack } from '../src/network/bulk.js';
+import { applyDelta, encodeDelta, jsKernel, kernel } from '../src/network/delta.js';
+
+const MEGABYTES = Number.parseFloat(process.argv[2]) || 5;
+const EDIT = Number.parseInt(process.argv[3]) || 1024;
+const RUNS = 5;
+
+// text that compresses about like source code or prose
+function clipboard(bytes, seed = 1) {
+  const words = ['const', 'return', 'peer', 'socket', 'frame', 'the', 'input', 'buffer', 'async', 'await'];
+  const parts = [];
+  let length = 0;
+  while (length < bytes) {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    const word = `${words[seed % words.length]}${seed % 1000} `;
+    parts.push(word);
+    length += word.length;
+  }
+  return Buffer.from(parts.join('').slice(0, bytes));
+}
+
+function cpu(fn) {
+  let result;
+  const times = [];
+  for (let i = 0; i < RUNS; i++) {
+    const start = process.cpuUsage();
+    result = fn();
+    const used = process.cpuUsage(start);
+    times.push((used.user + used.system) / 1000);
+  }
+  return { result, ms: times.sort((a, b) => a - b)[RUNS >> 1] };
+}
+
+const basis = clipboard(MEGABYTES * (1 << 20));
+const at = basis.length >> 1;
+const edited = Buffer.concat([basis.subarray(0, at), clipboard(EDIT, 42), basis.subarray(at + EDIT)]);
+
+const full = await pack(edited);
+console.log(`${MEGABYTES} MB, ${EDIT} byte edit`);
+console.log(`${'full transfer'.padEnd(24)} ${String(full.data.length).padStart(9)} bytes`);
+
+const kernels = [['delta, js kernel', jsKernel]];
+if (kernel !== jsKernel) kernels.unshift(['delta, native kernel', kernel]);
+for (const [label, k] of kernels) {
+  const { result: delta, ms } = cpu(() => encodeDelta(basis, edited, { kernel: k }));
+  const wire = await pack(delta);
+  const apply = cpu(() => applyDelta(basis, delta));
+  if (!apply.result.equals(edited)) throw new Error('delta does not rebuild the content');
+  console.log(
+    `${label.padEnd(24)} ${String(wire.data.length).padStart(9)} bytes  encode ${ms.toFixed(1).padStart(6)} ms cpu  apply ${apply.ms.toFixed(1).padStart(5)} ms cpu`,
+  );
+}
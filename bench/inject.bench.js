@@ -0,0 +1,88 @@
+/**
+ * Input injection into a headless sway (test/headless.js): the same stream
+ * of relative motion, wheel and key events is injected once an event at a
+ * time, each sent to the compositor on its own, and once in receive-batch
+ * sized wlInputBegin/wlInputCommit batches. Reports the syscalls of the
+ * compositor and of this process per event, from /proc/<pid>/io.
+ *
+ * The event at a time run is the unbatched path of this tree, not the code
+ * before batching, which also flushed again from peer.js after every event.
+ * It compares the two paths, it does not measure what batching saved.
+ *
+ *   bun bench/inject.bench.js [events] [batch]
+ */
+import { readFileSync } from 'node:fs';
+import { DisplayServer } from '../src/display.js';
+import '../src/wayland/index.js';
+import { Sway } from '../test/headless.js';
+
+const EVENTS = Number.parseInt(process.argv[2]) || 20_000;
+const BATCH = Number.parseInt(process.argv[3]) || 32;
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+// read and write syscalls of a process so far
+function syscalls(pid) {
+  const io = Object.fromEntries(
+    readFileSync(`/proc/${pid}/io`, 'utf8')
+      .trim()
+      .split('\n')
+      .map((line) => line.split(': ')),
+  );
+  return Number(io.syscr) + Number(io.syscw);
+}
+
+if (!Sway.which('sway')) {
+  console.error('sway not found, the benchmark needs a headless sway');
+  process.exit(1);
+}
+const sway = new Sway();
+await sway.start();
+process.env.WAYLAND_DISPLAY = sway.display;
+process.env.XDG_SESSION_TYPE = 'wayland';
+
+const display = DisplayServer.create();
+if (!display.setup(1920, 1080)) {
+  console.error('cannot set up the wayland display');
+  sway.stop();
+  process.exit(1);
+}
+
+// what a receive batch of pointer traffic looks like: mostly motion, a
+// wheel notch and a key now and then
+function inject(i) {
+  if (i % 256 === 255) {
+    display.keyRaw(30, 1);
+    display.keyRaw(30, 0);
+  } else if (i % 64 === 63) display.mouseWheel(0, 1);
+  else display.mouseRelativeMotion((i & 1) * 2 - 1, 1);
+}
+
+async function run(label, batched) {
+  await sleep(200);
+  const compositor = syscalls(sway.process.pid);
+  const self = syscalls('self');
+  const start = performance.now();
+  for (let i = 0; i < EVENTS; i += BATCH) {
+    if (batched) display.inputBegin();
+    for (let j = i; j < Math.min(i + BATCH, EVENTS); j++) inject(j);
+    if (batched) display.inputCommit();
+    // let the compositor keep up, as it would between receive batches
+    if ((i / BATCH) % 16 === 15) await sleep(1);
+  }
+  const elapsed = performance.now() - start;
+  await sleep(200);
+  const perEvent = (n) => (n / EVENTS).toFixed(3);
+  console.log(
+    `${label.padEnd(16)} compositor ${perEvent(syscalls(sway.process.pid) - compositor)} syscalls/event  ` +
+      `client ${perEvent(syscalls('self') - self)} syscalls/event  ${((elapsed * 1000) / EVENTS).toFixed(2)} us/event`,
+  );
+}
+
+console.log(`${EVENTS} events, batches of ${BATCH}`);
+await run('event at a time', false);
+await run('batched', true);
+
+display.close();
+sway.stop();
+process.exit(0);
@@ -0,0 +1,54 @@
+/**
+ * Wayland backend startup against a headless sway (test/headless.js): time
+ * from wlContextNew until wlSetup has the globals, the seat, the outputs and
+ * the keymap and the virtual input devices are made. The library is loaded
+ * once before, so this is setup alone, not compiling or dlopen.
+ *
+ * It times the setup of this tree only. The earlier setup, a roundtrip per
+ * step, is not here to compare against, so this shows what setup costs,
+ * not what the sync barriers saved.
+ *
+ *   bun bench/setup.bench.js [runs]
+ */
+import { DisplayServer } from '../src/display.js';
+import '../src/wayland/index.js';
+import { Sway } from '../test/headless.js';
+
+const RUNS = Number.parseInt(process.argv[2]) || 20;
+
+const percentile = (times, p) => times[Math.min(times.length - 1, Math.floor(times.length * p))];
+
+if (!Sway.which('sway')) {
+  console.error('sway not found, the benchmark needs a headless sway');
+  process.exit(1);
+}
+const sway = new Sway();
+await sway.start();
+process.env.WAYLAND_DISPLAY = sway.display;
+process.env.XDG_SESSION_TYPE = 'wayland';
+
+// loads the library
+DisplayServer.create().contextFree();
+
+const times = [];
+for (let i = 0; i < RUNS; i++) {
+  const start = performance.now();
+  const display = DisplayServer.create();
+  const ready = display.setup(1920, 1080);
+  const time = performance.now() - start;
+  display.close();
+  if (!ready) {
+    console.error('cannot set up the wayland display');
+    sway.stop();
+    process.exit(1);
+  }
+  times.push(time);
+}
+times.sort((a, b) => a - b);
+console.log(
+  `${RUNS} runs  median ${percentile(times, 0.5).toFixed(2)} ms  p95 ${percentile(times, 0.95).toFixed(2)} ms  ` +
+    `min ${times[0].toFixed(2)} ms`,
+);
+
+sway.stop();
+process.exit(0);
@@ -0,0 +1,69 @@
+/**
+ * CLI startup benchmark: wall time of `bzz spawn` until the peer is up and
+ * of a `bzz send` to it, once with every native unit compiled by TinyCC at
+ * import (a cold cache) and once loaded from the cache `bun run build`
+ * fills (warm). Runs in a scratch HOME so the real config and cache are
+ * left alone.
+ *
+ *   bun bench/startup.bench.js [runs]
+ */
+import { mkdtempSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+
+const RUNS = Number.parseInt(process.argv[2]) || 5;
+const CLI = join(import.meta.dir, '..', 'src', 'cli.js');
+const BUILD = join(import.meta.dir, '..', 'src', 'build.js');
+const PORT = 23456;
+
+const home = mkdtempSync(join(tmpdir(), 'bzz-startup-'));
+const baseEnv = { ...process.env, HOME: home, DEBUG: '' };
+
+const median = (times) => times.sort((a, b) => a - b)[Math.floor(times.length / 2)];
+
+async function spawnPeer(env) {
+  const start = performance.now();
+  const proc = Bun.spawn([process.execPath, CLI, 'spawn', String(PORT)], { env, stdout: 'pipe', stderr: 'ignore' });
+  const decoder = new TextDecoder();
+  let out = '';
+  for await (const chunk of proc.stdout) {
+    out += decoder.decode(chunk);
+    if (out.includes('Spawned peer')) break;
+  }
+  return { proc, time: performance.now() - start };
+}
+
+async function send(env) {
+  const start = performance.now();
+  const proc = Bun.spawn([process.execPath, CLI, 'send', String(PORT), 'bench'], { env, stdout: 'ignore', stderr: 'ignore' });
+  await proc.exited;
+  return performance.now() - start;
+}
+
+async function run(label, env) {
+  const spawns = [];
+  const sends = [];
+  for (let i = 0; i < RUNS; i++) {
+    const { proc, time } = await spawnPeer(env);
+    spawns.push(time);
+    sends.push(await send(env));
+    proc.kill();
+    await proc.exited;
+  }
+  console.log(`${label.padEnd(22)} spawn ${median(spawns).toFixed(0).padStart(5)} ms  send ${median(sends).toFixed(0).padStart(5)} ms`);
+}
+
+// the first start makes the identity and auth token, not what is measured
+await send({ ...baseEnv, BZZ_NATIVE: 'tcc' });
+
+console.log(`median of ${RUNS} runs`);
+await run('cold (tinycc)', { ...baseEnv, BZZ_NATIVE: 'tcc' });
+
+const start = performance.now();
+const build = Bun.spawnSync([process.execPath, BUILD], { env: baseEnv, stdout: 'ignore', stderr: 'inherit' });
+console.log(`${'build'.padEnd(22)} ${(performance.now() - start).toFixed(0).padStart(11)} ms${build.exitCode ? '  (failed)' : ''}`);
+
+await run('warm (cached, dlopen)', baseEnv);
+
+rmSync(home, { recursive: true, force: true });
+process.exit(0);
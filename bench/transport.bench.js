@@ -0,0 +1,108 @@
+/**
+ * Transport crypto benchmark: packets per second on one core for a 32 byte
+ * input payload, the old per-packet cipher setup with a random iv vs. the
+ * counter nonce Aead (node:crypto fallback and the native key schedule that
+ * is shared with the datapath), seal and open + replay check. Also times
+ * identity key generation and a full handshake.
+ *
+ *   bun bench/transport.bench.js [packets]
+ */
+import { createCipheriv, createDecipheriv, randomBytes } from 'node:crypto';
+import { mkdtempSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { Aead, ReplayWindow } from '../src/network/aead.js';
+import { loadIdentity } from '../src/network/certs.js';
+import { complete, initiate, respond } from '../src/network/handshake.js';
+import { HEADER_LENGTH } from '../src/network/wire.js';
+
+const COUNT = Number.parseInt(process.argv[2]) || 200_000;
+const PAYLOAD = 32;
+
+const key = randomBytes(32);
+const header = randomBytes(HEADER_LENGTH);
+const body = randomBytes(PAYLOAD - HEADER_LENGTH);
+const session = 0x12345678;
+
+// the scheme Peer used before: fresh iv and cipher for every packet
+const legacy = {
+  seal() {
+    const iv = randomBytes(12);
+    const cipher = createCipheriv('aes-256-gcm', key, iv);
+    cipher.setAAD(header);
+    const encrypted = Buffer.concat([cipher.update(body), cipher.final()]);
+    return Buffer.concat([header, iv, cipher.getAuthTag(), encrypted]);
+  },
+  open(packet) {
+    const iv = packet.subarray(HEADER_LENGTH, HEADER_LENGTH + 12);
+    const decipher = createDecipheriv('aes-256-gcm', key, iv);
+    decipher.setAAD(packet.subarray(0, HEADER_LENGTH));
+    decipher.setAuthTag(packet.subarray(HEADER_LENGTH + 12, HEADER_LENGTH + 28));
+    return Buffer.concat([decipher.update(packet.subarray(HEADER_LENGTH + 28)), decipher.final()]);
+  },
+};
+
+function counterScheme(aead) {
+  let replay = new ReplayWindow();
+  return {
+    // warm up runs replay the same counters
+    reset: () => (replay = new ReplayWindow()),
+    seal: (seq) => aead.seal(header, body, session, seq),
+    open(packet, seq) {
+      if (!replay.check(session, seq)) return null;
+      const res = aead.open(packet, HEADER_LENGTH, session, seq);
+      if (res) replay.update(session, seq);
+      return res;
+    },
+  };
+}
+
+function pps(fn, reset) {
+  // warm up the JIT before measuring
+  for (let i = 0; i < Math.min(COUNT, 10_000); i++) fn(i);
+  reset?.();
+  const start = Bun.nanoseconds();
+  for (let i = 0; i < COUNT; i++) fn(i);
+  return COUNT / ((Bun.nanoseconds() - start) / 1e9);
+}
+
+function run(label, scheme) {
+  const packets = [];
+  for (let i = 0; i < COUNT; i++) packets.push(scheme.seal(i));
+  const seal = pps((i) => scheme.seal(i));
+  const open = pps((i) => scheme.open(packets[i], i), scheme.reset);
+  const wire = packets[0].length;
+  console.log(
+    `${label.padEnd(24)} seal ${(seal / 1e3).toFixed(0).padStart(6)} kpps  open ${(open / 1e3).toFixed(0).padStart(6)} kpps  ${wire} bytes`,
+  );
+}
+
+console.log(`packets: ${COUNT}, payload: ${PAYLOAD} bytes, one core`);
+run('random iv (before)', legacy);
+run('counter nonce (node)', counterScheme(new Aead(key, { useNative: false })));
+const native = new Aead(key);
+if (native.native) run('counter nonce (native)', counterScheme(native));
+else console.log('native aead unavailable, skipped');
+
+const dir = mkdtempSync(join(tmpdir(), 'bzz-bench-'));
+let start = Bun.nanoseconds();
+const a = await loadIdentity(join(dir, 'a'));
+const cold = (Bun.nanoseconds() - start) / 1e6;
+start = Bun.nanoseconds();
+await loadIdentity(join(dir, 'a'));
+const warm = (Bun.nanoseconds() - start) / 1e6;
+const b = await loadIdentity(join(dir, 'b'));
+rmSync(dir, { recursive: true });
+
+const HANDSHAKES = 1000;
+start = Bun.nanoseconds();
+for (let i = 0; i < HANDSHAKES; i++) {
+  const offer = initiate(a, 1);
+  const { message, session } = respond(b, 2, offer.message, 1);
+  complete(offer, a, message, 2).free();
+  session.free();
+}
+const handshake = (Bun.nanoseconds() - start) / HANDSHAKES / 1e3;
+
+console.log(`identity key          generate ${cold.toFixed(2)} ms  load ${warm.toFixed(2)} ms`);
+console.log(`handshake             ${handshake.toFixed(0)} us cpu per session (both sides, excluding the round trip)`);
@@ -0,0 +1,89 @@
+/**
+ * Peer socket benchmark on loopback: a sender process streams mouse_move
+ * events at a fixed rate (coalescing off) to a receiving Peer, once on the
+ * Bun udp socket and once on the batched recvmmsg/sendmmsg socket from
+ * src/network/udp.js. Reports receiver CPU time per second of traffic,
+ * dispatch callbacks per event and, for the native socket, syscalls per
+ * event.
+ *
+ *   bun bench/udp.bench.js [events/s] [seconds]
+ */
+import { mkdtempSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { loadIdentity } from '../src/network/certs.js';
+import { Peer } from '../src/network/peer.js';
+
+const child = process.argv[2] === 'send';
+const [rateArg, secondsArg, portArg] = process.argv.slice(child ? 3 : 2);
+const RATE = Number.parseInt(rateArg) || 10_000;
+const SECONDS = Number.parseFloat(secondsArg) || 3;
+const WARMUP = 1000;
+const TOKEN = 'bench';
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+const dir = mkdtempSync(join(tmpdir(), 'bzz-bench-'));
+const identity = await loadIdentity(dir);
+rmSync(dir, { recursive: true });
+
+// child: connect and stream events until killed
+if (child) {
+  const port = Number(portArg);
+  const sender = new Peer({ port: 0, authToken: TOKEN, identity, coalesce: 0 });
+  await sender.init();
+  if (!(await sender.connect('127.0.0.1', port))) process.exit(1);
+  // 1ms ticks, carry the remainder so the average rate is exact
+  let owed = 0;
+  let last = performance.now();
+  setInterval(() => {
+    const now = performance.now();
+    owed += ((now - last) * RATE) / 1000;
+    last = now;
+    for (; owed >= 1; owed--) sender.broadcast('mouse_move', { dx: 1, dy: -1 });
+  }, 1);
+  await new Promise(() => {});
+}
+
+async function run(batchIO) {
+  const receiver = new Peer({ port: 0, authToken: TOKEN, identity, coalesce: 0, batchIO });
+  receiver.lockMouse = () => {};
+  await receiver.init();
+  let events = 0;
+  receiver.on('mouse_move', () => events++);
+
+  const port = receiver.socket.port;
+  const sender = Bun.spawn(
+    [process.execPath, import.meta.path, 'send', String(RATE), String(SECONDS), String(port)],
+    { stdout: 'ignore', stderr: 'inherit' },
+  );
+  await sleep(WARMUP);
+
+  const stats = () => receiver.socket.stats?.();
+  const before = { events, cpu: process.cpuUsage(), io: stats(), time: performance.now() };
+  await sleep(SECONDS * 1000);
+  const cpu = process.cpuUsage(before.cpu);
+  const io = stats();
+  const elapsed = (performance.now() - before.time) / 1000;
+  const received = events - before.events;
+
+  sender.kill();
+  await sender.exited;
+  receiver.cleanup();
+
+  const label = batchIO ? 'recvmmsg/sendmmsg' : 'bun udp socket';
+  const cpuPerSecond = (cpu.user + cpu.system) / 1000 / elapsed;
+  let line = `${label.padEnd(20)} ${(received / elapsed).toFixed(0).padStart(6)} ev/s  cpu ${cpuPerSecond.toFixed(1).padStart(5)} ms/s`;
+  if (io) {
+    const syscalls = io.polls - before.io.polls + (io.recvCalls - before.io.recvCalls);
+    const batches = io.batches - before.io.batches;
+    line += `  ${(syscalls / received).toFixed(3)} rx syscalls/event  ${(batches / received).toFixed(3)} callbacks/event`;
+  } else {
+    line += '  1 callback/event';
+  }
+  console.log(line);
+}
+
+console.log(`loopback, ${RATE} events/s for ${SECONDS}s, receiver side`);
+await run(false);
+await run(true);
+process.exit(0);
@@ -0,0 +1,75 @@
+/**
+ * Wire format benchmark: bytes on the wire and decode cost per input event,
+ * legacy JSON messages vs. the binary frames from src/network/wire.js and the
+ * native sspBuf decoder in src/wayland/wire.c.
+ *
+ *   bun bench/wire.bench.js [events]
+ */
+import { cc } from 'bun:ffi';
+import { randomBytes } from 'node:crypto';
+import { HEADER_LENGTH, decodeBody, decodeHeader, encodeFrame } from '../src/network/wire.js';
+
+// auth tag added by Peer.encrypt around either payload, the nonce is implicit
+const CRYPTO_OVERHEAD = 16;
+const COUNT = Number.parseInt(process.argv[2]) || 200_000;
+
+const { symbols } = cc({
+  source: ['./src/wayland/ssp.c', './src/wayland/wire.c'],
+  include: ['src/wayland/include'],
+  symbols: {
+    wireDecode: { args: ['ptr', 'u64', 'ptr'], returns: 'i32' },
+  },
+});
+
+function sampleEvents(n) {
+  const events = [];
+  for (let i = 0; i < n; i++) {
+    const r = i % 10;
+    if (r < 7) events.push(['mouse_move', { dx: (Math.random() * 20 - 10) | 0, dy: (Math.random() * 20 - 10) | 0 }]);
+    else if (r < 8) events.push(['mouse_button', { button: 1, pressed: i & 1 }]);
+    else if (r < 9) events.push(['key', { keycode: 30 + (i % 20), modifiers: 0, pressed: i & 1 }]);
+    else events.push(['mouse_wheel', { horizontal: 0, vertical: i & 1 ? 120 : -120 }]);
+  }
+  return events;
+}
+
+const sender = randomBytes(16).toString('hex');
+const events = sampleEvents(COUNT);
+
+const json = events.map(([type, data]) =>
+  Buffer.from(JSON.stringify({ type, data, sender, timestamp: Date.now() })),
+);
+const binary = events.map(([type, data], seq) => Buffer.from(encodeFrame(type, data, 0x12345678, seq)));
+
+const bytes = (frames) => frames.reduce((sum, f) => sum + f.length + CRYPTO_OVERHEAD, 0) / frames.length;
+
+function time(label, frames, decode) {
+  // warm up the JIT before measuring
+  for (let i = 0; i < Math.min(frames.length, 10_000); i++) decode(frames[i]);
+  const start = Bun.nanoseconds();
+  let sink = 0;
+  for (const frame of frames) sink ^= decode(frame) ? 1 : 0;
+  const ns = (Bun.nanoseconds() - start) / frames.length;
+  return { label, ns, sink };
+}
+
+const header = {};
+const out = new Int32Array(3);
+
+const results = [
+  time('json', json, (f) => {
+    const { type, data, sender: from } = JSON.parse(f.toString());
+    return from !== sender || type || data;
+  }),
+  time('binary (js)', binary, (f) => {
+    const h = decodeHeader(f, header);
+    return h.sender !== 0x12345678 || decodeBody(h.op, f.subarray(HEADER_LENGTH));
+  }),
+  time('binary (native)', binary, (f) => symbols.wireDecode(f, f.length, out) >= 0),
+];
+
+console.log(`events: ${COUNT} (70% motion, 10% button, 10% key, 10% wheel)`);
+console.log(`bytes/event  json: ${bytes(json).toFixed(1)}  binary: ${bytes(binary).toFixed(1)}`);
+for (const { label, ns } of results) {
+  console.log(`decode ${label.padEnd(16)} ${ns.toFixed(1)} ns/event`);
+}
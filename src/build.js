@@ -0,0 +1,26 @@
+#!/usr/bin/env bun
+
+// Build every native library into the cache, see native.js
+process.env.BZZ_NATIVE = 'build';
+
+const { libraries } = await import('./native.js');
+await Promise.all([
+  import('./trace.js'),
+  import('./network/aead.js'),
+  import('./network/udp.js'),
+  import('./network/delta.js'),
+  import('./network/clipboard.js'),
+  import('./x11/index.js'),
+  import('./wayland/index.js'),
+]);
+
+let failed = 0;
+for (const library of libraries.values()) {
+  try {
+    console.log(`${library.name}: ${library.build()}`);
+  } catch (err) {
+    console.error(err.message);
+    failed++;
+  }
+}
+process.exit(failed ? 1 : 0);
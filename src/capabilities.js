@@ -0,0 +1,234 @@
+import { createHash } from 'node:crypto';
+import { accessSync, constants, existsSync, readFileSync, statSync, writeFileSync } from 'node:fs';
+import { homedir } from 'node:os';
+import { delimiter, isAbsolute, join } from 'node:path';
+import { state } from './state.js';
+
+/**
+ * What this session can do, probed once when the daemon starts: display
+ * server and compositor, helper binaries on PATH, kernel modules, uinput
+ * access, and the protocol backends the display server settled on once it
+ * is set up.
+ *
+ * The probe is kept in the config dir under a key made from the session
+ * identity and the display socket, and holds the compositor pid. A later
+ * start of the same session on the same compositor reuses it. A new
+ * session, a recreated socket or a compositor that is gone probes again.
+ * Hot paths read `capabilities` and never spawn or reparse the environment.
+ */
+
+const VERSION = 1;
+// binaries looked for on PATH
+export const HELPERS = [
+  'bun',
+  'lsof',
+  'tar',
+  'gzip',
+  'git',
+  'xclip',
+  'wl-copy',
+  'wl-paste',
+  'gnome-session-inhibit',
+  'qdbus',
+  'gdbus',
+];
+// searched after PATH, where installers put things without touching it
+const EXTRA_PATHS = [join(homedir(), '.bun', 'bin')];
+const MODULES = ['uinput'];
+// sessions kept in the cache file
+const MAX_SESSIONS = 8;
+
+/** Full path of executable `name` in one of `dirs`, or null. */
+export function findBinary(name, dirs) {
+  for (const dir of dirs) {
+    if (!dir) continue;
+    const path = join(dir, name);
+    try {
+      accessSync(path, constants.X_OK);
+      if (statSync(path).isFile()) return path;
+    } catch {}
+  }
+  return null;
+}
+
+/** 'wayland-wlroots', 'wayland-kde', 'wayland-gnome', 'x11', 'x11-kde', 'x11-gnome' or 'unknown' */
+export function detectDisplayServer(env = process.env) {
+  const session = env.XDG_SESSION_TYPE?.toLowerCase();
+  const desktop = env.XDG_CURRENT_DESKTOP?.toLowerCase();
+  const flavor = desktop?.includes('kde') ? '-kde' : desktop?.includes('gnome') ? '-gnome' : null;
+
+  // the session type decides, the sockets only without one
+  if (session === 'wayland') return `wayland${flavor ?? '-wlroots'}`;
+  if (session === 'x11' || env.DISPLAY) return `x11${flavor ?? ''}`;
+  if (env.WAYLAND_DISPLAY) return `wayland${flavor ?? '-wlroots'}`;
+  return 'unknown';
+}
+
+/** 'kde', 'gnome', 'wlroots' or 'unknown' from XDG_CURRENT_DESKTOP */
+export function detectCompositor(env = process.env) {
+  const desktop = env.XDG_CURRENT_DESKTOP?.toLowerCase();
+  if (!desktop) return 'unknown';
+  if (desktop.includes('kde')) return 'kde';
+  if (desktop.includes('gnome')) return 'gnome';
+  if (desktop.includes('sway') || desktop.includes('hyprland') || desktop.includes('wlroots')) return 'wlroots';
+  return 'unknown';
+}
+
+/** Path of the socket the display server listens on, or null. */
+export function displaySocket(env = process.env) {
+  if (env.WAYLAND_DISPLAY) {
+    if (isAbsolute(env.WAYLAND_DISPLAY)) return env.WAYLAND_DISPLAY;
+    return env.XDG_RUNTIME_DIR ? join(env.XDG_RUNTIME_DIR, env.WAYLAND_DISPLAY) : null;
+  }
+  const local = /^(?:unix)?:(\d+)/.exec(env.DISPLAY ?? '');
+  return local ? `/tmp/.X11-unix/X${local[1]}` : null;
+}
+
+/** The session, and the display socket as it is now: a restarted compositor makes a new one. */
+export function sessionIdentity(env = process.env) {
+  const socket = displaySocket(env);
+  let stat = null;
+  try {
+    stat = socket && statSync(socket);
+  } catch {}
+  return {
+    uid: process.getuid?.() ?? null,
+    session: env.XDG_SESSION_ID ?? null,
+    type: env.XDG_SESSION_TYPE ?? null,
+    desktop: env.XDG_CURRENT_DESKTOP ?? null,
+    wayland: env.WAYLAND_DISPLAY ?? null,
+    display: env.DISPLAY ?? null,
+    socket: stat ? `${socket}:${stat.ino}:${Math.floor(stat.mtimeMs)}` : null,
+  };
+}
+
+const identityKey = (identity) => createHash('sha256').update(JSON.stringify(identity)).digest('hex').slice(0, 16);
+
+function loadedModules(names = MODULES) {
+  let modules = '';
+  try {
+    modules = readFileSync('/proc/modules', 'utf8');
+  } catch {}
+  const loaded = new Set(modules.split('\n').map((line) => line.split(' ')[0]));
+  return Object.fromEntries(names.map((name) => [name, loaded.has(name)]));
+}
+
+function uinputAccess() {
+  let writable = false;
+  try {
+    accessSync('/dev/uinput', constants.W_OK);
+    writable = true;
+  } catch {}
+  return { present: existsSync('/dev/uinput'), writable };
+}
+
+function alive(pid) {
+  try {
+    process.kill(pid, 0);
+    return true;
+  } catch (err) {
+    return err.code === 'EPERM';
+  }
+}
+
+/** Probe everything that can be known without a display connection. */
+export function probe(env = process.env) {
+  const dirs = [...(env.PATH ?? '').split(delimiter), ...EXTRA_PATHS];
+  return {
+    version: VERSION,
+    probed: Date.now(),
+    identity: sessionIdentity(env),
+    displayServer: detectDisplayServer(env),
+    // name and pid come from the display server once it is connected
+    compositor: { family: detectCompositor(env), name: null, pid: null },
+    binaries: Object.fromEntries(HELPERS.map((name) => [name, findBinary(name, dirs)])),
+    modules: loadedModules(),
+    uinput: uinputAccess(),
+    // backend hints by display server, what its setup settled on
+    backends: {},
+  };
+}
+
+export class Capabilities {
+  constructor({ file = join(state.configDir, 'capabilities.json'), env = process.env } = {}) {
+    this.file = file;
+    this.env = env;
+    this.record = null;
+    this.key = null;
+  }
+
+  /** The probe of this session, from the cache when it still holds. */
+  get current() {
+    this.record ??= this.load();
+    return this.record;
+  }
+
+  load() {
+    this.key = identityKey(sessionIdentity(this.env));
+    const cached = this.read().sessions[this.key];
+    if (cached?.version === VERSION && (!cached.compositor?.pid || alive(cached.compositor.pid))) return cached;
+    const record = probe(this.env);
+    this.write(record);
+    return record;
+  }
+
+  /** Path of a helper binary, or null. Ones the probe did not cover are looked up once. */
+  binary(name, extraPaths = []) {
+    if (!(name in this.current.binaries)) {
+      const dirs = [...(this.env.PATH ?? '').split(delimiter), ...extraPaths, ...EXTRA_PATHS];
+      this.update({ binaries: { [name]: findBinary(name, dirs) } });
+    }
+    return this.current.binaries[name];
+  }
+
+  has(name) {
+    return !!this.binary(name);
+  }
+
+  module(name) {
+    if (!(name in this.current.modules)) this.update({ modules: loadedModules([name]) });
+    return this.current.modules[name];
+  }
+
+  /** Merge what only a connected display server knows, `{ compositor: { pid } }` and such. */
+  update(changes) {
+    const record = this.current;
+    const before = JSON.stringify(record);
+    for (const [key, value] of Object.entries(changes)) {
+      record[key] = value && typeof value === 'object' ? { ...record[key], ...value } : value;
+    }
+    if (JSON.stringify(record) !== before) this.write(record);
+  }
+
+  /** Probe binaries and modules again, after something was installed. */
+  refresh() {
+    const fresh = probe(this.env);
+    this.update({ binaries: fresh.binaries, modules: fresh.modules, uinput: fresh.uinput });
+  }
+
+  read() {
+    try {
+      const cache = JSON.parse(readFileSync(this.file, 'utf8'));
+      if (cache.version === VERSION && cache.sessions) return cache;
+    } catch {}
+    return { version: VERSION, sessions: {} };
+  }
+
+  write(record) {
+    const cache = this.read();
+    cache.sessions[this.key ?? identityKey(record.identity)] = record;
+    // sessions whose compositor is gone are no use to anyone, the oldest go next
+    const sessions = Object.entries(cache.sessions)
+      .filter(([, entry]) => !entry.compositor?.pid || alive(entry.compositor.pid))
+      .sort(([, a], [, b]) => b.probed - a.probed)
+      .slice(0, MAX_SESSIONS);
+    cache.sessions = Object.fromEntries(sessions);
+    try {
+      writeFileSync(this.file, JSON.stringify(cache, null, 2));
+    } catch (err) {
+      console.debug(`Could not save capabilities: ${err.message}`);
+    }
+  }
+}
+
+export const capabilities = new Capabilities();
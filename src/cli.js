@@ -1,6 +1,7 @@
 #!/usr/bin/env bun
 
 import { commands } from './cli/index.js';
+import { capabilities } from './capabilities.js';
 import { ensureDependencies } from './dependencies.js';
 import { red, error, reset } from './colors.js';
 
@@ -10,6 +11,8 @@ if (!process.env.DEBUG) {
 
 async function main() {
   try {
+    // probed here once, or taken from the cache of this session
+    capabilities.current;
     await ensureDependencies({ verbose: false });
 
     const [command = 'help', ...args] = process.argv.slice(2);
@@ -0,0 +1,61 @@
+import { writeSync } from 'node:fs';
+import { clipboard as icon, cyan, gray, error, reset } from '../colors.js';
+import { historyDir, readHistory, readHistoryBody } from '../network/history.js';
+
+const usage = () => {
+  console.error(`${error} Usage: bzz clipboard list | bzz clipboard get <n|hash>`);
+  process.exit(1);
+};
+
+const age = (ms) => {
+  const s = Math.max(0, Math.round((Date.now() - ms) / 1000));
+  if (s < 60) return `${s}s`;
+  if (s < 3600) return `${Math.round(s / 60)}m`;
+  if (s < 86400) return `${Math.round(s / 3600)}h`;
+  return `${Math.round(s / 86400)}d`;
+};
+
+export const clipboard = {
+  command: "clipboard list|get <n|hash>",
+  description: "List the clipboard history, or write one entry to stdout\n(by position in the list or a prefix of its hash)",
+  handler: async ([sub, which]) => {
+    if (sub !== 'list' && sub !== 'get') usage();
+
+    let history;
+    try {
+      history = readHistory();
+    } catch (err) {
+      console.error(`${error} Cannot read ${cyan}${historyDir()}${reset}: ${err.message}`);
+      process.exit(1);
+    }
+    // most recently used first, as the daemon would drop them last
+    const entries = history.entries.reverse();
+
+    if (sub === 'list') {
+      console.log(`${icon} Clipboard history: ${cyan}${entries.length}${reset} entries`);
+      entries.forEach((entry, i) => {
+        console.log(
+          `${String(i).padStart(4)}  ${entry.key.slice(0, 12)}  ${String(entry.length).padStart(9)}  ` +
+            `${age(entry.used).padStart(4)}  ${entry.mime}`,
+        );
+      });
+      if (!entries.length) console.log(`${gray}  (empty)${reset}`);
+      return;
+    }
+
+    if (!which) usage();
+    const entry = /^\d+$/.test(which) ? entries[parseInt(which)] : entries.find((e) => e.key.startsWith(which));
+    if (!entry) {
+      console.error(`${error} No clipboard history entry ${cyan}${which}${reset}`);
+      process.exit(1);
+    }
+    let data;
+    try {
+      data = readHistoryBody(historyDir(), history.generation, entry);
+    } catch (err) {
+      console.error(`${error} Cannot read entry ${cyan}${entry.key}${reset}: ${err.message}`);
+      process.exit(1);
+    }
+    for (let off = 0; off < data.length; ) off += writeSync(1, data, off);
+  }
+};
@@ -5,6 +5,8 @@ import { deps } from "./deps.js";
 import { help } from "./help.js";
 import { infect } from "./infect.js";
 import { connect } from "./connect.js";
+import { trace } from "./trace.js";
+import { clipboard } from "./clipboard.js";
 
 export const commands = {
   spawn,
@@ -13,5 +15,7 @@ export const commands = {
   deps,
   infect,
   connect,
+  trace,
+  clipboard,
   help
 }; 
\ No newline at end of file
@@ -0,0 +1,44 @@
+import { statSync } from 'node:fs';
+import { join } from 'node:path';
+import { cyan, gray, bug, error, reset } from '../colors.js';
+import { formatRecord, listRings, readTrace, ringName, traceDir } from '../trace.js';
+
+const usage = () => {
+  console.error(`${error} Usage: bzz trace dump [pid]`);
+  process.exit(1);
+};
+
+export const trace = {
+  command: "trace dump [pid]",
+  description: "Decode the trace ring of a peer started with BZZ_TRACE\n(newest ring if no pid is given)",
+  handler: async ([sub, pidStr]) => {
+    if (sub !== 'dump') usage();
+
+    let path;
+    if (pidStr) {
+      path = join(traceDir(), ringName(parseInt(pidStr)));
+    } else {
+      const rings = listRings().sort((a, b) => statSync(b.path).mtimeMs - statSync(a.path).mtimeMs);
+      if (!rings.length) {
+        console.error(`${error} No trace rings in ${cyan}${traceDir()}${reset}, start a peer with BZZ_TRACE=1`);
+        process.exit(1);
+      }
+      path = rings[0].path;
+    }
+
+    let ring;
+    try {
+      ring = readTrace(path);
+    } catch (err) {
+      console.error(`${error} Cannot read ${cyan}${path}${reset}: ${err.message}`);
+      process.exit(1);
+    }
+
+    console.log(
+      `${bug} Trace of pid ${cyan}${ring.pid}${reset}: ${cyan}${ring.records.length}${reset} records` +
+        (ring.lost ? `, ${cyan}${ring.lost}${reset} overwritten` : ''),
+    );
+    for (const record of ring.records) console.log(formatRecord(record));
+    if (!ring.records.length) console.log(`${gray}  (empty)${reset}`);
+  }
+};
@@ -2,7 +2,7 @@ import { $ } from 'bun';
 import { state } from './state';
 import { Peer } from './network/peer';
 import { getAuthToken } from './lib';
-import { cyan, info, reset } from './colors.js';
+import { info } from './colors.js';
 
 async function isPortInUse(port) {
   return $`lsof -i:${port} -t`
@@ -32,24 +32,18 @@ export async function ensureLocalInstance() {
 
 export const commands = {
   async spawnPeer({ port = state.port } = {}) {
+    // the peer checks auth proofs and answers them itself
     const peer = new Peer({
       port,
       authToken: getAuthToken(),
     });
 
-    peer.on('auth', (data, info) => {
-      if (data.token === getAuthToken()) {
-        console.log(`${info} Authenticated client from ${cyan}${info.address}:${info.port}${reset}`);
-        peer.authenticatedPeers.add(`${info.address}:${info.port}`);
-      }
-    });
-
     await peer.init();
     return peer;
   },
 
   async killPeer(port = state.port) {
-    const peer = new Peer({ port: 0 });
+    const peer = new Peer({ port: 0, authToken: getAuthToken() });
 
     try {
       await peer.init();
@@ -69,14 +63,12 @@ export const commands = {
   },
 
   async sendMessage({ port = state.port, message = 'Hello!' } = {}) {
-    const peer = new Peer({ port: 0 });
+    const peer = new Peer({ port: 0, authToken: getAuthToken() });
 
     try {
       await peer.init();
+      // connect leaves both sides authenticated
       await peer.connect('127.0.0.1', port);
-
-      await peer.broadcast('auth', { token: getAuthToken() });
-
       await peer.broadcast('message', { text: message });
       return true;
     } finally {
@@ -85,7 +77,7 @@ export const commands = {
   },
 
   async findPeers() {
-    const peer = new Peer({ port: 0 });
+    const peer = new Peer({ port: 0, authToken: getAuthToken() });
     const foundPeers = [];
 
     try {
@@ -94,13 +86,16 @@ export const commands = {
       const startPort = state.port;
       const endPort = startPort + 10;
 
-      for (let port = startPort; port <= endPort; port++) {
-        try {
-          await peer.connect('127.0.0.1', port);
-          await peer.broadcast('ping', { token: getAuthToken() });
-          foundPeers.push(port);
-        } catch {}
+      // connect only succeeds once the handshake got an answer, probe all
+      // ports at once instead of waiting out each timeout in turn
+      const ports = [];
+      for (let port = startPort; port <= endPort; port++) ports.push(port);
+      const connected = await Promise.all(ports.map((port) => peer.connect('127.0.0.1', port).catch(() => false)));
+
+      for (let i = 0; i < ports.length; i++) {
+        if (connected[i]) foundPeers.push(ports[i]);
       }
+      if (foundPeers.length) await peer.broadcast('ping', { token: getAuthToken() });
     } finally {
       peer.cleanup();
     }
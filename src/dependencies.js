@@ -2,6 +2,7 @@ import { $ } from 'bun';
 import { homedir } from 'node:os';
 import { join } from 'node:path';
 import { existsSync } from 'node:fs';
+import { capabilities } from './capabilities.js';
 import { red, green, yellow, cyan, reset, success, error, warning, info, pkg, sparkles, clipboard } from './colors.js';
 
 export const DEPS = {
@@ -12,7 +13,7 @@ export const DEPS = {
     customInstall: true,
     install: async () => {
       try {
-        if (await commandExists('bun')) return true;
+        if (capabilities.has('bun')) return true;
 
         console.log(`${pkg} Installing Bun runtime...`);
         await $`curl -fsSL https://bun.sh/install | bash`.quiet();
@@ -84,52 +85,13 @@ const SYSTEM_LIBS = {
   },
 };
 
-const checkCache = new Map();
-
+// answered from the probe made at daemon start, see capabilities.js
 async function checkBinary(binary, additionalPaths = []) {
-  const cacheKey = `bin:${binary}:${additionalPaths.join(':')}`;
-  if (checkCache.has(cacheKey)) {
-    return checkCache.get(cacheKey);
-  }
-
-  try {
-    const result = await $`which ${binary}`.quiet();
-    if (result.exitCode === 0) {
-      checkCache.set(cacheKey, true);
-      return true;
-    }
-  } catch {}
-
-  for (const path of additionalPaths) {
-    try {
-      const fullPath = join(path, binary);
-      const result = await $`test -x ${fullPath}`.quiet();
-      if (result.exitCode === 0) {
-        checkCache.set(cacheKey, true);
-        return true;
-      }
-    } catch {}
-  }
-
-  checkCache.set(cacheKey, false);
-  return false;
+  return !!capabilities.binary(binary, additionalPaths);
 }
 
 async function checkKernelModule(module) {
-  const cacheKey = `module:${module}`;
-  if (checkCache.has(cacheKey)) {
-    return checkCache.get(cacheKey);
-  }
-
-  try {
-    const result = await $`lsmod | grep ^${module}`.quiet();
-    const loaded = result.exitCode === 0;
-    checkCache.set(cacheKey, loaded);
-    return loaded;
-  } catch {
-    checkCache.set(cacheKey, false);
-    return false;
-  }
+  return capabilities.module(module);
 }
 
 async function isDebianBased() {
@@ -267,7 +229,7 @@ export async function ensureDependencies({ verbose = false } = {}) {
       }
     }
 
-    checkCache.clear();
+    capabilities.refresh();
 
     if (verbose) console.log(`${sparkles}\n All dependencies installed successfully!\n`);
     return true;
@@ -1,3 +1,5 @@
+import { TEXT_MIME } from './network/clipboard.js';
+
 export class DisplayServer {
   contextNew() {
     throw new Error('Method not implemented');
@@ -51,6 +53,23 @@ export class DisplayServer {
     throw new Error('Method not implemented');
   }
 
+  inputSync(keys, raw, buttons, modifiers) {
+    throw new Error('Method not implemented');
+  }
+
+  /**
+   * Group the input injected until `inputCommit` into one flush to the
+   * display. Where the backend flushes each request itself these do nothing
+   * more than that flush.
+   */
+  inputBegin(ctx) {
+    return true;
+  }
+
+  inputCommit(ctx) {
+    return this.displayFlush(ctx);
+  }
+
   idleInhibit(inhibit) {
     throw new Error('Method not implemented');
   }
@@ -59,12 +78,55 @@ export class DisplayServer {
     throw new Error('Method not implemented');
   }
 
-  clipboardCopy(isPrimary, data, length) {
+  /**
+   * Own a selection with `data`, bytes or a ClipboardBody, offered as the
+   * MIME types `mimes`, by default the type of the body or text.
+   */
+  clipboardCopy(isPrimary, data, length, mimes) {
+    throw new Error('Method not implemented');
+  }
+
+  /**
+   * Take over a selection with content that `fetch()` resolves to when it is
+   * pasted, or null if it cannot be had. Backends that cannot own a selection
+   * themselves fetch right away and hand the bytes to clipboardCopy.
+   */
+  clipboardOffer(isPrimary, mimes, fetch) {
+    fetch().then((data) => data && this.clipboardCopy(isPrimary ? 1 : 0, data, data.length, mimes));
+    return true;
+  }
+
+  /** Call `onChange()` whenever the selection changes, returns a stop function or null. */
+  clipboardWatch(isPrimary, onChange) {
+    throw new Error('Method not implemented');
+  }
+
+  /** The selection as a stream of byte chunks, its text if it has text. */
+  clipboardStream(isPrimary) {
+    throw new Error('Method not implemented');
+  }
+
+  /** MIME type of what the last clipboardStream of the selection carried. */
+  clipboardType(isPrimary) {
+    return TEXT_MIME;
+  }
+
+  datapath(port) {
     throw new Error('Method not implemented');
   }
 
   static create(force = null) {
-    if (process.env.WAYLAND_DISPLAY && force !== 'x11') return new DisplayServer.Wayland();
+    if (DisplayServer.wayland(force)) return new DisplayServer.Wayland();
     return new DisplayServer.X11();
   }
+
+  /** Import the backend create picks, and only that one. */
+  static async load(force = null) {
+    if (DisplayServer.wayland(force)) await import('./wayland/index.js');
+    else await import('./x11/index.js');
+  }
+
+  static wayland(force) {
+    return !!process.env.WAYLAND_DISPLAY && force !== 'x11';
+  }
 }
\ No newline at end of file
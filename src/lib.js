@@ -3,6 +3,7 @@ import { join } from "node:path";
 import { writeFileSync, readFileSync, existsSync, mkdirSync } from "node:fs";
 import { randomBytes } from "node:crypto";
 import { cyan, info, pkg, reset } from './colors.js';
+import { capabilities } from './capabilities.js';
 
 const CONFIG_DIR = join(process.env.HOME || process.env.USERPROFILE, ".bzzwrd");
 const AUTH_FILE = join(CONFIG_DIR, "auth.json");
@@ -41,21 +42,8 @@ const DEPS = {
   }
 };
 
-// Cache for binary checks
-const binaryCache = new Map();
-
 async function checkBinary(binary) {
-  if (binaryCache.has(binary)) {
-    return binaryCache.get(binary);
-  }
-  try {
-    await $`command -v ${binary}`.quiet();
-    binaryCache.set(binary, true);
-    return true;
-  } catch {
-    binaryCache.set(binary, false);
-    return false;
-  }
+  return capabilities.has(binary);
 }
 
 // Check and install dependencies
@@ -106,8 +94,8 @@ export async function ensureDependencies() {
         await $`bash -c ${dep.customInstall}`.quiet();
       }
 
-      // Clear binary cache after installations
-      binaryCache.clear();
+      // Probe again after installations
+      capabilities.refresh();
     } catch (error) {
       console.error("Failed to install dependencies:", error);
       throw error;
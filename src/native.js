@@ -0,0 +1,215 @@
+import { cc, dlopen, suffix } from 'bun:ffi';
+import { createHash } from 'node:crypto';
+import { existsSync, mkdirSync, readdirSync, readFileSync, renameSync, rmSync, statSync, writeFileSync } from 'node:fs';
+import { dirname, join, resolve } from 'node:path';
+import { capabilities } from './capabilities.js';
+import { state } from './state.js';
+
+/**
+ * Native units built once with the system compiler and loaded with dlopen.
+ *
+ * Each library is described with the options `cc()` from bun:ffi takes. It
+ * is built into `<config dir>/lib/<name>-<hash>.so`. The hash covers the
+ * sources, the headers in its include dirs, the flags and the compiler, so
+ * an edit or a different flag makes a new one. Nothing is compiled until
+ * something asks for the symbols.
+ *
+ * A miss is compiled by TinyCC through `cc()` for this run, as before, while
+ * the optimized build runs in the background for the next start.
+ * `bun run build` builds everything ahead of time. BZZ_CFLAGS is added to
+ * the flags for LTO or profile guided builds. BZZ_NATIVE=build waits for
+ * the build on a miss and falls back to TinyCC when it fails,
+ * BZZ_NATIVE=tcc always uses TinyCC.
+ *
+ * Next to a build, `<build>.building` marks one in progress so other starts
+ * do not begin the same build again, and `<build>.failed` holds the compiler
+ * output of a build that failed or the dlopen error of one that did not
+ * load. A failed build is not tried again in the background, only a new
+ * hash or `bun run build` builds it again.
+ */
+
+const ROOT = resolve(import.meta.dir, '..');
+const CC = process.env.CC ?? 'cc';
+const CFLAGS = ['-O2', '-fPIC', '-shared', '-Wl,-Bsymbolic', ...(process.env.BZZ_CFLAGS ?? '').split(/\s+/).filter(Boolean)];
+
+export const libDir = () => join(state.configDir, 'lib');
+
+// a build marked in progress for longer than this was killed
+const BUILD_STALE = 10 * 60 * 1000;
+
+// every library declared so far, for the build target
+export const libraries = new Map();
+
+class NativeLibrary {
+  constructor(name, options, dir) {
+    this.name = name;
+    this.options = options;
+    this.dir = dir;
+    this.sources = [options.source].flat().map((path) => resolve(ROOT, path));
+    this.includes = (options.include ?? []).map((path) => resolve(ROOT, path));
+    this.loaded = null;
+    this.unavailable = false;
+    // what the symbols came from, 'dlopen' or 'tcc'
+    this.via = null;
+  }
+
+  /** The compiler command line, without the output file. */
+  args() {
+    const { define = {}, library = [] } = this.options;
+    return [
+      ...CFLAGS,
+      ...(this.options.flags ?? this.options.cflags ?? []),
+      ...this.includes.map((dir) => `-I${dir}`),
+      ...Object.entries(define).map(([key, value]) => `-D${key}=${value}`),
+      ...this.sources,
+      ...library.map((lib) => `-l${lib}`),
+    ];
+  }
+
+  get path() {
+    const hash = createHash('sha256').update(CC).update(JSON.stringify(this.args())).update(process.arch);
+    for (const file of this.sources) hash.update(readFileSync(file));
+    for (const dir of this.includes) {
+      for (const file of readdirSync(dir).filter((name) => name.endsWith('.h')).sort()) {
+        hash.update(file).update(readFileSync(join(dir, file)));
+      }
+    }
+    return join(this.dir ?? libDir(), `${this.name}-${hash.digest('hex').slice(0, 16)}.${suffix}`);
+  }
+
+  /** The symbols, from the cached build when there is one. */
+  get symbols() {
+    this.loaded ??= this.load();
+    return this.loaded;
+  }
+
+  /**
+   * The symbols for a unit with a JS fallback, null once it could not be
+   * built or lacks `symbol`. `fallback` says what runs instead.
+   */
+  optional(symbol, fallback) {
+    if (this.unavailable) return null;
+    try {
+      const { symbols } = this;
+      if (symbols[symbol]) return symbols;
+      console.debug(`Native ${this.name} lacks ${symbol}, ${fallback}`);
+    } catch (err) {
+      console.debug(`Native ${this.name} unavailable, ${fallback}: ${err.message}`);
+    }
+    this.unavailable = true;
+    return null;
+  }
+
+  load() {
+    const mode = process.env.BZZ_NATIVE;
+    if (mode !== 'tcc') {
+      const path = this.path;
+      if (mode === 'build') {
+        try {
+          this.build();
+        } catch (err) {
+          // TinyCC for this start, and no background build of the same hash
+          console.debug(`Could not build ${path}: ${err.message}`);
+          this.fail(path, err);
+        }
+      }
+      if (existsSync(path)) {
+        try {
+          const { symbols } = dlopen(path, this.options.symbols);
+          this.via = 'dlopen';
+          return symbols;
+        } catch (err) {
+          // not ours to use, a broken build or one for another libc. the
+          // same hash would build the same again
+          console.debug(`Could not load ${path}: ${err.message}`);
+          rmSync(path, { force: true });
+          writeFileSync(`${path}.failed`, `${err.message}\n`);
+        }
+      } else {
+        this.spawnBuild(path);
+      }
+    }
+    this.via = 'tcc';
+    return cc({ ...this.options, source: this.sources }).symbols;
+  }
+
+  /** Build into the cache and wait for it, throws with the compiler output. */
+  build() {
+    const path = this.path;
+    if (existsSync(path)) return path;
+    mkdirSync(dirname(path), { recursive: true });
+    const tmp = `${path}.${process.pid}`;
+    const proc = Bun.spawnSync([CC, ...this.args(), '-o', tmp], { stderr: 'pipe' });
+    if (proc.exitCode !== 0) {
+      rmSync(tmp, { force: true });
+      writeFileSync(`${path}.failed`, proc.stderr);
+      throw new Error(`${this.name}: ${proc.stderr.toString().trim()}`);
+    }
+    renameSync(tmp, path);
+    rmSync(`${path}.failed`, { force: true });
+    this.prune(path);
+    return path;
+  }
+
+  // build() records the compiler output itself, anything else that stopped
+  // it goes here
+  fail(path, err) {
+    try {
+      if (!existsSync(`${path}.failed`)) writeFileSync(`${path}.failed`, `${err.message}\n`);
+    } catch (write) {
+      console.debug(`Could not record the failed build of ${this.name}: ${write.message}`);
+    }
+  }
+
+  // a half written library must never be loaded, the shell renames it when
+  // done. one build per hash at a time, and none after it failed
+  spawnBuild(path) {
+    if (!(CC.includes('/') ? existsSync(CC) : capabilities.has(CC))) return;
+    if (existsSync(`${path}.failed`)) return;
+    try {
+      mkdirSync(dirname(path), { recursive: true });
+      if (!this.claim(`${path}.building`)) return;
+      this.prune(path);
+      const script =
+        'out=$1; shift; if "$@" -o "$out.$$" 2>"$out.$$.log"; then mv -f "$out.$$" "$out"; rm -f "$out.$$.log"; ' +
+        'else rm -f "$out.$$"; mv -f "$out.$$.log" "$out.failed"; fi; rm -f "$out.building"';
+      Bun.spawn(['sh', '-c', script, 'sh', path, CC, ...this.args()], {
+        stdin: 'ignore',
+        stdout: 'ignore',
+        stderr: 'ignore',
+      }).unref();
+    } catch (err) {
+      console.debug(`Could not build ${this.name}: ${err.message}`);
+    }
+  }
+
+  // create the marker unless another start holds a fresh one
+  claim(marker) {
+    try {
+      writeFileSync(marker, `${process.pid}\n`, { flag: 'wx' });
+      return true;
+    } catch (err) {
+      if (err.code !== 'EEXIST') throw err;
+    }
+    if (Date.now() - statSync(marker).mtimeMs < BUILD_STALE) return false;
+    writeFileSync(marker, `${process.pid}\n`);
+    return true;
+  }
+
+  // older builds of the same library, with their markers
+  prune(keep) {
+    for (const file of readdirSync(dirname(keep))) {
+      const path = join(dirname(keep), file);
+      if (!path.startsWith(keep) && file.startsWith(`${this.name}-`) && file.includes(`.${suffix}`)) {
+        rmSync(path, { force: true });
+      }
+    }
+  }
+}
+
+/** Declare a native library, `options` as for `cc()`, cached in `dir` or the config dir. */
+export function nativeLibrary(name, options, dir = null) {
+  const library = new NativeLibrary(name, options, dir);
+  libraries.set(name, library);
+  return library;
+}
@@ -0,0 +1,167 @@
+import { createCipheriv, createDecipheriv } from 'node:crypto';
+import { nativeLibrary } from '../native.js';
+
+export const KEY_LENGTH = 32;
+export const NONCE_LENGTH = 12;
+export const TAG_LENGTH = 16;
+// how far behind the newest counter a packet may arrive, see aead.h
+export const REPLAY_WINDOW = 128;
+// session ids a window remembers after the sender moved on, see aead.h
+export const REPLAY_RETIRED = 4;
+
+const ALGORITHM = 'aes-256-gcm';
+
+const library = nativeLibrary('aead', {
+  source: ['./src/wayland/aead.c'],
+  include: ['src/wayland/include'],
+  library: ['crypto'],
+  symbols: {
+    aeadNew: { args: ['ptr'], returns: 'ptr' },
+    aeadFree: { args: ['ptr'], returns: 'void' },
+    aeadSeal: { args: ['ptr', 'ptr', 'ptr', 'i32', 'ptr', 'i32', 'ptr'], returns: 'i32' },
+    aeadOpen: { args: ['ptr', 'ptr', 'ptr', 'i32', 'ptr', 'i32', 'ptr'], returns: 'i32' },
+  },
+});
+
+// built on the first Aead, importing compiles nothing
+let native = null;
+function load() {
+  native ??= library.optional('aeadNew', 'using node:crypto');
+  return native;
+}
+
+/** nonce = session id || 64 bit counter, big endian (aeadNonce in aead.c) */
+export function nonceOf(session, counter, nonce = Buffer.alloc(NONCE_LENGTH)) {
+  nonce.writeUInt32BE(session >>> 0, 0);
+  nonce.writeUInt32BE(Math.floor(counter / 0x100000000) >>> 0, 4);
+  nonce.writeUInt32BE(counter >>> 0, 8);
+  return nonce;
+}
+
+/**
+ * AES-256-GCM sealing for peer frames.
+ *
+ * The nonce is derived from the sender session id and frame counter that are
+ * already in the clear header, so packets carry no iv. With the native
+ * backend the key schedule is expanded once in `new Aead(key)`; node:crypto
+ * cannot reuse a cipher, so the fallback still builds one per packet.
+ */
+export class Aead {
+  constructor(key, { useNative = true } = {}) {
+    this.key = key;
+    this.nonce = Buffer.alloc(NONCE_LENGTH);
+    this.ctx = useNative && load() ? native.aeadNew(key) : null;
+    this.scratch = this.ctx ? Buffer.alloc(2048) : null;
+  }
+
+  get native() {
+    return !!this.ctx;
+  }
+
+  /** header | tag | ciphertext, the header is authenticated but not encrypted */
+  seal(header, body, session, counter) {
+    const nonce = nonceOf(session, counter, this.nonce);
+    if (!this.ctx) {
+      const cipher = createCipheriv(ALGORITHM, this.key, nonce);
+      cipher.setAAD(header);
+      const encrypted = Buffer.concat([cipher.update(body), cipher.final()]);
+      return Buffer.concat([header, cipher.getAuthTag(), encrypted]);
+    }
+    const out = this.reserve(header.length + TAG_LENGTH + body.length);
+    out.set(header);
+    const len = native.aeadSeal(
+      this.ctx,
+      nonce,
+      header,
+      header.length,
+      body,
+      body.length,
+      out.subarray(header.length),
+    );
+    if (len < 0) throw new Error('encryption failed');
+    return Buffer.from(out.subarray(0, header.length + len));
+  }
+
+  /** Plaintext body of a sealed packet, or null if it does not authenticate. */
+  open(packet, headerLength, session, counter) {
+    if (packet.length < headerLength + TAG_LENGTH) return null;
+    const nonce = nonceOf(session, counter, this.nonce);
+    const header = packet.subarray(0, headerLength);
+    const sealed = packet.subarray(headerLength);
+    if (!this.ctx) {
+      try {
+        const decipher = createDecipheriv(ALGORITHM, this.key, nonce);
+        decipher.setAAD(header);
+        decipher.setAuthTag(sealed.subarray(0, TAG_LENGTH));
+        return Buffer.concat([decipher.update(sealed.subarray(TAG_LENGTH)), decipher.final()]);
+      } catch {
+        return null;
+      }
+    }
+    const out = this.reserve(sealed.length);
+    const len = native.aeadOpen(this.ctx, nonce, header, header.length, sealed, sealed.length, out);
+    return len < 0 ? null : Buffer.from(out.subarray(0, len));
+  }
+
+  reserve(len) {
+    if (this.scratch.length < len) this.scratch = Buffer.alloc(Math.max(len, this.scratch.length * 2));
+    return this.scratch;
+  }
+
+  free() {
+    if (this.ctx) native.aeadFree(this.ctx);
+    this.ctx = null;
+  }
+}
+
+/**
+ * Sliding window replay protection for one sender, the JS side of struct
+ * aeadReplay. `check` before decrypting, `update` once the packet
+ * authenticated. A new session id (the sender rotated its tag) starts the
+ * window over and retires the old id: its packets are refused from then on,
+ * or they could be replayed into the fresh window.
+ */
+export class ReplayWindow {
+  constructor() {
+    this.session = null;
+    this.top = 0;
+    this.bits = new Uint32Array(REPLAY_WINDOW / 32);
+    // newest first
+    this.retired = [];
+  }
+
+  has(counter) {
+    const bit = counter % REPLAY_WINDOW;
+    return (this.bits[bit >>> 5] & (1 << (bit & 31))) !== 0;
+  }
+
+  set(counter, on) {
+    const bit = counter % REPLAY_WINDOW;
+    if (on) this.bits[bit >>> 5] |= 1 << (bit & 31);
+    else this.bits[bit >>> 5] &= ~(1 << (bit & 31));
+  }
+
+  check(session, counter) {
+    if (this.retired.includes(session)) return false;
+    if (this.session !== session || counter > this.top) return true;
+    if (this.top - counter >= REPLAY_WINDOW) return false;
+    return !this.has(counter);
+  }
+
+  update(session, counter) {
+    if (this.session !== session) {
+      if (this.session !== null) {
+        this.retired.unshift(this.session);
+        if (this.retired.length > REPLAY_RETIRED) this.retired.pop();
+      }
+      this.session = session;
+      this.top = counter;
+      this.bits.fill(0);
+    } else if (counter > this.top) {
+      if (counter - this.top >= REPLAY_WINDOW) this.bits.fill(0);
+      else for (let c = this.top + 1; c < counter; c++) this.set(c, false);
+      this.top = counter;
+    }
+    this.set(counter, true);
+  }
+}
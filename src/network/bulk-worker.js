@@ -0,0 +1,47 @@
+import { parentPort } from 'node:worker_threads';
+import { deflateRawSync, inflateRawSync } from 'node:zlib';
+import { CODEC, MAX_BULK, checkUnpacked, keepPacked } from './bulk.js';
+import { hashOf } from './clipboard.js';
+import { applyDelta, encodeDelta } from './delta.js';
+import { serve } from './workers.js';
+
+/**
+ * Jobs of the bulk worker pool (bulkPool in bulk.js). They run in a worker
+ * thread, or on the main thread where there are none, and do what pack,
+ * unpack and the clipboard deltas would do there, synchronously.
+ */
+
+const zstd = typeof Bun !== 'undefined' && typeof Bun.zstdCompressSync === 'function';
+
+export const jobs = {
+  pack(body) {
+    const data = zstd ? Bun.zstdCompressSync(body, { level: 3 }) : deflateRawSync(body, { level: 1 });
+    return keepPacked(body, zstd ? CODEC.ZSTD : CODEC.DEFLATE, data);
+  },
+
+  unpack(codec, data, size) {
+    let body;
+    if (codec === CODEC.DEFLATE) body = inflateRawSync(data, { maxOutputLength: MAX_BULK });
+    else if (codec === CODEC.ZSTD && zstd) body = Bun.zstdDecompressSync(data);
+    else throw new Error(`unsupported bulk codec ${codec}`);
+    return checkUnpacked(body, size);
+  },
+
+  // a fetched content and its hash, to check it against the announced one
+  hash(data) {
+    return { data, hash: hashOf(data) };
+  },
+
+  // the content comes back along with its delta, it was moved here
+  delta(basis, data) {
+    return { delta: encodeDelta(basis, data), data };
+  },
+
+  // the rebuilt content and its hash, to check it against the announced one
+  patch(basis, delta) {
+    const data = applyDelta(basis, delta);
+    return { data, hash: hashOf(data) };
+  },
+};
+
+serve(parentPort, jobs);
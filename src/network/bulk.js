@@ -0,0 +1,350 @@
+import { promisify } from 'node:util';
+import { deflateRaw, inflateRaw } from 'node:zlib';
+import { BULK, EV, trace } from '../trace.js';
+import { systemClock } from './clock.js';
+import { RttEstimator } from './reliable.js';
+import { WorkerPool } from './workers.js';
+
+/**
+ * Bulk channel for messages too big for one datagram, clipboard contents.
+ *
+ * The encoded message body is compressed when that pays off and cut into
+ * CHUNK_SIZE chunks that fit an IPv6 minimum MTU sealed, so nothing ever
+ * fragments at the IP layer. Each `bulk` frame carries one chunk plus the
+ * transfer parameters, so the receiver can preallocate the whole buffer from
+ * whichever chunk arrives first. The receiver answers with `bulk_ack`: the
+ * next chunk it is missing and a bitmap of the BULK_WINDOW chunks after it,
+ * the sender retransmits holes like the reliable lane does (reliable.js).
+ *
+ * Chunks go out at most BURST per event loop turn, with the input lanes
+ * served in between, and transfers have their own RTT estimate, so a large
+ * paste never delays a key. Compressing a large body, and diffing one
+ * (delta.js), happens on bulkPool's worker threads for the same reason.
+ */
+
+// payload bytes per chunk: with the header, chunk fields and auth tag a
+// frame stays below the 1280 byte IPv6 minimum MTU
+export const CHUNK_SIZE = 1200;
+// frames bigger than this go over the bulk channel
+export const BULK_THRESHOLD = CHUNK_SIZE;
+// chunks in flight per transfer, and bits in an ack bitmap
+export const BULK_WINDOW = 64;
+// refuse transfers bigger than this, compressed or not
+export const MAX_BULK = 64 << 20;
+// compression codec of a transfer
+export const CODEC = { NONE: 0, DEFLATE: 1, ZSTD: 2 };
+
+// chunks sent per event loop turn
+const BURST = 16;
+const REORDER_THRESHOLD = 3;
+// timeouts in a row before a transfer is given up
+const MAX_ATTEMPTS = 8;
+// concurrent incoming transfers per peer and finished ones remembered to
+// ack late duplicates
+const MAX_TRANSFERS = 4;
+const DONE_MEMORY = 16;
+// smaller bodies are not worth compressing
+const COMPRESS_MIN = 2 * CHUNK_SIZE;
+// smaller bodies are not worth a round trip to a worker
+export const WORKER_MIN = 64 << 10;
+
+const deflate = promisify(deflateRaw);
+const inflate = promisify(inflateRaw);
+// zstd where the runtime has it, it is faster and smaller than deflate
+const zstd = typeof Bun !== 'undefined' && typeof Bun.zstdCompress === 'function';
+
+const chunks = (length) => Math.max(1, Math.ceil(length / CHUNK_SIZE));
+
+/**
+ * Bulk work off the main thread, see workers.js and the jobs in
+ * bulk-worker.js. BZZ_BULK_WORKERS sets the number of workers, 0 keeps it
+ * all on the main thread.
+ */
+export const bulkPool = new WorkerPool(new URL('./bulk-worker.js', import.meta.url), {
+  size: process.env.BZZ_BULK_WORKERS === undefined ? undefined : Number(process.env.BZZ_BULK_WORKERS),
+  inline: async () => (await import('./bulk-worker.js')).jobs,
+});
+
+/** `{ codec, data }` of compressed `data`, or `body` itself if that saves less than an eighth. */
+export function keepPacked(body, codec, data) {
+  if (data.length > body.length - (body.length >>> 3)) return { codec: CODEC.NONE, data: body };
+  return { codec, data };
+}
+
+export function checkUnpacked(body, size) {
+  if (body.length !== size) throw new Error(`bulk body is ${body.length} bytes, expected ${size}`);
+  return body;
+}
+
+/**
+ * Compress `body` off the main thread, `{ codec, data }`. Compression is
+ * skipped for small bodies and kept only if it saves at least an eighth.
+ * A large body is moved to a worker, the caller must not use it after.
+ */
+export async function pack(body) {
+  if (body.length < COMPRESS_MIN) return { codec: CODEC.NONE, data: body };
+  if (body.length >= WORKER_MIN && bulkPool.size) return bulkPool.run('pack', [body]);
+  const data = zstd ? await Bun.zstdCompress(body, { level: 3 }) : await deflate(body, { level: 1 });
+  return keepPacked(body, zstd ? CODEC.ZSTD : CODEC.DEFLATE, data);
+}
+
+/** Undo `pack`, throws if the data does not decode to `size` bytes. */
+export async function unpack(codec, data, size) {
+  if (codec === CODEC.NONE) return checkUnpacked(data, size);
+  if (data.length >= WORKER_MIN && bulkPool.size) return bulkPool.run('unpack', [codec, data, size]);
+  let body;
+  if (codec === CODEC.DEFLATE) body = await inflate(data, { maxOutputLength: MAX_BULK });
+  else if (codec === CODEC.ZSTD && zstd) body = await Bun.zstdDecompress(data);
+  else throw new Error(`unsupported bulk codec ${codec}`);
+  return checkUnpacked(body, size);
+}
+
+/**
+ * One outgoing transfer to one peer. `send(chunk)` puts a `bulk` frame on the
+ * wire, `batch(fn)` runs fn so that everything it sends goes out at once.
+ * `start()` resolves true once every chunk is acked, false if the transfer
+ * was stopped or the peer stopped answering. Bursts and timeouts run on
+ * `clock`, see clock.js.
+ */
+export class BulkSend {
+  constructor(send, { id, op, codec, size, data, conn = 0, srtt = null, batch = (fn) => fn(), clock = systemClock }) {
+    this.send = send;
+    this.batch = batch;
+    this.clock = clock;
+    this.id = id;
+    this.op = op;
+    this.codec = codec;
+    this.size = size;
+    this.data = data;
+    this.conn = conn;
+    this.count = chunks(data.length);
+    this.acked = new Uint8Array(this.count);
+    this.remaining = this.count;
+    // lowest unacked chunk and next chunk never sent
+    this.base = 0;
+    this.next = 0;
+    this.inflight = new Map();
+    this.rtt = new RttEstimator();
+    if (srtt !== null) this.rtt.sample(srtt);
+    this.timer = null;
+    this.pending = null;
+    this.result = null;
+    this.stats = { sent: 0, retransmits: 0 };
+  }
+
+  start() {
+    this.result ??= new Promise((resolve) => {
+      this.resolve = resolve;
+    });
+    if (trace.enabled) trace.emit(EV.BULK, BULK.START, this.conn, this.id, this.data.length);
+    this.pump();
+    return this.result;
+  }
+
+  chunk(index) {
+    const start = index * CHUNK_SIZE;
+    const { id, op, codec, size } = this;
+    return { id, index, op, codec, length: this.data.length, size, data: this.data.subarray(start, start + CHUNK_SIZE) };
+  }
+
+  transmit(index, entry) {
+    this.stats.sent++;
+    this.inflight.set(index, entry);
+    this.send(this.chunk(index));
+  }
+
+  // send new chunks while the window has room, BURST per event loop turn
+  pump = () => {
+    this.pending = null;
+    if (!this.resolve) return;
+    this.batch(() => {
+      for (let burst = BURST; burst > 0 && this.next < this.count && this.next - this.base < BULK_WINDOW; burst--) {
+        this.transmit(this.next++, { sentAt: this.clock.now(), attempts: 1, rto: this.rtt.rto });
+      }
+    });
+    if (this.next < this.count && this.next - this.base < BULK_WINDOW) this.pending = this.clock.defer(this.pump);
+    this.schedule();
+  };
+
+  /** `next` and `bits` of a received bulk_ack */
+  ack(next, bits) {
+    if (!this.resolve) return;
+    const now = this.clock.now();
+    let sample = null;
+    let largest = -1;
+    const acked = (index) => {
+      if (index >= this.count || this.acked[index]) return;
+      this.acked[index] = 1;
+      this.remaining--;
+      const entry = this.inflight.get(index);
+      if (entry) {
+        this.inflight.delete(index);
+        if (entry.attempts === 1 && (sample === null || entry.sentAt > sample)) sample = entry.sentAt;
+      }
+      if (index > largest) largest = index;
+    };
+
+    for (let index = this.base; index < next && index < this.count; index++) acked(index);
+    for (let i = 0; i < bits.length * 8; i++) {
+      if (bits[i >>> 3] & (1 << (i & 7))) acked(next + 1 + i);
+    }
+    while (this.base < this.count && this.acked[this.base]) this.base++;
+    if (sample !== null) this.rtt.sample(now - sample);
+    if (this.remaining === 0) return this.finish(true);
+
+    this.batch(() => {
+      for (const [index, entry] of this.inflight) {
+        if (largest - index < REORDER_THRESHOLD) continue;
+        if (entry.attempts === 1 || now - entry.sentAt >= (this.rtt.srtt ?? 0)) this.retransmit(index, entry, now);
+      }
+    });
+    if (!this.pending) this.pump();
+  }
+
+  retransmit(index, entry, now) {
+    entry.attempts++;
+    entry.sentAt = now;
+    entry.rto = Math.min(this.rtt.rto * 2 ** (entry.attempts - 1), 1000);
+    this.stats.retransmits++;
+    this.stats.sent++;
+    this.send(this.chunk(index));
+  }
+
+  schedule() {
+    if (this.timer) this.clock.clearTimeout(this.timer);
+    this.timer = null;
+    let deadline = Infinity;
+    for (const entry of this.inflight.values()) deadline = Math.min(deadline, entry.sentAt + entry.rto);
+    if (deadline === Infinity) return;
+    this.timer = this.clock.setTimeout(this.onTimeout, Math.max(deadline - this.clock.now(), 0));
+  }
+
+  onTimeout = () => {
+    this.timer = null;
+    const now = this.clock.now();
+    this.batch(() => {
+      for (const [index, entry] of this.inflight) {
+        if (now < entry.sentAt + entry.rto) continue;
+        if (entry.attempts >= MAX_ATTEMPTS) return this.finish(false);
+        this.retransmit(index, entry, now);
+      }
+    });
+    if (this.resolve) this.schedule();
+  };
+
+  finish(ok) {
+    if (!this.resolve) return;
+    if (this.timer) this.clock.clearTimeout(this.timer);
+    if (this.pending) this.clock.cancel(this.pending);
+    this.timer = this.pending = null;
+    this.inflight.clear();
+    if (trace.enabled) trace.emit(EV.BULK, ok ? BULK.DONE : BULK.ABORT, this.conn, this.id, this.data.length);
+    const resolve = this.resolve;
+    this.resolve = null;
+    resolve(ok);
+  }
+
+  stop() {
+    this.finish(false);
+  }
+}
+
+/** One incoming transfer, reassembled into a buffer allocated up front. */
+export class BulkRecv {
+  constructor({ id, op, codec, length, size }) {
+    this.id = id;
+    this.op = op;
+    this.codec = codec;
+    this.length = length;
+    this.size = size;
+    this.buf = new Uint8Array(length);
+    this.count = chunks(length);
+    this.have = new Uint8Array(this.count);
+    this.missing = this.count;
+    // first chunk not received yet
+    this.next = 0;
+    this.lastSeen = performance.now();
+    this.delivered = false;
+  }
+
+  matches(chunk) {
+    const { op, codec, length, size } = chunk;
+    return op === this.op && codec === this.codec && length === this.length && size === this.size;
+  }
+
+  /** false for duplicates and chunks that do not fit the transfer */
+  accept(index, data) {
+    this.lastSeen = performance.now();
+    if (index >= this.count || this.have[index]) return false;
+    const start = index * CHUNK_SIZE;
+    if (data.length !== Math.min(CHUNK_SIZE, this.length - start)) return false;
+    this.buf.set(data, start);
+    this.have[index] = 1;
+    this.missing--;
+    while (this.next < this.count && this.have[this.next]) this.next++;
+    return true;
+  }
+
+  get complete() {
+    return this.missing === 0;
+  }
+
+  /** bitmap of the received chunks after `next`, bit i is next + 1 + i */
+  bits() {
+    const bits = new Uint8Array(BULK_WINDOW / 8);
+    const end = Math.min(this.next + 1 + BULK_WINDOW, this.count);
+    for (let index = this.next + 1; index < end; index++) {
+      const i = index - this.next - 1;
+      if (this.have[index]) bits[i >>> 3] |= 1 << (i & 7);
+    }
+    return bits;
+  }
+}
+
+/**
+ * Incoming transfers of one peer. Finished transfers are remembered for a
+ * while, without their buffer, so late duplicates are still acked.
+ */
+export class BulkInbox {
+  constructor({ id = 0 } = {}) {
+    this.id = id;
+    this.transfers = new Map();
+    this.done = [];
+  }
+
+  /** The transfer a `bulk` chunk belongs to, null if it was refused. */
+  accept(chunk) {
+    let transfer = this.transfers.get(chunk.id) ?? this.done.find((done) => done.id === chunk.id);
+    if (!transfer) {
+      if (chunk.length > MAX_BULK || chunk.size > MAX_BULK) return null;
+      if (this.transfers.size === MAX_TRANSFERS) {
+        let oldest = null;
+        for (const t of this.transfers.values()) if (!oldest || t.lastSeen < oldest.lastSeen) oldest = t;
+        this.transfers.delete(oldest.id);
+        if (trace.enabled) trace.emit(EV.BULK, BULK.ABORT, this.id, oldest.id, oldest.length);
+      }
+      transfer = new BulkRecv(chunk);
+      this.transfers.set(chunk.id, transfer);
+      if (trace.enabled) trace.emit(EV.BULK, BULK.RECV, this.id, chunk.id, chunk.length);
+    }
+    if (!transfer.matches(chunk)) return null;
+    transfer.accept(chunk.index, chunk.data);
+    return transfer;
+  }
+
+  /** Move a complete transfer to the finished ones, returns its buffer. */
+  take(transfer) {
+    const { buf } = transfer;
+    transfer.buf = null;
+    transfer.delivered = true;
+    this.transfers.delete(transfer.id);
+    this.done.push(transfer);
+    if (this.done.length > DONE_MEMORY) this.done.shift();
+    return buf;
+  }
+
+  clear() {
+    this.transfers.clear();
+    this.done.length = 0;
+  }
+}
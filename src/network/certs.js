@@ -1,49 +1,48 @@
-import { generateKeyPairSync, createPrivateKey, createPublicKey } from "crypto";
-import { writeFileSync, existsSync, readFileSync } from "fs";
-import { join } from "path";
-import { info, success } from '../colors.js';
-
-const CERT_DIR = join(process.cwd(), "certs");
-const CERT_PATH = join(CERT_DIR, "cert.pem");
-const KEY_PATH = join(CERT_DIR, "key.pem");
-
-export function ensureCertificates() {
-  // Create certs directory if it doesn't exist
-  if (!existsSync(CERT_DIR)) {
-    console.log(`${info} Creating certificates directory...`);
-    require("fs").mkdirSync(CERT_DIR, { recursive: true });
-  }
+import { createHash, createPrivateKey, createPublicKey, generateKeyPair } from 'node:crypto';
+import { existsSync, mkdirSync, readFileSync, writeFileSync } from 'node:fs';
+import { join } from 'node:path';
+import { promisify } from 'node:util';
+import { cyan, info, reset } from '../colors.js';
+import { state } from '../state.js';
+
+const generate = promisify(generateKeyPair);
+
+export const IDENTITY_FILE = 'identity.pem';
+
+/** raw 32 byte public key of an OKP (ed25519/x25519) key object */
+export function rawPublicKey(key) {
+  return Buffer.from(key.export({ format: 'jwk' }).x, 'base64url');
+}
+
+/** OKP public key object from its raw 32 bytes */
+export function publicKeyFromRaw(crv, raw) {
+  return createPublicKey({ key: { kty: 'OKP', crv, x: Buffer.from(raw).toString('base64url') }, format: 'jwk' });
+}
+
+export function fingerprint(raw) {
+  return createHash('sha256').update(raw).digest('hex').slice(0, 16);
+}
+
+/**
+ * Long term Ed25519 identity of this host, cached under the config dir.
+ *
+ * Generated in the background on first start; an Ed25519 key takes well
+ * under a millisecond, so a cold `bzz spawn` does not wait on it.
+ */
+export async function loadIdentity(dir = state.configDir) {
+  const path = join(dir, IDENTITY_FILE);
+  let privateKey;
 
-  // Check if certificates already exist
-  if (existsSync(CERT_PATH) && existsSync(KEY_PATH)) {
-    console.log(`${info} Using existing certificates...`);
-    return {
-      cert: readFileSync(CERT_PATH),
-      key: readFileSync(KEY_PATH)
-    };
+  if (existsSync(path)) {
+    privateKey = createPrivateKey(readFileSync(path));
+  } else {
+    console.debug(`${info} Generating identity key in ${cyan}${path}${reset}`);
+    ({ privateKey } = await generate('ed25519'));
+    mkdirSync(dir, { recursive: true });
+    writeFileSync(path, privateKey.export({ type: 'pkcs8', format: 'pem' }), { mode: 0o600 });
   }
 
-  console.log(`${info} Generating new certificates...`);
-
-  // Generate key pair
-  const { publicKey, privateKey } = generateKeyPairSync("rsa", {
-    modulusLength: 2048,
-    publicKeyEncoding: {
-      type: "spki",
-      format: "pem"
-    },
-    privateKeyEncoding: {
-      type: "pkcs8",
-      format: "pem"
-    }
-  });
-
-  // Save certificates
-  writeFileSync(CERT_PATH, publicKey);
-  writeFileSync(KEY_PATH, privateKey);
-
-  return {
-    cert: publicKey,
-    key: privateKey
-  };
-} 
\ No newline at end of file
+  const publicKey = createPublicKey(privateKey);
+  const raw = rawPublicKey(publicKey);
+  return { privateKey, publicKey, raw, fingerprint: fingerprint(raw) };
+}
@@ -0,0 +1,315 @@
+import { createHash } from 'node:crypto';
+import { closeSync, readSync, writeSync } from 'node:fs';
+import { warning } from '../colors.js';
+import { nativeLibrary } from '../native.js';
+import { MAX_BULK } from './bulk.js';
+
+/**
+ * Clipboard sync by announcement.
+ *
+ * A local selection change is read once, hashed while it streams in and
+ * announced to the peers as `clipboard_offer` with its hash, size and MIME
+ * types. A receiving peer hands the offer to its display server, which
+ * fetches the bytes (`clipboard_fetch`, answered by `clipboard_data` over the
+ * bulk channel) when something actually pastes. Contents are kept in a
+ * cache keyed by hash, so content seen before is never downloaded twice.
+ *
+ * A selection is read as text if it has text and in the first other MIME
+ * type it has otherwise (image/png first), that type is what is announced.
+ * Contents live in sealed memfds (ClipboardBody) rather than the JS heap:
+ * the native clipboards serve pastes straight from them, only sending a
+ * content to a peer reads it back.
+ *
+ * PRIMARY changes with every drag of a selection, so it is only read once it
+ * stopped changing for PRIMARY_DEBOUNCE milliseconds.
+ */
+
+// bytes of sha256 kept as the content hash
+export const HASH_LENGTH = 16;
+export const TEXT_MIME = 'text/plain;charset=utf-8';
+export const PRIMARY_DEBOUNCE = 300;
+// how long a paste waits for the owning peer to send the content
+export const FETCH_TIMEOUT = 5000;
+const CACHE_BYTES = 32 << 20;
+// events of the native clipboards, wlClipboardEvent in
+// src/wayland/include/wayland.h and the same in src/x11/x11.c
+export const CLIPBOARD_CHANGED = 0;
+export const CLIPBOARD_REQUEST = 1;
+const CACHE_ENTRIES = 64;
+
+const library = nativeLibrary('memfd', {
+  source: ['./src/wayland/memfd.c'],
+  include: ['src/wayland/include'],
+  symbols: {
+    memfdCreate: { args: [], returns: 'i32' },
+    memfdSeal: { args: ['i32'], returns: 'i32' },
+  },
+});
+
+// built on the first content, importing compiles nothing
+let memfd = null;
+function load() {
+  memfd ??= library.optional('memfdCreate', 'clipboard contents stay in memory');
+  return memfd;
+}
+
+function writeAll(fd, data) {
+  for (let off = 0; off < data.length; ) off += writeSync(fd, data, off);
+}
+
+/**
+ * A clipboard content of `length` bytes and its MIME type. Its bytes are in
+ * the sealed memfd `fd` where the native unit is there, in `data` otherwise.
+ * Backends hand `fd` to their clipboard, which keeps a dup of its own, so a
+ * body can be closed as soon as the cache lets go of it.
+ */
+export class ClipboardBody {
+  constructor(fd, length, mime = TEXT_MIME, data = null) {
+    this.fd = fd;
+    this.length = length;
+    this.mime = mime;
+    this.data = data;
+  }
+
+  static from(data, mime = TEXT_MIME) {
+    if (data instanceof ClipboardBody) return data;
+    const fd = load() ? memfd.memfdCreate() : -1;
+    if (fd < 0) return new ClipboardBody(-1, data.length, mime, Buffer.from(data));
+    try {
+      writeAll(fd, data);
+    } catch (err) {
+      closeSync(fd);
+      throw err;
+    }
+    memfd.memfdSeal(fd);
+    return new ClipboardBody(fd, data.length, mime);
+  }
+
+  /** The bytes, read back into a Buffer. */
+  read() {
+    if (this.data) return this.data;
+    if (this.fd < 0) throw new Error('clipboard body is closed');
+    const buf = Buffer.allocUnsafe(this.length);
+    for (let off = 0; off < this.length; ) {
+      const n = readSync(this.fd, buf, off, this.length - off, off);
+      if (n === 0) throw new Error('clipboard body is short');
+      off += n;
+    }
+    return buf;
+  }
+
+  close() {
+    if (this.fd >= 0) closeSync(this.fd);
+    this.fd = -1;
+    this.data = null;
+  }
+}
+
+/**
+ * `fn(fd, length)` with `data`, bytes or a ClipboardBody, as a sealed memfd:
+ * what the native clipboards take. Bytes get a memfd for the call only, the
+ * clipboard keeps a dup of it.
+ */
+export function withMemfd(data, fn) {
+  const body = ClipboardBody.from(data);
+  try {
+    return fn(body.fd, body.length);
+  } finally {
+    if (body !== data) body.close();
+  }
+}
+
+export const hashKey = (hash) => Buffer.from(hash).toString('hex');
+
+export function hashOf(data) {
+  return createHash('sha256').update(data).digest().subarray(0, HASH_LENGTH);
+}
+
+/**
+ * Read a selection stream to the end, hashing each chunk as it arrives.
+ * `{ hash, data }`, or null if it is bigger than the bulk channel takes.
+ */
+export async function readHashed(stream) {
+  const hash = createHash('sha256');
+  const chunks = [];
+  let size = 0;
+  for await (const chunk of stream) {
+    size += chunk.length;
+    if (size > MAX_BULK) return null;
+    hash.update(chunk);
+    chunks.push(chunk);
+  }
+  return { hash: hash.digest().subarray(0, HASH_LENGTH), data: Buffer.concat(chunks, size) };
+}
+
+/**
+ * readHashed into a memfd: each chunk is written out as it arrives and
+ * never collected in the heap. `{ hash, body }`, or null as for readHashed.
+ * The MIME type is `type()` once the stream ended, X11 only knows it then.
+ */
+export async function readBody(stream, type = () => TEXT_MIME) {
+  const fd = load() ? memfd.memfdCreate() : -1;
+  if (fd < 0) {
+    const content = await readHashed(stream);
+    return content && { hash: content.hash, body: new ClipboardBody(-1, content.data.length, type(), content.data) };
+  }
+  const hash = createHash('sha256');
+  let size = 0;
+  try {
+    for await (const chunk of stream) {
+      size += chunk.length;
+      if (size > MAX_BULK) {
+        closeSync(fd);
+        return null;
+      }
+      hash.update(chunk);
+      writeAll(fd, chunk);
+    }
+  } catch (err) {
+    closeSync(fd);
+    throw err;
+  }
+  memfd.memfdSeal(fd);
+  return { hash: hash.digest().subarray(0, HASH_LENGTH), body: new ClipboardBody(fd, size, type()) };
+}
+
+/**
+ * Contents by hash key, least recently used go first and are closed. `set`
+ * is false for content too big to keep, it stays the caller's to close.
+ */
+export class ClipboardCache {
+  constructor({ bytes = CACHE_BYTES, entries = CACHE_ENTRIES } = {}) {
+    this.limit = bytes;
+    this.entries = entries;
+    this.bytes = 0;
+    this.map = new Map();
+  }
+
+  get(key) {
+    const data = this.map.get(key);
+    if (data === undefined) return undefined;
+    this.map.delete(key);
+    this.map.set(key, data);
+    return data;
+  }
+
+  has(key) {
+    return this.map.has(key);
+  }
+
+  set(key, data) {
+    if (data.length > this.limit) return false;
+    const old = this.map.get(key);
+    if (old !== undefined) {
+      this.map.delete(key);
+      this.bytes -= old.length;
+      if (old !== data) old.close?.();
+    }
+    this.map.set(key, data);
+    this.bytes += data.length;
+    for (const [oldest, value] of this.map) {
+      if (this.bytes <= this.limit && this.map.size <= this.entries) break;
+      this.map.delete(oldest);
+      this.bytes -= value.length;
+      value.close?.();
+    }
+    return true;
+  }
+}
+
+/**
+ * Follows one local selection. `watch(onChange)` of the display server
+ * reports changes, the content is then read with `read()`, its MIME type
+ * taken from `type()` and handed to `onContent({ hash, body })`. Changes
+ * during a read trigger one more read after it, with `debounce` only a
+ * change followed by that much quiet does.
+ */
+export class SelectionWatch {
+  constructor({ watch, read, type, onContent, debounce = 0 }) {
+    this.read = read;
+    this.type = type;
+    this.onContent = onContent;
+    this.debounce = debounce;
+    this.timer = null;
+    this.reading = false;
+    this.dirty = false;
+    this.stopped = false;
+    this.stopWatch = watch(this.onChange);
+  }
+
+  onChange = () => {
+    if (this.debounce > 0) {
+      if (this.timer) clearTimeout(this.timer);
+      this.timer = setTimeout(this.update, this.debounce);
+    } else {
+      this.update();
+    }
+  };
+
+  update = async () => {
+    this.timer = null;
+    if (this.reading) {
+      this.dirty = true;
+      return;
+    }
+    this.reading = true;
+    try {
+      do {
+        this.dirty = false;
+        const content = await readBody(this.read(), this.type);
+        if (content && !this.dirty && !this.stopped) this.onContent(content);
+        else content?.body.close();
+      } while (this.dirty);
+    } catch (err) {
+      console.debug(`${warning} Reading the selection failed: ${err.message}`);
+    } finally {
+      this.reading = false;
+    }
+  };
+
+  stop() {
+    this.stopped = true;
+    if (this.timer) clearTimeout(this.timer);
+    this.timer = null;
+    this.stopWatch?.();
+  }
+}
+
+/**
+ * Selection bookkeeping of display servers that own selections natively.
+ * `onEvent` takes the events of the native clipboard: changes go to the
+ * watchers of the selection, a paste of a selection offered without content
+ * runs its fetch and hands the result, bytes or a ClipboardBody, to
+ * `fill(serial, data)`, null when there is none.
+ */
+export class NativeSelections {
+  constructor(fill) {
+    this.fill = fill;
+    this.watchers = [new Set(), new Set()];
+    // selections set without content: { serial, fetch }
+    this.lazy = [null, null];
+  }
+
+  watch(primary, onChange) {
+    const watchers = this.watchers[primary];
+    watchers.add(onChange);
+    return () => watchers.delete(onChange);
+  }
+
+  offer(primary, serial, fetch) {
+    this.lazy[primary] = { serial, fetch };
+  }
+
+  onEvent = (event, primary, serial) => {
+    if (event === CLIPBOARD_CHANGED) {
+      this.lazy[primary] = null;
+      for (const onChange of this.watchers[primary]) onChange();
+      return;
+    }
+    if (event !== CLIPBOARD_REQUEST) return;
+    const lazy = this.lazy[primary];
+    const fill = (data) => this.fill(serial, data ?? null);
+    if (!lazy || lazy.serial !== serial) return fill(null);
+    lazy.fetch().then(fill, () => fill(null));
+  };
+}
@@ -0,0 +1,13 @@
+/**
+ * Time and timers of the paced senders, bulk.js and coalesce.js. They take a
+ * clock so tests can step time by hand (test/clock.js) instead of sleeping
+ * and hoping every burst or deadline has passed.
+ */
+export const systemClock = {
+  now: () => performance.now(),
+  setTimeout: (fn, ms) => setTimeout(fn, ms),
+  clearTimeout: (timer) => clearTimeout(timer),
+  // runs fn on the next event loop turn, after pending I/O
+  defer: (fn) => setImmediate(fn),
+  cancel: (handle) => clearImmediate(handle),
+};
@@ -0,0 +1,81 @@
+import { EV, trace } from '../trace.js';
+import { systemClock } from './clock.js';
+
+/**
+ * Sender-side relative motion coalescing.
+ *
+ * Sums mouse deltas and hands them to `send(dx, dy)` at most once per
+ * `deadline` milliseconds. The first sample after an idle period goes out
+ * immediately so a lone movement pays no extra latency; samples arriving
+ * within the deadline are merged into the next send. Callers must `flush()`
+ * before any other input event so ordering is kept. Deadlines run on
+ * `clock`, see clock.js.
+ */
+export class MotionCoalescer {
+  constructor(send, { deadline = 4, clock = systemClock } = {}) {
+    this.send = send;
+    this.deadline = deadline;
+    this.clock = clock;
+    this.dx = 0;
+    this.dy = 0;
+    this.pending = 0;
+    // so the very first sample goes out at once, even right after startup
+    this.lastSent = -Infinity;
+    this.timer = null;
+    this.stats = { samples: 0, sent: 0, merged: 0, flushes: 0 };
+  }
+
+  push(dx, dy) {
+    this.stats.samples++;
+    this.dx += dx;
+    this.dy += dy;
+    this.pending++;
+
+    if (this.timer) return;
+    const wait = this.lastSent + this.deadline - this.clock.now();
+    if (wait <= 0) return this.emit();
+    this.timer = this.clock.setTimeout(this.onDeadline, wait);
+  }
+
+  onDeadline = () => {
+    this.timer = null;
+    this.emit();
+  };
+
+  /** Send pending motion now, e.g. before a button or key event. */
+  flush() {
+    if (!this.pending) return;
+    if (this.timer) {
+      this.clock.clearTimeout(this.timer);
+      this.timer = null;
+    }
+    this.stats.flushes++;
+    this.emit();
+  }
+
+  emit() {
+    const { dx, dy, pending } = this;
+    if (!pending) return;
+    this.dx = 0;
+    this.dy = 0;
+    this.pending = 0;
+    this.stats.merged += pending - 1;
+    if (trace.enabled) trace.emit(EV.MOTION_FLUSH, dx, dy, pending);
+    // movements that cancelled out are merged away entirely
+    if (dx === 0 && dy === 0) {
+      this.stats.merged++;
+      return;
+    }
+    this.lastSent = this.clock.now();
+    this.stats.sent++;
+    return this.send(dx, dy);
+  }
+
+  stop() {
+    if (this.timer) this.clock.clearTimeout(this.timer);
+    this.timer = null;
+    this.dx = 0;
+    this.dy = 0;
+    this.pending = 0;
+  }
+}
@@ -0,0 +1,109 @@
+import { CString, JSCallback, read, toArrayBuffer } from 'bun:ffi';
+import { SendBatch } from './udp.js';
+
+// struct dpControl layout, see src/wayland/include/datapath.h
+const CONTROL_PORT = 64;
+const CONTROL_DATA = 72;
+
+export const DATAPATH_SYMBOLS = {
+  dpNew: { args: ['i32'], returns: 'ptr' },
+  dpFree: { args: ['ptr'], returns: 'void' },
+  dpPort: { args: ['ptr'], returns: 'i32' },
+  dpSetTag: { args: ['ptr', 'u32'], returns: 'void' },
+  dpAllow: { args: ['ptr', 'i32', 'ptr'], returns: 'bool' },
+  dpRevoke: { args: ['ptr', 'i32'], returns: 'void' },
+  dpStart: { args: ['ptr', 'function'], returns: 'bool' },
+  dpStop: { args: ['ptr'], returns: 'void' },
+  dpControlFree: { args: ['ptr'], returns: 'void' },
+  dpSend: { args: ['ptr', 'ptr', 'i32', 'ptr', 'i32'], returns: 'i32' },
+  dpSendBatch: { args: ['ptr', 'ptr', 'ptr', 'ptr', 'i32'], returns: 'i32' },
+  udpAddr: { args: ['ptr', 'ptr', 'i32'], returns: 'bool' },
+  dpGetStats: { args: ['ptr', 'ptr'], returns: 'void' },
+};
+
+const cstr = (s) => Buffer.from(`${s}\0`);
+
+/**
+ * Native receive -> decrypt -> decode -> inject datapath.
+ *
+ * Owns the peer UDP socket on a C thread and injects input frames from
+ * authorized peers directly into the display backend. Control frames are
+ * handed back through `onMessage(packet, rinfo)`. Also stands in for the Bun
+ * udp socket (`send`, `sendMany`, `close`) so the Peer can keep sending
+ * through the same port.
+ */
+export class Datapath {
+  constructor(symbols, port, attach) {
+    this.symbols = symbols;
+    this.ptr = symbols.dpNew(port);
+    if (!this.ptr) throw new Error(`Failed to bind native datapath on port ${port}`);
+    if (!attach(this.ptr)) {
+      symbols.dpFree(this.ptr);
+      this.ptr = null;
+      throw new Error('Failed to attach native datapath to display server');
+    }
+    this.port = symbols.dpPort(this.ptr);
+    this.callback = null;
+    this.batch = new SendBatch(symbols.udpAddr);
+  }
+
+  start(onMessage) {
+    this.callback = new JSCallback(
+      (msg, len) => {
+        const address = new CString(msg).toString();
+        const port = read.i32(msg, CONTROL_PORT);
+        const packet = Buffer.from(toArrayBuffer(msg, CONTROL_DATA, len).slice(0));
+        this.symbols.dpControlFree(msg);
+        onMessage(packet, { address, port });
+      },
+      { args: ['ptr', 'i32'], returns: 'void', threadsafe: true },
+    );
+    if (!this.symbols.dpStart(this.ptr, this.callback)) throw new Error('Failed to start native datapath');
+  }
+
+  setTag(tag) {
+    this.symbols.dpSetTag(this.ptr, tag);
+  }
+
+  // conn is the peer's slot, key the receive traffic key of its session
+  allow(conn, key) {
+    return this.symbols.dpAllow(this.ptr, conn, key);
+  }
+
+  revoke(conn) {
+    this.symbols.dpRevoke(this.ptr, conn);
+  }
+
+  stats() {
+    const out = new BigUint64Array(12);
+    this.symbols.dpGetStats(this.ptr, out);
+    const [packets, injected, control, rejected, malformed, polls, recvCalls, received, truncated, batches, sendCalls, sent] =
+      Array.from(out, Number);
+    return {
+      packets,
+      injected,
+      control,
+      rejected,
+      malformed,
+      io: { polls, recvCalls, received, truncated, batches, sendCalls, sent },
+    };
+  }
+
+  send(data, port, address) {
+    return this.symbols.dpSend(this.ptr, data, data.length, cstr(address), port) === data.length;
+  }
+
+  sendMany(packets) {
+    const count = this.batch.pack(packets);
+    if (!count) return 0;
+    return this.symbols.dpSendBatch(this.ptr, this.batch.data, this.batch.lens, this.batch.addrs, count);
+  }
+
+  close() {
+    if (!this.ptr) return;
+    this.symbols.dpFree(this.ptr);
+    this.ptr = null;
+    this.callback?.close();
+    this.callback = null;
+  }
+}
@@ -0,0 +1,221 @@
+import { createHash } from 'node:crypto';
+import { nativeLibrary } from '../native.js';
+import { SspBuf, Writer } from './wire.js';
+
+/**
+ * rsync style deltas for clipboard contents that change a little at a time.
+ *
+ * Both peers hold an earlier content, the basis: the receiver names the ones
+ * it has from this peer in `clipboard_fetch`, the sender picks one it still
+ * has, matches the new content against its blocks and answers with
+ * `clipboard_delta`. Blocks of the basis are found anywhere in the new
+ * content with a rolling weak checksum, confirmed with a strong hash, and
+ * sent as block numbers; everything between them goes as literal bytes. The
+ * receiver checks the rebuilt content against the announced hash, so a
+ * delta against the wrong basis is caught and fetched in full.
+ *
+ * The checksum kernel is delta.c where it builds, the same in JS otherwise.
+ *
+ * A delta is: block size, content size, then ops. An op is a varint tag,
+ * `(count << 1)` followed by the first of count consecutive basis blocks,
+ * or 1 followed by literal bytes.
+ */
+
+// bases remembered per peer, newest first
+export const DELTA_BASES = 4;
+// smaller contents are sent whole
+export const DELTA_MIN = 16 << 10;
+const MIN_BLOCK = 512;
+const MAX_BLOCK = 16 << 10;
+const STRONG_LENGTH = 8;
+const FILTER_BITS = 16;
+const NO_WINDOW = 0xffffffff;
+
+const library = nativeLibrary('delta', {
+  source: ['./src/wayland/delta.c'],
+  include: ['src/wayland/include'],
+  // the block sums only vectorize at -O3
+  flags: ['-O3'],
+  symbols: {
+    deltaBlockSums: { args: ['ptr', 'i32', 'i32', 'ptr'], returns: 'i32' },
+    deltaScan: { args: ['ptr', 'i32', 'i32', 'i32', 'ptr', 'ptr'], returns: 'i32' },
+  },
+});
+
+// built on the first delta, importing compiles nothing
+let native = null;
+function load() {
+  native ??= library.optional('deltaScan', 'using JS');
+  return native;
+}
+
+/** Block size for a basis of `length` bytes, about its square root. */
+export function blockSize(length) {
+  const block = 1 << Math.round(Math.log2(Math.sqrt(length) || 1));
+  return Math.min(MAX_BLOCK, Math.max(MIN_BLOCK, block));
+}
+
+const filterIndex = (sum) => Math.imul(sum, 0x9e3779b1) >>> (32 - FILTER_BITS);
+
+function blockSum(data, pos, block, window) {
+  let a = 0;
+  let b = 0;
+  for (let i = 0; i < block; i++) {
+    a += data[pos + i];
+    b += (block - i) * data[pos + i];
+  }
+  window[1] = a & 0xffff;
+  window[2] = b & 0xffff;
+}
+
+/** The kernel in JS, deltaBlockSums and deltaScan of delta.c. */
+export const jsKernel = {
+  blockSums(data, block, sums) {
+    const count = Math.floor(data.length / block);
+    const window = new Uint32Array(4);
+    for (let i = 0; i < count; i++) {
+      blockSum(data, i * block, block, window);
+      sums[i] = (window[1] | (window[2] << 16)) >>> 0;
+    }
+    return count;
+  },
+
+  scan(data, from, block, filter, window) {
+    const len = data.length;
+    if (from > len - block) return -1;
+    let a;
+    let b;
+    if (window[0] !== NO_WINDOW && window[0] + 1 === from) {
+      a = (window[1] - data[from - 1] + data[from + block - 1]) & 0xffff;
+      b = (window[2] - block * data[from - 1] + a) & 0xffff;
+    } else {
+      if (window[0] !== from) blockSum(data, from, block, window);
+      a = window[1];
+      b = window[2];
+    }
+    for (let pos = from; ; pos++) {
+      const sum = (a | (b << 16)) >>> 0;
+      const idx = filterIndex(sum);
+      if (filter[idx >>> 3] & (1 << (idx & 7))) {
+        window[0] = pos;
+        window[1] = a;
+        window[2] = b;
+        window[3] = sum;
+        return pos;
+      }
+      if (pos + block >= len) {
+        window[0] = NO_WINDOW;
+        return -1;
+      }
+      a = (a - data[pos] + data[pos + block]) & 0xffff;
+      b = (b - block * data[pos] + a) & 0xffff;
+    }
+  },
+};
+
+const nativeKernel = {
+  blockSums: (data, block, sums) => native.deltaBlockSums(data, data.length, block, sums),
+  scan: (data, from, block, filter, window) => native.deltaScan(data, data.length, from, block, filter, window),
+};
+
+/** delta.c where it builds, jsKernel otherwise. */
+export const kernel = {
+  blockSums: (...args) => (load() ? nativeKernel : jsKernel).blockSums(...args),
+  scan: (...args) => (load() ? nativeKernel : jsKernel).scan(...args),
+};
+
+const strongOf = (data) => createHash('md5').update(data).digest().subarray(0, STRONG_LENGTH);
+
+/** Delta that turns `basis` into `data`. */
+export function encodeDelta(basis, data, { kernel: k = kernel } = {}) {
+  const block = blockSize(basis.length);
+  const w = new Writer(1024);
+  w.varu(block);
+  w.varu(data.length);
+
+  const sums = new Uint32Array(Math.floor(basis.length / block));
+  const count = sums.length && k.blockSums(basis, block, sums);
+  const filter = new Uint8Array(1 << (FILTER_BITS - 3));
+  const blocks = new Map();
+  for (let i = 0; i < count; i++) {
+    const idx = filterIndex(sums[i]);
+    filter[idx >>> 3] |= 1 << (idx & 7);
+    const same = blocks.get(sums[i]);
+    if (same) same.push(i);
+    else blocks.set(sums[i], [i]);
+  }
+  const strong = new Array(count);
+
+  let literal = 0;
+  let copy = -1;
+  let copies = 0;
+  const flushCopy = () => {
+    if (copies) w.varu(copies << 1), w.varu(copy);
+    copies = 0;
+  };
+  const emitLiteral = (end) => {
+    if (end <= literal) return;
+    flushCopy();
+    w.varu(1);
+    w.bytes(data.subarray(literal, end));
+  };
+
+  const window = new Uint32Array([NO_WINDOW, 0, 0, 0]);
+  let pos = 0;
+  while (count && pos <= data.length - block) {
+    const hit = k.scan(data, pos, block, filter, window);
+    if (hit < 0) break;
+    const candidates = blocks.get(window[3]);
+    let match = -1;
+    if (candidates) {
+      const hash = strongOf(data.subarray(hit, hit + block));
+      for (const i of candidates) {
+        strong[i] ??= strongOf(basis.subarray(i * block, (i + 1) * block));
+        if (!strong[i].equals(hash)) continue;
+        match = i;
+        // a run of blocks stays one op
+        if (copies && i === copy + copies) break;
+      }
+    }
+    if (match < 0) {
+      pos = hit + 1;
+      continue;
+    }
+    emitLiteral(hit);
+    if (!copies || match !== copy + copies) {
+      flushCopy();
+      copy = match;
+    }
+    copies++;
+    pos = literal = hit + block;
+  }
+  emitLiteral(data.length);
+  flushCopy();
+  return Buffer.from(w.finish());
+}
+
+/** Rebuild the content from `basis` and a delta, throws a RangeError if they do not fit. */
+export function applyDelta(basis, delta) {
+  const r = new SspBuf(delta);
+  const block = r.varu();
+  const size = r.varu();
+  const out = Buffer.allocUnsafe(size);
+  let pos = 0;
+  while (r.remaining()) {
+    const tag = r.varu();
+    if (tag === 1) {
+      const bytes = r.bytes();
+      if (pos + bytes.length > size) throw new RangeError('delta overruns its content');
+      out.set(bytes, pos);
+      pos += bytes.length;
+      continue;
+    }
+    const start = r.varu() * block;
+    const end = start + (tag >>> 1) * block;
+    if (tag & 1 || end > basis.length || pos + end - start > size) throw new RangeError('delta does not fit its basis');
+    basis.copy(out, pos, start, end);
+    pos += end - start;
+  }
+  if (pos !== size) throw new RangeError('delta is short of its content');
+  return out;
+}
@@ -0,0 +1,146 @@
+import { createHmac, diffieHellman, generateKeyPairSync, hkdfSync, sign, timingSafeEqual, verify } from 'node:crypto';
+import { Aead, ReplayWindow } from './aead.js';
+import { fingerprint, publicKeyFromRaw, rawPublicKey } from './certs.js';
+
+/**
+ * One round trip authenticated key exchange.
+ *
+ *   initiator -> responder  handshake_init  { identity, ephemeral, signature }
+ *   responder -> initiator  handshake_resp  { identity, ephemeral, signature }
+ *
+ * Both sides send a fresh X25519 key signed with their Ed25519 identity,
+ * bound to their session tag and, for the response, to the initiator's
+ * offer. The X25519 shared secret is run through HKDF into one traffic key
+ * per direction. Handshake frames travel unencrypted.
+ *
+ * The signatures only show each side holds the identity it sent, not that it
+ * is a peer we trust. That is proven afterwards under the session keys: each
+ * side sends an HMAC keyed by the auth token over the transcript (both tags,
+ * both ephemerals, both identities) and checks the other's. The token itself
+ * never goes on the wire, and a man in the middle has a different transcript
+ * with each side, so a proof it relays does not check.
+ */
+
+const INIT_CONTEXT = Buffer.from('bzzwrd handshake init');
+const RESP_CONTEXT = Buffer.from('bzzwrd handshake resp');
+const TRAFFIC_INFO = Buffer.from('bzzwrd traffic keys');
+// one label per direction, so a proof cannot be reflected back
+const PROOF_INITIATOR = Buffer.from('bzzwrd auth initiator');
+const PROOF_RESPONDER = Buffer.from('bzzwrd auth responder');
+
+const u32 = (v) => {
+  const buf = Buffer.alloc(4);
+  buf.writeUInt32BE(v >>> 0);
+  return buf;
+};
+
+function deriveKeys(ephemeral, peerEphemeral, initiatorEphemeral, responderEphemeral) {
+  const secret = diffieHellman({ privateKey: ephemeral, publicKey: publicKeyFromRaw('X25519', peerEphemeral) });
+  const salt = Buffer.concat([initiatorEphemeral, responderEphemeral]);
+  const okm = Buffer.from(hkdfSync('sha256', secret, salt, TRAFFIC_INFO, 64));
+  return { initiator: okm.subarray(0, 32), responder: okm.subarray(32) };
+}
+
+function verifySignature(context, parts, identity, signature) {
+  try {
+    return verify(null, Buffer.concat([context, ...parts]), publicKeyFromRaw('Ed25519', identity), signature);
+  } catch {
+    return false;
+  }
+}
+
+// initiator tag, responder tag, initiator and responder ephemeral, initiator
+// and responder identity
+const transcriptOf = (initiatorTag, responderTag, initiatorEphemeral, responderEphemeral, initiator, responder) =>
+  Buffer.concat([u32(initiatorTag), u32(responderTag), initiatorEphemeral, responderEphemeral, initiator, responder]);
+
+const proofOf = (token, transcript, initiator) =>
+  createHmac('sha256', token)
+    .update(initiator ? PROOF_INITIATOR : PROOF_RESPONDER)
+    .update(transcript)
+    .digest();
+
+/**
+ * Traffic state of one peer: separate keys per direction, the replay window
+ * for what it sends us, its identity and the handshake transcript the auth
+ * proofs are bound to.
+ */
+export class Session {
+  constructor(txKey, rxKey, identity, transcript, initiator) {
+    this.tx = new Aead(txKey);
+    this.rx = new Aead(rxKey);
+    this.rxKey = rxKey;
+    this.replay = new ReplayWindow();
+    this.identity = identity;
+    this.fingerprint = fingerprint(identity);
+    this.transcript = transcript;
+    this.initiator = initiator;
+    this.response = null;
+    this.offer = null;
+  }
+
+  /** Our proof that we hold `token`, for this session only. */
+  proof(token) {
+    return proofOf(token, this.transcript, this.initiator);
+  }
+
+  /** Whether the peer's `proof` shows it holds `token`. */
+  checkProof(token, proof) {
+    const expected = proofOf(token, this.transcript, !this.initiator);
+    return proof?.length === expected.length && timingSafeEqual(proof, expected);
+  }
+
+  free() {
+    this.tx.free();
+    this.rx.free();
+  }
+}
+
+/** Start a handshake. Keep the result until the response arrives. */
+export function initiate(identity, tag) {
+  const { privateKey, publicKey } = generateKeyPairSync('x25519');
+  const ephemeral = rawPublicKey(publicKey);
+  const signature = sign(null, Buffer.concat([INIT_CONTEXT, u32(tag), ephemeral]), identity.privateKey);
+  return { privateKey, ephemeral, tag, message: { identity: identity.raw, ephemeral, signature } };
+}
+
+/**
+ * Answer a handshake_init from `sender`. Returns `{ session, message }` or
+ * null if the offer does not verify.
+ */
+export function respond(identity, tag, offer, sender) {
+  const { identity: peerIdentity, ephemeral: peerEphemeral, signature } = offer;
+  if (!verifySignature(INIT_CONTEXT, [u32(sender), peerEphemeral], peerIdentity, signature)) return null;
+
+  const { privateKey, publicKey } = generateKeyPairSync('x25519');
+  const ephemeral = rawPublicKey(publicKey);
+  const keys = deriveKeys(privateKey, peerEphemeral, peerEphemeral, ephemeral);
+  const transcript = Buffer.concat([RESP_CONTEXT, u32(tag), peerEphemeral, ephemeral, peerIdentity]);
+
+  const session = new Session(
+    keys.responder,
+    keys.initiator,
+    Buffer.from(peerIdentity),
+    transcriptOf(sender, tag, peerEphemeral, ephemeral, peerIdentity, identity.raw),
+    false,
+  );
+  session.offer = Buffer.from(peerEphemeral);
+  session.response = { identity: identity.raw, ephemeral, signature: sign(null, transcript, identity.privateKey) };
+  return { session, message: session.response };
+}
+
+/** Finish a handshake we initiated. Returns the session or null. */
+export function complete(pending, identity, response, sender) {
+  const { identity: peerIdentity, ephemeral: peerEphemeral, signature } = response;
+  const parts = [u32(sender), pending.ephemeral, peerEphemeral, identity.raw];
+  if (!verifySignature(RESP_CONTEXT, parts, peerIdentity, signature)) return null;
+
+  const keys = deriveKeys(pending.privateKey, peerEphemeral, pending.ephemeral, peerEphemeral);
+  return new Session(
+    keys.initiator,
+    keys.responder,
+    Buffer.from(peerIdentity),
+    transcriptOf(pending.tag, sender, pending.ephemeral, peerEphemeral, identity.raw, peerIdentity),
+    true,
+  );
+}
@@ -0,0 +1,328 @@
+import {
+  closeSync,
+  existsSync,
+  mkdirSync,
+  openSync,
+  readFileSync,
+  readSync,
+  readdirSync,
+  renameSync,
+  unlinkSync,
+  writeSync,
+} from 'node:fs';
+import { join } from 'node:path';
+import { state } from '../state.js';
+import { HASH_LENGTH, TEXT_MIME, hashKey, hashOf } from './clipboard.js';
+
+/**
+ * Clipboard history, the last contents seen on any peer by content hash.
+ *
+ * Bodies are appended to a data file and never held in memory, an index of
+ * fixed size records says where each is and when it was last used. Only the
+ * index is read to list the history (`bzz clipboard list`), a body is read
+ * from the file when it is asked for. Past the byte or entry budget the least
+ * recently used entries are dropped from the index; once the data file holds
+ * more dead bytes than live ones it is rewritten under the next generation
+ * and the index swapped to it in one rename, so a reader never pairs an index
+ * with the wrong data.
+ */
+
+export const HISTORY_MAGIC = 0x49485a42;
+export const HISTORY_VERSION = 1;
+export const HEADER_SIZE = 16;
+export const RECORD_SIZE = 96;
+export const HISTORY_BYTES = 64 << 20;
+export const HISTORY_ENTRIES = 256;
+const MIME_OFFSET = 48;
+const MIME_SIZE = RECORD_SIZE - MIME_OFFSET;
+const LIVE = 1;
+// dead bytes before a compaction is worth it at all
+const COMPACT_MIN = 1 << 20;
+const COPY_CHUNK = 1 << 16;
+
+export const historyDir = () => join(state.configDir, 'clipboard');
+export const INDEX_FILE = 'history.index';
+export const dataFile = (generation) => `history.${generation}.data`;
+
+function encodeHeader(generation) {
+  const buf = Buffer.alloc(HEADER_SIZE);
+  buf.writeUInt32LE(HISTORY_MAGIC, 0);
+  buf.writeUInt32LE(HISTORY_VERSION, 4);
+  buf.writeUInt32LE(RECORD_SIZE, 8);
+  buf.writeUInt32LE(generation, 12);
+  return buf;
+}
+
+function encodeRecord({ hash, offset, length, added, used }, mime, flags = LIVE) {
+  const buf = Buffer.alloc(RECORD_SIZE);
+  Buffer.from(hash).copy(buf, 0, 0, HASH_LENGTH);
+  buf.writeBigUInt64LE(BigInt(offset), 16);
+  buf.writeUInt32LE(length, 24);
+  buf.writeUInt32LE(flags, 28);
+  buf.writeDoubleLE(added, 32);
+  buf.writeDoubleLE(used, 40);
+  buf.write(mime, MIME_OFFSET, MIME_SIZE - 1, 'latin1');
+  return buf;
+}
+
+/**
+ * Decode an index image: `{ generation, entries, free }`, the live entries
+ * least recently used first and the slots of dropped ones.
+ */
+export function decodeHistoryIndex(buf) {
+  if (buf.length < HEADER_SIZE || buf.readUInt32LE(0) !== HISTORY_MAGIC) throw new Error('not a clipboard history');
+  if (buf.readUInt32LE(4) !== HISTORY_VERSION) throw new Error(`unsupported history version ${buf.readUInt32LE(4)}`);
+  if (buf.readUInt32LE(8) !== RECORD_SIZE) throw new Error('unsupported history record size');
+  const generation = buf.readUInt32LE(12);
+  const entries = [];
+  const free = [];
+  // a record cut short by a crash is not there
+  const slots = Math.floor((buf.length - HEADER_SIZE) / RECORD_SIZE);
+  for (let slot = 0; slot < slots; slot++) {
+    const off = HEADER_SIZE + slot * RECORD_SIZE;
+    if (!(buf.readUInt32LE(off + 28) & LIVE)) {
+      free.push(slot);
+      continue;
+    }
+    const mime = buf.subarray(off + MIME_OFFSET, off + RECORD_SIZE);
+    const end = mime.indexOf(0);
+    const hash = Buffer.from(buf.subarray(off, off + HASH_LENGTH));
+    entries.push({
+      slot,
+      key: hashKey(hash),
+      hash,
+      offset: Number(buf.readBigUInt64LE(off + 16)),
+      length: buf.readUInt32LE(off + 24),
+      added: buf.readDoubleLE(off + 32),
+      used: buf.readDoubleLE(off + 40),
+      mime: mime.toString('latin1', 0, end === -1 ? MIME_SIZE : end) || TEXT_MIME,
+    });
+  }
+  entries.sort((a, b) => a.used - b.used);
+  return { generation, entries, free };
+}
+
+/** The index in `dir`, an empty history if there is none yet. */
+export function readHistory(dir = historyDir()) {
+  const path = join(dir, INDEX_FILE);
+  if (!existsSync(path)) return { generation: 0, entries: [], free: [] };
+  return decodeHistoryIndex(readFileSync(path));
+}
+
+function readAt(fd, length, offset) {
+  const buf = Buffer.allocUnsafe(length);
+  for (let off = 0; off < length; ) {
+    const n = readSync(fd, buf, off, length - off, offset + off);
+    if (n === 0) throw new Error('clipboard history entry is short');
+    off += n;
+  }
+  return buf;
+}
+
+function writeAt(fd, data, offset) {
+  for (let off = 0; off < data.length; ) off += writeSync(fd, data, off, data.length - off, offset + off);
+}
+
+// `length` bytes from `src` at `from` to `dst` at `to`, a chunk at a time
+function copyAt(src, from, dst, to, length) {
+  const chunk = Buffer.allocUnsafe(Math.min(length, COPY_CHUNK));
+  for (let off = 0; off < length; ) {
+    const n = readSync(src, chunk, 0, Math.min(chunk.length, length - off), from + off);
+    if (n === 0) throw new Error('clipboard body is short');
+    writeAt(dst, chunk.subarray(0, n), to + off);
+    off += n;
+  }
+}
+
+// the bytes of an entry, checked against its hash: an entry of an index
+// that was swapped since it was read is gone rather than wrong
+function readBody(fd, entry) {
+  const data = readAt(fd, entry.length, entry.offset);
+  if (hashKey(hashOf(data)) !== entry.key) throw new Error(`clipboard history entry ${entry.key} is gone`);
+  return data;
+}
+
+/** Bytes of an entry of readHistory(dir), without opening the history. */
+export function readHistoryBody(dir, generation, entry) {
+  const fd = openSync(join(dir, dataFile(generation)), 'r');
+  try {
+    return readBody(fd, entry);
+  } finally {
+    closeSync(fd);
+  }
+}
+
+/**
+ * The history of this peer. The files are opened on first use; `add` takes
+ * a content by hash, a ClipboardBody or bytes, and keeps it as the most
+ * recently used entry, `read` loads the bytes of an entry.
+ */
+export class ClipboardHistory {
+  constructor({ dir = historyDir(), bytes = HISTORY_BYTES, entries = HISTORY_ENTRIES } = {}) {
+    this.dir = dir;
+    this.limit = bytes;
+    this.max = entries;
+    this.index = -1;
+    this.data = -1;
+    this.clock = 0;
+  }
+
+  open() {
+    if (this.index >= 0) return;
+    mkdirSync(this.dir, { recursive: true });
+    const path = join(this.dir, INDEX_FILE);
+    let image = null;
+    if (existsSync(path)) {
+      try {
+        image = decodeHistoryIndex(readFileSync(path));
+        this.index = openSync(path, 'r+');
+      } catch (err) {
+        console.debug(`Clipboard history unreadable, starting over: ${err.message}`);
+      }
+    }
+    if (!image) {
+      image = { generation: 0, entries: [], free: [] };
+      this.index = openSync(path, 'w+');
+      writeAt(this.index, encodeHeader(0), 0);
+    }
+    this.generation = image.generation;
+    const data = join(this.dir, dataFile(this.generation));
+    this.data = openSync(data, existsSync(data) ? 'r+' : 'w+');
+    // data of an older generation, left by a crash in the middle of compact
+    for (const file of readdirSync(this.dir)) {
+      if (/^history\.\d+\.data$/.test(file) && file !== dataFile(this.generation)) unlinkSync(join(this.dir, file));
+    }
+    this.map = new Map(image.entries.map((entry) => [entry.key, entry]));
+    this.free = image.free;
+    this.slots = image.entries.length + image.free.length;
+    this.bytes = 0;
+    this.end = 0;
+    for (const entry of image.entries) {
+      this.clock = Math.max(this.clock, entry.used);
+      this.bytes += entry.length;
+      this.end = Math.max(this.end, entry.offset + entry.length);
+    }
+    this.dead = this.end - this.bytes;
+  }
+
+  get size() {
+    this.open();
+    return this.map.size;
+  }
+
+  has(key) {
+    this.open();
+    return this.map.has(key);
+  }
+
+  /** Entries without their bodies, most recently used first. */
+  list() {
+    this.open();
+    return [...this.map.values()].reverse();
+  }
+
+  get(key) {
+    this.open();
+    return this.map.get(key);
+  }
+
+  read(entry) {
+    this.open();
+    return readBody(this.data, entry);
+  }
+
+  /** Keep `content` of `hash`, the entry, or null if it is over the budget. */
+  add(hash, content, mime = content.mime ?? TEXT_MIME) {
+    this.open();
+    const key = hashKey(hash);
+    // strictly increasing, so entries added within a millisecond keep their order
+    const now = (this.clock = Math.max(Date.now(), this.clock + 0.001));
+    const old = this.map.get(key);
+    if (old) {
+      old.used = now;
+      this.map.delete(key);
+      this.map.set(key, old);
+      this.write(old);
+      return old;
+    }
+    if (content.length > this.limit) return null;
+
+    const entry = { slot: 0, key, hash: Buffer.from(hash), offset: this.end, length: content.length, added: now, used: now, mime };
+    // body first, an index record never points past the data
+    if (content.fd >= 0) copyAt(content.fd, 0, this.data, entry.offset, entry.length);
+    else writeAt(this.data, content.data ?? content, entry.offset);
+    this.end += entry.length;
+    entry.slot = this.free.length ? this.free.pop() : this.slots++;
+    this.write(entry);
+    this.map.set(key, entry);
+    this.bytes += entry.length;
+
+    for (const [oldest, value] of this.map) {
+      if (this.bytes <= this.limit && this.map.size <= this.max) break;
+      this.map.delete(oldest);
+      this.bytes -= value.length;
+      this.dead += value.length;
+      writeAt(this.index, encodeRecord(value, value.mime, 0), HEADER_SIZE + value.slot * RECORD_SIZE);
+      this.free.push(value.slot);
+    }
+    if (this.dead >= COMPACT_MIN && this.dead > this.bytes) this.compact();
+    return entry;
+  }
+
+  write(entry) {
+    writeAt(this.index, encodeRecord(entry, entry.mime), HEADER_SIZE + entry.slot * RECORD_SIZE);
+  }
+
+  /** Rewrite the live bodies under the next generation, dropping dead ones. */
+  compact() {
+    this.open();
+    const generation = (this.generation + 1) >>> 0;
+    const data = openSync(join(this.dir, dataFile(generation)), 'w+');
+    const records = [encodeHeader(generation)];
+    let end = 0;
+    let slot = 0;
+    try {
+      for (const entry of this.map.values()) {
+        copyAt(this.data, entry.offset, data, end, entry.length);
+        records.push(encodeRecord({ ...entry, offset: end }, entry.mime));
+        end += entry.length;
+      }
+      const tmp = join(this.dir, `${INDEX_FILE}.tmp`);
+      const index = openSync(tmp, 'w');
+      try {
+        writeAt(index, Buffer.concat(records), 0);
+      } finally {
+        closeSync(index);
+      }
+      renameSync(tmp, join(this.dir, INDEX_FILE));
+    } catch (err) {
+      closeSync(data);
+      unlinkSync(join(this.dir, dataFile(generation)));
+      throw err;
+    }
+
+    end = 0;
+    for (const entry of this.map.values()) {
+      entry.offset = end;
+      entry.slot = slot++;
+      end += entry.length;
+    }
+    closeSync(this.index);
+    closeSync(this.data);
+    unlinkSync(join(this.dir, dataFile(this.generation)));
+    this.index = openSync(join(this.dir, INDEX_FILE), 'r+');
+    this.data = data;
+    this.generation = generation;
+    this.slots = slot;
+    this.free = [];
+    this.end = end;
+    this.dead = 0;
+  }
+
+  close() {
+    if (this.index < 0) return;
+    closeSync(this.index);
+    closeSync(this.data);
+    this.index = this.data = -1;
+  }
+}
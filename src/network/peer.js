@@ -1,4 +1,6 @@
-import { randomBytes, createCipheriv, createDecipheriv } from 'node:crypto';
+import { randomBytes } from 'node:crypto';
+import { lookup } from 'node:dns/promises';
+import { isIP } from 'node:net';
 import {
   red,
   green,
@@ -14,43 +16,118 @@ import {
   skull,
   handshake,
   wave,
-  token,
   mouse,
 } from '../colors.js';
 import { DisplayServer } from '../display.js';
-import '../x11/index.js';
-import '../wayland/index.js';
-import { cc } from 'bun:ffi';
+import { BULK, DROP, EV, HANDSHAKE, trace } from '../trace.js';
+import { BULK_THRESHOLD, BulkSend, WORKER_MIN, bulkPool, pack, unpack } from './bulk.js';
+import { loadIdentity } from './certs.js';
+import {
+  ClipboardBody,
+  ClipboardCache,
+  FETCH_TIMEOUT,
+  PRIMARY_DEBOUNCE,
+  SelectionWatch,
+  TEXT_MIME,
+  hashKey,
+  hashOf,
+} from './clipboard.js';
+import { MotionCoalescer } from './coalesce.js';
+import { DELTA_BASES, DELTA_MIN } from './delta.js';
+import { complete, initiate, respond } from './handshake.js';
+import { ClipboardHistory } from './history.js';
+import { RELIABLE_TYPES, RecvLane, SendLane } from './reliable.js';
+import { SlotTable } from './slots.js';
+import { InputState } from './snapshot.js';
+import { UdpSocket } from './udp.js';
+import {
+  FLAG_RELIABLE,
+  HEADER_CONN,
+  HEADER_LENGTH,
+  OP_ACK,
+  OP_AUTH,
+  OP_BULK,
+  OP_BULK_ACK,
+  OP_CLIPBOARD_DELTA,
+  OP_CLIPBOARD_FETCH,
+  OP_EXT,
+  OP_HANDSHAKE_INIT,
+  OP_HANDSHAKE_RESP,
+  OP_HELLO,
+  OP_IDLE_INHIBIT,
+  OP_INPUT_STATE,
+  OP_KEY,
+  OP_KEY_RAW,
+  OP_KEY_RELEASE_ALL,
+  OP_MOUSE_ABS,
+  OP_MOUSE_BUTTON,
+  OP_MOUSE_MOVE,
+  OP_MOUSE_WHEEL,
+  decodeBody,
+  decodeHeader,
+  encodeFrame,
+  opcodeOf,
+} from './wire.js';
 
 const DEFAULT_PORT = 12345;
-const ALGORITHM = 'aes-256-gcm';
-const IV_LENGTH = 12;
-const AUTH_TAG_LENGTH = 16;
-
-const SHARED_KEY = Buffer.from('0123456789abcdef0123456789abcdef0123456789abcdef0123456789abcdef', 'hex');
+// handshake_init retransmits before connect gives up
+const HANDSHAKE_ATTEMPTS = 3;
+const HANDSHAKE_TIMEOUT = 250;
+// how long connect waits for the peer's token in answer to ours
+const AUTH_TIMEOUT = 1000;
 
 export class Peer {
   constructor(options = {}) {
     this.port = options.port || DEFAULT_PORT;
-    this.peers = new Map();
-    this.handlers = new Map();
-    this.authenticatedPeers = new Set();
+    this.peers = new SlotTable();
+    this.handlers = new Array(256);
+    this.extHandlers = new Map();
     this.id = randomBytes(16).toString('hex');
-    this.key = SHARED_KEY;
+    this.tag = randomBytes(4).readUInt32BE(0);
+    this.seq = 0;
+    this.identity = options.identity ?? null;
     this.authToken = options.authToken;
     this.displayServer = null;
     this.displayContext = null;
     this.mouseLocked = false;
-
-    if (process.env.DEBUG) {
-      console.debug(`${info} Peer ID: ${cyan}${this.id}${reset}`);
-      console.debug(`${info} DTLS Key: ${cyan}${this.key.toString('hex')}${reset}`);
-    }
+    this.native = options.native ?? !!process.env.BZZ_NATIVE_DATAPATH;
+    this.datapath = null;
+    this.batchIO = options.batchIO ?? process.env.BZZ_BATCH_IO !== '0';
+    // set while a receive batch is dispatched, see handleBatch
+    this.batching = false;
+    this.acks = new Set();
+    // incoming bulk transfers to ack at the end of a batch, with their slot
+    this.bulkAcks = new Map();
+    this.bulkId = 0;
+    // clipboard announcements, see clipboard.js. the hash keys of what the
+    // CLIPBOARD and PRIMARY selections hold, index 1 is PRIMARY
+    this.clipboardSync = options.clipboard ?? process.env.BZZ_CLIPBOARD !== '0';
+    this.clipboardCache = new ClipboardCache();
+    // every content announced or fetched, on disk, see history.js
+    this.clipboardHistory = options.history ?? (process.env.BZZ_HISTORY !== '0' ? new ClipboardHistory() : null);
+    this.selections = [null, null];
+    this.selectionWatches = null;
+    this.fetches = new Map();
+    // collects frames sent to several peers or in bursts, see collect
+    this.outbox = null;
+
+    const deadline = options.coalesce ?? Number(process.env.BZZ_COALESCE_MS ?? 4);
+    this.motion =
+      deadline > 0 ? new MotionCoalescer((dx, dy) => this.transmit('mouse_move', { dx, dy }), { deadline }) : null;
+    const interval = options.snapshot ?? Number(process.env.BZZ_SNAPSHOT_MS ?? 200);
+    this.input = interval > 0 ? new InputState(this.sendSnapshot, { interval }) : null;
+
+    console.debug(`${info} Peer ID: ${cyan}${this.id}${reset}`);
   }
 
   async init() {
     try {
-      this.socket = await Bun.udpSocket({
+      this.identity ??= await loadIdentity();
+      console.debug(`${info} Identity: ${cyan}${this.identity.fingerprint}${reset}`);
+
+      if (this.native) this.socket = await this.initDatapath();
+      if (this.batchIO) this.socket ??= this.initBatchSocket();
+      this.socket ??= await Bun.udpSocket({
         port: this.port,
         socket: {
           data: (socket, message, port, addr) => {
@@ -71,8 +148,14 @@ export class Peer {
       this.on('key', this.onKey);
       this.on('key_raw', this.onKeyRaw);
       this.on('key_release_all', this.onKeyReleaseAll);
+      this.on('input_state', this.onInputState);
       this.on('idle_inhibit', this.onIdleInhibit);
       this.on('clipboard', this.onClipboard);
+      this.on('bulk', this.onBulk);
+      this.on('clipboard_offer', this.onClipboardOffer);
+      this.on('clipboard_fetch', this.onClipboardFetch);
+      this.on('clipboard_data', this.onClipboardData);
+      this.on('clipboard_delta', this.onClipboardDelta);
       return true;
     } catch (error) {
       console.error(`${error} Failed to initialize peer:`, error);
@@ -80,44 +163,237 @@ export class Peer {
     }
   }
 
-  onAuth = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authToken && data.token === this.authToken) {
-      if (!this.authenticatedPeers.has(peerKey)) {
-        this.authenticatedPeers.add(peerKey);
+  // recvmmsg/sendmmsg socket, falls back to the Bun socket if the native
+  // module did not build
+  initBatchSocket() {
+    if (!UdpSocket.available) return null;
+    try {
+      const socket = new UdpSocket(this.port, (messages, rinfos, count) => this.handleBatch(messages, rinfos, count));
+      console.debug(`${info} Batched UDP I/O on port ${cyan}${socket.port}${reset}`);
+      return socket;
+    } catch (err) {
+      console.warn(`${warning} Batched UDP I/O unavailable, falling back to Bun sockets: ${err.message}`);
+      return null;
+    }
+  }
+
+  // input then bypasses JS entirely: the datapath thread decrypts and injects
+  // it, only control messages come back through handleMessage
+  async initDatapath() {
+    try {
+      await this.ensureDisplayServerInitialized();
+      const datapath = this.displayServer.datapath(this.port);
+      datapath.setTag(this.tag);
+      datapath.start((message, rinfo) => this.handleMessage(message, rinfo));
+      this.datapath = datapath;
+      console.debug(`${info} Native datapath listening on port ${cyan}${datapath.port}${reset}`);
+      return datapath;
+    } catch (err) {
+      console.warn(`${warning} Native datapath unavailable, falling back to JS: ${err.message}`);
+      return null;
+    }
+  }
 
-        const peer = this.peers.get(peerKey) || {
-          address: info.address,
-          port: info.port,
-          lastSeen: Date.now(),
-        };
+  rotateTag() {
+    this.tag = randomBytes(4).readUInt32BE(0);
+    this.datapath?.setTag(this.tag);
+  }
+
+  authorize(slot) {
+    this.peers.setAuthenticated(slot, true);
+    if (slot.session) this.datapath?.allow(slot.id, slot.session.rxKey);
+  }
+
+  // a new session drops the authorization of the old one, the peer has to
+  // send its auth token again
+  setSession(slot, session) {
+    slot.session?.free();
+    slot.session = session;
+    // both sides start new lanes with the session
+    slot.sendLane?.stop();
+    slot.sendLane = new SendLane((lane, type, data) => this.sendTo(slot, type, data, FLAG_RELIABLE, lane), {
+      id: slot.id,
+    });
+    slot.recvLane = new RecvLane({ id: slot.id });
+    slot.authSent = false;
+    if (slot.authenticated) {
+      this.peers.setAuthenticated(slot, false);
+      this.datapath?.revoke(slot.id);
+    }
+    console.debug(
+      `${handshake} Session with ${cyan}${slot.address}:${slot.port}${reset} on slot ${cyan}${slot.id}${reset}, identity ${cyan}${session.fingerprint}${reset}`,
+    );
+  }
+
+  slotFor(address, port) {
+    return this.peers.find(address, port) ?? this.peers.alloc(address, port, this.evict);
+  }
+
+  // the unauthenticated peer seen least recently, its slot goes to a new one
+  evict = (slot) => {
+    console.debug(`${warning} Evicting peer ${cyan}${slot.address}:${slot.port}${reset} from slot ${slot.id}`);
+    if (trace.enabled) trace.emit(EV.HANDSHAKE, HANDSHAKE.EVICT, slot.id);
+    slot.pending?.done(null);
+    slot.session?.free();
+    if (slot.authenticated) this.datapath?.revoke(slot.id);
+  };
+
+  // drop the session a re-handshake replaced
+  replace(old, slot) {
+    console.debug(`${info} Session on slot ${old.id} replaced by slot ${cyan}${slot.id}${reset}`);
+    old.pending?.done(null);
+    old.authWait?.(false);
+    old.session?.free();
+    this.datapath?.revoke(old.id);
+    this.peers.free(old);
+  }
+
+  // the peer proved itself with a packet from a new address: a laptop that
+  // changed networks or a NAT that picked a new port
+  migrate(slot, rinfo) {
+    if (trace.enabled) trace.emit(EV.MIGRATE, slot.id, rinfo.port);
+    console.debug(
+      `${info} Peer on slot ${slot.id} moved from ${cyan}${slot.address}:${slot.port}${reset} to ${cyan}${rinfo.address}:${rinfo.port}${reset}`,
+    );
+    slot.address = rinfo.address;
+    slot.port = rinfo.port;
+  }
+
+  // proof of our token, bound to this session (see handshake.js), on the
+  // reliable lane so a lost datagram does not leave either side
+  // unauthenticated
+  sendAuth(slot) {
+    if (!slot.session) return;
+    slot.authSent = true;
+    slot.sendLane?.push('auth', { proof: slot.session.proof(this.authToken), id: this.id });
+  }
+
+  // send our token and wait for the peer's, resolves to whether it came
+  authenticateSlot(slot) {
+    if (slot.authenticated && slot.authSent) return Promise.resolve(true);
+    return new Promise((resolve) => {
+      const timer = setTimeout(() => done(false), AUTH_TIMEOUT);
+      const done = (ok) => {
+        clearTimeout(timer);
+        if (slot.authWait === done) slot.authWait = null;
+        resolve(ok);
+      };
+      slot.authWait = done;
+      this.sendAuth(slot);
+      if (slot.authenticated) done(true);
+    });
+  }
+
+  // run the key exchange with the peer in slot, resolves to the session or null
+  handshake(slot) {
+    const pending = initiate(this.identity, this.tag);
+    const message = { ...pending.message, conn: slot.id };
+    return new Promise((resolve) => {
+      let attempts = 0;
+      const done = (session) => {
+        clearTimeout(pending.timer);
+        if (slot.pending === pending) slot.pending = null;
+        resolve(session);
+      };
+      const send = () => {
+        if (attempts++ === HANDSHAKE_ATTEMPTS) {
+          if (trace.enabled) trace.emit(EV.HANDSHAKE, HANDSHAKE.TIMEOUT, slot.id);
+          return done(null);
+        }
+        if (trace.enabled) trace.emit(EV.HANDSHAKE, HANDSHAKE.OFFER, slot.id);
+        this.sendClear('handshake_init', message, slot.address, slot.port);
+        pending.timer = setTimeout(send, HANDSHAKE_TIMEOUT);
+      };
+      pending.done = done;
+      slot.pending = pending;
+      send();
+    });
+  }
+
+  onHandshake(header, data, rinfo) {
+    if (header.op === OP_HANDSHAKE_RESP) {
+      // the response is addressed to the slot we sent in our offer
+      const slot = this.peers.get(header.conn);
+      const pending = slot?.pending;
+      if (!pending) return;
+      const session = complete(pending, this.identity, data, header.sender);
+      if (!session) {
+        if (trace.enabled) trace.emit(EV.HANDSHAKE, HANDSHAKE.BAD_RESPONSE, slot.id);
+        return console.debug(`${warning} Bad handshake response from ${cyan}${rinfo.address}:${rinfo.port}${reset}`);
+      }
+      if (!slot.is(rinfo.address, rinfo.port)) this.migrate(slot, rinfo);
+      slot.remote = data.conn;
+      this.setSession(slot, session);
+      if (trace.enabled) trace.emit(EV.HANDSHAKE, HANDSHAKE.COMPLETE, slot.id);
+      return pending.done(session);
+    }
+
+    // an offer only has to be self-signed, so an authenticated session
+    // stays until the new one in a slot of its own proved the token. a
+    // forged offer from the peer's address must not drop it, see onAuth
+    let slot = null;
+    for (const other of this.peers) {
+      if (!other.is(rinfo.address, rinfo.port)) continue;
+      // a retransmitted offer, our response got lost
+      if (other.session?.offer?.equals(data.ephemeral)) {
+        return this.sendClear('handshake_resp', other.session.response, rinfo.address, rinfo.port, data.conn);
+      }
+      if (!other.authenticated) slot = other;
+    }
+    const pending = slot?.pending;
+
+    // both sides initiated at once, the larger identity (or tag, peers on
+    // one host share their identity) keeps its offer
+    if (pending && (Buffer.compare(this.identity.raw, data.identity) || this.tag - header.sender) > 0) return;
+
+    const res = respond(this.identity, this.tag, data, header.sender);
+    if (!res) {
+      if (trace.enabled) trace.emit(EV.HANDSHAKE, HANDSHAKE.BAD_OFFER, slot?.id ?? 0);
+      return console.debug(`${warning} Bad handshake offer from ${cyan}${rinfo.address}:${rinfo.port}${reset}`);
+    }
+    slot ??= this.peers.alloc(rinfo.address, rinfo.port, this.evict);
+    if (!slot) {
+      if (trace.enabled) trace.emit(EV.HANDSHAKE, HANDSHAKE.FULL, 0);
+      return console.debug(`${warning} No free slot for ${cyan}${rinfo.address}:${rinfo.port}${reset}`);
+    }
+    slot.remote = data.conn;
+    res.message.conn = slot.id;
+    this.setSession(slot, res.session);
+    if (trace.enabled) trace.emit(EV.HANDSHAKE, HANDSHAKE.ANSWER, slot.id);
+    this.sendClear('handshake_resp', res.message, rinfo.address, rinfo.port, data.conn);
+    pending?.done(res.session);
+  }
+
+  onAuth = async (data, info) => {
+    const { slot } = info;
+    if (this.authToken && slot.session?.checkProof(this.authToken, data.proof)) {
+      if (!slot.authenticated) {
+        this.authorize(slot);
+        // the peer handshook again from where it was, the new session
+        // proved the token and takes over
+        for (const old of this.peers) {
+          if (old !== slot && old.authenticated && old.is(slot.address, slot.port)) this.replace(old, slot);
+        }
 
         if (data.id) {
-          peer.id = data.id;
+          slot.peerId = data.id;
           console.debug(
             `${info} Identified peer ${cyan}${data.id}${reset} at ${cyan}${info.address}:${info.port}${reset}`,
           );
         }
 
-        if (!this.peers.has(peerKey)) {
-          this.peers.set(peerKey, peer);
-        } else {
-          this.peers.set(peerKey, {
-            ...this.peers.get(peerKey),
-            ...peer,
-            lastSeen: Date.now(),
-          });
-        }
-
         console.log(`${handshake} Peer authenticated: ${cyan}${info.address}:${info.port}${reset}`);
-        console.debug(`${token} Auth token matches: ${cyan}${data.token}${reset}`);
 
-        if (this.authenticatedPeers.size === 1) {
+        if (this.peers.authenticated === 1) {
           this.lockMouse();
         }
       }
+      // nothing goes to a peer before it proved the token, so it gets ours
+      // in answer
+      if (!slot.authSent) this.sendAuth(slot);
+      slot.authWait?.(true);
     } else {
-      console.debug(`${warning} Auth failed from ${cyan}${info.address}:${info.port}${reset} - invalid token`);
+      console.debug(`${warning} Auth failed from ${cyan}${info.address}:${info.port}${reset} - invalid proof`);
     }
   };
 
@@ -142,148 +418,310 @@ export class Peer {
     }
   };
 
-  onMouseMove = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authenticatedPeers.has(peerKey)) {
-      await this.ensureDisplayServerInitialized();
-      console.debug(`${info} Moving mouse relatively: dx=${cyan}${data.dx}${reset}, dy=${cyan}${data.dy}${reset}`);
-      this.displayServer.mouseRelativeMotion(this.displayContext, data.dx, data.dy);
-      this.displayServer.displayFlush(this.displayContext);
-    } else {
-      console.debug(
-        `${warning} Rejected mouse_move from unauthenticated peer ${cyan}${info.address}:${info.port}${reset}`,
-      );
-    }
+  // input handlers, handleMessage only dispatches these for authenticated
+  // peers. once the display is up they inject synchronously: outside a
+  // receive batch the backend sends each event right away, a batch is
+  // injected before its single commit
+  onMouseMove = async (data) => {
+    if (!this.displayServer) await this.ensureDisplayServerInitialized();
+    if (trace.enabled) trace.emit(EV.INJECT, OP_MOUSE_MOVE, data.dx, data.dy);
+    this.displayServer.mouseRelativeMotion(data.dx, data.dy);
   };
 
-  onMouseAbs = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authenticatedPeers.has(peerKey)) {
-      await this.ensureDisplayServerInitialized();
-      console.debug(
-        `${info} Moving mouse to absolute position: x=${cyan}${data.x}${reset}, y=${cyan}${data.y}${reset}`,
-      );
-      this.displayServer.mouseMotion(this.displayContext, data.x, data.y);
-      this.displayServer.displayFlush(this.displayContext);
-    } else {
-      console.debug(
-        `${warning} Rejected mouse_abs from unauthenticated peer ${cyan}${info.address}:${info.port}${reset}`,
-      );
-    }
+  onMouseAbs = async (data) => {
+    if (!this.displayServer) await this.ensureDisplayServerInitialized();
+    if (trace.enabled) trace.emit(EV.INJECT, OP_MOUSE_ABS, data.x, data.y);
+    this.displayServer.mouseMotion(data.x, data.y);
   };
 
-  onMouseButton = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authenticatedPeers.has(peerKey)) {
-      await this.ensureDisplayServerInitialized();
-      console.debug(
-        `${info} Mouse button: button=${cyan}${data.button}${reset}, pressed=${cyan}${data.pressed}${reset}`,
-      );
-      this.displayServer.mouseButton(this.displayContext, data.button, data.pressed);
-      this.displayServer.displayFlush(this.displayContext);
-    } else {
-      console.debug(
-        `${warning} Rejected mouse_button from unauthenticated peer ${cyan}${info.address}:${info.port}${reset}`,
-      );
-    }
+  onMouseButton = async (data) => {
+    if (!this.displayServer) await this.ensureDisplayServerInitialized();
+    if (trace.enabled) trace.emit(EV.INJECT, OP_MOUSE_BUTTON, data.button, data.pressed);
+    this.displayServer.mouseButton(data.button, data.pressed);
   };
 
-  onMouseWheel = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authenticatedPeers.has(peerKey)) {
-      await this.ensureDisplayServerInitialized();
-      console.debug(
-        `${info} Mouse wheel: horizontal=${cyan}${data.horizontal}${reset}, vertical=${cyan}${data.vertical}${reset}`,
-      );
-      this.displayServer.mouseWheel(this.displayContext, data.horizontal, data.vertical);
-      this.displayServer.displayFlush(this.displayContext);
-    } else {
-      console.debug(
-        `${warning} Rejected mouse_wheel from unauthenticated peer ${cyan}${info.address}:${info.port}${reset}`,
-      );
+  onMouseWheel = async (data) => {
+    if (!this.displayServer) await this.ensureDisplayServerInitialized();
+    if (trace.enabled) trace.emit(EV.INJECT, OP_MOUSE_WHEEL, data.horizontal, data.vertical);
+    this.displayServer.mouseWheel(data.horizontal, data.vertical);
+  };
+
+  onKey = async (data) => {
+    if (!this.displayServer) await this.ensureDisplayServerInitialized();
+    if (trace.enabled) trace.emit(EV.INJECT, OP_KEY, data.keycode, data.pressed, data.modifiers);
+    this.displayServer.key(data.keycode, data.modifiers, data.pressed);
+  };
+
+  onKeyRaw = async (data) => {
+    if (!this.displayServer) await this.ensureDisplayServerInitialized();
+    if (trace.enabled) trace.emit(EV.INJECT, OP_KEY_RAW, data.keycode, data.pressed);
+    this.displayServer.keyRaw(data.keycode, data.pressed);
+  };
+
+  onKeyReleaseAll = async () => {
+    if (!this.displayServer) await this.ensureDisplayServerInitialized();
+    if (trace.enabled) trace.emit(EV.INJECT, OP_KEY_RELEASE_ALL);
+    this.displayServer.keyReleaseAll();
+  };
+
+  // a snapshot only describes the state after every reliable frame before it,
+  // so it is applied when the lane is exactly there and dropped otherwise
+  onInputState = async (data, info) => {
+    if (data.lane !== info.slot.recvLane.next) {
+      if (trace.enabled) trace.emit(EV.DROP, DROP.STALE, OP_INPUT_STATE, info.slot.id, data.lane);
+      return;
     }
+    if (!this.displayServer) await this.ensureDisplayServerInitialized();
+    if (trace.enabled) trace.emit(EV.INJECT, OP_INPUT_STATE);
+    this.displayServer.inputSync(data.keys, data.raw, data.buttons, data.modifiers);
   };
 
-  onKey = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authenticatedPeers.has(peerKey)) {
-      await this.ensureDisplayServerInitialized();
+  onIdleInhibit = async (data) => {
+    if (!this.displayServer) await this.ensureDisplayServerInitialized();
+    if (trace.enabled) trace.emit(EV.INJECT, OP_IDLE_INHIBIT, data.inhibit);
+    this.displayServer.idleInhibit(data.inhibit);
+  };
+
+  onClipboard = async (data) => {
+    await this.ensureDisplayServerInitialized();
+
+    if (this.displayServer.haveClipboard()) {
       console.debug(
-        `${info} Key event: keycode=${cyan}${data.keycode}${reset}, modifiers=${cyan}${data.modifiers}${reset}, pressed=${cyan}${data.pressed}${reset}`,
+        `${info} Setting clipboard data: primary=${cyan}${data.primary}${reset}, length=${cyan}${data.text.length}${reset}`,
       );
-      this.displayServer.key(this.displayContext, data.keycode, data.modifiers, data.pressed);
-      this.displayServer.displayFlush(this.displayContext);
+      const text = Buffer.from(data.text);
+      this.displayServer.clipboardCopy(data.primary ? 1 : 0, text, text.length);
     } else {
-      console.debug(`${warning} Rejected key from unauthenticated peer ${cyan}${info.address}:${info.port}${reset}`);
+      console.debug(`${warning} Clipboard not available`);
     }
   };
 
-  onKeyRaw = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authenticatedPeers.has(peerKey)) {
-      await this.ensureDisplayServerInitialized();
-      console.debug(
-        `${info} Raw key event: keycode=${cyan}${data.keycode}${reset}, pressed=${cyan}${data.pressed}${reset}`,
-      );
-      this.displayServer.keyRaw(this.displayContext, data.keycode, data.pressed);
-      this.displayServer.displayFlush(this.displayContext);
-    } else {
-      console.debug(
-        `${warning} Rejected key_raw from unauthenticated peer ${cyan}${info.address}:${info.port}${reset}`,
-      );
+  // a peer's selection changed: use the cached content if we have it, or let
+  // the display server fetch it once something pastes
+  onClipboardOffer = async (data, info) => {
+    const key = hashKey(data.hash);
+    const primary = data.primary ? 1 : 0;
+    // our own watch will see the change, it must not be announced back
+    this.selections[primary] = key;
+    await this.ensureDisplayServerInitialized();
+    if (!this.displayServer.haveClipboard()) return;
+
+    const cached = this.clipboardCache.get(key);
+    if (cached) {
+      console.debug(`${info} Clipboard ${cyan}${key}${reset} is cached`);
+      this.rememberClipboard(info.slot, key);
+      this.displayServer.clipboardCopy(primary, cached, cached.length, data.mimes);
+      return;
     }
+    const mime = data.mimes.includes(TEXT_MIME) ? TEXT_MIME : data.mimes[0];
+    this.displayServer.clipboardOffer(primary, data.mimes, () => this.fetchClipboard(info.slot, data.hash, mime));
   };
 
-  onKeyReleaseAll = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authenticatedPeers.has(peerKey)) {
-      await this.ensureDisplayServerInitialized();
-      console.debug(`${info} Releasing all keys`);
-      this.displayServer.keyReleaseAll(this.displayContext);
-      this.displayServer.displayFlush(this.displayContext);
-    } else {
-      console.debug(
-        `${warning} Rejected key_release_all from unauthenticated peer ${cyan}${info.address}:${info.port}${reset}`,
-      );
+  // resolves to the content, or null if the peer does not send it in time
+  fetchClipboard(slot, hash, mime) {
+    const key = hashKey(hash);
+    const cached = this.clipboardCache.get(key) ?? this.recallClipboard(key);
+    if (cached) return Promise.resolve(cached);
+    let fetch = this.fetches.get(key);
+    if (!fetch) {
+      fetch = {};
+      fetch.promise = new Promise((resolve) => {
+        fetch.resolve = resolve;
+      });
+      fetch.timer = setTimeout(() => {
+        this.fetches.delete(key);
+        fetch.resolve(null);
+      }, FETCH_TIMEOUT);
+      this.fetches.set(key, fetch);
+      if (slot.session) this.transmitTo(slot, 'clipboard_fetch', { hash, mime, bases: this.clipboardBases(slot) });
+    }
+    return fetch.promise;
+  }
+
+  // content seen in an earlier run comes from the history, into the cache
+  recallClipboard(key) {
+    try {
+      const entry = this.clipboardHistory?.get(key);
+      if (!entry) return undefined;
+      const content = ClipboardBody.from(this.clipboardHistory.read(entry), entry.mime);
+      this.clipboardCache.set(key, content);
+      return content;
+    } catch (err) {
+      console.debug(`${warning} Clipboard history unavailable: ${err.message}`);
+      return undefined;
+    }
+  }
+
+  // keep content in the history, once its body is in a ClipboardBody
+  recordClipboard(hash, body) {
+    try {
+      this.clipboardHistory?.add(hash, body);
+    } catch (err) {
+      console.debug(`${warning} Clipboard history unavailable: ${err.message}`);
+    }
+  }
+
+  // earlier contents of this peer we still have, it can send a delta
+  // against one of them
+  clipboardBases(slot) {
+    return slot.clipboardBases.filter((key) => this.clipboardCache.has(key)).map((key) => Buffer.from(key, 'hex'));
+  }
+
+  rememberClipboard(slot, key) {
+    const bases = slot.clipboardBases;
+    const known = bases.indexOf(key);
+    if (known >= 0) bases.splice(known, 1);
+    bases.unshift(key);
+    if (bases.length > DELTA_BASES) bases.length = DELTA_BASES;
+  }
+
+  // only what our selections hold right now is handed out, and only to
+  // authenticated peers (dispatch)
+  onClipboardFetch = async (data, info) => {
+    const key = hashKey(data.hash);
+    const content = this.selections.includes(key) ? this.clipboardCache.get(key) : undefined;
+    if (!content) {
+      if (trace.enabled) trace.emit(EV.DROP, DROP.STALE, OP_CLIPBOARD_FETCH, info.slot.id);
+      return;
+    }
+    this.rememberClipboard(info.slot, key);
+    // the bytes are only read out of the memfd to go on the wire
+    let bytes = content.read();
+    // the newest basis the peer has that we still have too
+    const basis = bytes.length >= DELTA_MIN && data.bases.find((hash) => this.clipboardCache.has(hashKey(hash)));
+    if (basis) {
+      let diffed;
+      try {
+        // on a worker, the bytes go there and come back with the delta
+        diffed = await bulkPool.run('delta', [this.clipboardCache.get(hashKey(basis)).read(), bytes]);
+      } catch (err) {
+        console.debug(`${warning} Delta against ${cyan}${hashKey(basis)}${reset} failed: ${err.message}`);
+        return;
+      }
+      bytes = diffed.data;
+      if (diffed.delta.length < bytes.length / 2) {
+        this.transmitTo(info.slot, 'clipboard_delta', { hash: data.hash, mime: content.mime, basis, delta: diffed.delta });
+        return;
+      }
     }
+    this.transmitTo(info.slot, 'clipboard_data', { hash: data.hash, mime: content.mime, data: bytes });
   };
 
-  onIdleInhibit = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authenticatedPeers.has(peerKey)) {
-      await this.ensureDisplayServerInitialized();
-      console.debug(`${info} Setting idle inhibit: ${cyan}${data.inhibit}${reset}`);
-      this.displayServer.idleInhibit(this.displayContext, data.inhibit);
-      this.displayServer.displayFlush(this.displayContext);
-    } else {
-      console.debug(
-        `${warning} Rejected idle_inhibit from unauthenticated peer ${cyan}${info.address}:${info.port}${reset}`,
-      );
+  // a large content is hashed on a worker, it is moved there and back. the
+  // message it came in is detached with it, so the hash is copied first
+  onClipboardData = async (data, info) => {
+    const hash = Buffer.from(data.hash);
+    let checked = { data: data.data, hash: null };
+    try {
+      if (data.data.length >= WORKER_MIN) checked = await bulkPool.run('hash', [data.data]);
+    } catch (err) {
+      console.debug(`${warning} Hashing clipboard ${cyan}${hashKey(hash)}${reset} failed: ${err.message}`);
+      return;
     }
+    this.fetched(info.slot, hash, checked.data, data.mime, checked.hash ?? hashOf(checked.data));
   };
 
-  onClipboard = async (data, info) => {
-    const peerKey = `${info.address}:${info.port}`;
-    if (this.authenticatedPeers.has(peerKey)) {
-      await this.ensureDisplayServerInitialized();
+  // a delta that does not rebuild the announced content is fetched again,
+  // in full this time
+  onClipboardDelta = async (data, info) => {
+    const hash = Buffer.from(data.hash);
+    if (!this.fetches.has(hashKey(hash))) return;
+    const basis = this.clipboardCache.get(hashKey(data.basis));
+    let content = null;
+    try {
+      if (basis) content = await bulkPool.run('patch', [basis.read(), data.delta]);
+    } catch {}
+    if (content && this.fetched(info.slot, hash, content.data, data.mime, content.hash)) return;
+    if (trace.enabled) trace.emit(EV.DROP, DROP.MALFORMED, OP_CLIPBOARD_DELTA, info.slot.id);
+    this.transmitTo(info.slot, 'clipboard_fetch', { hash, mime: data.mime, bases: [] });
+  };
 
-      if (this.displayServer.haveClipboard()) {
-        console.debug(
-          `${info} Setting clipboard data: primary=${cyan}${data.primary}${reset}, length=${cyan}${data.text.length}${reset}`,
-        );
-        const textBytes = new TextEncoder().encode(data.text);
-        this.displayServer.clipboardCopy(data.primary ? 1 : 0, textBytes, textBytes.length);
-      } else {
-        console.debug(`${warning} Clipboard not available`);
-      }
-    } else {
-      console.debug(
-        `${warning} Rejected clipboard from unauthenticated peer ${cyan}${info.address}:${info.port}${reset}`,
-      );
+  // hand fetched content to whoever waits for it, false if it is not what
+  // was announced, `digest` is its hash. it goes into a memfd, the heap copy
+  // is garbage after this
+  fetched(slot, hash, data, mime, digest = hashOf(data)) {
+    const key = hashKey(hash);
+    const fetch = this.fetches.get(key);
+    if (!fetch || hashKey(digest) !== key) return false;
+    const content = ClipboardBody.from(data, mime || TEXT_MIME);
+    this.recordClipboard(hash, content);
+    // the waiting paste takes it synchronously, an uncached one is done after
+    if (!this.clipboardCache.set(key, content)) fetch.promise.then(() => content.close());
+    this.rememberClipboard(slot, key);
+    this.fetches.delete(key);
+    clearTimeout(fetch.timer);
+    fetch.resolve(content);
+    return true;
+  }
+
+  // follow the local selections and announce what they hold. PRIMARY is
+  // debounced, it changes with every drag of a selection
+  async watchClipboard() {
+    if (!this.clipboardSync || this.selectionWatches) return;
+    await this.ensureDisplayServerInitialized();
+    if (this.selectionWatches || !this.displayServer.haveClipboard()) return;
+    this.selectionWatches = [0, 1].map(
+      (primary) =>
+        new SelectionWatch({
+          watch: (onChange) => this.displayServer.clipboardWatch(primary, onChange),
+          read: () => this.displayServer.clipboardStream(primary),
+          type: () => this.displayServer.clipboardType(primary),
+          onContent: (content) => this.announceClipboard(primary, content),
+          debounce: primary ? PRIMARY_DEBOUNCE : 0,
+        }),
+    );
+  }
+
+  announceClipboard(primary, { hash, body }) {
+    const key = hashKey(hash);
+    if (this.selections[primary] === key) {
+      body.close();
+      return;
+    }
+    this.selections[primary] = key;
+    this.recordClipboard(hash, body);
+    if (!this.clipboardCache.set(key, body)) body.close();
+    console.debug(
+      `${info} Announcing clipboard ${cyan}${key}${reset}, ${cyan}${body.length}${reset} bytes of ${cyan}${body.mime}${reset}`,
+    );
+    this.broadcast('clipboard_offer', { primary: !!primary, hash, size: body.length, mimes: [body.mime] });
+  }
+
+  // a chunk of a message too big for one datagram. once all chunks are in
+  // the message is dispatched as if it had arrived in one piece
+  onBulk = async (data, info) => {
+    const { slot } = info;
+    const transfer = slot.bulkIn.accept(data);
+    if (!transfer) {
+      if (trace.enabled) trace.emit(EV.DROP, DROP.MALFORMED, OP_BULK, slot.id, data.id);
+      return;
+    }
+    if (this.batching) this.bulkAcks.set(transfer, slot);
+    else this.sendBulkAck(slot, transfer);
+    if (!transfer.complete || transfer.delivered) return;
+
+    const buf = slot.bulkIn.take(transfer);
+    let decoded;
+    try {
+      decoded = decodeBody(transfer.op, await unpack(transfer.codec, buf, transfer.size));
+    } catch (err) {
+      console.debug(`${warning} Bad bulk transfer from ${cyan}${info.address}:${info.port}${reset}: ${err.message}`);
+    }
+    if (!decoded || transfer.op === OP_BULK) {
+      if (trace.enabled) trace.emit(EV.BULK, BULK.ABORT, slot.id, transfer.id, transfer.size);
+      return;
     }
+    if (trace.enabled) trace.emit(EV.BULK, BULK.DELIVER, slot.id, transfer.id, transfer.size);
+    this.dispatch({ op: transfer.op, conn: slot.id, seq: transfer.id }, decoded, info);
   };
 
+  sendBulkAck(slot, transfer) {
+    if (!slot.session) return;
+    this.sendTo(slot, 'bulk_ack', { id: transfer.id, next: transfer.next, bits: transfer.bits() });
+  }
+
   async ensureDisplayServerInitialized() {
+    if (!this.displayServer) await DisplayServer.load();
     if (!this.displayServer) {
       console.debug(`${info} Initializing display server...`);
       this.displayServer = DisplayServer.create();
@@ -293,7 +731,8 @@ export class Peer {
       console.debug(`${info} Using display server: ${cyan}${serverType}${reset}`);
 
       this.displayContext = this.displayServer.contextNew();
-      const success = this.displayServer.setup(this.displayContext, 1920, 1080);
+      // the screen is the size of the outputs, not a guess
+      const success = this.displayServer.setup(0, 0);
 
       if (!success) {
         console.error(`${error} Failed to set up display server`);
@@ -303,38 +742,17 @@ export class Peer {
     return this.displayServer;
   }
 
-  lockMouse() {
+  async lockMouse() {
     if (this.mouseLocked) return console.debug('Mouse already locked');
 
     try {
-      this.ensureDisplayServerInitialized();
+      await this.ensureDisplayServerInitialized();
 
       if (!this.displayServer || !this.displayContext)
         return console.error('Failed to initialize display server for mouse locking');
 
       try {
-        if (this.displayServer.type === 'x11') {
-          console.debug('Using X11 legacy functions for cursor handling');
-          if (cc.x11_hide_cursor && cc.x11_lock_input) {
-            cc.x11_hide_cursor(this.displayContext);
-            cc.x11_lock_input(this.displayContext);
-          } else {
-            this.displayServer.mouseButton(this.displayContext, 1, 1);
-          }
-        } else if (this.displayServer.type === 'wayland') {
-          console.debug('Using Wayland legacy functions for cursor handling');
-          if (cc.wayland_hide_cursor && cc.wayland_lock_input) {
-            cc.wayland_hide_cursor(this.displayContext);
-            cc.wayland_lock_input(this.displayContext);
-          } else {
-            this.displayServer.mouseButton(this.displayContext, 1, 1);
-          }
-        } else {
-          console.error(`Unknown display server type: ${this.displayServer.type}`);
-
-          this.displayServer.mouseButton(this.displayContext, 1, 1);
-        }
-
+        this.displayServer.mouseButton(this.displayContext, 1, 1);
         this.mouseLocked = true;
         console.log('🖱️  Mouse locked and hidden');
       } catch (e) {
@@ -351,40 +769,9 @@ export class Peer {
     try {
       if (!this.mouseLocked) return;
 
-      if (!this.displayServer || !this.displayContext) {
-        this.mouseLocked = false;
-        console.log(`${mouse} Mouse unlocked and visible`);
-        return;
-      }
-
-      try {
-        const { symbols } = cc({
-          source: this.displayServer.constructor.name.includes('X11') ? './src/x11/x11.c' : './src/wayland/wayland.c',
-          symbols: {
-            x11_show_cursor: { args: [], returns: 'i32' },
-            x11_unlock_input: { args: [], returns: 'i32' },
-            wl_show_cursor: { args: [], returns: 'i32' },
-            wl_unlock_input: { args: [], returns: 'i32' },
-          },
-          includes: ['/usr/include'],
-          libs: ['dl'],
-          cflags: ['-ldl'],
-        });
-
-        if (this.displayServer.constructor.name.includes('X11')) {
-          symbols.x11_show_cursor();
-          symbols.x11_unlock_input();
-        } else {
-          symbols.wl_show_cursor();
-          symbols.wl_unlock_input();
-        }
-      } catch (e) {
-        console.error(`Failed to show cursor: ${e}`);
-
+      if (this.displayServer && this.displayContext) {
         try {
-          if (this.displayServer && this.displayContext) {
-            this.displayServer.mouseButton(this.displayContext, 1, 0);
-          }
+          this.displayServer.mouseButton(this.displayContext, 1, 0);
         } catch (err) {
           console.error(`Failed to unlock input: ${err}`);
         }
@@ -398,28 +785,35 @@ export class Peer {
     }
   }
 
-  async connect(host, port) {
+  async connect(host, port = DEFAULT_PORT) {
     try {
       console.debug(`${info} Connecting to ${cyan}${host}:${port}${reset}...`);
 
-      this.peers.set(`${host}:${port}`, {
-        address: host,
-        port,
-        lastSeen: Date.now(),
-      });
+      // handshake replies are matched by the address they come from
+      const address = isIP(host) ? host : (await lookup(host)).address;
+      const slot = this.slotFor(address, port);
+      if (!slot) {
+        console.debug(`${warning} No free slot for ${cyan}${host}:${port}${reset}`);
+        return false;
+      }
+
+      if (!slot.session && !(await this.handshake(slot))) {
+        console.debug(`${warning} No handshake response from ${cyan}${host}:${port}${reset}`);
+        return false;
+      }
 
-      if (this.authToken) {
-        console.debug(`${info} Sending auth with ID ${cyan}${this.id}${reset}`);
-        await this.broadcast('auth', {
-          token: this.authToken,
-          id: this.id,
-        });
-      } else {
+      if (!this.authToken) {
         console.debug(`${warning} No auth token set, cannot establish secure connection`);
         return false;
       }
+      console.debug(`${info} Sending auth with ID ${cyan}${this.id}${reset}`);
+      if (!(await this.authenticateSlot(slot))) {
+        console.debug(`${warning} No auth answer from ${cyan}${host}:${port}${reset}`);
+        return false;
+      }
 
       console.log(`${sparkles} Connected to ${cyan}${host}:${port}${reset}`);
+      this.watchClipboard().catch((err) => console.debug(`${warning} Clipboard sync unavailable: ${err.message}`));
       return true;
     } catch (error) {
       console.error(`${error} Failed to connect to ${host}:${port}: ${error}`);
@@ -429,9 +823,9 @@ export class Peer {
 
   async authenticate(peerId) {
     let peerToAuthenticate = null;
-    for (const [key, peer] of this.peers.entries()) {
-      if (peer.id === peerId) {
-        peerToAuthenticate = peer;
+    for (const slot of this.peers) {
+      if (slot.peerId === peerId) {
+        peerToAuthenticate = slot;
         break;
       }
     }
@@ -440,10 +834,7 @@ export class Peer {
       console.debug(
         `${info} Sending auth with ID to ${cyan}${peerToAuthenticate.address}:${peerToAuthenticate.port}${reset}`,
       );
-      await this.broadcast('auth', {
-        token: this.authToken,
-        id: this.id,
-      });
+      this.sendAuth(peerToAuthenticate);
       return true;
     }
 
@@ -451,104 +842,283 @@ export class Peer {
     return false;
   }
 
-  encrypt(data) {
-    const iv = randomBytes(IV_LENGTH);
-    const cipher = createCipheriv(ALGORITHM, this.key, iv);
-    const encrypted = Buffer.concat([cipher.update(data), cipher.final()]);
-    const authTag = cipher.getAuthTag();
-    return Buffer.concat([iv, authTag, encrypted]);
+  // packet layout: header | auth tag | ciphertext, the header travels in the
+  // clear as additional authenticated data so it can be inspected before any
+  // decryption work is done. the nonce is our tag and the frame seq.
+  encrypt(session, header, body, seq) {
+    return session.tx.seal(header, body, this.tag, seq);
   }
 
-  decrypt(data) {
-    try {
-      const iv = data.subarray(0, IV_LENGTH);
-      const authTag = data.subarray(IV_LENGTH, IV_LENGTH + AUTH_TAG_LENGTH);
-      const encrypted = data.subarray(IV_LENGTH + AUTH_TAG_LENGTH);
-      const decipher = createDecipheriv(ALGORITHM, this.key, iv);
-      decipher.setAuthTag(authTag);
-      return Buffer.concat([decipher.update(encrypted), decipher.final()]);
-    } catch (error) {
-      console.error('Decryption failed:', error);
-      throw error;
+  // drops replays before paying for the decryption, null if the frame is
+  // dropped
+  decrypt(session, data, header) {
+    if (!session.replay.check(header.sender, header.seq)) {
+      if (trace.enabled) trace.emit(EV.DROP, DROP.REPLAY, header.op, header.conn, header.seq);
+      return null;
+    }
+    const body = session.rx.open(data, HEADER_LENGTH, header.sender, header.seq);
+    if (!body) {
+      if (trace.enabled) trace.emit(EV.DROP, DROP.AUTH, header.op, header.conn, header.seq);
+      return null;
     }
+    session.replay.update(header.sender, header.seq);
+    return body;
+  }
+
+  // handshake frames have no session to be sealed with yet
+  sendClear(type, data, address, port, conn = 0) {
+    const frame = encodeFrame(type, data, this.tag, this.seq, 0, conn);
+    this.seq = (this.seq + 1) >>> 0;
+    this.socket.send(Buffer.from(frame), port, address);
   }
 
+  // relative motion goes through the coalescer, anything else flushes pending
+  // motion first so the receiver sees events in order
   async broadcast(type, data) {
-    const message = {
-      type,
-      data,
-      sender: this.id,
-      timestamp: Date.now(),
-    };
-
-    const payload = this.encrypt(Buffer.from(JSON.stringify(message)));
-    const packets = [];
+    this.input?.update(type, data);
+    if (this.motion) {
+      if (type === 'mouse_move') return this.motion.push(data.dx, data.dy);
+      this.motion.flush();
+    }
+    return this.transmit(type, data);
+  }
+
+  transmit(type, data) {
+    if (RELIABLE_TYPES.has(type)) return this.transmitReliable(type, data);
 
-    for (const [_, peer] of this.peers) {
-      packets.push(payload, peer.port, peer.address);
+    const seq = this.seq;
+    const frame = encodeFrame(type, data, this.tag, seq);
+    if (frame.length > BULK_THRESHOLD) return this.transmitBulk(frame[1], frame.slice(HEADER_LENGTH));
+    this.seq = (seq + 1) >>> 0;
+
+    const header = frame.subarray(0, HEADER_LENGTH);
+    const body = frame.subarray(HEADER_LENGTH);
+    const packets = [];
+    let bytes = 0;
+
+    // every session has its own keys and connection ID, so each peer gets
+    // its own packet
+    for (const slot of this.peers) {
+      if (!slot.session || !slot.authenticated) continue;
+      header[HEADER_CONN] = slot.remote;
+      const payload = this.encrypt(slot.session, header, body, seq);
+      bytes = payload.length;
+      packets.push(payload, slot.port, slot.address);
     }
+    // the nonce must never repeat under one key, start a new session id
+    // before the counter wraps
+    if (this.seq === 0) this.rotateTag();
 
     if (packets.length > 0) {
       const sent = this.socket.sendMany(packets);
       if (sent < packets.length / 3) {
         console.warn(`${warning} Only sent ${sent} out of ${packets.length / 3} packets`);
       }
-      console.debug(
-        `${info} Broadcasting ${cyan}${type}${reset} (${cyan}${payload.length}${reset} bytes) to ${cyan}${packets.length / 3}${reset} peers`,
-      );
-      for (const [_, peer] of this.peers) {
-        console.debug(`${gray}  → ${cyan}${peer.address}:${peer.port}${reset}`);
-      }
+      if (trace.enabled) trace.emit(EV.TX, opcodeOf(type), packets.length / 3, bytes, seq);
+    }
+  }
+
+  // every peer has its own lane and lane sequence, so the frames differ per
+  // peer; the lanes hand them to sendTo, which collects them for one sendMany
+  transmitReliable(type, data) {
+    this.perPeer((slot) => slot.sendLane?.push(type, data));
+  }
+
+  // runs send for every authenticated peer, collected for one sendMany
+  perPeer(send) {
+    this.collect(() => {
+      for (const slot of this.peers) if (slot.authenticated) send(slot);
+    });
+  }
+
+  // runs fn, sendTo collects what it sends and it goes out in one sendMany
+  collect = (fn) => {
+    if (this.outbox) return fn();
+    const packets = (this.outbox = []);
+    try {
+      fn();
+    } finally {
+      this.outbox = null;
     }
+    if (packets.length > 0) this.socket?.sendMany(packets);
+  };
+
+  // one message for one peer, over the bulk channel if it is big
+  transmitTo(slot, type, data) {
+    const frame = encodeFrame(type, data, this.tag, 0);
+    if (frame.length > BULK_THRESHOLD) return this.transmitBulk(frame[1], frame.slice(HEADER_LENGTH), [slot]);
+    this.sendTo(slot, type, data);
+  }
+
+  // a message too big for one datagram, compressed and sent in chunks to
+  // every peer, see bulk.js. resolves true if all peers got all of it
+  async transmitBulk(op, body, slots = this.peers) {
+    // a large body is moved to a worker by pack
+    const size = body.length;
+    const { codec, data } = await pack(body);
+    const id = this.bulkId;
+    this.bulkId = (id + 1) >>> 0;
+    const transfers = [];
+    for (const slot of slots) {
+      if (!slot.session || !slot.authenticated) continue;
+      const transfer = new BulkSend((chunk) => slot.session && this.sendTo(slot, 'bulk', chunk), {
+        id,
+        op,
+        codec,
+        size,
+        data,
+        conn: slot.id,
+        srtt: slot.sendLane?.rtt.srtt ?? null,
+        batch: this.collect,
+      });
+      const { bulkOut } = slot;
+      bulkOut.set(id, transfer);
+      transfers.push(transfer.start().finally(() => bulkOut.delete(id)));
+    }
+    return (await Promise.all(transfers)).every(Boolean);
+  }
+
+  // periodic input state, positioned at the lane sequence of the next
+  // reliable frame. while frames wait for room in the window the snapshot
+  // could never line up with the receiver's lane, so it is left out
+  sendSnapshot = (state) => {
+    if (!this.socket) return;
+    this.perPeer((slot) => {
+      if (!slot.session || !slot.sendLane || slot.sendLane.queue.length) return;
+      this.sendTo(slot, 'input_state', { ...state, lane: slot.sendLane.next });
+    });
+  };
+
+  // one sealed frame for one peer: reliable lane frames, their retransmits
+  // and acks
+  sendTo(slot, type, data, flags = 0, lane = 0) {
+    const seq = this.seq;
+    const frame = encodeFrame(type, data, this.tag, seq, flags, slot.remote, lane);
+    this.seq = (seq + 1) >>> 0;
+    const packet = this.encrypt(slot.session, frame.subarray(0, HEADER_LENGTH), frame.subarray(HEADER_LENGTH), seq);
+    if (this.seq === 0) this.rotateTag();
+
+    if (this.outbox) this.outbox.push(packet, slot.port, slot.address);
+    else this.socket.send(packet, slot.port, slot.address);
+    if (trace.enabled) trace.emit(EV.TX, opcodeOf(type), 1, packet.length, seq);
+  }
+
+  // acks for a receive batch go out once at its end
+  ackLater(slot) {
+    if (this.batching) this.acks.add(slot);
+    else this.sendAck(slot);
+  }
+
+  sendAck(slot) {
+    if (!slot.session) return;
+    this.sendTo(slot, 'ack', { next: slot.recvLane.next, bits: slot.recvLane.bits() });
   }
 
   on(type, handler) {
-    this.handlers.set(type, handler);
+    const op = opcodeOf(type);
+    if (op === OP_EXT) this.extHandlers.set(type, handler);
+    else this.handlers[op] = handler;
+  }
+
+  // a batch drained from the socket with one recvmmsg: dispatch all of it
+  // as one input batch, flushed to the display once at its end
+  handleBatch(messages, rinfos, count) {
+    const display = this.displayServer;
+    display?.inputBegin();
+    this.batching = true;
+    try {
+      for (let i = 0; i < count; i++) this.handleMessage(messages[i], rinfos[i]);
+    } finally {
+      this.batching = false;
+      display?.inputCommit();
+    }
+    for (const slot of this.acks) this.sendAck(slot);
+    this.acks.clear();
+    for (const [transfer, slot] of this.bulkAcks) this.sendBulkAck(slot, transfer);
+    this.bulkAcks.clear();
   }
 
   handleMessage(message, rinfo) {
     try {
-      console.debug(
-        `${info} Received ${cyan}${message.length}${reset} bytes from ${cyan}${rinfo.address}:${rinfo.port}${reset}`,
-      );
+      const header = decodeHeader(message);
+      if (!header) {
+        if (trace.enabled) trace.emit(EV.DROP, DROP.MALFORMED, -1, -1, message.length);
+        return;
+      }
+      if (trace.enabled) trace.emit(EV.RX, header.op, header.conn, message.length, header.seq);
+
+      if (header.sender === this.tag) {
+        if (trace.enabled) trace.emit(EV.DROP, DROP.OWN, header.op, header.conn, header.seq);
+        return;
+      }
 
-      const decrypted = this.decrypt(message);
-      const { type, data, sender, timestamp } = JSON.parse(decrypted.toString());
+      if (header.op === OP_HANDSHAKE_INIT || header.op === OP_HANDSHAKE_RESP) {
+        const { data } = decodeBody(header.op, message.subarray(HEADER_LENGTH));
+        return this.onHandshake(header, data, rinfo);
+      }
 
-      if (sender === this.id) {
-        console.debug(`${gray}Ignoring own message of type ${cyan}${type}${reset}`);
+      const slot = this.peers.get(header.conn);
+      if (!slot?.session) {
+        if (trace.enabled) trace.emit(EV.DROP, DROP.NO_SESSION, header.op, header.conn, header.seq);
         return;
       }
 
-      const peerKey = `${rinfo.address}:${rinfo.port}`;
-
-      if (type === 'hello') {
-        console.debug(`${info} Processing hello from ${cyan}${rinfo.address}:${rinfo.port}${reset}`);
-        console.debug(`Message data: ${JSON.stringify(data, null, 2)}`);
-        this.peers.set(peerKey, {
-          address: rinfo.address,
-          port: rinfo.port,
-          lastSeen: Date.now(),
-          id: data.id,
-        });
+      const body = this.decrypt(slot.session, message, header);
+      if (!body) return;
+      slot.lastSeen = Date.now();
+      // only the newest packet moves the peer, like QUIC: a delayed one from
+      // the old path must not flip it back. a new sender tag is newer, the
+      // replay window already refused those of rotated tags
+      if (header.sender !== slot.rxTag || header.seq > slot.rxSeq) {
+        slot.rxTag = header.sender;
+        slot.rxSeq = header.seq;
+        if (!slot.is(rinfo.address, rinfo.port)) this.migrate(slot, rinfo);
+      }
+      const reliable = header.flags & FLAG_RELIABLE;
+      if (reliable && body.length < 4) {
+        if (trace.enabled) trace.emit(EV.DROP, DROP.MALFORMED, header.op, header.conn, header.seq);
+        return;
+      }
+      const decoded = decodeBody(header.op, reliable ? body.subarray(4) : body);
+      if (!decoded) {
+        if (trace.enabled) trace.emit(EV.DROP, DROP.NO_HANDLER, header.op, header.conn, header.seq);
+        return;
       }
+      rinfo.slot = slot;
 
-      if (this.handlers.has(type)) {
-        const handler = this.handlers.get(type);
+      if (header.op === OP_ACK) return slot.sendLane.ack(decoded.data.next, decoded.data.bits);
+      if (header.op === OP_BULK_ACK) return slot.bulkOut.get(decoded.data.id)?.ack(decoded.data.next, decoded.data.bits);
+      if (header.op === OP_HELLO) slot.peerId = decoded.data.id;
 
-        if (type !== 'hello' && type !== 'auth' && !this.authenticatedPeers.has(peerKey)) {
-          console.debug(
-            `${warning} Rejected ${type} from unauthenticated peer ${cyan}${rinfo.address}:${rinfo.port}${reset}`,
-          );
-          return;
-        }
+      if (reliable) {
+        // ack duplicates as well, it may have been our ack that got lost
+        slot.recvLane.accept(body.readUInt32BE(0), [header, decoded, rinfo], this.deliver);
+        return this.ackLater(slot);
+      }
+      this.dispatch(header, decoded, rinfo);
+    } catch (error) {
+      console.error(`${error} Error handling message:`, error);
+    }
+  }
+
+  // reliable lane frames arrive here in lane order
+  deliver = ([header, decoded, rinfo]) => this.dispatch(header, decoded, rinfo);
 
-        console.debug(`${info} Processing ${cyan}${type}${reset} from ${cyan}${rinfo.address}:${rinfo.port}${reset}`);
-        console.debug(`Message data: ${JSON.stringify(data, null, 2)}`);
-        handler(data, rinfo);
-      } else {
-        console.debug(`${warning} No handler for message type: ${cyan}${type}${reset}`);
+  dispatch(header, { type, data }, rinfo) {
+    const { slot } = rinfo;
+    try {
+      const handler = header.op === OP_EXT ? this.extHandlers.get(type) : this.handlers[header.op];
+      if (!handler) {
+        if (trace.enabled) trace.emit(EV.DROP, DROP.NO_HANDLER, header.op, header.conn, header.seq);
+        return;
+      }
+      const open = header.op === OP_HELLO || header.op === OP_AUTH;
+      if (!open && !slot.authenticated) {
+        if (trace.enabled) trace.emit(EV.DROP, DROP.UNAUTHORIZED, header.op, header.conn, header.seq);
+        return;
       }
+      if (trace.enabled) trace.emit(EV.DISPATCH, header.op, slot.id);
+      handler(data, rinfo);
     } catch (error) {
       console.error(`${error} Error handling message:`, error);
     }
@@ -557,12 +1127,42 @@ export class Peer {
   cleanup() {
     console.log(`${success} Cleaned up peer resources`);
 
+    this.motion?.stop();
+    this.input?.stop();
+    for (const watch of this.selectionWatches ?? []) watch.stop();
+    this.selectionWatches = null;
+    for (const fetch of this.fetches.values()) {
+      clearTimeout(fetch.timer);
+      fetch.resolve(null);
+    }
+    this.fetches.clear();
+    this.clipboardHistory?.close();
+
     if (this.mouseLocked) {
       this.unlockMouse().catch((err) => {
         console.error(`${error} Failed to unlock mouse during cleanup:`, err);
       });
     }
 
+    // the native datapath injects from its own thread, stop it before the
+    // display context goes away
+    if (this.socket) {
+      try {
+        this.socket.close();
+        this.socket = null;
+        this.datapath = null;
+      } catch (err) {
+        console.error(`${error} Failed to close socket:`, err);
+        this.socket = null;
+      }
+    }
+
+    for (const slot of this.peers) {
+      if (slot.pending) clearTimeout(slot.pending.timer);
+      slot.session?.free();
+      this.peers.free(slot);
+    }
+
     if (this.displayServer && this.displayContext) {
       try {
         this.displayServer.contextFree(this.displayContext);
@@ -575,15 +1175,5 @@ export class Peer {
         this.displayServer = null;
       }
     }
-
-    if (this.socket) {
-      try {
-        this.socket.close();
-        this.socket = null;
-      } catch (err) {
-        console.error(`${error} Failed to close socket:`, err);
-        this.socket = null;
-      }
-    }
   }
 }
@@ -0,0 +1,218 @@
+import { DROP, EV, trace } from '../trace.js';
+
+/**
+ * Reliable ordered lane for discrete input, next to fire-and-forget motion.
+ *
+ * Key, button and wheel frames carry a per-session lane sequence number at
+ * the start of their sealed body (FLAG_RELIABLE). The receiver applies them
+ * strictly in lane order and answers with an `ack` holding the next lane
+ * sequence it expects plus a bitmap of the LANE_WINDOW frames after it that
+ * it already buffered. The sender retransmits a hole as soon as later frames
+ * are acked past it, otherwise when its RTO from a smoothed RTT estimate
+ * (RFC 6298) runs out. Every transmission is a new frame with a fresh nonce,
+ * only the lane sequence repeats.
+ *
+ * Motion keeps riding plain datagrams, so a lost key never holds it up.
+ */
+
+export const LANE_WINDOW = 32;
+export const RELIABLE_TYPES = new Set(['mouse_button', 'mouse_wheel', 'key', 'key_raw', 'key_release_all']);
+
+// LAN sized bounds for the retransmit timeout, in milliseconds
+export const RTO_INITIAL = 100;
+export const RTO_MIN = 10;
+export const RTO_MAX = 1000;
+// a hole counts as lost once this many later frames are acked, or 9/8 rtt
+// after it was sent
+const REORDER_THRESHOLD = 3;
+// events waiting for room in the window, the oldest go first beyond this
+const QUEUE_LIMIT = 256;
+
+// lane sequence numbers wrap, compare them as distances
+const distance = (a, b) => (a - b) | 0;
+
+/** Smoothed RTT and retransmit timeout, fed with samples in milliseconds. */
+export class RttEstimator {
+  constructor() {
+    this.srtt = null;
+    this.rttvar = 0;
+    this.rto = RTO_INITIAL;
+  }
+
+  sample(rtt) {
+    if (this.srtt === null) {
+      this.srtt = rtt;
+      this.rttvar = rtt / 2;
+    } else {
+      this.rttvar = 0.75 * this.rttvar + 0.25 * Math.abs(this.srtt - rtt);
+      this.srtt = 0.875 * this.srtt + 0.125 * rtt;
+    }
+    this.rto = Math.min(Math.max(this.srtt + Math.max(4 * this.rttvar, 1), RTO_MIN), RTO_MAX);
+  }
+}
+
+/**
+ * Sending half of a lane. `send(seq, type, data)` puts one frame on the wire,
+ * for the first transmission and every retransmit. At most LANE_WINDOW frames
+ * are in flight; later events wait in a queue until acks make room.
+ */
+export class SendLane {
+  constructor(send, { id = 0 } = {}) {
+    this.send = send;
+    this.id = id;
+    this.next = 0;
+    this.base = 0;
+    this.inflight = new Map();
+    this.queue = [];
+    this.rtt = new RttEstimator();
+    this.timer = null;
+    this.stats = { sent: 0, acked: 0, retransmits: 0, fast: 0, dropped: 0 };
+  }
+
+  push(type, data) {
+    if ((this.next - this.base) >>> 0 >= LANE_WINDOW) {
+      if (this.queue.length === QUEUE_LIMIT) {
+        this.queue.shift();
+        this.stats.dropped++;
+      }
+      this.queue.push([type, data]);
+      return;
+    }
+    const seq = this.next;
+    this.next = (seq + 1) >>> 0;
+    const entry = { type, data, sentAt: performance.now(), attempts: 1, rto: this.rtt.rto };
+    this.inflight.set(seq, entry);
+    this.stats.sent++;
+    this.send(seq, type, data);
+    this.schedule();
+  }
+
+  /** `next` and `bits` of a received ack */
+  ack(next, bits) {
+    const now = performance.now();
+    let sample = null;
+    let largest = null;
+    const acked = (seq) => {
+      const entry = this.inflight.get(seq);
+      if (!entry) return;
+      this.inflight.delete(seq);
+      this.stats.acked++;
+      // Karn: a retransmitted frame does not tell which copy was acked
+      if (entry.attempts === 1 && (sample === null || entry.sentAt > sample)) sample = entry.sentAt;
+      if (largest === null || distance(seq, largest) > 0) largest = seq;
+    };
+
+    for (let seq = this.base; distance(next, seq) > 0 && distance(this.next, seq) > 0; seq = (seq + 1) >>> 0) {
+      acked(seq);
+    }
+    for (let i = 0; i < LANE_WINDOW; i++) {
+      if (bits & (1 << i)) acked((next + 1 + i) >>> 0);
+    }
+    while (this.base !== this.next && !this.inflight.has(this.base)) this.base = (this.base + 1) >>> 0;
+    if (sample !== null) this.rtt.sample(now - sample);
+
+    // selective retransmit of the holes below the largest acked frame
+    if (largest !== null) {
+      const threshold = this.rtt.srtt === null ? Infinity : (this.rtt.srtt * 9) / 8;
+      for (const [seq, entry] of this.inflight) {
+        if (distance(largest, seq) <= 0) continue;
+        const lost = distance(largest, seq) >= REORDER_THRESHOLD || now - entry.sentAt >= threshold;
+        // once retransmitted give the new copy an rtt before trying again
+        const settled = entry.attempts === 1 || now - entry.sentAt >= (this.rtt.srtt ?? 0);
+        if (lost && settled) this.retransmit(seq, entry, now, true);
+      }
+    }
+
+    while (this.queue.length && (this.next - this.base) >>> 0 < LANE_WINDOW) this.push(...this.queue.shift());
+    this.schedule();
+  }
+
+  retransmit(seq, entry, now, fast) {
+    entry.attempts++;
+    entry.sentAt = now;
+    entry.rto = Math.min(this.rtt.rto * 2 ** (entry.attempts - 1), RTO_MAX);
+    this.stats.retransmits++;
+    if (fast) this.stats.fast++;
+    if (trace.enabled) trace.emit(EV.RETRANSMIT, this.id, seq, entry.attempts, Math.round(entry.rto));
+    this.send(seq, entry.type, entry.data);
+  }
+
+  schedule() {
+    if (this.timer) clearTimeout(this.timer);
+    this.timer = null;
+    let deadline = Infinity;
+    for (const entry of this.inflight.values()) deadline = Math.min(deadline, entry.sentAt + entry.rto);
+    if (deadline === Infinity) return;
+    this.timer = setTimeout(this.onTimeout, Math.max(deadline - performance.now(), 0));
+  }
+
+  onTimeout = () => {
+    this.timer = null;
+    const now = performance.now();
+    for (const [seq, entry] of this.inflight) {
+      if (now >= entry.sentAt + entry.rto) this.retransmit(seq, entry, now, false);
+    }
+    this.schedule();
+  };
+
+  stop() {
+    if (this.timer) clearTimeout(this.timer);
+    this.timer = null;
+    this.inflight.clear();
+    this.queue.length = 0;
+  }
+}
+
+/**
+ * Receiving half of a lane. `accept` hands frames to `deliver` in lane order,
+ * holding back the ones that arrive ahead of a hole.
+ */
+export class RecvLane {
+  constructor({ id = 0 } = {}) {
+    this.id = id;
+    this.next = 0;
+    this.buffer = new Map();
+    this.stats = { delivered: 0, reordered: 0, duplicates: 0, outside: 0 };
+  }
+
+  /** false if the frame was a duplicate or too far ahead to buffer */
+  accept(seq, item, deliver) {
+    const ahead = distance(seq, this.next);
+    if (ahead < 0 || this.buffer.has(seq)) {
+      this.stats.duplicates++;
+      if (trace.enabled) trace.emit(EV.DROP, DROP.DUPLICATE, -1, this.id, seq);
+      return false;
+    }
+    if (ahead > LANE_WINDOW) {
+      this.stats.outside++;
+      if (trace.enabled) trace.emit(EV.DROP, DROP.WINDOW, -1, this.id, seq);
+      return false;
+    }
+    if (ahead > 0) {
+      this.stats.reordered++;
+      this.buffer.set(seq, item);
+      return true;
+    }
+    this.deliver(item, deliver);
+    while (this.buffer.size) {
+      const held = this.buffer.get(this.next);
+      if (held === undefined) break;
+      this.buffer.delete(this.next);
+      this.deliver(held, deliver);
+    }
+    return true;
+  }
+
+  deliver(item, deliver) {
+    this.next = (this.next + 1) >>> 0;
+    this.stats.delivered++;
+    deliver(item);
+  }
+
+  /** bitmap of the buffered frames after `next`, bit i is next + 1 + i */
+  bits() {
+    let bits = 0;
+    for (const seq of this.buffer.keys()) bits |= 1 << (distance(seq, this.next) - 1);
+    return bits >>> 0;
+  }
+}
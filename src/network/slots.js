@@ -0,0 +1,134 @@
+import { BulkInbox } from './bulk.js';
+
+/**
+ * Preallocated peer table indexed by connection ID.
+ *
+ * Each side hands its slot index to the other during the handshake and the
+ * other puts it into the `conn` byte of every frame header, so finding the
+ * peer of a packet is a single array index instead of an address lookup.
+ * ID 0 means "no connection" and is used by handshake frames. Mirrors the
+ * peer table of the native datapath (DP_MAX_PEERS in datapath.h).
+ */
+
+export const MAX_PEERS = 32;
+// slots a handshake can take before the peer authenticated
+export const MAX_UNAUTHENTICATED = 8;
+
+export class PeerSlot {
+  constructor(id) {
+    this.id = id;
+    this.reset();
+  }
+
+  reset() {
+    this.used = false;
+    this.address = null;
+    this.port = 0;
+    // connection ID the peer assigned to us, goes into frames we send it
+    this.remote = 0;
+    this.peerId = undefined;
+    this.session = null;
+    // reliable lane of the session, see reliable.js
+    this.sendLane?.stop();
+    this.sendLane = null;
+    this.recvLane = null;
+    // bulk transfers to and from the peer, see bulk.js
+    for (const transfer of this.bulkOut?.values() ?? []) transfer.stop();
+    this.bulkOut = new Map();
+    this.bulkIn = new BulkInbox({ id: this.id });
+    // hash keys of clipboard contents both sides had, newest first, see delta.js
+    this.clipboardBases = [];
+    this.pending = null;
+    this.authenticated = false;
+    // our token went out on this session, and connect waiting for theirs
+    this.authSent = false;
+    this.authWait = null;
+    this.lastSeen = 0;
+    // sender tag and seq of the newest packet that authenticated, only it
+    // may migrate the peer to a new address
+    this.rxTag = null;
+    this.rxSeq = -1;
+  }
+
+  is(address, port) {
+    return this.port === port && this.address === address;
+  }
+}
+
+export class SlotTable {
+  constructor(size = MAX_PEERS, unauthenticated = MAX_UNAUTHENTICATED) {
+    this.limit = unauthenticated;
+    this.slots = new Array(size);
+    for (let i = 0; i < size; i++) this.slots[i] = new PeerSlot(i);
+    this.size = 0;
+    this.authenticated = 0;
+  }
+
+  /** The slot for a connection ID from a header, or undefined. */
+  get(id) {
+    const slot = this.slots[id];
+    return slot?.used ? slot : undefined;
+  }
+
+  /** Linear scan, only needed before a connection ID is known. */
+  find(address, port) {
+    for (let i = 1; i < this.slots.length; i++) {
+      const slot = this.slots[i];
+      if (slot.used && slot.is(address, port)) return slot;
+    }
+  }
+
+  /**
+   * Take a slot for address:port. Peers that did not authenticate yet hold at
+   * most `limit` slots, past that (or when the table is full) the one of them
+   * seen least recently is evicted, `onEvict(slot)` runs before it is reused.
+   * Authenticated peers are never evicted, so a flood of handshakes cannot
+   * push them out; null when every slot belongs to one.
+   */
+  alloc(address, port, onEvict) {
+    let free = null;
+    let victim = null;
+    let unauthenticated = 0;
+    for (let i = 1; i < this.slots.length; i++) {
+      const slot = this.slots[i];
+      if (!slot.used) {
+        free ??= slot;
+        continue;
+      }
+      if (slot.authenticated) continue;
+      unauthenticated++;
+      if (!victim || slot.lastSeen < victim.lastSeen) victim = slot;
+    }
+    if (free && unauthenticated < this.limit) victim = free;
+    if (!victim) return null;
+    if (victim.used) {
+      onEvict?.(victim);
+      this.free(victim);
+    }
+    victim.used = true;
+    victim.address = address;
+    victim.port = port;
+    victim.lastSeen = Date.now();
+    this.size++;
+    return victim;
+  }
+
+  free(slot) {
+    if (!slot.used) return;
+    if (slot.authenticated) this.authenticated--;
+    this.size--;
+    slot.reset();
+  }
+
+  setAuthenticated(slot, authenticated) {
+    if (slot.authenticated === authenticated) return;
+    slot.authenticated = authenticated;
+    this.authenticated += authenticated ? 1 : -1;
+  }
+
+  *[Symbol.iterator]() {
+    for (let i = 1; i < this.slots.length; i++) {
+      if (this.slots[i].used) yield this.slots[i];
+    }
+  }
+}
@@ -0,0 +1,111 @@
+/**
+ * Sender-side input state snapshots.
+ *
+ * Tracks which keys and buttons this host has pressed on its peers, from the
+ * input events it broadcasts, and hands a compact snapshot to `send(state)`
+ * every `interval` milliseconds while input is flowing: as long as anything
+ * is held and for IDLE milliseconds after the last event. The receiver diffs
+ * it against what it injected and fixes up only the differences, so a key
+ * that got stuck through a crash or a flapping link is released within one
+ * interval. Key bitmaps are trimmed after the highest held key, a snapshot
+ * with nothing held has no bitmap bytes at all.
+ */
+
+// keycodes past this are not tracked, xkb and X11 keycodes stay below 256
+export const MAX_KEYCODE = 512;
+// synergy modifier bits (the `modifiers` of key events) that are locks
+export const MOD_CAPS_LOCK = 0x1000;
+export const MOD_NUM_LOCK = 0x2000;
+// keep sending this long after the last input event
+const IDLE = 1000;
+
+const none = new Uint8Array(0);
+
+function trimmed(bits) {
+  let len = bits.length;
+  while (len > 0 && bits[len - 1] === 0) len--;
+  return len ? bits.slice(0, len) : none;
+}
+
+export class InputState {
+  constructor(send, { interval = 200 } = {}) {
+    this.send = send;
+    this.interval = interval;
+    // keycodes of key events, mapped through the receiver's keymap
+    this.keys = new Uint8Array(MAX_KEYCODE / 8);
+    // keycodes of key_raw events, injected as they are
+    this.raw = new Uint8Array(MAX_KEYCODE / 8);
+    this.buttons = 0;
+    this.modifiers = 0;
+    this.held = 0;
+    this.lastInput = 0;
+    this.timer = null;
+    this.stats = { snapshots: 0 };
+  }
+
+  static set(bits, code, pressed) {
+    if (code < 0 || code >= MAX_KEYCODE) return 0;
+    const mask = 1 << (code & 7);
+    const was = (bits[code >>> 3] & mask) !== 0;
+    if (pressed) bits[code >>> 3] |= mask;
+    else bits[code >>> 3] &= ~mask;
+    return (pressed ? 1 : 0) - (was ? 1 : 0);
+  }
+
+  /** Record an outgoing input event, anything else is ignored. */
+  update(type, data) {
+    switch (type) {
+      case 'key':
+        this.modifiers = data.modifiers >>> 0;
+        this.held += InputState.set(this.keys, data.keycode, data.pressed);
+        break;
+      case 'key_raw':
+        this.held += InputState.set(this.raw, data.keycode, data.pressed);
+        break;
+      case 'key_release_all':
+        this.keys.fill(0);
+        this.raw.fill(0);
+        this.held = 0;
+        break;
+      case 'mouse_button': {
+        const bit = 1 << (data.button & 31);
+        if (data.pressed) this.buttons |= bit;
+        else this.buttons &= ~bit;
+        break;
+      }
+      case 'mouse_move':
+      case 'mouse_abs':
+      case 'mouse_wheel':
+        break;
+      default:
+        return;
+    }
+    this.touch();
+  }
+
+  /** Input went out, keep the snapshots coming for a while. */
+  touch() {
+    this.lastInput = performance.now();
+    if (!this.timer && this.interval > 0) this.timer = setTimeout(this.onInterval, this.interval);
+  }
+
+  get active() {
+    return this.held > 0 || this.buttons !== 0 || performance.now() - this.lastInput < IDLE;
+  }
+
+  snapshot() {
+    return { modifiers: this.modifiers, buttons: this.buttons >>> 0, keys: trimmed(this.keys), raw: trimmed(this.raw) };
+  }
+
+  onInterval = () => {
+    this.timer = null;
+    this.stats.snapshots++;
+    this.send(this.snapshot());
+    if (this.active) this.timer = setTimeout(this.onInterval, this.interval);
+  };
+
+  stop() {
+    if (this.timer) clearTimeout(this.timer);
+    this.timer = null;
+  }
+}
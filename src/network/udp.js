@@ -0,0 +1,180 @@
+import { JSCallback, toArrayBuffer } from 'bun:ffi';
+import { nativeLibrary } from '../native.js';
+
+// struct udpMsg and struct udpSlab layout, see src/wayland/include/udp.h
+export const BATCH = 32;
+export const SLOT = 65536;
+export const SLABS = 2;
+const MSG_PORT = 48;
+const MSG_LEN = 52;
+const MSG_SIZE = 56;
+const SLAB_DATA = BATCH * MSG_SIZE;
+const SLAB_SIZE = SLAB_DATA + BATCH * SLOT;
+const SOCKADDR_SIZE = 28;
+
+export const UDP_SYMBOLS = {
+  udpNew: { args: ['i32'], returns: 'ptr' },
+  udpFree: { args: ['ptr'], returns: 'void' },
+  udpPort: { args: ['ptr'], returns: 'i32' },
+  udpSlab: { args: ['ptr', 'i32'], returns: 'ptr' },
+  udpStart: { args: ['ptr', 'function'], returns: 'bool' },
+  udpRelease: { args: ['ptr', 'i32'], returns: 'void' },
+  udpAddr: { args: ['ptr', 'ptr', 'i32'], returns: 'bool' },
+  udpSend: { args: ['ptr', 'ptr', 'ptr', 'ptr', 'i32'], returns: 'i32' },
+  udpGetStats: { args: ['ptr', 'ptr'], returns: 'void' },
+};
+
+const library = nativeLibrary('udp', {
+  source: ['./src/wayland/udp.c'],
+  include: ['src/wayland/include'],
+  symbols: UDP_SYMBOLS,
+});
+
+// built when a peer first asks for a socket, importing compiles nothing
+let native = null;
+function load() {
+  native ??= library.optional('udpNew', 'using Bun sockets');
+  return native;
+}
+
+const cstr = (s) => Buffer.from(`${s}\0`);
+
+/**
+ * Packs the `[payload, port, address, ...]` triples of `sendMany` into one
+ * buffer, a length table and a sockaddr table for a single sendmmsg call.
+ * `resolve(out, address, port)` is udpAddr from whichever compiled unit owns
+ * the socket; resolved addresses are cached.
+ */
+export class SendBatch {
+  constructor(resolve) {
+    this.resolve = resolve;
+    this.data = Buffer.alloc(4096);
+    this.lens = new Int32Array(BATCH);
+    this.addrs = Buffer.alloc(BATCH * SOCKADDR_SIZE);
+    this.cache = new Map();
+  }
+
+  sockaddr(address, port) {
+    const key = `${address}|${port}`;
+    let addr = this.cache.get(key);
+    if (!addr) {
+      addr = Buffer.alloc(SOCKADDR_SIZE);
+      if (!this.resolve(addr, cstr(address), port)) return null;
+      // peers move around, do not let the cache grow with them
+      if (this.cache.size >= 256) this.cache.clear();
+      this.cache.set(key, addr);
+    }
+    return addr;
+  }
+
+  /** Returns the number of datagrams packed, unresolvable ones are left out. */
+  pack(packets) {
+    const count = packets.length / 3;
+    if (this.lens.length < count) {
+      this.lens = new Int32Array(count);
+      this.addrs = Buffer.alloc(count * SOCKADDR_SIZE);
+    }
+    let size = 0;
+    for (let i = 0; i < packets.length; i += 3) size += packets[i].length;
+    if (this.data.length < size) this.data = Buffer.alloc(Math.max(size, this.data.length * 2));
+
+    let n = 0;
+    let off = 0;
+    for (let i = 0; i < packets.length; i += 3) {
+      const addr = this.sockaddr(packets[i + 2], packets[i + 1]);
+      if (!addr) continue;
+      this.data.set(packets[i], off);
+      off += packets[i].length;
+      this.lens[n] = packets[i].length;
+      this.addrs.set(addr, n++ * SOCKADDR_SIZE);
+    }
+    return n;
+  }
+}
+
+/**
+ * Peer socket with batched I/O: a native thread drains it with recvmmsg and
+ * hands over up to BATCH datagrams per callback, `sendMany` goes out with
+ * sendmmsg. Same `send`/`sendMany`/`close` surface as a Bun udp socket.
+ *
+ * `onBatch(messages, rinfos, count)` gets views into the receive slab; they
+ * are only valid until it returns, the slab is then handed back for reuse.
+ */
+export class UdpSocket {
+  static get available() {
+    return !!load();
+  }
+
+  constructor(port, onBatch) {
+    this.ptr = native.udpNew(port);
+    if (!this.ptr) throw new Error(`Failed to bind UDP port ${port}`);
+    this.port = native.udpPort(this.ptr);
+    this.onBatch = onBatch;
+    this.slabs = [];
+    for (let i = 0; i < SLABS; i++) {
+      this.slabs.push(Buffer.from(toArrayBuffer(native.udpSlab(this.ptr, i), 0, SLAB_SIZE)));
+    }
+    this.messages = new Array(BATCH);
+    this.rinfos = new Array(BATCH);
+    this.batch = new SendBatch(native.udpAddr);
+    this.callback = new JSCallback((slab, count) => this.receive(slab, count), {
+      args: ['i32', 'i32'],
+      returns: 'void',
+      threadsafe: true,
+    });
+    if (!native.udpStart(this.ptr, this.callback)) {
+      this.close();
+      throw new Error('Failed to start UDP receive thread');
+    }
+  }
+
+  receive(slab, count) {
+    // batches queued before close arrive after the slabs are gone
+    if (!this.ptr) return;
+    const buf = this.slabs[slab];
+    let n = 0;
+    try {
+      for (let i = 0; i < count; i++) {
+        const meta = i * MSG_SIZE;
+        const len = buf.readInt32LE(meta + MSG_LEN);
+        if (len < 0) continue;
+        const data = SLAB_DATA + i * SLOT;
+        this.messages[n] = buf.subarray(data, data + len);
+        this.rinfos[n++] = {
+          address: buf.toString('latin1', meta, buf.indexOf(0, meta)),
+          port: buf.readInt32LE(meta + MSG_PORT),
+        };
+      }
+      this.onBatch(this.messages, this.rinfos, n);
+    } finally {
+      this.messages.fill(undefined, 0, n);
+      native.udpRelease(this.ptr, slab);
+    }
+  }
+
+  send(data, port, address) {
+    return this.sendMany([data, port, address]) === 1;
+  }
+
+  sendMany(packets) {
+    const count = this.batch.pack(packets);
+    if (!count) return 0;
+    return native.udpSend(this.ptr, this.batch.data, this.batch.lens, this.batch.addrs, count);
+  }
+
+  stats() {
+    const out = new BigUint64Array(7);
+    native.udpGetStats(this.ptr, out);
+    const [polls, recvCalls, received, truncated, batches, sendCalls, sent] = Array.from(out, Number);
+    return { polls, recvCalls, received, truncated, batches, sendCalls, sent };
+  }
+
+  close() {
+    if (!this.ptr) return;
+    native.udpFree(this.ptr);
+    this.ptr = null;
+    this.slabs = [];
+    this.callback?.close();
+    this.callback = null;
+  }
+}
@@ -0,0 +1,414 @@
+/**
+ * Binary wire format for peer messages.
+ *
+ * Mirrors src/wayland/include/wire.h: a fixed 12 byte header (version, opcode,
+ * flags, connection ID, sender tag, sequence number, network byte order) followed
+ * by packed per-opcode fields. Deltas are zigzag LEB128 varints. Sealed
+ * packets are header | auth tag | ciphertext, see aead.js.
+ *
+ * Message types without a dedicated opcode travel as OP_EXT frames carrying
+ * the type name and a JSON body, so `peer.broadcast('anything', {...})` keeps
+ * working.
+ */
+
+export const WIRE_VERSION = 3;
+export const HEADER_LENGTH = 12;
+// offset of the receiver's connection ID (peer slot), see slots.js
+export const HEADER_CONN = 3;
+
+export const OP_EXT = 0x00;
+export const OP_AUTH = 0x01;
+export const OP_KILL = 0x02;
+export const OP_PING = 0x03;
+export const OP_PONG = 0x04;
+export const OP_HELLO = 0x05;
+export const OP_CLIPBOARD = 0x06;
+// handshake frames are the only ones sent unencrypted, see handshake.js
+export const OP_HANDSHAKE_INIT = 0x07;
+export const OP_HANDSHAKE_RESP = 0x08;
+// acknowledges the reliable lane, see reliable.js
+export const OP_ACK = 0x09;
+// periodic pressed key and button state, see snapshot.js
+export const OP_INPUT_STATE = 0x0a;
+// chunks of messages too big for one datagram and their acks, see bulk.js
+export const OP_BULK = 0x0b;
+export const OP_BULK_ACK = 0x0c;
+// clipboard announcements and lazy fetches, see clipboard.js
+export const OP_CLIPBOARD_OFFER = 0x0d;
+export const OP_CLIPBOARD_FETCH = 0x0e;
+export const OP_CLIPBOARD_DATA = 0x0f;
+export const OP_INPUT = 0x10;
+export const OP_MOUSE_MOVE = 0x10;
+export const OP_MOUSE_ABS = 0x11;
+export const OP_MOUSE_BUTTON = 0x12;
+export const OP_MOUSE_WHEEL = 0x13;
+export const OP_KEY = 0x14;
+export const OP_KEY_RAW = 0x15;
+export const OP_KEY_RELEASE_ALL = 0x16;
+export const OP_IDLE_INHIBIT = 0x17;
+// input events are OP_INPUT up to, not including, OP_INPUT_END
+export const OP_INPUT_END = 0x18;
+// a control message numbered after the input events, see delta.js
+export const OP_CLIPBOARD_DELTA = 0x18;
+
+// the sealed body starts with a u32 lane sequence number, see reliable.js
+export const FLAG_RELIABLE = 0x01;
+
+const textEncoder = new TextEncoder();
+const textDecoder = new TextDecoder();
+
+/**
+ * Bounds-checked reader over a byte buffer, the JS side of struct sspBuf.
+ * Reads past the end throw a RangeError instead of returning false.
+ */
+export class SspBuf {
+  constructor(data, pos = 0, len = data.length) {
+    this.data = data;
+    this.pos = pos;
+    this.len = len;
+  }
+
+  remaining() {
+    return this.len - this.pos;
+  }
+
+  seek(len) {
+    if (this.len - this.pos < len) throw new RangeError('truncated frame');
+    this.pos += len;
+  }
+
+  u8() {
+    if (this.pos >= this.len) throw new RangeError('truncated frame');
+    return this.data[this.pos++];
+  }
+
+  u32() {
+    if (this.len - this.pos < 4) throw new RangeError('truncated frame');
+    const d = this.data;
+    const p = this.pos;
+    this.pos += 4;
+    return ((d[p] << 24) | (d[p + 1] << 16) | (d[p + 2] << 8) | d[p + 3]) >>> 0;
+  }
+
+  varu() {
+    let v = 0;
+    for (let shift = 0; shift < 35; shift += 7) {
+      const c = this.u8();
+      v |= (c & 0x7f) << shift;
+      if (!(c & 0x80)) return v >>> 0;
+    }
+    throw new RangeError('varint too long');
+  }
+
+  var() {
+    const v = this.varu();
+    return (v >>> 1) ^ -(v & 1);
+  }
+
+  bytes() {
+    const len = this.varu();
+    if (this.len - this.pos < len) throw new RangeError('truncated frame');
+    const res = this.data.subarray(this.pos, this.pos + len);
+    this.pos += len;
+    return res;
+  }
+
+  string() {
+    return textDecoder.decode(this.bytes());
+  }
+}
+
+/**
+ * Append-only writer backed by a growable scratch buffer. The returned frames
+ * are views into the scratch buffer and must be consumed before the next
+ * `reset()`.
+ */
+export class Writer {
+  constructor(size = 1500) {
+    this.buf = new Uint8Array(size);
+    this.pos = 0;
+  }
+
+  reset() {
+    this.pos = 0;
+    return this;
+  }
+
+  reserve(len) {
+    if (this.pos + len <= this.buf.length) return;
+    let size = this.buf.length * 2;
+    while (size < this.pos + len) size *= 2;
+    const buf = new Uint8Array(size);
+    buf.set(this.buf.subarray(0, this.pos));
+    this.buf = buf;
+  }
+
+  u8(v) {
+    this.reserve(1);
+    this.buf[this.pos++] = v;
+  }
+
+  u32(v) {
+    this.reserve(4);
+    const b = this.buf;
+    const p = this.pos;
+    b[p] = v >>> 24;
+    b[p + 1] = v >>> 16;
+    b[p + 2] = v >>> 8;
+    b[p + 3] = v;
+    this.pos += 4;
+  }
+
+  varu(v) {
+    v >>>= 0;
+    this.reserve(5);
+    while (v > 0x7f) {
+      this.buf[this.pos++] = (v & 0x7f) | 0x80;
+      v >>>= 7;
+    }
+    this.buf[this.pos++] = v;
+  }
+
+  var(v) {
+    this.varu((v << 1) ^ (v >> 31));
+  }
+
+  bytes(data) {
+    this.varu(data.length);
+    this.reserve(data.length);
+    this.buf.set(data, this.pos);
+    this.pos += data.length;
+  }
+
+  string(s) {
+    this.bytes(textEncoder.encode(s ?? ''));
+  }
+
+  finish() {
+    return this.buf.subarray(0, this.pos);
+  }
+}
+
+const CODECS = [
+  {
+    op: OP_AUTH,
+    type: 'auth',
+    encode: (w, d) => (w.bytes(d.proof), w.string(d.id)),
+    decode: (r) => ({ proof: r.bytes(), id: r.string() || undefined }),
+  },
+  { op: OP_KILL, type: 'kill', encode: (w, d) => w.string(d.token), decode: (r) => ({ token: r.string() }) },
+  { op: OP_PING, type: 'ping', encode: (w, d) => w.string(d.token), decode: (r) => ({ token: r.string() }) },
+  { op: OP_PONG, type: 'pong', encode: (w, d) => w.string(d.id), decode: (r) => ({ id: r.string() }) },
+  { op: OP_HELLO, type: 'hello', encode: (w, d) => w.string(d.id), decode: (r) => ({ id: r.string() }) },
+  {
+    op: OP_CLIPBOARD,
+    type: 'clipboard',
+    encode: (w, d) => (w.u8(d.primary ? 1 : 0), w.string(d.text)),
+    decode: (r) => ({ primary: r.u8() === 1, text: r.string() }),
+  },
+  {
+    op: OP_HANDSHAKE_INIT,
+    type: 'handshake_init',
+    encode: (w, d) => (w.bytes(d.identity), w.bytes(d.ephemeral), w.bytes(d.signature), w.u8(d.conn)),
+    decode: (r) => ({ identity: r.bytes(), ephemeral: r.bytes(), signature: r.bytes(), conn: r.u8() }),
+  },
+  {
+    op: OP_HANDSHAKE_RESP,
+    type: 'handshake_resp',
+    encode: (w, d) => (w.bytes(d.identity), w.bytes(d.ephemeral), w.bytes(d.signature), w.u8(d.conn)),
+    decode: (r) => ({ identity: r.bytes(), ephemeral: r.bytes(), signature: r.bytes(), conn: r.u8() }),
+  },
+  {
+    op: OP_ACK,
+    type: 'ack',
+    encode: (w, d) => (w.u32(d.next), w.u32(d.bits)),
+    decode: (r) => ({ next: r.u32(), bits: r.u32() }),
+  },
+  {
+    op: OP_INPUT_STATE,
+    type: 'input_state',
+    encode: (w, d) => (w.u32(d.lane), w.varu(d.modifiers), w.varu(d.buttons), w.bytes(d.keys), w.bytes(d.raw)),
+    decode: (r) => ({ lane: r.u32(), modifiers: r.varu(), buttons: r.varu(), keys: r.bytes(), raw: r.bytes() }),
+  },
+  {
+    op: OP_BULK,
+    type: 'bulk',
+    encode: (w, d) => (
+      w.u32(d.id), w.varu(d.index), w.u8(d.op), w.u8(d.codec), w.varu(d.length), w.varu(d.size), w.bytes(d.data)
+    ),
+    decode: (r) => ({
+      id: r.u32(),
+      index: r.varu(),
+      op: r.u8(),
+      codec: r.u8(),
+      length: r.varu(),
+      size: r.varu(),
+      data: r.bytes(),
+    }),
+  },
+  {
+    op: OP_BULK_ACK,
+    type: 'bulk_ack',
+    encode: (w, d) => (w.u32(d.id), w.varu(d.next), w.bytes(d.bits)),
+    decode: (r) => ({ id: r.u32(), next: r.varu(), bits: r.bytes() }),
+  },
+  {
+    op: OP_CLIPBOARD_OFFER,
+    type: 'clipboard_offer',
+    encode: (w, d) => {
+      w.u8(d.primary ? 1 : 0);
+      w.bytes(d.hash);
+      w.varu(d.size);
+      w.varu(d.mimes.length);
+      for (const mime of d.mimes) w.string(mime);
+    },
+    decode: (r) => ({
+      primary: r.u8() === 1,
+      hash: r.bytes(),
+      size: r.varu(),
+      mimes: Array.from({ length: r.varu() }, () => r.string()),
+    }),
+  },
+  {
+    op: OP_CLIPBOARD_FETCH,
+    type: 'clipboard_fetch',
+    encode: (w, d) => {
+      w.bytes(d.hash);
+      w.string(d.mime);
+      w.varu(d.bases?.length ?? 0);
+      for (const basis of d.bases ?? []) w.bytes(basis);
+    },
+    decode: (r) => ({
+      hash: r.bytes(),
+      mime: r.string(),
+      bases: Array.from({ length: r.remaining() ? r.varu() : 0 }, () => r.bytes()),
+    }),
+  },
+  {
+    op: OP_CLIPBOARD_DATA,
+    type: 'clipboard_data',
+    encode: (w, d) => (w.bytes(d.hash), w.string(d.mime), w.bytes(d.data)),
+    decode: (r) => ({ hash: r.bytes(), mime: r.string(), data: r.bytes() }),
+  },
+  {
+    op: OP_CLIPBOARD_DELTA,
+    type: 'clipboard_delta',
+    encode: (w, d) => (w.bytes(d.hash), w.string(d.mime), w.bytes(d.basis), w.bytes(d.delta)),
+    decode: (r) => ({ hash: r.bytes(), mime: r.string(), basis: r.bytes(), delta: r.bytes() }),
+  },
+  {
+    op: OP_MOUSE_MOVE,
+    type: 'mouse_move',
+    encode: (w, d) => (w.var(d.dx), w.var(d.dy)),
+    decode: (r) => ({ dx: r.var(), dy: r.var() }),
+  },
+  {
+    op: OP_MOUSE_ABS,
+    type: 'mouse_abs',
+    encode: (w, d) => (w.varu(d.x), w.varu(d.y)),
+    decode: (r) => ({ x: r.varu(), y: r.varu() }),
+  },
+  {
+    op: OP_MOUSE_BUTTON,
+    type: 'mouse_button',
+    encode: (w, d) => (w.u8(d.button), w.u8(d.pressed ? 1 : 0)),
+    decode: (r) => ({ button: r.u8(), pressed: r.u8() }),
+  },
+  {
+    op: OP_MOUSE_WHEEL,
+    type: 'mouse_wheel',
+    encode: (w, d) => (w.var(d.horizontal), w.var(d.vertical)),
+    decode: (r) => ({ horizontal: r.var(), vertical: r.var() }),
+  },
+  {
+    op: OP_KEY,
+    type: 'key',
+    encode: (w, d) => (w.varu(d.keycode), w.varu(d.modifiers), w.u8(d.pressed ? 1 : 0)),
+    decode: (r) => ({ keycode: r.varu(), modifiers: r.varu(), pressed: r.u8() }),
+  },
+  {
+    op: OP_KEY_RAW,
+    type: 'key_raw',
+    encode: (w, d) => (w.varu(d.keycode), w.u8(d.pressed ? 1 : 0)),
+    decode: (r) => ({ keycode: r.varu(), pressed: r.u8() }),
+  },
+  { op: OP_KEY_RELEASE_ALL, type: 'key_release_all', encode: () => {}, decode: () => ({}) },
+  {
+    op: OP_IDLE_INHIBIT,
+    type: 'idle_inhibit',
+    encode: (w, d) => w.u8(d.inhibit ? 1 : 0),
+    decode: (r) => ({ inhibit: r.u8() === 1 }),
+  },
+];
+
+const byOp = new Array(256);
+const byType = new Map();
+for (const codec of CODECS) {
+  byOp[codec.op] = codec;
+  byType.set(codec.type, codec);
+}
+
+/** Opcode for a message type; OP_EXT if it has no binary encoding. */
+export function opcodeOf(type) {
+  return byType.get(type)?.op ?? OP_EXT;
+}
+
+/** Message type name for an opcode, or undefined. */
+export function typeOf(op) {
+  return byOp[op]?.type;
+}
+
+const scratch = new Writer();
+
+/**
+ * Encode a message into a frame (header + fields). The result is a view into
+ * a shared scratch buffer; copy or consume it before encoding the next frame.
+ * With FLAG_RELIABLE the fields are preceded by the `lane` sequence number.
+ */
+export function encodeFrame(type, data, sender, seq, flags = 0, conn = 0, lane = 0) {
+  const codec = byType.get(type);
+  const w = scratch.reset();
+  w.u8(WIRE_VERSION);
+  w.u8(codec ? codec.op : OP_EXT);
+  w.u8(flags);
+  w.u8(conn);
+  w.u32(sender);
+  w.u32(seq);
+  if (flags & FLAG_RELIABLE) w.u32(lane);
+  if (codec) {
+    codec.encode(w, data ?? {});
+  } else {
+    w.string(type);
+    w.string(JSON.stringify(data ?? null));
+  }
+  return w.finish();
+}
+
+/**
+ * Decode the fixed header. Returns null for frames that are too short or carry
+ * a different wire version.
+ */
+export function decodeHeader(buf, header = {}) {
+  if (buf.length < HEADER_LENGTH || buf[0] !== WIRE_VERSION) return null;
+  header.op = buf[1];
+  header.flags = buf[2];
+  header.conn = buf[HEADER_CONN];
+  header.sender = ((buf[4] << 24) | (buf[5] << 16) | (buf[6] << 8) | buf[7]) >>> 0;
+  header.seq = ((buf[8] << 24) | (buf[9] << 16) | (buf[10] << 8) | buf[11]) >>> 0;
+  return header;
+}
+
+/**
+ * Decode the fields following the header of an `op` frame. Returns
+ * `{ type, data }`; unknown opcodes yield null.
+ */
+export function decodeBody(op, body) {
+  const r = new SspBuf(body);
+  if (op === OP_EXT) {
+    const type = r.string();
+    return { type, data: JSON.parse(r.string()) };
+  }
+  const codec = byOp[op];
+  if (!codec) return null;
+  return { type: codec.type, data: codec.decode(r) };
+}
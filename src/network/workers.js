@@ -0,0 +1,146 @@
+import { availableParallelism } from 'node:os';
+import { Worker } from 'node:worker_threads';
+
+/**
+ * A few worker threads for bulk work, so a large clipboard is compressed or
+ * diffed while the main thread goes on dispatching input.
+ *
+ * `run(op, args)` posts a job to an idle worker and resolves to its result.
+ * Buffers in `args` are transferred, not copied, and unusable to the caller
+ * afterwards; results come back the same way. Jobs beyond `queue` wait in
+ * `run` until there is room, so a burst of transfers holds on to its own
+ * buffers instead of piling them up in the pool. Without workers, or for
+ * `size` 0, jobs run on the main thread with `inline()`'s functions.
+ */
+
+export const POOL_SIZE = Math.max(1, Math.min(2, availableParallelism() - 1));
+const POOL_QUEUE = 8;
+// buffers this small can share a pooled ArrayBuffer, they are copied
+const POOLED = Buffer.poolSize;
+
+// ArrayBuffers that can go along with a message, each once
+function transferList(args) {
+  const list = new Set();
+  for (const arg of args) {
+    if (ArrayBuffer.isView(arg) && arg.buffer instanceof ArrayBuffer && arg.buffer.byteLength > POOLED) {
+      list.add(arg.buffer);
+    }
+  }
+  return [...list];
+}
+
+const toBuffer = (value) =>
+  value instanceof Uint8Array && !Buffer.isBuffer(value) ? Buffer.from(value.buffer, value.byteOffset, value.length) : value;
+
+/** Typed arrays back as Buffers, in a result or one level into it. */
+export function buffers(result) {
+  if (!result || typeof result !== 'object' || ArrayBuffer.isView(result)) return toBuffer(result);
+  for (const [key, value] of Object.entries(result)) result[key] = toBuffer(value);
+  return result;
+}
+
+/**
+ * The worker side: answer the jobs of a pool with `jobs[op](...args)`.
+ * A no-op on the main thread, so a job module can be imported from both.
+ */
+export function serve(parentPort, jobs) {
+  if (!parentPort) return;
+  parentPort.on('message', ({ id, op, args }) => {
+    try {
+      const result = jobs[op](...args.map(toBuffer));
+      const values = result && typeof result === 'object' && !ArrayBuffer.isView(result) ? Object.values(result) : [result];
+      parentPort.postMessage({ id, result }, transferList(values));
+    } catch (err) {
+      parentPort.postMessage({ id, error: err.message });
+    }
+  });
+}
+
+export class WorkerPool {
+  constructor(url, { size = POOL_SIZE, queue = POOL_QUEUE, inline }) {
+    this.url = url;
+    this.size = size;
+    this.limit = queue;
+    this.inline = inline;
+    this.workers = [];
+    this.idle = [];
+    this.queue = [];
+    // callers of run waiting for room in the queue
+    this.waiting = [];
+    this.jobs = new Map();
+    this.id = 0;
+  }
+
+  async run(op, args) {
+    if (!this.size) return (await this.inline())[op](...args);
+    while (this.queue.length >= this.limit) await new Promise((resolve) => this.waiting.push(resolve));
+    return new Promise((resolve, reject) => {
+      this.queue.push({ op, args, resolve, reject });
+      this.next();
+    });
+  }
+
+  spawn() {
+    let worker;
+    try {
+      worker = new Worker(this.url);
+    } catch (err) {
+      console.debug(`Worker threads unavailable, bulk work stays on the main thread: ${err.message}`);
+      this.size = 0;
+      return null;
+    }
+    worker.unref();
+    worker.on('message', ({ id, result, error }) => {
+      const job = this.jobs.get(id);
+      this.jobs.delete(id);
+      worker.job = null;
+      worker.unref();
+      this.idle.push(worker);
+      if (error === undefined) job.resolve(buffers(result));
+      else job.reject(new Error(error));
+      this.next();
+    });
+    worker.on('error', (err) => this.lost(worker, err));
+    worker.on('exit', (code) => this.lost(worker, new Error(`bulk worker exited with ${code}`)));
+    this.workers.push(worker);
+    return worker;
+  }
+
+  // a worker that died takes its job with it, the next run spawns another
+  lost(worker, err) {
+    if (!this.workers.includes(worker)) return;
+    this.workers.splice(this.workers.indexOf(worker), 1);
+    const idle = this.idle.indexOf(worker);
+    if (idle >= 0) this.idle.splice(idle, 1);
+    if (worker.job) {
+      this.jobs.delete(worker.job.id);
+      worker.job.reject(err);
+    }
+    this.next();
+  }
+
+  next() {
+    while (this.queue.length) {
+      const worker = this.idle.pop() ?? (this.workers.length < this.size ? this.spawn() : null);
+      if (!worker) break;
+      const job = this.queue.shift();
+      job.id = this.id++;
+      this.jobs.set(job.id, job);
+      worker.job = job;
+      // a job in flight keeps the process alive, an idle worker does not
+      worker.ref();
+      worker.postMessage({ id: job.id, op: job.op, args: job.args }, transferList(job.args));
+      this.waiting.shift()?.();
+    }
+    // the pool fell back to the main thread
+    if (!this.size) {
+      for (const job of this.queue.splice(0)) this.run(job.op, job.args).then(job.resolve, job.reject);
+      for (const resolve of this.waiting.splice(0)) resolve();
+    }
+  }
+
+  close() {
+    for (const worker of this.workers.splice(0)) worker.terminate();
+    this.idle.length = 0;
+  }
+}
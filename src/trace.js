@@ -0,0 +1,238 @@
+import { existsSync, readdirSync, readFileSync, unlinkSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { nativeLibrary } from './native.js';
+import { OP_EXT, typeOf } from './network/wire.js';
+
+/**
+ * Binary event tracing shared by JS and the native code (trace.h).
+ *
+ * Off unless BZZ_TRACE is set; a number sets the ring capacity in records.
+ * Events are fixed size records in a ring buffer in a shared memory file,
+ * `bzz trace dump` reads it from another process, also after a crash. Call
+ * sites guard with `if (trace.enabled)` so a disabled trace costs a branch
+ * and builds no arguments.
+ */
+
+export const TRACE_MAGIC = 0x52545a42;
+export const TRACE_VERSION = 1;
+export const HEADER_SIZE = 64;
+export const RECORD_SIZE = 32;
+export const DEFAULT_CAPACITY = 65536;
+
+// enum traceEvent
+export const EV = {
+  RX: 1,
+  DROP: 2,
+  TX: 3,
+  DISPATCH: 4,
+  INJECT: 5,
+  MIGRATE: 6,
+  HANDSHAKE: 7,
+  KEY: 8,
+  BUTTON: 9,
+  INPUT_DROP: 10,
+  MOTION_FLUSH: 11,
+  RETRANSMIT: 12,
+  SYNC: 13,
+  BULK: 14,
+};
+
+// enum traceDrop
+export const DROP = {
+  MALFORMED: 1,
+  OWN: 2,
+  NO_SESSION: 3,
+  AUTH: 4,
+  REPLAY: 5,
+  UNAUTHORIZED: 6,
+  NO_HANDLER: 7,
+  DUPLICATE: 8,
+  WINDOW: 9,
+  STALE: 10,
+};
+
+// enum traceInputDrop
+export const INPUT_DROP = {
+  SUPERFLUOUS_RELEASE: 1,
+  OUTSIDE_KEYMAP: 2,
+  UNMAPPED: 3,
+  BUTTON_RANGE: 4,
+  UNSUPPORTED: 5,
+  STALE: 6,
+};
+
+// enum traceSync
+export const SYNC = {
+  KEY: 1,
+  BUTTON: 2,
+  LOCK: 3,
+};
+
+// states of a bulk transfer (EV.BULK), only traced from JS
+export const BULK = {
+  START: 1,
+  DONE: 2,
+  ABORT: 3,
+  RECV: 4,
+  DELIVER: 5,
+};
+
+// phases of EV.HANDSHAKE, only traced from JS
+export const HANDSHAKE = {
+  OFFER: 1,
+  ANSWER: 2,
+  COMPLETE: 3,
+  BAD_OFFER: 4,
+  BAD_RESPONSE: 5,
+  TIMEOUT: 6,
+  EVICT: 7,
+  FULL: 8,
+};
+
+export const SOURCE = ['js', 'c'];
+
+const nameOf = (table) => {
+  const names = [];
+  for (const [name, value] of Object.entries(table)) names[value] = name.toLowerCase();
+  return (v) => names[v] ?? v;
+};
+const opName = (op) => typeOf(op) ?? (op === OP_EXT ? 'ext' : `op${op}`);
+const unsigned = (v) => v >>> 0;
+
+// name and argument formatters per event, the argument order of trace.h
+export const TRACE_EVENTS = {
+  [EV.RX]: ['rx', { op: opName, conn: null, len: null, seq: unsigned }],
+  [EV.DROP]: ['drop', { reason: nameOf(DROP), op: opName, conn: null, seq: unsigned }],
+  [EV.TX]: ['tx', { op: opName, peers: null, bytes: null, seq: unsigned }],
+  [EV.DISPATCH]: ['dispatch', { op: opName, conn: null }],
+  [EV.INJECT]: ['inject', { op: opName, a0: null, a1: null, a2: null }],
+  [EV.MIGRATE]: ['migrate', { conn: null, port: null }],
+  [EV.HANDSHAKE]: ['handshake', { phase: nameOf(HANDSHAKE), conn: null }],
+  [EV.KEY]: ['key', { key: null, state: null, mapped: null, id: null }],
+  [EV.BUTTON]: ['button', { button: null, mapped: null, state: null }],
+  [EV.INPUT_DROP]: ['input_drop', { reason: nameOf(INPUT_DROP), code: null }],
+  [EV.MOTION_FLUSH]: ['motion_flush', { dx: null, dy: null, merged: null }],
+  [EV.RETRANSMIT]: ['retransmit', { conn: null, lane: unsigned, attempt: null, rto: null }],
+  [EV.SYNC]: ['sync', { what: nameOf(SYNC), code: null, state: null, was: null }],
+  [EV.BULK]: ['bulk', { state: nameOf(BULK), conn: null, id: unsigned, bytes: null }],
+};
+
+export const TRACE_SYMBOLS = {
+  traceAttach: { args: ['ptr'], returns: 'void' },
+};
+
+const library = nativeLibrary('trace', {
+  source: ['./src/wayland/trace.c'],
+  include: ['src/wayland/include'],
+  symbols: {
+    ...TRACE_SYMBOLS,
+    traceOpen: { args: ['cstring', 'u32'], returns: 'ptr' },
+    traceEmit: { args: ['ptr', 'i32', 'i32', 'i32', 'i32', 'i32', 'i32'], returns: 'void' },
+  },
+});
+
+/** Directory the rings live in, shared memory where there is some. */
+export function traceDir() {
+  if (process.env.XDG_RUNTIME_DIR) return process.env.XDG_RUNTIME_DIR;
+  return existsSync('/dev/shm') ? '/dev/shm' : tmpdir();
+}
+
+export const ringName = (pid) => `bzzwrd-trace-${pid}.ring`;
+
+/** `[{ pid, path }]` of the rings in the trace dir */
+export function listRings(dir = traceDir()) {
+  const rings = [];
+  for (const file of readdirSync(dir)) {
+    const match = /^bzzwrd-trace-(\d+)\.ring$/.exec(file);
+    if (match) rings.push({ pid: Number(match[1]), path: join(dir, file) });
+  }
+  return rings;
+}
+
+const alive = (pid) => {
+  try {
+    process.kill(pid, 0);
+    return true;
+  } catch (err) {
+    return err.code === 'EPERM';
+  }
+};
+
+export const trace = {
+  enabled: false,
+  path: null,
+  ring: null,
+  native: null,
+
+  emit(event, a0 = 0, a1 = 0, a2 = 0, a3 = 0) {
+    this.native.traceEmit(this.ring, 0, event, a0 | 0, a1 | 0, a2 | 0, a3 | 0);
+  },
+
+  /** Point TRACE() in another compiled unit at our ring. */
+  attach(symbols) {
+    if (this.ring) symbols.traceAttach(this.ring);
+  },
+
+  open(capacity = DEFAULT_CAPACITY) {
+    const { symbols } = library;
+    // rings of peers that are gone were kept for post mortem dumps until now
+    for (const { pid, path } of listRings()) {
+      if (pid !== process.pid && !alive(pid)) unlinkSync(path);
+    }
+    const path = join(traceDir(), ringName(process.pid));
+    const ring = symbols.traceOpen(Buffer.from(`${path}\0`), capacity);
+    if (!ring) throw new Error(`cannot create trace ring ${path}`);
+    Object.assign(this, { enabled: true, path, ring, native: symbols });
+  },
+};
+
+if (process.env.BZZ_TRACE) {
+  try {
+    trace.open(Number(process.env.BZZ_TRACE) || DEFAULT_CAPACITY);
+  } catch (err) {
+    console.warn(`Tracing unavailable: ${err.message}`);
+  }
+}
+
+/**
+ * Decode a ring image. Records still being written or already overwritten
+ * while it was read fail the stamp check and are skipped.
+ */
+export function decodeTrace(buf) {
+  if (buf.length < HEADER_SIZE || buf.readUInt32LE(0) !== TRACE_MAGIC) throw new Error('not a trace ring');
+  if (buf.readUInt32LE(4) !== TRACE_VERSION) throw new Error(`unsupported trace version ${buf.readUInt32LE(4)}`);
+  const capacity = buf.readUInt32LE(8);
+  if (buf.readUInt32LE(12) !== RECORD_SIZE || buf.length < HEADER_SIZE + capacity * RECORD_SIZE) {
+    throw new Error('truncated trace ring');
+  }
+  const head = Number(buf.readBigUInt64LE(16));
+  const start = buf.readBigUInt64LE(24);
+  const pid = buf.readUInt32LE(32);
+
+  const records = [];
+  const first = Math.max(0, head - capacity);
+  for (let i = first; i < head; i++) {
+    const off = HEADER_SIZE + (i % capacity) * RECORD_SIZE;
+    if (buf.readUInt32LE(off + 8) !== (i + 1) >>> 0) continue;
+    records.push({
+      index: i,
+      time: Number(buf.readBigUInt64LE(off) - start) / 1e3,
+      event: buf.readUInt16LE(off + 12),
+      source: buf.readUInt16LE(off + 14),
+      args: [buf.readInt32LE(off + 16), buf.readInt32LE(off + 20), buf.readInt32LE(off + 24), buf.readInt32LE(off + 28)],
+    });
+  }
+  return { pid, capacity, head, lost: first, records };
+}
+
+export function readTrace(path) {
+  return decodeTrace(readFileSync(path));
+}
+
+/** One line per record: microseconds since the ring was opened, source, event, args. */
+export function formatRecord({ time, event, source, args }) {
+  const [name, fields] = TRACE_EVENTS[event] ?? [`event${event}`, { a0: null, a1: null, a2: null, a3: null }];
+  const parts = Object.entries(fields).map(([field, fmt], i) => `${field}=${fmt ? fmt(args[i]) : args[i]}`);
+  return `${time.toFixed(1).padStart(12)}us ${SOURCE[source] ?? source} ${name.padEnd(12)} ${parts.join(' ')}`;
+}
@@ -95,6 +95,10 @@ export class MouseTracker {
 
   stop() {
     this.tracking = false;
+    if (process.env.DEBUG && this.peer.motion) {
+      const { samples, sent, merged } = this.peer.motion.stats;
+      console.debug(`${info} Motion coalescing: ${samples} samples, ${sent} sent, ${merged} merged`);
+    }
     if (this.display) {
       this.display.cleanup();
       this.display = null;
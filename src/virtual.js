@@ -1,44 +1,6 @@
 import { red, reset } from './colors.js';
 import { $ } from 'bun';
-
-// Detect display server and compositor
-async function detectDisplayServer() {
-  try {
-    const env = {
-      session: process.env.XDG_SESSION_TYPE?.toLowerCase(),
-      desktop: process.env.XDG_CURRENT_DESKTOP?.toLowerCase(),
-      wayland: process.env.WAYLAND_DISPLAY,
-      display: process.env.DISPLAY,
-    };
-
-    // First check session type
-    if (env.session === 'wayland') {
-      // Detect specific Wayland compositor
-      if (env.desktop?.includes('kde')) return 'wayland-kde';
-      if (env.desktop?.includes('gnome')) return 'wayland-gnome';
-      return 'wayland-wlroots'; // Default to wlroots for other Wayland compositors
-    }
-
-    if (env.session === 'x11' || env.display) {
-      if (env.desktop?.includes('kde')) return 'x11-kde';
-      if (env.desktop?.includes('gnome')) return 'x11-gnome';
-      return 'x11'; // Default X11
-    }
-
-    // Fallback detection
-    if (env.wayland) {
-      if (env.desktop?.includes('kde')) return 'wayland-kde';
-      if (env.desktop?.includes('gnome')) return 'wayland-gnome';
-      return 'wayland-wlroots';
-    }
-
-    if (env.display) return 'x11';
-
-    return 'unknown';
-  } catch {
-    return 'unknown';
-  }
-}
+import { capabilities } from './capabilities.js';
 
 export class VirtualMouse {
   constructor() {
@@ -48,7 +10,7 @@ export class VirtualMouse {
   async init() {
     try {
       // Detect display server
-      this.displayServer = await detectDisplayServer();
+      this.displayServer = capabilities.current.displayServer;
       console.debug(`Using display server: ${this.displayServer}`);
       return true;
     } catch (error) {
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include "aead.h"
+
+struct aeadCtx *aeadNew(const unsigned char *key)
+{
+	struct aeadCtx *ctx = calloc(1, sizeof(*ctx));
+
+	if (!ctx)
+		return NULL;
+	if (!(ctx->enc = EVP_CIPHER_CTX_new()) || !(ctx->dec = EVP_CIPHER_CTX_new()))
+		goto fail;
+	if (!EVP_EncryptInit_ex(ctx->enc, EVP_aes_256_gcm(), NULL, key, NULL) ||
+	    !EVP_DecryptInit_ex(ctx->dec, EVP_aes_256_gcm(), NULL, key, NULL))
+		goto fail;
+	return ctx;
+fail:
+	aeadFree(ctx);
+	return NULL;
+}
+
+void aeadFree(struct aeadCtx *ctx)
+{
+	if (!ctx)
+		return;
+	EVP_CIPHER_CTX_free(ctx->enc);
+	EVP_CIPHER_CTX_free(ctx->dec);
+	free(ctx);
+}
+
+void aeadNonce(unsigned char *nonce, uint32_t session, uint64_t counter)
+{
+	int i;
+
+	for (i = 0; i < 4; ++i)
+		nonce[i] = session >> (24 - i * 8);
+	for (i = 0; i < 8; ++i)
+		nonce[4 + i] = counter >> (56 - i * 8);
+}
+
+int aeadSeal(struct aeadCtx *ctx, const unsigned char *nonce, const unsigned char *aad, int aad_len,
+		const unsigned char *in, int len, unsigned char *out)
+{
+	int out_len, final_len;
+
+	if (!EVP_EncryptInit_ex(ctx->enc, NULL, NULL, NULL, nonce) ||
+	    !EVP_EncryptUpdate(ctx->enc, NULL, &out_len, aad, aad_len) ||
+	    !EVP_EncryptUpdate(ctx->enc, out + AEAD_TAG_LEN, &out_len, in, len) ||
+	    !EVP_EncryptFinal_ex(ctx->enc, out + AEAD_TAG_LEN + out_len, &final_len) ||
+	    !EVP_CIPHER_CTX_ctrl(ctx->enc, EVP_CTRL_GCM_GET_TAG, AEAD_TAG_LEN, out))
+		return -1;
+	return AEAD_TAG_LEN + out_len + final_len;
+}
+
+int aeadOpen(struct aeadCtx *ctx, const unsigned char *nonce, const unsigned char *aad, int aad_len,
+		const unsigned char *in, int len, unsigned char *out)
+{
+	int out_len, final_len;
+
+	if (len < AEAD_TAG_LEN)
+		return -1;
+	if (!EVP_DecryptInit_ex(ctx->dec, NULL, NULL, NULL, nonce) ||
+	    !EVP_DecryptUpdate(ctx->dec, NULL, &out_len, aad, aad_len) ||
+	    !EVP_DecryptUpdate(ctx->dec, out, &out_len, in + AEAD_TAG_LEN, len - AEAD_TAG_LEN) ||
+	    !EVP_CIPHER_CTX_ctrl(ctx->dec, EVP_CTRL_GCM_SET_TAG, AEAD_TAG_LEN, (void *)in) ||
+	    !EVP_DecryptFinal_ex(ctx->dec, out + out_len, &final_len))
+		return -1;
+	return out_len + final_len;
+}
+
+static bool replay_bit(const struct aeadReplay *r, uint64_t counter)
+{
+	size_t bit = counter % AEAD_REPLAY_WINDOW;
+	return r->bits[bit / 64] & (1ULL << (bit % 64));
+}
+
+bool aeadReplayCheck(const struct aeadReplay *r, uint32_t session, uint64_t counter)
+{
+	int i;
+
+	/* packets of a rotated tag would replay into the new window */
+	for (i = 0; i < r->retired_len; ++i) {
+		if (r->retired[i] == session)
+			return false;
+	}
+	/* a new session id means the peer rotated its tag, the window starts over */
+	if (!r->init || r->session != session || counter > r->top)
+		return true;
+	if (r->top - counter >= AEAD_REPLAY_WINDOW)
+		return false;
+	return !replay_bit(r, counter);
+}
+
+void aeadReplayUpdate(struct aeadReplay *r, uint32_t session, uint64_t counter)
+{
+	uint64_t c;
+	size_t bit;
+
+	if (!r->init || r->session != session) {
+		if (r->init) {
+			if (r->retired_len < AEAD_REPLAY_RETIRED)
+				r->retired_len++;
+			memmove(r->retired + 1, r->retired, (r->retired_len - 1) * sizeof(*r->retired));
+			r->retired[0] = r->session;
+		}
+		memset(r->bits, 0, sizeof(r->bits));
+		r->init = true;
+		r->session = session;
+		r->top = counter;
+	} else if (counter > r->top) {
+		if (counter - r->top >= AEAD_REPLAY_WINDOW) {
+			memset(r->bits, 0, sizeof(r->bits));
+		} else {
+			for (c = r->top + 1; c < counter; ++c) {
+				bit = c % AEAD_REPLAY_WINDOW;
+				r->bits[bit / 64] &= ~(1ULL << (bit % 64));
+			}
+		}
+		r->top = counter;
+	}
+	bit = counter % AEAD_REPLAY_WINDOW;
+	r->bits[bit / 64] |= 1ULL << (bit % 64);
+}
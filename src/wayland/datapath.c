@@ -0,0 +1,339 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "xmem.h"
+#include "datapath.h"
+
+struct dpContext *dpNew(int port)
+{
+	struct dpContext *dp;
+
+	dp = xcalloc(1, sizeof(*dp));
+	dp->wake[0] = dp->wake[1] = -1;
+	pthread_mutex_init(&dp->lock, NULL);
+	dp->slab = xmalloc(sizeof(*dp->slab));
+	dp->rx = udpRxNew(dp->slab);
+
+	if ((dp->fd = udpBind(port)) == -1)
+		goto fail;
+	if (pipe2(dp->wake, O_CLOEXEC | O_NONBLOCK) == -1) {
+		LOG(stderr, "datapath: pipe() failed: %s\n", strerror(errno));
+		goto fail;
+	}
+	return dp;
+fail:
+	dpFree(dp);
+	return NULL;
+}
+
+void dpFree(struct dpContext *dp)
+{
+	size_t i;
+
+	if (!dp)
+		return;
+	dpStop(dp);
+	if (dp->fd != -1)
+		close(dp->fd);
+	if (dp->wake[0] != -1)
+		close(dp->wake[0]);
+	if (dp->wake[1] != -1)
+		close(dp->wake[1]);
+	for (i = 0; i < DP_MAX_PEERS; ++i)
+		aeadFree(dp->peers[i].aead);
+	udpRxFree(dp->rx);
+	free(dp->slab);
+	pthread_mutex_destroy(&dp->lock);
+	free(dp);
+}
+
+int dpPort(struct dpContext *dp)
+{
+	struct sockaddr_in6 addr;
+	socklen_t len = sizeof(addr);
+
+	if (getsockname(dp->fd, (struct sockaddr *)&addr, &len) == -1)
+		return -1;
+	return ntohs(addr.sin6_port);
+}
+
+void dpSetTag(struct dpContext *dp, uint32_t tag)
+{
+	pthread_mutex_lock(&dp->lock);
+	dp->tag = tag;
+	pthread_mutex_unlock(&dp->lock);
+}
+
+bool dpAllow(struct dpContext *dp, int conn, const unsigned char *key)
+{
+	struct aeadCtx *aead, *old;
+
+	if (conn <= 0 || conn >= DP_MAX_PEERS)
+		return false;
+	/* expand the key schedule outside the lock */
+	if (!(aead = aeadNew(key)))
+		return false;
+	pthread_mutex_lock(&dp->lock);
+	old = dp->peers[conn].aead;
+	dp->peers[conn] = (struct dpPeer){ .aead = aead };
+	pthread_mutex_unlock(&dp->lock);
+	aeadFree(old);
+	return true;
+}
+
+void dpRevoke(struct dpContext *dp, int conn)
+{
+	struct aeadCtx *old;
+
+	if (conn <= 0 || conn >= DP_MAX_PEERS)
+		return;
+	pthread_mutex_lock(&dp->lock);
+	old = dp->peers[conn].aead;
+	dp->peers[conn] = (struct dpPeer){ 0 };
+	pthread_mutex_unlock(&dp->lock);
+	aeadFree(old);
+}
+
+void dpSetSink(struct dpContext *dp, const struct dpSink *sink)
+{
+	dp->sink = *sink;
+}
+
+void dpControlFree(struct dpControl *msg)
+{
+	free(msg);
+}
+
+/* authenticate and decrypt an input frame for an allowed connection into
+ * dp->plain, enforcing the replay window of that peer */
+static int decrypt(struct dpContext *dp, const struct wireHeader *hdr, const unsigned char *pkt, size_t len)
+{
+	unsigned char nonce[AEAD_NONCE_LEN];
+	struct dpPeer *peer;
+	int res = -1;
+
+	aeadNonce(nonce, hdr->sender, hdr->seq);
+	pthread_mutex_lock(&dp->lock);
+	if (hdr->conn >= DP_MAX_PEERS || !dp->peers[hdr->conn].aead) {
+		TRACE(TRACE_DROP, TRACE_DROP_NO_SESSION, hdr->op, hdr->conn, hdr->seq);
+		goto done;
+	}
+	peer = &dp->peers[hdr->conn];
+	if (!aeadReplayCheck(&peer->replay, hdr->sender, hdr->seq)) {
+		TRACE(TRACE_DROP, TRACE_DROP_REPLAY, hdr->op, hdr->conn, hdr->seq);
+		goto done;
+	}
+	res = aeadOpen(peer->aead, nonce, pkt, WIRE_HEADER_LEN, pkt + WIRE_HEADER_LEN,
+			len - WIRE_HEADER_LEN, dp->plain);
+	if (res >= 0)
+		aeadReplayUpdate(&peer->replay, hdr->sender, hdr->seq);
+	else
+		TRACE(TRACE_DROP, TRACE_DROP_AUTH, hdr->op, hdr->conn, hdr->seq);
+done:
+	pthread_mutex_unlock(&dp->lock);
+	return res;
+}
+
+static void inject(struct dpContext *dp, const struct wireEvent *ev)
+{
+	const struct dpSink *s = &dp->sink;
+
+	TRACE(TRACE_INJECT, ev->op, ev->arg[0], ev->arg[1], ev->arg[2]);
+	switch (ev->op) {
+		case WIRE_OP_MOUSE_MOVE:
+			s->mouse_rel_motion(s->ctx, ev->arg[0], ev->arg[1]);
+			break;
+		case WIRE_OP_MOUSE_ABS:
+			s->mouse_motion(s->ctx, ev->arg[0], ev->arg[1]);
+			break;
+		case WIRE_OP_MOUSE_BUTTON:
+			s->mouse_button(s->ctx, ev->arg[0], ev->arg[1]);
+			break;
+		case WIRE_OP_MOUSE_WHEEL:
+			s->mouse_wheel(s->ctx, ev->arg[0], ev->arg[1]);
+			break;
+		case WIRE_OP_KEY:
+			/* wire order is keycode, modifiers, pressed */
+			s->key(s->ctx, ev->arg[0], ev->arg[1], ev->arg[2]);
+			break;
+		case WIRE_OP_KEY_RAW:
+			s->key_raw(s->ctx, ev->arg[0], ev->arg[1]);
+			break;
+		case WIRE_OP_KEY_RELEASE_ALL:
+			s->key_release_all(s->ctx);
+			break;
+		case WIRE_OP_IDLE_INHIBIT:
+			s->idle_inhibit(s->ctx, ev->arg[0]);
+			break;
+	}
+}
+
+static void forward(struct dpContext *dp, const struct sockaddr_storage *from, const unsigned char *pkt, size_t len)
+{
+	struct dpControl *msg = xmalloc(sizeof(*msg) + len);
+	int32_t port;
+
+	udpAddrFormat(from, msg->addr, &port);
+	msg->port = port;
+	msg->len = len;
+	memcpy(msg->data, pkt, len);
+	dp->stats.control++;
+	dp->on_control(msg, len);
+}
+
+/* returns whether an event was injected */
+static bool handle_packet(struct dpContext *dp, unsigned char *pkt, const struct sockaddr_storage *from, size_t len)
+{
+	struct sspBuf buf = { .data = pkt, .pos = 0, .len = len };
+	struct wireHeader hdr;
+	struct wireEvent ev;
+	int plain_len;
+
+	dp->stats.packets++;
+	if (!wireHeaderDecode(&buf, &hdr)) {
+		dp->stats.malformed++;
+		TRACE(TRACE_DROP, TRACE_DROP_MALFORMED, -1, -1, -1);
+		return false;
+	}
+	TRACE(TRACE_RX, hdr.op, hdr.conn, len, hdr.seq);
+	if (hdr.sender == dp->tag) {
+		TRACE(TRACE_DROP, TRACE_DROP_OWN, hdr.op, hdr.conn, hdr.seq);
+		return false;
+	}
+	/* control traffic is JS business, pass it on untouched. so is the
+	 * reliable lane, JS keeps its order and acks it */
+	if (hdr.op < WIRE_OP_INPUT || hdr.op >= WIRE_OP_INPUT_END || (hdr.flags & WIRE_FLAG_RELIABLE)) {
+		forward(dp, from, pkt, len);
+		return false;
+	}
+	if ((plain_len = decrypt(dp, &hdr, pkt, len)) < 0) {
+		dp->stats.rejected++;
+		return false;
+	}
+	buf = (struct sspBuf){ .data = dp->plain, .pos = 0, .len = plain_len };
+	if (!wireEventDecode(&buf, hdr.op, &ev)) {
+		dp->stats.malformed++;
+		return false;
+	}
+	inject(dp, &ev);
+	dp->stats.injected++;
+	return true;
+}
+
+static void *dp_thread(void *data)
+{
+	struct dpContext *dp = data;
+	struct pollfd pfd[2] = {
+		{ .fd = dp->fd, .events = POLLIN },
+		{ .fd = dp->wake[0], .events = POLLIN },
+	};
+	bool injected;
+	int i, n;
+
+	LOG(stderr, "datapath: thread running on port %d\n", dpPort(dp));
+	while (dp->running) {
+		dp->io.polls++;
+		if (poll(pfd, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			LOG(stderr, "datapath: poll() failed: %s\n", strerror(errno));
+			break;
+		}
+		if (pfd[1].revents)
+			break;
+		/* drain everything that queued up while we were injecting, a
+		 * recvmmsg batch at a time, and flush the display once per batch */
+		do {
+			if ((n = udpRecvBatch(dp->fd, dp->rx, false, &dp->io)))
+				dp->io.batches++;
+			if (n && dp->sink.begin)
+				dp->sink.begin(dp->sink.ctx);
+			injected = false;
+			for (i = 0; i < n; ++i) {
+				if (dp->slab->msg[i].len < 0) {
+					dp->stats.malformed++;
+					continue;
+				}
+				injected |= handle_packet(dp, dp->slab->data[i], udpRxFrom(dp->rx, i),
+						dp->slab->msg[i].len);
+			}
+			if ((injected || (n && dp->sink.begin)) && dp->sink.flush)
+				dp->sink.flush(dp->sink.ctx);
+		} while (n == UDP_BATCH);
+	}
+	LOG(stderr, "datapath: thread exiting\n");
+	return NULL;
+}
+
+bool dpStart(struct dpContext *dp, dpControlFunc on_control)
+{
+	if (dp->running)
+		return true;
+	if (!dp->sink.mouse_rel_motion) {
+		LOG(stderr, "datapath: no backend sink attached\n");
+		return false;
+	}
+	dp->on_control = on_control;
+	dp->running = true;
+	if (pthread_create(&dp->thread, NULL, dp_thread, dp)) {
+		dp->running = false;
+		return false;
+	}
+	return true;
+}
+
+void dpStop(struct dpContext *dp)
+{
+	char c = 0;
+
+	if (!dp->running)
+		return;
+	dp->running = false;
+	if (write(dp->wake[1], &c, 1) == -1) {
+		LOG(stderr, "datapath: could not wake thread\n");
+	}
+	pthread_join(dp->thread, NULL);
+}
+
+int dpSend(struct dpContext *dp, const unsigned char *data, int len, const char *addr, int port)
+{
+	struct sockaddr_in6 to;
+
+	if (!udpAddrParse(addr, port, &to))
+		return -1;
+	dp->io.send_calls++;
+	if ((len = sendto(dp->fd, data, len, 0, (struct sockaddr *)&to, sizeof(to))) >= 0)
+		dp->io.sent++;
+	return len;
+}
+
+int dpSendBatch(struct dpContext *dp, const unsigned char *data, const int32_t *lens,
+		const struct sockaddr_in6 *to, int count)
+{
+	return udpSendBatch(dp->fd, data, lens, to, count, &dp->io);
+}
+
+void dpGetStats(struct dpContext *dp, uint64_t *out)
+{
+	out[0] = dp->stats.packets;
+	out[1] = dp->stats.injected;
+	out[2] = dp->stats.control;
+	out[3] = dp->stats.rejected;
+	out[4] = dp->stats.malformed;
+	out[5] = dp->io.polls;
+	out[6] = dp->io.recv_calls;
+	out[7] = dp->io.received;
+	out[8] = dp->io.truncated;
+	out[9] = dp->io.batches;
+	out[10] = dp->io.send_calls;
+	out[11] = dp->io.sent;
+}
@@ -0,0 +1,67 @@
+#include "delta.h"
+
+static inline void block_sum(const uint8_t *p, int n, uint32_t *a, uint32_t *b)
+{
+	uint32_t sa = 0, sb = 0;
+	int i;
+
+	/* no dependency between iterations but the sums, this vectorizes */
+	for (i = 0; i < n; ++i) {
+		sa += p[i];
+		sb += (uint32_t)(n - i) * p[i];
+	}
+	*a = sa & 0xffff;
+	*b = sb & 0xffff;
+}
+
+int deltaBlockSums(const uint8_t *data, int len, int block, uint32_t *sums)
+{
+	int count = block > 0 ? len / block : 0;
+	uint32_t a, b;
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		block_sum(data + (long)i * block, block, &a, &b);
+		sums[i] = a | b << 16;
+	}
+	return count;
+}
+
+int deltaScan(const uint8_t *data, int len, int from, int block, const uint8_t *filter,
+	      struct deltaWindow *w)
+{
+	uint32_t a, b, sum, idx;
+	int pos = from;
+
+	if (block <= 0 || from < 0 || from > len - block)
+		return -1;
+	if (w->start != DELTA_NO_WINDOW && w->start + 1 == (uint32_t)from) {
+		/* roll the window the last scan stopped at by one byte */
+		a = (w->a - data[from - 1] + data[from + block - 1]) & 0xffff;
+		b = (w->b - (uint32_t)block * data[from - 1] + a) & 0xffff;
+	} else if (w->start == (uint32_t)from) {
+		a = w->a;
+		b = w->b;
+	} else {
+		block_sum(data + from, block, &a, &b);
+	}
+
+	for (;;) {
+		sum = a | b << 16;
+		idx = deltaFilterIndex(sum);
+		if (filter[idx >> 3] & (1 << (idx & 7)))
+			break;
+		if (pos + block >= len) {
+			w->start = DELTA_NO_WINDOW;
+			return -1;
+		}
+		a = (a - data[pos] + data[pos + block]) & 0xffff;
+		b = (b - (uint32_t)block * data[pos] + a) & 0xffff;
+		++pos;
+	}
+	w->start = pos;
+	w->a = a;
+	w->b = b;
+	w->sum = sum;
+	return pos;
+}
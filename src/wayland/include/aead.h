@@ -0,0 +1,51 @@
+#pragma once
+/* AES-256-GCM with a key schedule expanded once per session
+ *
+ * Nonces are never sent: both ends build them from the sender's session id
+ * and the frame sequence number carried in the wire header, so every packet
+ * costs one IV set instead of a full cipher setup. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <openssl/evp.h>
+
+#define AEAD_KEY_LEN 32
+#define AEAD_NONCE_LEN 12
+#define AEAD_TAG_LEN 16
+/* how far behind the newest counter a packet may arrive */
+#define AEAD_REPLAY_WINDOW 128
+/* session ids a window remembers after the sender moved on */
+#define AEAD_REPLAY_RETIRED 4
+
+struct aeadCtx {
+	EVP_CIPHER_CTX *enc;
+	EVP_CIPHER_CTX *dec;
+};
+
+struct aeadReplay {
+	bool init;
+	uint32_t session;
+	uint64_t top;
+	uint64_t bits[AEAD_REPLAY_WINDOW / 64];
+	/* earlier session ids, newest first, refused from then on */
+	uint32_t retired[AEAD_REPLAY_RETIRED];
+	int retired_len;
+};
+
+extern struct aeadCtx *aeadNew(const unsigned char *key);
+extern void aeadFree(struct aeadCtx *ctx);
+/* nonce = session id || 64 bit counter, big endian */
+extern void aeadNonce(unsigned char *nonce, uint32_t session, uint64_t counter);
+/* out receives tag || ciphertext, len + AEAD_TAG_LEN bytes. returns the
+ * number of bytes written or -1 */
+extern int aeadSeal(struct aeadCtx *ctx, const unsigned char *nonce, const unsigned char *aad, int aad_len,
+		const unsigned char *in, int len, unsigned char *out);
+/* in is tag || ciphertext; returns the plaintext length or -1 if the packet
+ * does not authenticate */
+extern int aeadOpen(struct aeadCtx *ctx, const unsigned char *nonce, const unsigned char *aad, int aad_len,
+		const unsigned char *in, int len, unsigned char *out);
+/* sliding window replay protection. check before decrypting, update only
+ * once the packet authenticated. a new session id starts the window over and
+ * retires the old one */
+extern bool aeadReplayCheck(const struct aeadReplay *r, uint32_t session, uint64_t counter);
+extern void aeadReplayUpdate(struct aeadReplay *r, uint32_t session, uint64_t counter);
@@ -0,0 +1,117 @@
+#pragma once
+/* native receive -> decrypt -> decode -> inject datapath
+ *
+ * Owns the peer UDP socket on a dedicated thread. Unreliable input frames
+ * (motion) from authorized peers are decrypted, decoded and injected straight
+ * through a backend sink; everything else (auth, kill, clipboard, the reliable
+ * key and button lane, ...) is handed to JS through the control callback. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include "aead.h"
+#include "trace.h"
+#include "udp.h"
+#include "wire.h"
+
+#ifndef LOG
+#ifdef __DEBUG__
+#define LOG(file, fmt, ...) fprintf(file, fmt, ##__VA_ARGS__)
+#else
+#define LOG(file, fmt, ...)
+#endif
+#endif
+
+/* peer slots, indexed by the connection id in the frame header. slot 0 is
+ * never used, see MAX_PEERS in src/network/slots.js */
+#define DP_MAX_PEERS 32
+#define DP_MAX_PACKET UDP_SLOT
+#define DP_ADDR_LEN 64
+
+/* injection entry points of a display backend */
+struct dpSink {
+	void *ctx;
+	void (*mouse_rel_motion)(void *ctx, int dx, int dy);
+	void (*mouse_motion)(void *ctx, int x, int y);
+	void (*mouse_button)(void *ctx, int button, int state);
+	void (*mouse_wheel)(void *ctx, signed short dx, signed short dy);
+	void (*key)(void *ctx, int key, int modifiers, int state);
+	void (*key_raw)(void *ctx, int key, int state);
+	void (*key_release_all)(void *ctx);
+	void (*idle_inhibit)(void *ctx, bool on);
+	/* called before each receive batch, may be NULL. where it is set, flush
+	 * follows every batch whether or not it injected anything */
+	void (*begin)(void *ctx);
+	/* called once after each receive batch, may be NULL */
+	void (*flush)(void *ctx);
+};
+
+/* a control frame for JS. addr is NUL terminated, data follows the struct;
+ * release with dpControlFree once consumed */
+struct dpControl {
+	char addr[DP_ADDR_LEN];
+	int port;
+	int len;
+	unsigned char data[];
+};
+
+typedef void (*dpControlFunc)(struct dpControl *msg, int len);
+
+struct dpStats {
+	uint64_t packets;
+	uint64_t injected;
+	uint64_t control;
+	uint64_t rejected;
+	uint64_t malformed;
+};
+
+/* an authorized peer and the receive key of its session. peers are found
+ * by connection id and proven by their key, not by address, so a peer that
+ * moves to a new address keeps working */
+struct dpPeer {
+	struct aeadCtx *aead;
+	struct aeadReplay replay;
+};
+
+struct dpContext {
+	int fd;
+	int wake[2];
+	pthread_t thread;
+	bool running;
+	/* protects tag and peers, which JS updates while we run */
+	pthread_mutex_t lock;
+	uint32_t tag;
+	struct dpPeer peers[DP_MAX_PEERS];
+	struct dpSink sink;
+	dpControlFunc on_control;
+	struct dpStats stats;
+	struct udpStats io;
+	/* recvmmsg target, drained a batch at a time */
+	struct udpSlab *slab;
+	struct udpRx *rx;
+	unsigned char plain[DP_MAX_PACKET];
+};
+
+/* bind a UDP socket on port (0 for any) and create a stopped datapath */
+extern struct dpContext *dpNew(int port);
+extern void dpFree(struct dpContext *dp);
+/* the port actually bound */
+extern int dpPort(struct dpContext *dp);
+/* our own sender tag, frames carrying it are dropped */
+extern void dpSetTag(struct dpContext *dp, uint32_t tag);
+/* accept input frames for connection id conn sealed with key, the receive
+ * traffic key of the peer's session. allowing a used slot again rekeys it */
+extern bool dpAllow(struct dpContext *dp, int conn, const unsigned char *key);
+extern void dpRevoke(struct dpContext *dp, int conn);
+extern void dpSetSink(struct dpContext *dp, const struct dpSink *sink);
+extern bool dpStart(struct dpContext *dp, dpControlFunc on_control);
+extern void dpStop(struct dpContext *dp);
+extern void dpControlFree(struct dpControl *msg);
+/* send a datagram from the datapath socket */
+extern int dpSend(struct dpContext *dp, const unsigned char *data, int len, const char *addr, int port);
+/* sendmmsg fan-out, see udpSendBatch */
+extern int dpSendBatch(struct dpContext *dp, const unsigned char *data, const int32_t *lens,
+		const struct sockaddr_in6 *to, int count);
+/* copy counters out as 12 u64s, struct dpStats then struct udpStats order */
+extern void dpGetStats(struct dpContext *dp, uint64_t *out);
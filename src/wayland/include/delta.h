@@ -0,0 +1,33 @@
+#pragma once
+/* rsync style weak checksums for clipboard deltas, see src/network/delta.js
+ *
+ * The checksum of a window of n bytes is a | b << 16 with a = sum x[i] and
+ * b = sum (n - i) x[i], both mod 2^16, so moving the window by a byte costs
+ * two updates. Block sums are independent and written for the vectorizer,
+ * the scan is inherently serial and only hands windows back to JS when
+ * their checksum hits the filter of basis blocks. */
+
+#include <stdint.h>
+
+/* bit of the DELTA_FILTER_BITS filter a checksum sets */
+#define DELTA_FILTER_BITS 16
+#define deltaFilterIndex(sum) ((uint32_t)((sum) * 2654435761u) >> (32 - DELTA_FILTER_BITS))
+
+/* window the scan stopped at, its a and b, and its checksum. start is
+ * DELTA_NO_WINDOW before the first scan */
+#define DELTA_NO_WINDOW UINT32_MAX
+struct deltaWindow {
+	uint32_t start;
+	uint32_t a;
+	uint32_t b;
+	uint32_t sum;
+};
+
+/* checksums of the len / block full blocks of data into sums, returns their
+ * number */
+extern int deltaBlockSums(const uint8_t *data, int len, int block, uint32_t *sums);
+/* first window at or after from whose checksum is set in filter, -1 when
+ * there is none. w carries the rolling state between calls: scanning on from
+ * the window after a miss rolls instead of summing the block again */
+extern int deltaScan(const uint8_t *data, int len, int from, int block, const uint8_t *filter,
+		     struct deltaWindow *w);
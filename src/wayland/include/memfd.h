@@ -0,0 +1,21 @@
+#pragma once
+/* sealed memfds for clipboard contents, see ClipboardBody in
+ * src/network/clipboard.js
+ *
+ * A content is written into a memfd once and sealed, after that it is only
+ * ever passed around as a file descriptor: the clipboards of wl_clipboard.c
+ * and x11.c dup it and serve pastes from it with sendfile, so its bytes never
+ * have to live in the heap of the process. */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* an empty memfd that can be sealed, -1 on failure */
+extern int memfdCreate(void);
+/* make fd immutable, 0 or -1 where the system cannot seal it */
+extern int memfdSeal(int fd);
+/* a sealed memfd holding the len bytes of data, -1 on failure */
+extern int memfdFrom(const unsigned char *data, size_t len);
+/* copy up to len bytes of fd from *off to out and advance *off, the result
+ * of the write: bytes written, or -1 with errno set (EAGAIN included) */
+extern ssize_t memfdSend(int out, int fd, off_t *off, size_t len);
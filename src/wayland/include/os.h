@@ -15,5 +15,7 @@ extern bool osMakeParentDir(const char *path, mode_t mode);
 extern void osDropPriv(void);
 /* determine the name of the other end of a socket */
 extern char *osGetPeerProcName(int fd);
+/* pid of the other end of a socket, -1 if unknown */
+extern pid_t osGetPeerPid(int fd);
 /* set environment variable for testing */
 extern int osSetEnv(const char *name, const char *value);
@@ -15,6 +15,9 @@ struct sspBuf {
 extern bool sspSeek(struct sspBuf *buf, size_t len);
 extern bool sspNetInt(struct sspBuf *buf, void *res, size_t len);
 extern bool sspMemMove(void *dest, struct sspBuf *buf, size_t len);
+/* LEB128 varints, as used by the wire format for small counts and deltas */
+extern bool sspVarU32(struct sspBuf *buf, uint32_t *res);
+extern bool sspVar32(struct sspBuf *buf, int32_t *res);
 
 static inline bool sspChar(struct sspBuf *buf, char *res)
 {
@@ -40,4 +43,7 @@ static inline bool sspNetU32(struct sspBuf *buf, uint32_t *res)
 {
 	return sspNetInt(buf, res, 4);
 }
-
+static inline size_t sspRemaining(const struct sspBuf *buf)
+{
+	return buf->len - buf->pos;
+}
@@ -0,0 +1,108 @@
+#pragma once
+/* binary event tracing shared with src/trace.js
+ *
+ * fixed size records go into a ring buffer in a shared memory file, written
+ * lock-free from any thread of either language. `bzz trace dump` decodes
+ * it. with no ring attached TRACE() costs one branch. */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TRACE_MAGIC 0x52545a42 /* "BZTR" */
+#define TRACE_VERSION 1
+
+/* event ids and their arguments, keep in sync with TRACE_EVENTS in
+ * src/trace.js */
+enum traceEvent {
+	TRACE_RX = 1, /* op, conn, len, seq */
+	TRACE_DROP, /* reason, op, conn, seq */
+	TRACE_TX, /* op, peers, bytes, seq */
+	TRACE_DISPATCH, /* op, conn */
+	TRACE_INJECT, /* op, arg0, arg1, arg2 */
+	TRACE_MIGRATE, /* conn, port */
+	TRACE_HANDSHAKE, /* phase (HANDSHAKE in src/trace.js), conn */
+	TRACE_KEY, /* key, state, mapped, id */
+	TRACE_BUTTON, /* button, mapped, state */
+	TRACE_INPUT_DROP, /* reason, code */
+	TRACE_MOTION_FLUSH, /* dx, dy, merged */
+	TRACE_RETRANSMIT, /* conn, lane seq, attempt, rto */
+	TRACE_SYNC, /* what (traceSync), code, state, previous */
+	TRACE_BULK, /* state (BULK in src/trace.js), conn, transfer, bytes */
+};
+
+/* why a frame was dropped (TRACE_DROP) */
+enum traceDrop {
+	TRACE_DROP_MALFORMED = 1,
+	TRACE_DROP_OWN,
+	TRACE_DROP_NO_SESSION,
+	TRACE_DROP_AUTH,
+	TRACE_DROP_REPLAY,
+	TRACE_DROP_UNAUTHORIZED,
+	TRACE_DROP_NO_HANDLER,
+	TRACE_DROP_DUPLICATE, /* reliable lane, already applied */
+	TRACE_DROP_WINDOW, /* reliable lane, too far ahead */
+	TRACE_DROP_STALE, /* input snapshot not at the receiver's lane position */
+};
+
+/* what an input state snapshot corrected (TRACE_SYNC) */
+enum traceSync {
+	TRACE_SYNC_KEY = 1,
+	TRACE_SYNC_BUTTON,
+	TRACE_SYNC_LOCK,
+};
+
+/* why an input event was not injected (TRACE_INPUT_DROP) */
+enum traceInputDrop {
+	TRACE_INPUT_SUPERFLUOUS_RELEASE = 1,
+	TRACE_INPUT_OUTSIDE_KEYMAP,
+	TRACE_INPUT_UNMAPPED,
+	TRACE_INPUT_BUTTON_RANGE,
+	TRACE_INPUT_UNSUPPORTED,
+	TRACE_INPUT_STALE, /* motion dropped from a full outbound queue */
+};
+
+enum traceSource {
+	TRACE_SOURCE_JS,
+	TRACE_SOURCE_C,
+};
+
+/* 32 bytes. stamp is the low 32 bits of the record index + 1, written last:
+ * a reader skips records whose stamp does not match their position, they
+ * are being written or were already overwritten */
+struct traceRecord {
+	uint64_t ts;
+	uint32_t stamp;
+	uint16_t event;
+	uint16_t source;
+	int32_t arg[4];
+};
+
+/* 64 byte header followed by capacity records, capacity is a power of two */
+struct traceRing {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t capacity;
+	uint32_t record_size;
+	uint64_t head;
+	uint64_t start;
+	uint32_t pid;
+	unsigned char reserved[28];
+	struct traceRecord rec[];
+};
+
+/* the ring this compilation unit writes to, NULL while tracing is off */
+extern struct traceRing *traceRing;
+
+#define TRACE(event, a0, a1, a2, a3) \
+	do { \
+		if (traceRing) \
+			traceEmit(traceRing, TRACE_SOURCE_C, event, a0, a1, a2, a3); \
+	} while (0)
+
+/* create path holding a ring of capacity records and map it shared */
+extern struct traceRing *traceOpen(const char *path, uint32_t capacity);
+extern void traceClose(struct traceRing *ring);
+/* point TRACE() in this unit at ring, NULL turns it off */
+extern void traceAttach(struct traceRing *ring);
+extern void traceEmit(struct traceRing *ring, int source, int event, int32_t a0, int32_t a1, int32_t a2,
+		int32_t a3);
@@ -0,0 +1,110 @@
+#pragma once
+/* batched UDP socket I/O
+ *
+ * A receive thread drains the socket with recvmmsg into preallocated slabs
+ * and hands each batch to JS in one callback; sends go out with sendmmsg.
+ * Two slabs alternate so the kernel can be drained into one while JS still
+ * dispatches the other. The native datapath uses the same receive and send
+ * helpers on its own socket. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <netinet/in.h>
+
+#ifndef LOG
+#ifdef __DEBUG__
+#define LOG(file, fmt, ...) fprintf(file, fmt, ##__VA_ARGS__)
+#else
+#define LOG(file, fmt, ...)
+#endif
+#endif
+
+/* datagrams per recvmmsg/sendmmsg call */
+#define UDP_BATCH 32
+/* largest datagram, slots only touch the pages a packet fills */
+#define UDP_SLOT 65536
+#define UDP_SLABS 2
+#define UDP_ADDR_LEN 48
+/* requested socket receive buffer, the kernel caps it at rmem_max */
+#define UDP_RCVBUF (1 << 20)
+
+/* where a received datagram came from, see MSG_* in src/network/udp.js */
+struct udpMsg {
+	char addr[UDP_ADDR_LEN];
+	int32_t port;
+	int32_t len;
+};
+
+/* one batch: the metadata table followed by a slot per datagram */
+struct udpSlab {
+	struct udpMsg msg[UDP_BATCH];
+	unsigned char data[UDP_BATCH][UDP_SLOT];
+};
+
+/* polls, recv_calls and send_calls are syscalls */
+struct udpStats {
+	uint64_t polls;
+	uint64_t recv_calls;
+	uint64_t received;
+	uint64_t truncated;
+	uint64_t batches;
+	uint64_t send_calls;
+	uint64_t sent;
+};
+
+/* recvmmsg headers pointing into a slab, opaque so this header does not
+ * need _GNU_SOURCE */
+struct udpRx;
+
+/* called on the receive thread with a filled slab; JS must udpRelease it */
+typedef void (*udpBatchFunc)(int slab, int count);
+
+struct udpSocket {
+	int fd;
+	int wake[2];
+	pthread_t thread;
+	bool running;
+	/* protects busy, the slabs JS has not released yet */
+	pthread_mutex_t lock;
+	pthread_cond_t released;
+	bool busy[UDP_SLABS];
+	udpBatchFunc on_batch;
+	struct udpStats stats;
+	struct udpSlab *slab[UDP_SLABS];
+	struct udpRx *rx[UDP_SLABS];
+};
+
+/* dual-stack non-blocking UDP socket bound to port (0 for any), -1 on error */
+extern int udpBind(int port);
+/* addr:port as a v4-mapped or v6 socket address for a dual-stack socket */
+extern bool udpAddrParse(const char *addr, int port, struct sockaddr_in6 *out);
+/* numeric host and port of from, IPv4-mapped addresses unmapped */
+extern void udpAddrFormat(const struct sockaddr_storage *from, char *addr, int32_t *port);
+extern struct udpRx *udpRxNew(struct udpSlab *slab);
+extern void udpRxFree(struct udpRx *rx);
+extern const struct sockaddr_storage *udpRxFrom(struct udpRx *rx, int i);
+/* one recvmmsg without blocking: fills the lengths in the slab and returns
+ * the number of datagrams, 0 when the socket is drained. truncated datagrams
+ * get len -1. addresses are only formatted into the slab if format is set */
+extern int udpRecvBatch(int fd, struct udpRx *rx, bool format, struct udpStats *stats);
+/* send count datagrams packed back to back in data, lens[i] bytes each to
+ * to[i], with as few sendmmsg calls as possible. returns how many went out */
+extern int udpSendBatch(int fd, const unsigned char *data, const int32_t *lens, const struct sockaddr_in6 *to,
+		int count, struct udpStats *stats);
+
+/* socket with a receive thread delivering slabs to on_batch */
+extern struct udpSocket *udpNew(int port);
+extern void udpFree(struct udpSocket *sock);
+extern int udpPort(struct udpSocket *sock);
+extern struct udpSlab *udpSlab(struct udpSocket *sock, int i);
+extern bool udpStart(struct udpSocket *sock, udpBatchFunc on_batch);
+extern void udpStop(struct udpSocket *sock);
+/* JS is done with a slab, the thread may fill it again */
+extern void udpRelease(struct udpSocket *sock, int slab);
+/* fill out (a struct sockaddr_in6) for udpSend */
+extern bool udpAddr(struct sockaddr_in6 *out, const char *addr, int port);
+extern int udpSend(struct udpSocket *sock, const unsigned char *data, const int32_t *lens,
+		const struct sockaddr_in6 *to, int count);
+/* copy counters out as 7 u64s, in struct udpStats order */
+extern void udpGetStats(struct udpSocket *sock, uint64_t *out);
@@ -3,10 +3,12 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <poll.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <xkbcommon/xkbcommon.h>
 #include "os.h"
 #include "xmem.h"
+#include "trace.h"
 #include <unistd.h>
 #include <wayland-client.h>
 #include <wayland-client-protocol.h>
@@ -16,6 +18,8 @@
 #include "xdg-output-unstable-v1-client-protocol.h"
 #include "idle-client-protocol.h"
 #include "ext-idle-notify-v1-client-protocol.h"
+#include "wlr-data-control-unstable-v1-client-protocol.h"
+#include "ext-data-control-v1-client-protocol.h"
 
 #ifdef __DEBUG__
 #define LOG(file, fmt, ...) fprintf(file, fmt, ##__VA_ARGS__)
@@ -25,20 +29,27 @@
 
 struct wlOutput
 {
+	struct wlContext *wl_ctx;
 	uint32_t wl_name;
 	struct wl_output *wl_output;
 	struct zxdg_output_v1 *xdg_output;
+	/* slot in the output table */
+	int index;
+	/* logical position and size in the compositor's layout */
 	int32_t x;
 	int32_t y;
 	int width;
 	int height;
+	/* what the logical size comes from without xdg-output */
+	int mode_width;
+	int mode_height;
 	int32_t scale;
+	int32_t transform;
 	bool complete;
 	bool have_log_size;
 	bool have_log_pos;
 	char *name;
 	char *desc;
-	struct wlOutput *next;
 };
 
 struct wlIdle
@@ -78,6 +89,16 @@ struct wlInput {
 	bool *id_keymap_valid;
 	/* mouse button map */
 	int button_map[WL_INPUT_BUTTON_COUNT];
+	/* pressed buttons, bit n for button n before mapping */
+	unsigned button_state;
+	/* open wlInputBegin batches, requests queued since the last flush, pointer
+	 * events since the last frame and when the batch queued its first. all
+	 * but the depth, and the key and button state above, are shared by the
+	 * injecting threads and only touched under the outbound lock */
+	int batch_depth;
+	bool batch_dirty;
+	bool frame_pending;
+	uint64_t batch_start;
 	/* wayland context */
 	struct wlContext *wl_ctx;
 	/* actual functions */
@@ -88,6 +109,54 @@ struct wlInput {
 	void (*key)(struct wlInput *, int, int);
 	bool (*key_map)(struct wlInput *, char *);
 	void (*update_geom)(struct wlInput *);
+	/* end a group of pointer events, NULL where the protocol has no frames */
+	void (*mouse_frame)(struct wlInput *);
+};
+
+/* a batch flushes anyway once it has held requests this long */
+#define WL_INPUT_BATCH_MAX_NS 2000000
+
+/* for the backends: requests were queued, pointer events if pointer. sent
+ * right away outside a batch, at wlInputCommit or the latency cap in one.
+ * called from replay, with the outbound lock held */
+extern void wlInputQueued(struct wlInput *input, bool pointer);
+
+/* input held back while the compositor does not read, see wlDisplayFlush */
+#define WL_OUTBOUND_LEN 256
+/* queued events replayed per flush when draining */
+#define WL_OUTBOUND_CHUNK 32
+
+enum wlOutboundType {
+	WL_OUT_REL_MOTION,
+	WL_OUT_MOTION,
+	WL_OUT_BUTTON, /* a is the mapped button */
+	WL_OUT_WHEEL,
+	WL_OUT_KEY, /* a is the raw keycode */
+};
+
+struct wlOutboundOp {
+	int type;
+	int a;
+	int b;
+};
+
+struct wlOutbound {
+	/* set on a flush hitting EAGAIN: input goes into ops instead of to
+	 * the backend until they are drained. stalled is cleared before each
+	 * replayed chunk and tells if it backed up again */
+	bool queued;
+	bool stalled;
+	/* guards ops and len, taken by every injection so ops reach the backend
+	 * in the order they were sent. the dispatch thread holds it to change
+	 * the output table, the layout and the keymap. recursive, the key and
+	 * sync paths hold it around the sends that take it again */
+	pthread_mutex_t lock;
+	struct wlOutboundOp ops[WL_OUTBOUND_LEN];
+	int len;
+	uint64_t stalls;
+	uint64_t coalesced;
+	uint64_t dropped;
+	uint64_t spilled;
 };
 
 /* uinput must open device fds before privileges are dropped, so this is
@@ -97,8 +166,26 @@ extern bool wlInputInitWlr(struct wlContext *ctx);
 extern bool wlInputInitKde(struct wlContext *ctx);
 extern bool wlInputInitUinput(struct wlContext *ctx);
 
+/* clipboard events, see wlClipboardInit */
+enum wlClipboardEvent {
+	/* another client set the selection */
+	WL_CLIPBOARD_CHANGED = 0,
+	/* something pastes a selection set without content, answer with
+	 * wlClipboardFill */
+	WL_CLIPBOARD_REQUEST = 1,
+};
+
+typedef void (*wlClipboardFunc)(int event, int primary, uint32_t serial);
+
+struct wlClipboard;
+
 struct wlContext {
 	char *comp_name;
+	pid_t comp_pid;
+	/* backends wlSetup settled on, see wlBackends */
+	const char *input_backend;
+	const char *idle_backend;
+	char backends[32];
 	struct wl_registry *registry;
 	struct wl_display *display;
 	struct wl_seat *seat;
@@ -106,6 +193,7 @@ struct wlContext {
 	struct wl_keyboard *kb;
 	char *kb_map;
 	struct wlInput input;
+	struct wlOutbound outbound;
 	/* /dev/uinput file descriptors, for mouse or keyboard
 	 * or -1 to disable */
 	int uinput_fd[2];
@@ -113,18 +201,39 @@ struct wlContext {
 	struct zwp_virtual_keyboard_manager_v1 *keyboard_manager;
 	struct zwlr_virtual_pointer_manager_v1 *pointer_manager;
 	struct org_kde_kwin_fake_input *fake_input;
-	/* output stuff */
+	/* output stuff, the table in the order outputs were announced */
 	struct zxdg_output_manager_v1 *output_manager;
-	struct wlOutput *outputs;
+	struct wlOutput **outputs;
+	int output_count;
+	int output_cap;
 	/* idle stuff */
 	struct org_kde_kwin_idle *idle_manager; /* old KDE */
 	struct ext_idle_notifier_v1 *idle_notifier; /* new standard */
 	struct wlIdle idle;
+	/* clipboard stuff */
+	struct zwlr_data_control_manager_v1 *data_control; /* wlroots */
+	uint32_t data_control_version;
+	struct ext_data_control_manager_v1 *ext_data_control; /* new standard */
+	struct wlClipboard *clipboard;
+	/* thread dispatching the default queue, see wlSetup */
+	pthread_t dispatch_thread;
+	int dispatch_wake[2];
+	bool dispatching;
+	/* wlPrepareFd prepared a read that wlPollProc completes */
+	bool reading;
+	/* setup barrier out, requests made since it went out, and how many
+	 * went, see setup_barrier */
+	bool setup_waiting;
+	bool setup_more;
+	int setup_round_trips;
 	//state
+	/* the layout: bounding box of the outputs, absolute motion is relative
+	 * to its corner */
+	int32_t x;
+	int32_t y;
 	int width;
 	int height;
 	time_t epoch;
-	long timeout;
 	//callbacks
 	void (*on_output_update)(struct wlContext *ctx);
 };
@@ -134,7 +243,9 @@ extern struct wlContext *wlContextNew(void);
 /* Free a wayland context */
 extern void wlContextFree(struct wlContext *ctx);
 
-/* flush the display with proper error checking */
+/* flush the display with proper error checking. never blocks: when the
+ * compositor is not reading, input is queued (coalesced, stale motion
+ * dropped first once full) until the dispatch thread sees POLLOUT */
 extern void wlDisplayFlush(struct wlContext *ctx);
 
 /* (re)set the keyboard layout according to the configuration
@@ -142,19 +253,37 @@ extern void wlDisplayFlush(struct wlContext *ctx);
 extern int wlKeySetConfigLayout(struct wlContext *ctx);
 /* load button map */
 extern void wlLoadButtonMap(struct wlContext *ctx);
-/* set up the wayland context */
+/* set up the wayland context. backend, "input/idle" as wlBackends
+ * returns it, names the backends to try first, NULL for the usual order.
+ * width and height are the screen size where the compositor reports no
+ * outputs, 0 where none is known */
 extern bool wlSetup(struct wlContext *context, int width, int height, char *backend);
+/* the backends of a set up context as "input/idle", e.g. "wlr/ext" */
+extern const char *wlBackends(struct wlContext *context);
+/* name and pid of the compositor, NULL and -1 if unknown */
+extern const char *wlCompositorName(struct wlContext *context);
+extern int wlCompositorPid(struct wlContext *context);
 
 /* obtain a monotonic timestamp */
 extern uint32_t wlTS(struct wlContext *context);
-/* update screen resolution */
+/* update screen resolution, done by the output table as outputs change */
 extern void wlResUpdate(struct wlContext *context, int width, int height);
+/* copy the layout out as 4 i32s: x, y, width and height */
+extern void wlGetLayout(struct wlContext *context, int32_t *out);
 /* close wayland connection */
 extern void wlClose(struct wlContext *context);
-/* retrieve the wayland connection file descriptor, for polling purposes */
+/* retrieve the wayland connection file descriptor, for polling purposes.
+ * without the dispatch thread this prepares a read, the revents of polling
+ * the fd have to be handed to wlPollProc after */
 extern int wlPrepareFd(struct wlContext *context);
-/* process IO indicated by poll() */
+/* process IO indicated by poll(), a no-op while the dispatch thread runs */
 extern void wlPollProc(struct wlContext *context, short revents);
+/* dispatch the default queue (outputs, keymap, idle) on a thread of its
+ * own as events arrive. wlSetup starts it, wlClose stops it */
+extern bool wlDispatchStart(struct wlContext *context);
+extern void wlDispatchStop(struct wlContext *context);
+/* have the dispatch thread look at its poll events again */
+extern void wlDispatchWake(struct wlContext *context);
 
 /* mouse-related functions */
 extern void wlMouseRelativeMotion(struct wlContext *context, int dx, int dy);
@@ -169,6 +298,51 @@ extern void wlKeyRaw(struct wlContext *context, int key, int state);
 extern void wlKey(struct wlContext *context, int key, int id, int state);
 /* release all currently-pressed keys, usually on exiting the screen */
 extern void wlKeyReleaseAll(struct wlContext *context);
+/* reconcile the tracked key, button and lock state with a sender's snapshot
+ * (src/network/snapshot.js): keys are bitmaps of keycodes as wlKey takes
+ * them, raw of keycodes as wlKeyRaw takes them, buttons a bitmask and
+ * modifiers the synergy modifier mask. Only the differences are injected. */
+extern void wlInputSync(struct wlContext *context, const unsigned char *keys, int keys_len,
+		const unsigned char *raw, int raw_len, unsigned buttons, unsigned modifiers);
+
+/* batch input: between wlInputBegin and wlInputCommit the backends queue
+ * their requests in the libwayland buffer instead of flushing each, pointer
+ * events go under one frame, and the commit flushes once. Batches nest, the
+ * outermost commit flushes */
+extern void wlInputBegin(struct wlContext *context);
+extern void wlInputCommit(struct wlContext *context);
+
+/* the connection backed up, queue input from here on */
+extern void wlInputStall(struct wlContext *context);
+/* flush and replay queued input as far as the connection takes it, on
+ * POLLOUT. injection drains too before queueing more */
+extern void wlInputDrain(struct wlContext *context);
+/* copy counters out as 5 u64s: stalls, coalesced, dropped, spilled and
+ * the events queued now */
+extern void wlInputGetStats(struct wlContext *context, uint64_t *out);
 
 /* enable or disable idle inhibition */
 extern void wlIdleInhibit(struct wlContext *context, bool on);
+
+/* take over clipboard handling through data-control, events are reported
+ * through on_event from the clipboard thread. false if the compositor has
+ * no data-control protocol */
+extern bool wlClipboardInit(struct wlContext *context, wlClipboardFunc on_event);
+extern void wlClipboardFree(struct wlContext *context);
+/* own a selection, offering the MIME types in the newline separated list.
+ * the content is fd, a sealed memfd of len bytes the clipboard keeps a dup
+ * of (see memfd.h). fd may be -1 with len -1 to supply it on the first
+ * paste. returns the serial of the selection, 0 on failure */
+extern uint32_t wlClipboardSet(struct wlContext *context, int primary, const char *mimes, int fd, int len);
+/* supply the content of a selection set without it, fd -1 if there is none */
+extern bool wlClipboardFill(struct wlContext *context, uint32_t serial, int fd, int len);
+/* read end of a pipe the current selection arrives on, as text if it has
+ * text and in the first other MIME type it has otherwise. -1 if there is no
+ * selection or nothing it has can be read */
+extern int wlClipboardReceive(struct wlContext *context, int primary);
+/* MIME type of the last wlClipboardReceive of a selection, NULL before */
+extern const char *wlClipboardType(struct wlContext *context, int primary);
+
+/* route input from a native datapath (see datapath.h) into this context */
+struct dpContext;
+extern bool wlDatapathAttach(struct wlContext *context, struct dpContext *dp);
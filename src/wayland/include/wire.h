@@ -0,0 +1,87 @@
+#pragma once
+/* binary wire format shared with src/network/wire.js
+ *
+ * every frame starts with a fixed header, all integers in network order:
+ *
+ *   0  u8   version
+ *   1  u8   opcode
+ *   2  u8   flags
+ *   3  u8   connection id, the receiver's peer slot (0 for none)
+ *   4  u32  sender tag
+ *   8  u32  sequence number
+ *
+ * followed by the opcode-specific fields. Relative quantities are zigzag
+ * LEB128 varints, so a typical mouse delta costs two bytes.
+ *
+ * On the network the header stays in the clear as additional data and the
+ * fields are sealed behind it (see aead.h): header | tag | ciphertext. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ssp.h"
+
+#define WIRE_VERSION 3
+#define WIRE_HEADER_LEN 12
+
+/* frame flags */
+/* reliable lane (src/network/reliable.js): the sealed fields are preceded by
+ * a u32 lane sequence number and the frame is applied in lane order by JS */
+#define WIRE_FLAG_RELIABLE 0x01
+
+enum wireOp {
+	/* control messages, handled in JS */
+	WIRE_OP_EXT = 0x00,
+	WIRE_OP_AUTH = 0x01,
+	WIRE_OP_KILL = 0x02,
+	WIRE_OP_PING = 0x03,
+	WIRE_OP_PONG = 0x04,
+	WIRE_OP_HELLO = 0x05,
+	WIRE_OP_CLIPBOARD = 0x06,
+	WIRE_OP_HANDSHAKE_INIT = 0x07,
+	WIRE_OP_HANDSHAKE_RESP = 0x08,
+	WIRE_OP_ACK = 0x09,
+	WIRE_OP_INPUT_STATE = 0x0a,
+	WIRE_OP_BULK = 0x0b,
+	WIRE_OP_BULK_ACK = 0x0c,
+	WIRE_OP_CLIPBOARD_OFFER = 0x0d,
+	WIRE_OP_CLIPBOARD_FETCH = 0x0e,
+	WIRE_OP_CLIPBOARD_DATA = 0x0f,
+	/* input events, up to WIRE_OP_INPUT_END */
+	WIRE_OP_INPUT = 0x10,
+	WIRE_OP_MOUSE_MOVE = 0x10,
+	WIRE_OP_MOUSE_ABS = 0x11,
+	WIRE_OP_MOUSE_BUTTON = 0x12,
+	WIRE_OP_MOUSE_WHEEL = 0x13,
+	WIRE_OP_KEY = 0x14,
+	WIRE_OP_KEY_RAW = 0x15,
+	WIRE_OP_KEY_RELEASE_ALL = 0x16,
+	WIRE_OP_IDLE_INHIBIT = 0x17,
+	/* a control message, numbered after the input events */
+	WIRE_OP_CLIPBOARD_DELTA = 0x18,
+};
+
+/* input events are WIRE_OP_INPUT up to, not including, this. kept out of
+ * the enum so ops added after the input events do not move it */
+#define WIRE_OP_INPUT_END 0x18
+
+struct wireHeader {
+	uint8_t version;
+	uint8_t op;
+	uint8_t flags;
+	uint8_t conn;
+	uint32_t sender;
+	uint32_t seq;
+};
+
+/* a decoded input event -- the meaning of arg depends on op, in the order the
+ * fields appear on the wire (dx/dy, x/y, button/pressed, keycode/modifiers/pressed) */
+struct wireEvent {
+	uint8_t op;
+	int32_t arg[3];
+};
+
+extern bool wireHeaderDecode(struct sspBuf *buf, struct wireHeader *hdr);
+extern bool wireEventDecode(struct sspBuf *buf, uint8_t op, struct wireEvent *ev);
+/* decode a whole plaintext frame, storing the event args in out[3].
+ * returns the opcode or -1 if the frame is malformed */
+extern int wireDecode(const unsigned char *data, size_t len, int32_t *out);
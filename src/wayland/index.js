@@ -1,9 +1,15 @@
-import { cc } from 'bun:ffi';
+import { JSCallback } from 'bun:ffi';
+import { createReadStream } from 'node:fs';
+import { capabilities } from '../capabilities.js';
 import { DisplayServer } from '../display.js';
+import { ClipboardBody, NativeSelections, TEXT_MIME, withMemfd } from '../network/clipboard.js';
+import { DATAPATH_SYMBOLS, Datapath } from '../network/datapath.js';
+import { nativeLibrary } from '../native.js';
+import { TRACE_SYMBOLS, trace } from '../trace.js';
 
 const DEBUG = process.env.DEBUG ? { __DEBUG__: '1' } : {};
 
-const { symbols } = cc({
+const library = nativeLibrary('wayland', {
   source: [
     './src/wayland/wl_idle.c',
     './src/wayland/wl_idle_gnome.c',
@@ -13,7 +19,16 @@ const { symbols } = cc({
     './src/wayland/wl_input_wlr.c',
     './src/wayland/wl_input_kde.c',
     './src/wayland/wl_input_uinput.c',
+    './src/wayland/wl_clipboard.c',
+    './src/wayland/memfd.c',
     './src/wayland/os.c',
+    './src/wayland/ssp.c',
+    './src/wayland/wire.c',
+    './src/wayland/aead.c',
+    './src/wayland/udp.c',
+    './src/wayland/datapath.c',
+    './src/wayland/trace.c',
+    './src/wayland/wl_datapath.c',
     './src/wayland/wayland.c',
     './src/wayland/protocol/generated/idle-protocol.c',
     './src/wayland/protocol/generated/ext-idle-notify-v1-protocol.c',
@@ -23,27 +38,27 @@ const { symbols } = cc({
     './src/wayland/protocol/generated/wlr-virtual-pointer-unstable-v1-protocol.c',
     './src/wayland/protocol/generated/xdg-output-unstable-v1-protocol.c',
     './src/wayland/protocol/generated/xdg-shell-protocol.c',
+    './src/wayland/protocol/generated/wlr-data-control-unstable-v1-protocol.c',
+    './src/wayland/protocol/generated/ext-data-control-v1-protocol.c',
   ],
   include: [
     'src/wayland/include',
     'src/wayland/protocol/generated',
   ],
-  system_include: [
-    '/usr/include',
-    '/usr/include/x86_64-linux-gnu',
-    '/usr/local/include',
-    '/usr/lib/x86_64-linux-gnu/glib-2.0/include',
-    '/usr/include/glib-2.0',
-    '/usr/lib/gcc/x86_64-linux-gnu/13/include',
-  ],
   define: {
     ...DEBUG,
     __USE_GNU: '1',
     _GNU_SOURCE: '1',
   },
   cflags: ['-std=gnu2x'],
-  library: ['wayland-client', 'xkbcommon', 'wlroots-0.18'],
+  library: ['wayland-client', 'xkbcommon', 'wlroots-0.18', 'crypto'],
   symbols: {
+    ...DATAPATH_SYMBOLS,
+    ...TRACE_SYMBOLS,
+    wlDatapathAttach: {
+      args: ['ptr', 'ptr'],
+      returns: 'bool',
+    },
     wlContextNew: {
       args: [],
       returns: 'ptr',
@@ -60,10 +75,30 @@ const { symbols } = cc({
       args: ['ptr'],
       returns: 'void',
     },
+    wlBackends: {
+      args: ['ptr'],
+      returns: 'cstring',
+    },
+    wlCompositorName: {
+      args: ['ptr'],
+      returns: 'cstring',
+    },
+    wlCompositorPid: {
+      args: ['ptr'],
+      returns: 'i32',
+    },
+    wlGetLayout: {
+      args: ['ptr', 'ptr'],
+      returns: 'void',
+    },
     wlPrepareFd: {
       args: ['ptr'],
       returns: 'i32',
     },
+    wlPollProc: {
+      args: ['ptr', 'i16'],
+      returns: 'void',
+    },
     wlDisplayFlush: {
       args: ['ptr'],
       returns: 'void',
@@ -96,10 +131,46 @@ const { symbols } = cc({
       args: ['ptr'],
       returns: 'void',
     },
+    wlInputSync: {
+      args: ['ptr', 'ptr', 'i32', 'ptr', 'i32', 'u32', 'u32'],
+      returns: 'void',
+    },
+    wlInputBegin: {
+      args: ['ptr'],
+      returns: 'void',
+    },
+    wlInputCommit: {
+      args: ['ptr'],
+      returns: 'void',
+    },
+    wlInputGetStats: {
+      args: ['ptr', 'ptr'],
+      returns: 'void',
+    },
     wlIdleInhibit: {
       args: ['ptr', 'bool'],
       returns: 'void',
     },
+    wlClipboardInit: {
+      args: ['ptr', 'function'],
+      returns: 'bool',
+    },
+    wlClipboardSet: {
+      args: ['ptr', 'i32', 'ptr', 'i32', 'i32'],
+      returns: 'u32',
+    },
+    wlClipboardFill: {
+      args: ['ptr', 'u32', 'i32', 'i32'],
+      returns: 'bool',
+    },
+    wlClipboardReceive: {
+      args: ['ptr', 'i32'],
+      returns: 'i32',
+    },
+    wlClipboardType: {
+      args: ['ptr', 'i32'],
+      returns: 'cstring',
+    },
     osSetEnv: {
       args: ['ptr', 'ptr'],
       returns: 'i32',
@@ -111,9 +182,23 @@ const { symbols } = cc({
   },
 });
 
+let symbols = null;
+
+// built or loaded with the first context, importing costs nothing
+function load() {
+  if (symbols) return;
+  symbols = library.symbols;
+  // this unit has its own copy of the ring pointer
+  trace.attach(symbols);
+}
+
+// an empty array cannot be passed as a pointer, the length says it is empty
+const nonEmpty = (bits) => (bits.length ? bits : new Uint8Array(1));
+
 export class Wayland extends DisplayServer {
   constructor() {
     super();
+    load();
     this.initialized = true;
     this.contextNew();
   }
@@ -121,7 +206,7 @@ export class Wayland extends DisplayServer {
   contextNew() {
     this.ptr = symbols.wlContextNew();
     if (this.ptr === 0) throw new Error('Failed to create wayland context');
-    this.compositor = detectCompositor();
+    this.compositor = capabilities.current.compositor.family;
     this.width = 0;
     this.height = 0;
   }
@@ -130,23 +215,50 @@ export class Wayland extends DisplayServer {
     symbols.wlContextFree(this.ptr);
   }
   
-  setup( width, height, backend = null) {
-    const result = symbols.wlSetup(this.ptr, width, height, null);
+  // backend as wlBackends puts it, what the last setup in this session
+  // settled on by default. width and height only count where the
+  // compositor reports no outputs, the screen is their layout
+  setup(width = 0, height = 0, backend = null) {
+    const hint = typeof backend === 'string' ? backend : capabilities.current.backends.wayland;
+    const result = symbols.wlSetup(this.ptr, width, height, hint ? Buffer.from(`${hint}\0`) : null);
     if (result) {
-      this.width = width;
-      this.height = height;
+      ({ width: this.width, height: this.height } = this.layout());
+      this.ready = true;
+      const pid = symbols.wlCompositorPid(this.ptr);
+      capabilities.update({
+        compositor: { name: String(symbols.wlCompositorName(this.ptr) ?? ''), pid: pid > 0 ? pid : null },
+        backends: { wayland: String(symbols.wlBackends(this.ptr)) },
+      });
     }
     return result;
   }
   
+  // bounding box of the outputs, kept up to date as they come and go
+  layout() {
+    const out = new Int32Array(4);
+    symbols.wlGetLayout(this.ptr, out);
+    const [x, y, width, height] = out;
+    return { x, y, width, height };
+  }
+
   close() {
     symbols.wlClose(this.ptr);
+    this.clipboardCallback?.close();
+    this.clipboardCallback = null;
+    this.nativeClipboard = undefined;
     return true;
   }
   
+  // events are dispatched by a thread of the library once set up, before
+  // that (or without the thread) the fd's poll() revents go to pollProc
   prepareFd() {
     return symbols.wlPrepareFd(this.ptr);
   }
+
+  pollProc(revents) {
+    symbols.wlPollProc(this.ptr, revents);
+    return true;
+  }
   
   displayFlush() {
     symbols.wlDisplayFlush(this.ptr);
@@ -187,28 +299,77 @@ export class Wayland extends DisplayServer {
     symbols.wlKeyReleaseAll(this.ptr);
     return true;
   }
+
+  inputSync(keys, raw, buttons, modifiers) {
+    symbols.wlInputSync(this.ptr, nonEmpty(keys), keys.length, nonEmpty(raw), raw.length, buttons, modifiers);
+    return true;
+  }
+  
+  inputBegin() {
+    symbols.wlInputBegin(this.ptr);
+    return true;
+  }
+
+  inputCommit() {
+    symbols.wlInputCommit(this.ptr);
+    return true;
+  }
+
+  // how often the compositor stopped reading and what happened to the input
+  // queued meanwhile, see wlDisplayFlush
+  inputStats() {
+    const out = new BigUint64Array(5);
+    symbols.wlInputGetStats(this.ptr, out);
+    const [stalls, coalesced, dropped, spilled, queued] = Array.from(out, Number);
+    return { stalls, coalesced, dropped, spilled, queued };
+  }
   
   idleInhibit(inhibit) {
     symbols.wlIdleInhibit(this.ptr, inhibit);
     return true;
   }
   
+  // data-control where the compositor has it, wl-clipboard otherwise
   haveClipboard() {
-    try {
-      return Bun.spawnSync(['wl-paste', '-v']).exitCode === 0 && 
-             Bun.spawnSync(['wl-copy', '-v']).exitCode === 0;
-    } catch (error) {
-      console.error('Error checking wl-clipboard:', error);
+    if (this.nativeClipboard ?? this.clipboardInit()) return true;
+    return capabilities.has('wl-copy') && capabilities.has('wl-paste');
+  }
+
+  clipboardInit() {
+    const selections = new NativeSelections((serial, data) =>
+      data
+        ? withMemfd(data, (fd, length) => symbols.wlClipboardFill(this.ptr, serial, fd, length))
+        : symbols.wlClipboardFill(this.ptr, serial, -1, -1),
+    );
+    const callback = new JSCallback(selections.onEvent, {
+      args: ['i32', 'i32', 'u32'],
+      returns: 'void',
+      threadsafe: true,
+    });
+    // not before setup, the context needs a display and a seat
+    if (!symbols.wlClipboardInit(this.ptr, callback)) {
+      callback.close();
+      if (this.ready) this.nativeClipboard = false;
       return false;
     }
+    this.clipboardCallback = callback;
+    this.selections = selections;
+    this.nativeClipboard = true;
+    return true;
   }
-  
-  clipboardCopy(isPrimary, data, length) {
+
+  clipboardCopy(isPrimary, data, length, mimes = [data.mime ?? TEXT_MIME]) {
+    const content = data instanceof ClipboardBody ? data : data.subarray(0, length);
+    if (this.nativeClipboard) {
+      const list = Buffer.from(`${mimes.join('\n')}\0`);
+      return withMemfd(content, (fd, size) => symbols.wlClipboardSet(this.ptr, isPrimary ? 1 : 0, list, fd, size) !== 0);
+    }
     try {
       const args = ['wl-copy', '-f'];
       if (isPrimary === 1) args.push('--primary');
+      if (mimes[0] !== TEXT_MIME) args.push('--type', mimes[0]);
       const proc = Bun.spawn({ cmd: args, stdin: 'pipe' });
-      proc.stdin.write(data.slice(0, length));
+      proc.stdin.write(content instanceof ClipboardBody ? content.read() : content);
       proc.stdin.end();
       return true;
     } catch (error) {
@@ -217,6 +378,46 @@ export class Wayland extends DisplayServer {
     }
   }
 
+  // the compositor asks for the content when something pastes, only then
+  // is it fetched
+  clipboardOffer(isPrimary, mimes, fetch) {
+    if (!this.nativeClipboard) return super.clipboardOffer(isPrimary, mimes, fetch);
+    const primary = isPrimary ? 1 : 0;
+    const serial = symbols.wlClipboardSet(this.ptr, primary, Buffer.from(`${mimes.join('\n')}\0`), -1, -1);
+    if (!serial) return false;
+    this.selections.offer(primary, serial, fetch);
+    return true;
+  }
+
+  clipboardWatch(isPrimary, onChange) {
+    if (this.nativeClipboard) return this.selections.watch(isPrimary ? 1 : 0, onChange);
+    // wl-paste runs echo for every selection change, one line each
+    const args = ['wl-paste', '--watch', 'echo'];
+    if (isPrimary) args.splice(1, 0, '--primary');
+    const proc = Bun.spawn({ cmd: args, stdout: 'pipe', stderr: 'ignore' });
+    (async () => {
+      for await (const chunk of proc.stdout) {
+        for (const byte of chunk) if (byte === 0x0a) onChange();
+      }
+    })().catch(() => {});
+    return () => proc.kill();
+  }
+
+  clipboardStream(isPrimary) {
+    if (this.nativeClipboard) {
+      const fd = symbols.wlClipboardReceive(this.ptr, isPrimary ? 1 : 0);
+      return fd < 0 ? [] : createReadStream(null, { fd });
+    }
+    const args = ['wl-paste', '--no-newline', '--type', 'text'];
+    if (isPrimary) args.push('--primary');
+    return Bun.spawn({ cmd: args, stdout: 'pipe', stderr: 'ignore' }).stdout;
+  }
+
+  clipboardType(isPrimary) {
+    if (!this.nativeClipboard) return TEXT_MIME;
+    return String(symbols.wlClipboardType(this.ptr, isPrimary ? 1 : 0) ?? '') || TEXT_MIME;
+  }
+
   clipboardPaste(isPrimary) {
     const args = ['wl-paste'];
     if (isPrimary === 1) args.push('--primary');
@@ -224,6 +425,10 @@ export class Wayland extends DisplayServer {
     return proc.stdout.toString();
   }
 
+  datapath(port) {
+    return new Datapath(symbols, port, (dp) => symbols.wlDatapathAttach(this.ptr, dp));
+  }
+
   setEnv(key, value) {
     symbols.osSetEnv(Buffer.from(`${key}\0`), Buffer.from(`${value}\0`));
   }
@@ -233,18 +438,4 @@ export class Wayland extends DisplayServer {
   }
 }
 
-function detectCompositor() {
-  const { XDG_CURRENT_DESKTOP } = process.env;
-  if (!XDG_CURRENT_DESKTOP) return 'unknown';
-  
-  const desktop = XDG_CURRENT_DESKTOP.toLowerCase();
-  if (desktop.includes('kde')) return 'kde';
-  if (desktop.includes('gnome')) return 'gnome';
-  if (desktop.includes('sway') || 
-      desktop.includes('hyprland') || 
-      desktop.includes('wlroots')) return 'wlroots';
-  
-  return 'unknown';
-}
-
 DisplayServer.Wayland = Wayland;
\ No newline at end of file
@@ -0,0 +1,88 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#include "memfd.h"
+
+#ifdef __FreeBSD__
+#include <sys/param.h>
+#endif
+
+/* bytes moved per write where sendfile cannot be had */
+#define MEMFD_CHUNK 16384
+
+int memfdCreate(void)
+{
+	FILE *f;
+	int fd;
+
+	#if defined(__linux__) || ((defined(__FreeBSD__) && (__FreeBSD_version >= 1300048)))
+	fd = memfd_create("bzz-clipboard", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd != -1)
+		return fd;
+	#endif
+	/* unsealed, but still out of the heap */
+	if (!(f = tmpfile()))
+		return -1;
+	fd = fcntl(fileno(f), F_DUPFD_CLOEXEC, 0);
+	fclose(f);
+	return fd;
+}
+
+int memfdSeal(int fd)
+{
+	#ifdef F_ADD_SEALS
+	return fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+	#else
+	return -1;
+	#endif
+}
+
+int memfdFrom(const unsigned char *data, size_t len)
+{
+	size_t off = 0;
+	ssize_t n;
+	int fd;
+
+	if ((fd = memfdCreate()) == -1)
+		return -1;
+	while (off < len) {
+		n = write(fd, data + off, len - off);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			close(fd);
+			return -1;
+		}
+		off += n;
+	}
+	memfdSeal(fd);
+	return fd;
+}
+
+ssize_t memfdSend(int out, int fd, off_t *off, size_t len)
+{
+	unsigned char buf[MEMFD_CHUNK];
+	ssize_t n, written;
+
+	#ifdef __linux__
+	/* page cache to pipe or socket without a copy through user space */
+	n = sendfile(out, fd, off, len);
+	if (n != -1 || (errno != EINVAL && errno != ENOSYS))
+		return n;
+	#endif
+	if (len > sizeof(buf))
+		len = sizeof(buf);
+	if ((n = pread(fd, buf, len, *off)) <= 0)
+		return n;
+	if ((written = write(out, buf, n)) > 0)
+		*off += written;
+	return written;
+}
@@ -127,6 +127,18 @@ void osDropPriv(void)
 
 
 #ifdef __linux__
+pid_t osGetPeerPid(int fd)
+{
+	struct ucred uc;
+	socklen_t len = sizeof(uc);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &uc, &len) == -1) {
+		LOG(stderr, "GetPeerPid: getsockopt() failure");
+		return -1;
+	}
+	return uc.pid;
+}
+
 char *osGetPeerProcName(int fd)
 {
 	struct ucred uc;
@@ -166,6 +178,18 @@ done:
 #include <sys/user.h>
 #include <sys/ucred.h>
 #include <sys/sysctl.h>
+pid_t osGetPeerPid(int fd)
+{
+	struct xucred cred = {0};
+	socklen_t len = sizeof(cred);
+
+	if (getsockopt(fd, SOL_LOCAL, LOCAL_PEERCRED, &cred, &len) == -1) {
+		LOG(stderr, "GetPeerPid: getsockopt() failure");
+		return -1;
+	}
+	return cred.cr_pid;
+}
+
 char *osGetPeerProcName(int fd)
 {
 	char *name = NULL;
@@ -207,6 +231,12 @@ done:
 	return name;
 }
 #else
+pid_t osGetPeerPid(int fd)
+{
+	LOG(stderr, "osGetPeerPid not implemented for this platform");
+	return -1;
+}
+
 char *osGetPeerProcName(int fd)
 {
 	LOG(stderr, "osGetPeerProcName not implemented for this platform");
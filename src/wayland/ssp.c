@@ -0,0 +1,81 @@
+#include <string.h>
+#include "ssp.h"
+
+bool sspSeek(struct sspBuf *buf, size_t len)
+{
+	if (buf->len - buf->pos < len)
+		return false;
+	buf->pos += len;
+	return true;
+}
+
+/* read a big-endian integer of 1, 2, 4 or 8 bytes into host order */
+bool sspNetInt(struct sspBuf *buf, void *res, size_t len)
+{
+	uint64_t v = 0;
+	size_t i;
+
+	if (buf->len - buf->pos < len)
+		return false;
+	for (i = 0; i < len; ++i) {
+		v = (v << 8) | buf->data[buf->pos + i];
+	}
+	switch (len) {
+		case 1:
+			*(uint8_t *)res = v;
+			break;
+		case 2:
+			*(uint16_t *)res = v;
+			break;
+		case 4:
+			*(uint32_t *)res = v;
+			break;
+		case 8:
+			*(uint64_t *)res = v;
+			break;
+		default:
+			return false;
+	}
+	buf->pos += len;
+	return true;
+}
+
+bool sspMemMove(void *dest, struct sspBuf *buf, size_t len)
+{
+	if (buf->len - buf->pos < len)
+		return false;
+	memmove(dest, buf->data + buf->pos, len);
+	buf->pos += len;
+	return true;
+}
+
+bool sspVarU32(struct sspBuf *buf, uint32_t *res)
+{
+	uint32_t v = 0;
+	unsigned shift;
+	unsigned char c;
+
+	for (shift = 0; shift < 35; shift += 7) {
+		if (buf->pos >= buf->len)
+			return false;
+		c = buf->data[buf->pos++];
+		v |= (uint32_t)(c & 0x7f) << shift;
+		if (!(c & 0x80)) {
+			*res = v;
+			return true;
+		}
+	}
+	/* more than 5 bytes can't be a 32 bit value */
+	return false;
+}
+
+bool sspVar32(struct sspBuf *buf, int32_t *res)
+{
+	uint32_t v;
+
+	if (!sspVarU32(buf, &v))
+		return false;
+	/* zigzag */
+	*res = (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+	return true;
+}
@@ -0,0 +1,83 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "trace.h"
+
+struct traceRing *traceRing;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static size_t ring_size(uint32_t capacity)
+{
+	return sizeof(struct traceRing) + (size_t)capacity * sizeof(struct traceRecord);
+}
+
+struct traceRing *traceOpen(const char *path, uint32_t capacity)
+{
+	struct traceRing *ring;
+	size_t size;
+	int fd;
+
+	/* the record index is masked, round up to a power of two */
+	if (capacity < 2)
+		capacity = 2;
+	if (capacity & (capacity - 1))
+		capacity = 1U << (32 - __builtin_clz(capacity));
+	size = ring_size(capacity);
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) == -1)
+		return NULL;
+	if (ftruncate(fd, size) == -1) {
+		close(fd);
+		return NULL;
+	}
+	ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring == MAP_FAILED)
+		return NULL;
+
+	ring->version = TRACE_VERSION;
+	ring->capacity = capacity;
+	ring->record_size = sizeof(struct traceRecord);
+	ring->start = now_ns();
+	ring->pid = getpid();
+	__atomic_store_n(&ring->magic, TRACE_MAGIC, __ATOMIC_RELEASE);
+	return ring;
+}
+
+void traceClose(struct traceRing *ring)
+{
+	if (ring)
+		munmap(ring, ring_size(ring->capacity));
+}
+
+void traceAttach(struct traceRing *ring)
+{
+	traceRing = ring;
+}
+
+void traceEmit(struct traceRing *ring, int source, int event, int32_t a0, int32_t a1, int32_t a2, int32_t a3)
+{
+	uint64_t i = __atomic_fetch_add(&ring->head, 1, __ATOMIC_RELAXED);
+	struct traceRecord *rec = &ring->rec[i & (ring->capacity - 1)];
+
+	/* invalidate first so a reader never pairs old fields with a new stamp */
+	__atomic_store_n(&rec->stamp, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	rec->ts = now_ns();
+	rec->event = event;
+	rec->source = source;
+	rec->arg[0] = a0;
+	rec->arg[1] = a1;
+	rec->arg[2] = a2;
+	rec->arg[3] = a3;
+	__atomic_store_n(&rec->stamp, (uint32_t)(i + 1), __ATOMIC_RELEASE);
+}
@@ -0,0 +1,339 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "xmem.h"
+#include "udp.h"
+
+struct udpRx {
+	struct udpSlab *slab;
+	struct mmsghdr hdr[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	struct sockaddr_storage from[UDP_BATCH];
+};
+
+int udpBind(int port)
+{
+	struct sockaddr_in6 addr = {0};
+	int fd, off = 0, rcvbuf = UDP_RCVBUF;
+
+	if ((fd = socket(AF_INET6, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) == -1) {
+		LOG(stderr, "udp: socket() failed: %s\n", strerror(errno));
+		return -1;
+	}
+	setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+	/* room for a burst while the receiver is busy dispatching a batch */
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr = in6addr_any;
+	addr.sin6_port = htons(port);
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+		LOG(stderr, "udp: bind() to port %d failed: %s\n", port, strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool udpAddrParse(const char *addr, int port, struct sockaddr_in6 *out)
+{
+	struct in_addr in4;
+
+	memset(out, 0, sizeof(*out));
+	out->sin6_family = AF_INET6;
+	out->sin6_port = htons(port);
+	/* the socket is AF_INET6, so IPv4 destinations need mapping */
+	if (inet_pton(AF_INET, addr, &in4) == 1) {
+		out->sin6_addr.s6_addr[10] = 0xff;
+		out->sin6_addr.s6_addr[11] = 0xff;
+		memcpy(&out->sin6_addr.s6_addr[12], &in4, 4);
+		return true;
+	}
+	return inet_pton(AF_INET6, addr, &out->sin6_addr) == 1;
+}
+
+void udpAddrFormat(const struct sockaddr_storage *from, char *addr, int32_t *port)
+{
+	const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)from;
+	const struct sockaddr_in *in4 = (const struct sockaddr_in *)from;
+
+	if (from->ss_family == AF_INET) {
+		inet_ntop(AF_INET, &in4->sin_addr, addr, UDP_ADDR_LEN);
+		*port = ntohs(in4->sin_port);
+		return;
+	}
+	/* dual-stack sockets report IPv4 peers as ::ffff:a.b.c.d */
+	if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr))
+		inet_ntop(AF_INET, &in6->sin6_addr.s6_addr[12], addr, UDP_ADDR_LEN);
+	else
+		inet_ntop(AF_INET6, &in6->sin6_addr, addr, UDP_ADDR_LEN);
+	*port = ntohs(in6->sin6_port);
+}
+
+struct udpRx *udpRxNew(struct udpSlab *slab)
+{
+	struct udpRx *rx = xcalloc(1, sizeof(*rx));
+	int i;
+
+	rx->slab = slab;
+	for (i = 0; i < UDP_BATCH; ++i) {
+		rx->iov[i].iov_base = slab->data[i];
+		rx->iov[i].iov_len = UDP_SLOT;
+		rx->hdr[i].msg_hdr.msg_name = &rx->from[i];
+		rx->hdr[i].msg_hdr.msg_iov = &rx->iov[i];
+		rx->hdr[i].msg_hdr.msg_iovlen = 1;
+	}
+	return rx;
+}
+
+void udpRxFree(struct udpRx *rx)
+{
+	free(rx);
+}
+
+const struct sockaddr_storage *udpRxFrom(struct udpRx *rx, int i)
+{
+	return &rx->from[i];
+}
+
+int udpRecvBatch(int fd, struct udpRx *rx, bool format, struct udpStats *stats)
+{
+	struct udpMsg *msg;
+	int i, n;
+
+	/* recvmmsg overwrites these with what it received */
+	for (i = 0; i < UDP_BATCH; ++i)
+		rx->hdr[i].msg_hdr.msg_namelen = sizeof(rx->from[i]);
+	n = recvmmsg(fd, rx->hdr, UDP_BATCH, MSG_DONTWAIT, NULL);
+	stats->recv_calls++;
+	if (n <= 0)
+		return 0;
+	stats->received += n;
+	for (i = 0; i < n; ++i) {
+		msg = &rx->slab->msg[i];
+		if (rx->hdr[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			msg->len = -1;
+			stats->truncated++;
+		} else {
+			msg->len = rx->hdr[i].msg_len;
+		}
+		if (format)
+			udpAddrFormat(&rx->from[i], msg->addr, &msg->port);
+	}
+	return n;
+}
+
+int udpSendBatch(int fd, const unsigned char *data, const int32_t *lens, const struct sockaddr_in6 *to,
+		int count, struct udpStats *stats)
+{
+	struct mmsghdr hdr[UDP_BATCH];
+	struct iovec iov[UDP_BATCH];
+	const unsigned char *p;
+	int i, n, chunk, done = 0, sent = 0;
+
+	while (done < count) {
+		chunk = count - done < UDP_BATCH ? count - done : UDP_BATCH;
+		p = data;
+		for (i = 0; i < chunk; ++i) {
+			iov[i].iov_base = (void *)p;
+			iov[i].iov_len = lens[done + i];
+			memset(&hdr[i], 0, sizeof(hdr[i]));
+			hdr[i].msg_hdr.msg_name = (void *)&to[done + i];
+			hdr[i].msg_hdr.msg_namelen = sizeof(*to);
+			hdr[i].msg_hdr.msg_iov = &iov[i];
+			hdr[i].msg_hdr.msg_iovlen = 1;
+			p += lens[done + i];
+		}
+		n = sendmmsg(fd, hdr, chunk, 0);
+		stats->send_calls++;
+		/* the first datagram failed, skip it so one bad peer does not
+		 * hold back the rest */
+		if (n <= 0) {
+			LOG(stderr, "udp: sendmmsg() failed: %s\n", strerror(errno));
+			n = 1;
+		} else {
+			sent += n;
+		}
+		for (i = 0; i < n; ++i)
+			data += lens[done + i];
+		done += n;
+	}
+	stats->sent += sent;
+	return sent;
+}
+
+static void *udp_thread(void *data)
+{
+	struct udpSocket *sock = data;
+	struct pollfd pfd[2] = {
+		{ .fd = sock->fd, .events = POLLIN },
+		{ .fd = sock->wake[0], .events = POLLIN },
+	};
+	int cur = 0, n;
+
+	LOG(stderr, "udp: receive thread running on port %d\n", udpPort(sock));
+	while (sock->running) {
+		sock->stats.polls++;
+		if (poll(pfd, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			LOG(stderr, "udp: poll() failed: %s\n", strerror(errno));
+			break;
+		}
+		if (pfd[1].revents)
+			break;
+		for (;;) {
+			/* JS may still be dispatching the slab we are about to fill */
+			pthread_mutex_lock(&sock->lock);
+			while (sock->busy[cur] && sock->running)
+				pthread_cond_wait(&sock->released, &sock->lock);
+			pthread_mutex_unlock(&sock->lock);
+			if (!sock->running)
+				break;
+			if (!(n = udpRecvBatch(sock->fd, sock->rx[cur], true, &sock->stats)))
+				break;
+			pthread_mutex_lock(&sock->lock);
+			sock->busy[cur] = true;
+			pthread_mutex_unlock(&sock->lock);
+			sock->stats.batches++;
+			sock->on_batch(cur, n);
+			cur = (cur + 1) % UDP_SLABS;
+			/* a short batch means the socket is drained */
+			if (n < UDP_BATCH)
+				break;
+		}
+	}
+	LOG(stderr, "udp: receive thread exiting\n");
+	return NULL;
+}
+
+struct udpSocket *udpNew(int port)
+{
+	struct udpSocket *sock;
+	int i;
+
+	sock = xcalloc(1, sizeof(*sock));
+	sock->wake[0] = sock->wake[1] = -1;
+	pthread_mutex_init(&sock->lock, NULL);
+	pthread_cond_init(&sock->released, NULL);
+	for (i = 0; i < UDP_SLABS; ++i) {
+		sock->slab[i] = xmalloc(sizeof(*sock->slab[i]));
+		sock->rx[i] = udpRxNew(sock->slab[i]);
+	}
+	if ((sock->fd = udpBind(port)) == -1)
+		goto fail;
+	if (pipe2(sock->wake, O_CLOEXEC | O_NONBLOCK) == -1) {
+		LOG(stderr, "udp: pipe() failed: %s\n", strerror(errno));
+		goto fail;
+	}
+	return sock;
+fail:
+	udpFree(sock);
+	return NULL;
+}
+
+void udpFree(struct udpSocket *sock)
+{
+	int i;
+
+	if (!sock)
+		return;
+	udpStop(sock);
+	if (sock->fd != -1)
+		close(sock->fd);
+	if (sock->wake[0] != -1)
+		close(sock->wake[0]);
+	if (sock->wake[1] != -1)
+		close(sock->wake[1]);
+	for (i = 0; i < UDP_SLABS; ++i) {
+		udpRxFree(sock->rx[i]);
+		free(sock->slab[i]);
+	}
+	pthread_cond_destroy(&sock->released);
+	pthread_mutex_destroy(&sock->lock);
+	free(sock);
+}
+
+int udpPort(struct udpSocket *sock)
+{
+	struct sockaddr_in6 addr;
+	socklen_t len = sizeof(addr);
+
+	if (getsockname(sock->fd, (struct sockaddr *)&addr, &len) == -1)
+		return -1;
+	return ntohs(addr.sin6_port);
+}
+
+struct udpSlab *udpSlab(struct udpSocket *sock, int i)
+{
+	return i >= 0 && i < UDP_SLABS ? sock->slab[i] : NULL;
+}
+
+bool udpStart(struct udpSocket *sock, udpBatchFunc on_batch)
+{
+	if (sock->running)
+		return true;
+	sock->on_batch = on_batch;
+	sock->running = true;
+	if (pthread_create(&sock->thread, NULL, udp_thread, sock)) {
+		sock->running = false;
+		return false;
+	}
+	return true;
+}
+
+void udpStop(struct udpSocket *sock)
+{
+	char c = 0;
+
+	if (!sock->running)
+		return;
+	pthread_mutex_lock(&sock->lock);
+	sock->running = false;
+	pthread_cond_broadcast(&sock->released);
+	pthread_mutex_unlock(&sock->lock);
+	if (write(sock->wake[1], &c, 1) == -1) {
+		LOG(stderr, "udp: could not wake thread\n");
+	}
+	pthread_join(sock->thread, NULL);
+}
+
+void udpRelease(struct udpSocket *sock, int slab)
+{
+	if (slab < 0 || slab >= UDP_SLABS)
+		return;
+	pthread_mutex_lock(&sock->lock);
+	sock->busy[slab] = false;
+	pthread_cond_signal(&sock->released);
+	pthread_mutex_unlock(&sock->lock);
+}
+
+bool udpAddr(struct sockaddr_in6 *out, const char *addr, int port)
+{
+	return udpAddrParse(addr, port, out);
+}
+
+int udpSend(struct udpSocket *sock, const unsigned char *data, const int32_t *lens, const struct sockaddr_in6 *to,
+		int count)
+{
+	return udpSendBatch(sock->fd, data, lens, to, count, &sock->stats);
+}
+
+void udpGetStats(struct udpSocket *sock, uint64_t *out)
+{
+	out[0] = sock->stats.polls;
+	out[1] = sock->stats.recv_calls;
+	out[2] = sock->stats.received;
+	out[3] = sock->stats.truncated;
+	out[4] = sock->stats.batches;
+	out[5] = sock->stats.send_calls;
+	out[6] = sock->stats.sent;
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -9,6 +10,7 @@
 #include <wayland-client-protocol.h>
 #include <sys/mman.h>
 #include <errno.h>
+#include <pthread.h>
 #include "wayland.h"
 #include <stdbool.h>
 
@@ -47,309 +49,264 @@ static void wl_log_handler(const char *fmt, va_list ap)
 	LOG(stderr, "Logged wayland errors set to fatal\n");
 }
 
-static bool wl_display_flush_base(struct wlContext *ctx)
+void wlDisplayFlush(struct wlContext *ctx)
 {
 	int error;
 
 	if ((error = wl_display_get_error(ctx->display))) {
 		LOG(stderr, "Wayland display error %d: %s\n", error, display_strerror(error));
-		return false;
+		return;
 	}
-
-	if (wl_display_flush(ctx->display) == -1) {
-		if (errno == EAGAIN) {
-			return false;
-		} else {
-			if ((error = wl_display_get_error(ctx->display))) {
-				LOG(stderr, "Wayland display error %d: %s\n", error, display_strerror(error));
-			} else {
-				LOG(stderr, "No wayland display error, but flush failed\n");
-			}
-			return false;
-		}
+	if (wl_display_flush(ctx->display) != -1)
+		return;
+	/* the compositor is not keeping up, whatever was written stays in the
+	 * libwayland buffer and input waits in the outbound queue */
+	if (errno == EAGAIN) {
+		wlInputStall(ctx);
+		return;
+	}
+	if ((error = wl_display_get_error(ctx->display))) {
+		LOG(stderr, "Wayland display error %d: %s\n", error, display_strerror(error));
+	} else {
+		LOG(stderr, "No wayland display error, but flush failed\n");
 	}
-	return true;
 }
 
-static bool wl_display_flush_block(struct wlContext *ctx)
-{
-	struct pollfd pfd = {0};
-	int pret;
-
-	pfd.fd = wlPrepareFd(ctx);
-	pfd.events = POLLOUT;
+/* the output table: outputs in announcement order, each listener gets its
+ * own wlOutput so events find it without a lookup. the layout, the bounding
+ * box of all complete outputs, is recomputed when one is done or removed and
+ * pushed into wlResUpdate, absolute motion maps into it with one offset.
+ * the listeners run on the dispatch thread while injection reads the layout
+ * and the backends' geometry, so they change all of it under the outbound
+ * lock */
 
-	pret = poll(&pfd, 1, ctx->timeout);
+static struct wlOutput *output_add(struct wlContext *ctx, struct wl_output *wl_output, uint32_t wl_name)
+{
+	struct wlOutput *output = xcalloc(1, sizeof(*output));
 
-	if (pret == 1) {
-		if (pfd.revents & POLLOUT) {
-			if (wl_display_flush_base(ctx)) {
-				return true;
-			}
-			LOG(stderr, "blocking display flush failed\n");
-		} else {
-			LOG(stderr, "blocking display flush socket unwritable\n");
-		}
-	} else if (pret == 0) {
-		LOG(stderr, "blocking display flush timed out\n");
-	} else if (pret == -1)  {
-		LOG(stderr, "blocking display poll failed\n");
+	output->wl_ctx = ctx;
+	output->wl_output = wl_output;
+	output->wl_name = wl_name;
+	output->scale = 1;
+	if (ctx->output_count == ctx->output_cap) {
+		ctx->output_cap = ctx->output_cap ? ctx->output_cap * 2 : 4;
+		ctx->outputs = xreallocarray(ctx->outputs, ctx->output_cap, sizeof(*ctx->outputs));
 	}
-
-	return false;
+	output->index = ctx->output_count;
+	ctx->outputs[ctx->output_count++] = output;
+	return output;
 }
 
-void wlDisplayFlush(struct wlContext *ctx)
+static struct wlOutput *output_by_name(struct wlContext *ctx, uint32_t wl_name)
 {
-	if (wl_display_flush_base(ctx)) return;
-	if (wl_display_flush_block(ctx)) return;
-	LOG(stderr, "Display flush failed\n");
-}
+	int i;
 
-void wlOutputAppend(struct wlOutput **outputs, struct wl_output *output, struct zxdg_output_v1 *xdg_output, uint32_t wl_name)
-{
-	struct wlOutput *l;
-	struct wlOutput *n = xmalloc(sizeof(*n));
-	memset(n, 0, sizeof(*n));
-	n->wl_output = output;
-	n->xdg_output = xdg_output;
-	n->wl_name = wl_name;
-	if (!*outputs) {
-		*outputs = n;
-	} else {
-		for (l = *outputs; l->next; l = l->next);
-		l->next = n;
+	for (i = 0; i < ctx->output_count; ++i) {
+		if (ctx->outputs[i]->wl_name == wl_name)
+			return ctx->outputs[i];
 	}
+	return NULL;
 }
 
-struct wlOutput *wlOutputGet(struct wlOutput *outputs, struct wl_output *wl_output)
+/* the last output takes the slot of the removed one */
+static void output_remove(struct wlContext *ctx, struct wlOutput *output)
 {
-	struct wlOutput *l = NULL;
-	for (l = outputs; l; l = l->next) {
-		if (l->wl_output == wl_output) {
-			break;
-		}
-	}
-	return l;
-}
+	struct wlOutput *last = ctx->outputs[--ctx->output_count];
 
-struct wlOutput *wlOutputGetXdg(struct wlOutput *outputs, struct zxdg_output_v1 *xdg_output)
-{
-	struct wlOutput *l = NULL;
-	for (l = outputs; l; l = l->next) {
-		if (l->xdg_output == xdg_output)
-			break;
-	}
-	return l;
+	last->index = output->index;
+	ctx->outputs[output->index] = last;
+	free(output->name);
+	free(output->desc);
+	if (output->xdg_output)
+		zxdg_output_v1_destroy(output->xdg_output);
+	if (output->wl_output)
+		wl_output_destroy(output->wl_output);
+	free(output);
 }
 
-struct wlOutput *wlOutputGetWlName(struct wlOutput *outputs, uint32_t wl_name)
+static const struct zxdg_output_v1_listener xdg_output_listener;
+
+static void output_watch_xdg(struct wlContext *ctx, struct wlOutput *output)
 {
-	struct wlOutput *l = NULL;
-	for (l = outputs; l; l = l->next) {
-		if (l->wl_name == wl_name)
-			break;
-	}
-	return l;
+	output->xdg_output = zxdg_output_manager_v1_get_xdg_output(ctx->output_manager, output->wl_output);
+	zxdg_output_v1_add_listener(output->xdg_output, &xdg_output_listener, output);
 }
 
-void wlOutputRemove(struct wlOutput **outputs, struct wlOutput *output)
+/* logical size from the mode where xdg-output does not tell it: scaled
+ * down, and turned for the 90 and 270 degree transforms */
+static void output_logical_size(struct wlOutput *output)
 {
-	struct wlOutput *prev = NULL;
-	if (!outputs)
+	int scale = output->scale > 0 ? output->scale : 1;
+
+	if (output->have_log_size)
 		return;
-	if (*outputs != output) {
-		for (prev = *outputs; prev; prev = prev->next) {
-			if (prev->next == output)
-				break;
-		}
-		if (!prev) {
-			LOG(stderr, "Tried to remove unknown output\n");
-			return;
-		}
-		prev->next = prev->next->next;
+	if (output->transform & 1) {
+		output->width = output->mode_height / scale;
+		output->height = output->mode_width / scale;
 	} else {
-		*outputs = NULL;
-	}
-	free(output->name);
-	free(output->desc);
-	if (output->xdg_output) {
-		zxdg_output_v1_destroy(output->xdg_output);
+		output->width = output->mode_width / scale;
+		output->height = output->mode_height / scale;
 	}
-	if (output->wl_output) {
-		wl_output_destroy(output->wl_output);
-	}
-	free(output);
 }
 
-static void output_geometry(void *data, struct wl_output *wl_output, int32_t x, int32_t y, int32_t physical_width, int32_t physical_height, int32_t subpixel, const char *make, const char *model, int32_t transform)
+static void layout_update(struct wlContext *ctx)
 {
-	struct wlContext *ctx = data;
-	struct wlOutput *output = wlOutputGet(ctx->outputs, wl_output);
-	if (!output) {
-		LOG(stderr, "Output not found\n");
+	struct wlOutput *output;
+	int32_t x1 = INT32_MAX, y1 = INT32_MAX, x2 = INT32_MIN, y2 = INT32_MIN;
+	int i;
+
+	for (i = 0; i < ctx->output_count; ++i) {
+		output = ctx->outputs[i];
+		if (!output->complete || output->width <= 0 || output->height <= 0)
+			continue;
+		if (output->x < x1)
+			x1 = output->x;
+		if (output->y < y1)
+			y1 = output->y;
+		if (output->x + output->width > x2)
+			x2 = output->x + output->width;
+		if (output->y + output->height > y2)
+			y2 = output->y + output->height;
+	}
+	/* no outputs known, the size wlSetup was given stays */
+	if (x1 == INT32_MAX)
 		return;
-	}
-	LOG(stderr, "Mutating output...\n");
-	if (output->have_log_pos) {
-		LOG(stderr, "Except not really, because the logical position outweighs this\n");
+	if (x1 == ctx->x && y1 == ctx->y && x2 - x1 == ctx->width && y2 - y1 == ctx->height)
 		return;
-	}
-	output->complete = false;
-	output->x = x;
-	output->y = y;
+	LOG(stderr, "Layout of %d outputs: %dx%d at %d,%d\n", ctx->output_count, x2 - x1, y2 - y1, x1, y1);
+	ctx->x = x1;
+	ctx->y = y1;
+	wlResUpdate(ctx, x2 - x1, y2 - y1);
+	if (ctx->on_output_update)
+		ctx->on_output_update(ctx);
+}
 
-	LOG(stderr, "Got output at position %d,%d\n", x, y);
+static void output_geometry(void *data, struct wl_output *wl_output, int32_t x, int32_t y, int32_t physical_width, int32_t physical_height, int32_t subpixel, const char *make, const char *model, int32_t transform)
+{
+	struct wlOutput *output = data;
+
+	LOG(stderr, "Got output at position %d,%d, transform %d\n", x, y, transform);
+	pthread_mutex_lock(&output->wl_ctx->outbound.lock);
+	output->complete = false;
+	output->transform = transform;
+	/* the logical position outweighs this */
+	if (!output->have_log_pos) {
+		output->x = x;
+		output->y = y;
+	}
+	pthread_mutex_unlock(&output->wl_ctx->outbound.lock);
 }
 
 static void output_mode(void *data, struct wl_output *wl_output, uint32_t flags, int32_t width, int32_t height, int32_t refresh)
 {
-	struct wlContext *ctx = data;
-	struct wlOutput *output = wlOutputGet(ctx->outputs, wl_output);
+	struct wlOutput *output = data;
 	bool preferred = flags & WL_OUTPUT_MODE_PREFERRED;
 	bool current = flags & WL_OUTPUT_MODE_CURRENT;
+
 	LOG(stderr, "Got %smode: %dx%d@%d%s\n", current ? "current " : "", width, height, refresh, preferred ? "*" : "");
-	if (!output) {
-		LOG(stderr, "Output not found in list\n");
+	if (!current)
 		return;
-	}
-	if (current) {
-		if (!preferred) {
-			LOG(stderr, "Not using preferred mode on output -- check config\n");
-		}
-		LOG(stderr, "Mutating output...\n");
-		if (output->have_log_size) {
-			LOG(stderr, "Except not really, because the logical size outweighs this\n");
-			return;
-		}
-		output->complete = false;
-		output->width = width;
-		output->height = height;
-	}
+	if (!preferred)
+		LOG(stderr, "Not using preferred mode on output -- check config\n");
+	pthread_mutex_lock(&output->wl_ctx->outbound.lock);
+	output->complete = false;
+	output->mode_width = width;
+	output->mode_height = height;
+	pthread_mutex_unlock(&output->wl_ctx->outbound.lock);
 }
 
 static void output_scale(void *data, struct wl_output *wl_output, int32_t factor)
 {
-	struct wlContext *ctx = data;
-	struct wlOutput *output = wlOutputGet(ctx->outputs, wl_output);
+	struct wlOutput *output = data;
+
 	LOG(stderr, "Got scale factor for output: %d\n", factor);
-	if (!output) {
-		LOG(stderr, "Output not found in list\n");
-		return;
-	}
-	LOG(stderr, "Mutating output...\n");
+	pthread_mutex_lock(&output->wl_ctx->outbound.lock);
 	output->complete = false;
 	output->scale = factor;
+	pthread_mutex_unlock(&output->wl_ctx->outbound.lock);
 }
 
 static void output_done(void *data, struct wl_output *wl_output)
 {
-	struct wlContext *ctx = data;
-	struct wlOutput *output = wlOutputGet(ctx->outputs, wl_output);
-	if (!output) {
-		LOG(stderr, "Output not found in list\n");
-		return;
-	}
+	struct wlOutput *output = data;
+	struct wlContext *ctx = output->wl_ctx;
+
+	pthread_mutex_lock(&ctx->outbound.lock);
+	output_logical_size(output);
 	output->complete = true;
-	if (output->name) {
-		LOG(stderr, "Output name: %s\n", output->name);
-	}
-	if (output->desc) {
-		LOG(stderr, "Output description: %s\n", output->desc);
-	}
-	LOG(stderr, "Output updated: %dx%d at %d, %d (scale: %d)\n",
+	LOG(stderr, "Output %s updated: %dx%d at %d, %d (scale: %d)\n",
+			output->name ? output->name : "",
 			output->width,
 			output->height,
 			output->x,
 			output->y,
 			output->scale);
-
-	/* fire event if all outputs are complete. */
-	bool complete = true;
-	for (output = ctx->outputs; output; output = output->next) {
-		complete = complete && output->complete;
-	}
-	if (complete) {
-		LOG(stderr, "All outputs updated, triggering event\n");
-		if (ctx->on_output_update)
-			ctx->on_output_update(ctx);
-	}
+	layout_update(ctx);
+	pthread_mutex_unlock(&ctx->outbound.lock);
 }
 
 static void xdg_output_pos(void *data, struct zxdg_output_v1 *xdg_output, int32_t x, int32_t y)
 {
+	struct wlOutput *output = data;
+
 	LOG(stderr, "Got xdg output position: %d, %d\n", x, y);
-	struct wlContext *ctx = data;
-	struct wlOutput *output = wlOutputGetXdg(ctx->outputs, xdg_output);
-	if (!output) {
-		LOG(stderr, "Could not find xdg output\n");
-		return;
-	}
-	LOG(stderr, "Mutating output from xdg_output event\n");
+	pthread_mutex_lock(&output->wl_ctx->outbound.lock);
 	output->complete = false;
 	output->have_log_pos = true;
 	output->x = x;
 	output->y = y;
+	pthread_mutex_unlock(&output->wl_ctx->outbound.lock);
 }
 
 static void xdg_output_size(void *data, struct zxdg_output_v1 *xdg_output, int32_t width, int32_t height)
 {
+	struct wlOutput *output = data;
+
 	LOG(stderr, "Got xdg output size: %dx%d\n", width, height);
-	struct wlContext *ctx = data;
-	struct wlOutput *output = wlOutputGetXdg(ctx->outputs, xdg_output);
-	if (!output) {
-		LOG(stderr, "Could not find xdg output\n");
-		return;
-	}
-	LOG(stderr, "Mutating output from xdg_output event\n");
+	pthread_mutex_lock(&output->wl_ctx->outbound.lock);
 	output->complete = false;
 	output->have_log_size = true;
 	output->width = width;
 	output->height = height;
+	pthread_mutex_unlock(&output->wl_ctx->outbound.lock);
 }
 
 static void xdg_output_name(void *data, struct zxdg_output_v1 *xdg_output, const char *name)
 {
+	struct wlOutput *output = data;
+
 	LOG(stderr, "Got xdg output name: %s\n", name);
-	struct wlContext *ctx = data;
-	struct wlOutput *output = wlOutputGetXdg(ctx->outputs, xdg_output);
-	if (!output) {
-		LOG(stderr, "Could not find xdg output\n");
-		return;
-	}
-	LOG(stderr, "Mutating output from xdg_output event\n");
-	output->complete = false;
-	if (output->name) {
-		free(output->name);
-	}
+	pthread_mutex_lock(&output->wl_ctx->outbound.lock);
+	free(output->name);
 	output->name = xstrdup(name);
+	pthread_mutex_unlock(&output->wl_ctx->outbound.lock);
 }
 
 static void xdg_output_desc(void *data, struct zxdg_output_v1 *xdg_output, const char *desc)
 {
+	struct wlOutput *output = data;
+
 	LOG(stderr, "Got xdg output desc: %s\n", desc);
-	struct wlContext *ctx = data;
-	struct wlOutput *output = wlOutputGetXdg(ctx->outputs, xdg_output);
-	if (!output) {
-		LOG(stderr, "Could not find xdg output\n");
-		return;
-	}
-	LOG(stderr, "Mutating output from xdg_output event\n");
-	output->complete = false;
-	if (output->desc) {
-		free(output->desc);
-	}
+	pthread_mutex_lock(&output->wl_ctx->outbound.lock);
+	free(output->desc);
 	output->desc = xstrdup(desc);
+	pthread_mutex_unlock(&output->wl_ctx->outbound.lock);
 }
 
-static struct zxdg_output_v1_listener xdg_output_listener = {
+/* xdg_output.done is deprecated in version 3, wl_output.done covers it */
+static void xdg_output_done(void *data, struct zxdg_output_v1 *xdg_output)
+{
+}
+
+static const struct zxdg_output_v1_listener xdg_output_listener = {
 	.logical_position = xdg_output_pos,
 	.logical_size = xdg_output_size,
+	.done = xdg_output_done,
 	.name = xdg_output_name,
 	.description = xdg_output_desc,
 };
 
-static struct wl_output_listener output_listener = {
+static const struct wl_output_listener output_listener = {
 	.geometry = output_geometry,
 	.mode = output_mode,
 	.done = output_done,
@@ -372,10 +329,18 @@ static void keyboard_keymap(void *data, struct wl_keyboard *wl_kb, uint32_t form
 
 	buf = xcalloc(size + 1, 1);
 	memcpy(buf, map, size);
+	/* wlKeySetConfigLayout reads it on another thread */
+	pthread_mutex_lock(&ctx->outbound.lock);
+	bool changed = ctx->kb_map && strcmp(ctx->kb_map, buf);
 	free(ctx->kb_map);
 	ctx->kb_map = buf;
 	buf = NULL;
 	LOG(stderr, "Current keymap updated\n");
+	/* wlSetup loads the first keymap once input is set up, one that
+	 * changes after is a layout switch the virtual keyboard follows */
+	if (changed && ctx->input.xkb_map && wlKeySetConfigLayout(ctx))
+		LOG(stderr, "Could not load the new keymap into the virtual keyboard\n");
+	pthread_mutex_unlock(&ctx->outbound.lock);
 	free(buf);
 	munmap(map, size);
 cleanup:
@@ -420,10 +385,12 @@ static void seat_capabilities(void *data, struct wl_seat *wl_seat, uint32_t caps
 	}
 	if (caps & WL_SEAT_CAPABILITY_KEYBOARD) {
 		LOG(stderr, "Seat has keyboard\n");
+		if (ctx->kb)
+			return;
 		ctx->kb = wl_seat_get_keyboard(wl_seat);
 		wl_keyboard_add_listener(ctx->kb, &keyboard_listener, ctx);
-		wl_display_dispatch(ctx->display);
-		wl_display_roundtrip(ctx->display);
+		/* wlSetup waits for the keymap, later the dispatch thread gets it */
+		ctx->setup_more = true;
 	}
 }
 
@@ -441,10 +408,11 @@ static void handle_global(void *data, struct wl_registry *registry, uint32_t nam
 {
 	struct wlContext *ctx = data;
 	struct wl_output *wl_output;
-	struct zxdg_output_v1 *xdg_output;
+	struct wlOutput *output;
 	if (strcmp(interface, wl_seat_interface.name) == 0) {
 		ctx->seat = wl_registry_bind(registry, name, &wl_seat_interface, version);
 		wl_seat_add_listener(ctx->seat, &seat_listener, ctx);
+		ctx->setup_more = true;
 	} else if (strcmp(interface, zwlr_virtual_pointer_manager_v1_interface.name) == 0) {
 		ctx->pointer_manager = wl_registry_bind(registry, name, &zwlr_virtual_pointer_manager_v1_interface, 1);
 	} else if (strcmp(interface, zwp_virtual_keyboard_manager_v1_interface.name) == 0) {
@@ -457,30 +425,36 @@ static void handle_global(void *data, struct wl_registry *registry, uint32_t nam
 			return;
 		}
 		ctx->output_manager = wl_registry_bind(registry, name, &zxdg_output_manager_v1_interface, 3);
-		if (ctx->outputs) {
-			for (struct wlOutput *output = ctx->outputs; output; output = output->next) {
-				if (!output->xdg_output) {
-					output->xdg_output = zxdg_output_manager_v1_get_xdg_output(ctx->output_manager, output->wl_output);
-					zxdg_output_v1_add_listener(output->xdg_output, &xdg_output_listener, ctx);
-				}
+		pthread_mutex_lock(&ctx->outbound.lock);
+		for (int i = 0; i < ctx->output_count; ++i) {
+			if (!ctx->outputs[i]->xdg_output) {
+				output_watch_xdg(ctx, ctx->outputs[i]);
+				ctx->setup_more = true;
 			}
 		}
+		pthread_mutex_unlock(&ctx->outbound.lock);
 	} else if (strcmp(interface, wl_output_interface.name) == 0) {
 		wl_output = wl_registry_bind(registry, name, &wl_output_interface, 2);
-		wl_output_add_listener(wl_output, &output_listener, ctx);
-		if (ctx->output_manager) {
-			xdg_output = zxdg_output_manager_v1_get_xdg_output(ctx->output_manager, wl_output);
-			zxdg_output_v1_add_listener(xdg_output, &xdg_output_listener, ctx);
-		} else {
-			xdg_output = NULL;
-		}
-		wlOutputAppend(&ctx->outputs, wl_output, xdg_output, name);
+		pthread_mutex_lock(&ctx->outbound.lock);
+		output = output_add(ctx, wl_output, name);
+		wl_output_add_listener(wl_output, &output_listener, output);
+		if (ctx->output_manager)
+			output_watch_xdg(ctx, output);
+		pthread_mutex_unlock(&ctx->outbound.lock);
+		ctx->setup_more = true;
 	} else if (strcmp(interface, org_kde_kwin_idle_interface.name) == 0) {
 		LOG(stderr, "Got idle manager\n");
 		ctx->idle_manager = wl_registry_bind(registry, name, &org_kde_kwin_idle_interface, version);
 	} else if (strcmp(interface, ext_idle_notifier_v1_interface.name) == 0) {
 		LOG(stderr, "Got idle notifier\n");
 		ctx->idle_notifier = wl_registry_bind(registry, name, &ext_idle_notifier_v1_interface, version);
+	} else if (strcmp(interface, zwlr_data_control_manager_v1_interface.name) == 0) {
+		LOG(stderr, "Got wlr data control manager\n");
+		ctx->data_control_version = version < 2 ? version : 2;
+		ctx->data_control = wl_registry_bind(registry, name, &zwlr_data_control_manager_v1_interface, ctx->data_control_version);
+	} else if (strcmp(interface, ext_data_control_manager_v1_interface.name) == 0) {
+		LOG(stderr, "Got ext data control manager\n");
+		ctx->ext_data_control = wl_registry_bind(registry, name, &ext_data_control_manager_v1_interface, 1);
 	}
 }
 
@@ -490,12 +464,14 @@ static void handle_global_remove(void *data, struct wl_registry *registry, uint3
 	/* possible objects */
 	struct wlOutput *output;
 	/* for now we only handle the case of outputs going away */
-	output = wlOutputGetWlName(ctx->outputs, name);
+	pthread_mutex_lock(&ctx->outbound.lock);
+	output = output_by_name(ctx, name);
 	if (output) {
 		LOG(stderr, "Lost output %s\n", output->name ? output->name : "");
-		wlOutputRemove(&ctx->outputs, output);
-		ctx->on_output_update(ctx);
+		output_remove(ctx, output);
+		layout_update(ctx);
 	}
+	pthread_mutex_unlock(&ctx->outbound.lock);
 }
 
 static const struct wl_registry_listener registry_listener = {
@@ -516,16 +492,99 @@ uint32_t wlTS(struct wlContext *ctx)
 
 void wlClose(struct wlContext *ctx)
 {
-	return;
+	wlDispatchStop(ctx);
+	wlClipboardFree(ctx);
+}
+
+/* setup barrier: a wl_display_sync whose done comes after the replies to
+ * every request sent before it. requests made by handlers while it is out
+ * set setup_more and get a barrier of their own once it is done, so setup
+ * takes as many round trips as its longest chain of requests (registry,
+ * seat, keyboard, keymap) and waits for all of them in one loop */
+static const struct wl_callback_listener barrier_listener;
+
+static void setup_barrier(struct wlContext *ctx)
+{
+	struct wl_callback *cb = wl_display_sync(ctx->display);
+
+	wl_callback_add_listener(cb, &barrier_listener, ctx);
+	ctx->setup_more = false;
+	ctx->setup_waiting = true;
+}
+
+static void barrier_done(void *data, struct wl_callback *cb, uint32_t serial)
+{
+	struct wlContext *ctx = data;
+
+	wl_callback_destroy(cb);
+	ctx->setup_round_trips++;
+	if (ctx->setup_more)
+		setup_barrier(ctx);
+	else
+		ctx->setup_waiting = false;
+}
+
+static const struct wl_callback_listener barrier_listener = {
+	.done = barrier_done,
+};
+
+static bool setup_wait(struct wlContext *ctx)
+{
+	while (ctx->setup_waiting) {
+		if (wl_display_dispatch(ctx->display) == -1) {
+			LOG(stderr, "Lost wayland connection during setup\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+struct setup_backend {
+	const char *name;
+	bool (*init)(struct wlContext *ctx);
+};
+
+static const struct setup_backend input_backends[] = {
+	{"wlr", wlInputInitWlr},
+	{"kde", wlInputInitKde},
+};
+
+static const struct setup_backend idle_backends[] = {
+	{"ext", wlIdleInitExt},
+	{"kde", wlIdleInitKde},
+	{"gnome", wlIdleInitGnome},
+};
+
+/* initialize the first backend that works, the one named by the first
+ * hint_len characters of hint before the others. its name, or NULL */
+static const char *setup_backend(struct wlContext *ctx, const struct setup_backend *list, size_t count,
+				 const char *hint, size_t hint_len)
+{
+	size_t i, tried = count;
+
+	for (i = 0; hint && i < count; ++i) {
+		if (strlen(list[i].name) != hint_len || strncmp(list[i].name, hint, hint_len))
+			continue;
+		if (list[i].init(ctx))
+			return list[i].name;
+		tried = i;
+		break;
+	}
+	for (i = 0; i < count; ++i) {
+		if (i != tried && list[i].init(ctx))
+			return list[i].name;
+	}
+	return NULL;
 }
 
 bool wlSetup(struct wlContext *ctx, int width, int height, char *backend)
 {
 	int fd;
 	bool input_init = false;
+	const char *idle_hint = NULL;
+	size_t input_len = 0;
 
 	wl_log_set_handler_client(&wl_log_handler);
-	ctx->timeout = 5000;
 
 	ctx->width = width;
 	ctx->height = height;
@@ -543,20 +602,33 @@ bool wlSetup(struct wlContext *ctx, int width, int height, char *backend)
 		return false;
 	}
 
+	/* globals, then the seat and outputs they bind, then the keymap of the
+	 * keyboard the seat has */
 	ctx->registry = wl_display_get_registry(ctx->display);
 	wl_registry_add_listener(ctx->registry, &registry_listener, ctx);
-	wl_display_dispatch(ctx->display);
-	wl_display_roundtrip(ctx->display);
+	setup_barrier(ctx);
+	if (!setup_wait(ctx))
+		return false;
+	LOG(stderr, "Setup took %d round trips\n", ctx->setup_round_trips);
 
 	/* figure out which compositor we are using */
 	fd = wl_display_get_fd(ctx->display);
 	ctx->comp_name = osGetPeerProcName(fd);
+	ctx->comp_pid = osGetPeerPid(fd);
 	LOG(stderr, "Compositor seems to be %s\n", ctx->comp_name);
 
-	if (wlInputInitWlr(ctx)) {
-		LOG(stderr, "Using wlroots protocols for virtual input\n");
-	} else if (wlInputInitKde(ctx)) {
-		LOG(stderr, "Using kde protocols for virtual input\n");
+	/* a hint from an earlier run spares probing backends that did not work */
+	if (backend) {
+		idle_hint = strchr(backend, '/');
+		input_len = idle_hint ? (size_t)(idle_hint - backend) : strlen(backend);
+		if (idle_hint)
+			idle_hint++;
+	}
+
+	ctx->input_backend = setup_backend(ctx, input_backends, sizeof(input_backends) / sizeof(input_backends[0]),
+					   backend, input_len);
+	if (ctx->input_backend) {
+		LOG(stderr, "Using %s protocols for virtual input\n", ctx->input_backend);
 	} else {
 		LOG(stderr, "Virtual input not supported by compositor\n");
 		return false;
@@ -569,12 +641,10 @@ bool wlSetup(struct wlContext *ctx, int width, int height, char *backend)
 
 	/* initiailize idle inhibition */
 	if (true) {
-		if (wlIdleInitExt(ctx)) {
-			LOG(stderr, "Using ext-idle-notify-v1 idle inhibition protocol\n");
-		} else if (wlIdleInitKde(ctx)) {
-			LOG(stderr, "Using KDE idle inhibition protocol\n");
-		} else if (wlIdleInitGnome(ctx)) {
-			LOG(stderr, "Using GNOME idle inhibition through gnome-session-inhibit\n");
+		ctx->idle_backend = setup_backend(ctx, idle_backends, sizeof(idle_backends) / sizeof(idle_backends[0]),
+						  idle_hint, idle_hint ? strlen(idle_hint) : 0);
+		if (ctx->idle_backend) {
+			LOG(stderr, "Using %s idle inhibition\n", ctx->idle_backend);
 		} else {
 			LOG(stderr, "No idle inhibition support\n");
 		}
@@ -586,9 +656,41 @@ bool wlSetup(struct wlContext *ctx, int width, int height, char *backend)
 	int flags = fcntl(fd, F_GETFD);
 	flags |= FD_CLOEXEC;
 	fcntl(fd, F_SETFD, flags);
+
+	/* events from here on are dispatched as they arrive */
+	if (!wlDispatchStart(ctx))
+		LOG(stderr, "No dispatch thread, events wait for wlPollProc\n");
 	return true;
 }
 
+const char *wlBackends(struct wlContext *ctx)
+{
+	snprintf(ctx->backends, sizeof(ctx->backends), "%s/%s",
+		 ctx->input_backend ? ctx->input_backend : "",
+		 ctx->idle_backend ? ctx->idle_backend : "");
+	return ctx->backends;
+}
+
+const char *wlCompositorName(struct wlContext *ctx)
+{
+	return ctx->comp_name;
+}
+
+int wlCompositorPid(struct wlContext *ctx)
+{
+	return ctx->comp_pid;
+}
+
+void wlGetLayout(struct wlContext *ctx, int32_t *out)
+{
+	pthread_mutex_lock(&ctx->outbound.lock);
+	out[0] = ctx->x;
+	out[1] = ctx->y;
+	out[2] = ctx->width;
+	out[3] = ctx->height;
+	pthread_mutex_unlock(&ctx->outbound.lock);
+}
+
 void wlResUpdate(struct wlContext *ctx, int width, int height)
 {
 	ctx->width = width;
@@ -602,29 +704,143 @@ void wlResUpdate(struct wlContext *ctx, int width, int height)
 
 int wlPrepareFd(struct wlContext *ctx)
 {
-	int fd;
+	struct wl_display *display = ctx->display;
 
-	fd = wl_display_get_fd(ctx->display);
-//	while (wl_display_prepare_read(display) != 0) {
-//		wl_display_dispatch(display);
-//	}
-//	wl_display_flush(display);
-	return fd;
+	if (!display)
+		return -1;
+	if (ctx->dispatching || ctx->reading)
+		return wl_display_get_fd(display);
+	while (wl_display_prepare_read(display) != 0) {
+		if (wl_display_dispatch_pending(display) == -1)
+			return -1;
+	}
+	wl_display_flush(display);
+	ctx->reading = true;
+	return wl_display_get_fd(display);
 }
 
 void wlPollProc(struct wlContext *ctx, short revents)
 {
+	if (!ctx->reading)
+		return;
+	ctx->reading = false;
 	if (revents & POLLIN) {
-//		wl_display_cancel_read(display);
-		wl_display_dispatch(ctx->display);
+		if (wl_display_read_events(ctx->display) == -1)
+			goto lost;
+	} else {
+		wl_display_cancel_read(ctx->display);
+		if (revents & (POLLHUP | POLLERR))
+			goto lost;
 	}
-	if (revents & POLLHUP) return;
+	if (wl_display_dispatch_pending(ctx->display) != -1)
+		return;
+lost:
 	LOG(stderr, "Lost wayland connection\n");
 }
 
+/* the default queue, read and dispatched as soon as the display fd turns
+ * readable. injection never waits for it, requests from any thread go out
+ * through wlDisplayFlush as before. the listeners that change what
+ * injection reads, outputs, layout and keymap, take the outbound lock */
+static void *dispatch_thread(void *data)
+{
+	struct wlContext *ctx = data;
+	struct wl_display *display = ctx->display;
+	struct pollfd pfd[2];
+	char buf[64];
+
+	LOG(stderr, "dispatch: thread running\n");
+	while (__atomic_load_n(&ctx->dispatching, __ATOMIC_ACQUIRE)) {
+		while (wl_display_prepare_read(display) != 0) {
+			if (wl_display_dispatch_pending(display) == -1)
+				goto lost;
+		}
+		/* whatever the handlers asked for, an idle response say */
+		wl_display_flush(display);
+
+		pfd[0] = (struct pollfd) { .fd = wl_display_get_fd(display), .events = POLLIN };
+		/* queued input drains once the compositor reads again */
+		if (__atomic_load_n(&ctx->outbound.queued, __ATOMIC_ACQUIRE))
+			pfd[0].events |= POLLOUT;
+		pfd[1] = (struct pollfd) { .fd = ctx->dispatch_wake[0], .events = POLLIN };
+		if (poll(pfd, 2, -1) == -1) {
+			wl_display_cancel_read(display);
+			if (errno == EINTR)
+				continue;
+			LOG(stderr, "dispatch: poll() failed: %s\n", strerror(errno));
+			break;
+		}
+		if (pfd[0].revents & POLLIN) {
+			if (wl_display_read_events(display) == -1)
+				goto lost;
+		} else {
+			wl_display_cancel_read(display);
+			if (pfd[0].revents & (POLLHUP | POLLERR))
+				goto lost;
+		}
+		if (pfd[1].revents)
+			while (read(ctx->dispatch_wake[0], buf, sizeof(buf)) > 0);
+		if (wl_display_dispatch_pending(display) == -1)
+			goto lost;
+		if (pfd[0].revents & POLLOUT)
+			wlInputDrain(ctx);
+	}
+	LOG(stderr, "dispatch: thread exiting\n");
+	return NULL;
+lost:
+	LOG(stderr, "dispatch: lost wayland connection\n");
+	return NULL;
+}
+
+bool wlDispatchStart(struct wlContext *ctx)
+{
+	if (ctx->dispatching)
+		return true;
+	if (!ctx->display || ctx->reading)
+		return false;
+	if (pipe2(ctx->dispatch_wake, O_CLOEXEC | O_NONBLOCK) == -1) {
+		LOG(stderr, "dispatch: pipe() failed: %s\n", strerror(errno));
+		return false;
+	}
+	__atomic_store_n(&ctx->dispatching, true, __ATOMIC_RELEASE);
+	if (pthread_create(&ctx->dispatch_thread, NULL, dispatch_thread, ctx)) {
+		__atomic_store_n(&ctx->dispatching, false, __ATOMIC_RELEASE);
+		close(ctx->dispatch_wake[0]);
+		close(ctx->dispatch_wake[1]);
+		return false;
+	}
+	return true;
+}
+
+void wlDispatchWake(struct wlContext *ctx)
+{
+	if (!__atomic_load_n(&ctx->dispatching, __ATOMIC_ACQUIRE))
+		return;
+	if (write(ctx->dispatch_wake[1], "", 1) == -1 && errno != EAGAIN)
+		LOG(stderr, "dispatch: wake failed: %s\n", strerror(errno));
+}
+
+void wlDispatchStop(struct wlContext *ctx)
+{
+	if (!ctx->dispatching)
+		return;
+	__atomic_store_n(&ctx->dispatching, false, __ATOMIC_RELEASE);
+	if (write(ctx->dispatch_wake[1], "", 1) == -1)
+		LOG(stderr, "dispatch: wake failed: %s\n", strerror(errno));
+	pthread_join(ctx->dispatch_thread, NULL);
+	close(ctx->dispatch_wake[0]);
+	close(ctx->dispatch_wake[1]);
+}
+
 struct wlContext *wlContextNew(void)
 {
 	struct wlContext *ctx = xcalloc(1, sizeof(*ctx));
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&ctx->outbound.lock, &attr);
+	pthread_mutexattr_destroy(&attr);
 	return ctx;
 }
 
@@ -632,5 +848,9 @@ void wlContextFree(struct wlContext *ctx)
 {
 	if (!ctx) return;
 	wlClose(ctx);
+	while (ctx->output_count)
+		output_remove(ctx, ctx->outputs[0]);
+	free(ctx->outputs);
+	pthread_mutex_destroy(&ctx->outbound.lock);
 	free(ctx);
 }
@@ -0,0 +1,67 @@
+#include <string.h>
+#include "wire.h"
+
+bool wireHeaderDecode(struct sspBuf *buf, struct wireHeader *hdr)
+{
+	if (!sspUChar(buf, &hdr->version) || hdr->version != WIRE_VERSION)
+		return false;
+	return sspUChar(buf, &hdr->op) &&
+		sspUChar(buf, &hdr->flags) &&
+		sspUChar(buf, &hdr->conn) &&
+		sspNetU32(buf, &hdr->sender) &&
+		sspNetU32(buf, &hdr->seq);
+}
+
+static bool decode_u8(struct sspBuf *buf, int32_t *res)
+{
+	unsigned char c;
+	if (!sspUChar(buf, &c))
+		return false;
+	*res = c;
+	return true;
+}
+
+static bool decode_varu(struct sspBuf *buf, int32_t *res)
+{
+	return sspVarU32(buf, (uint32_t *)res);
+}
+
+bool wireEventDecode(struct sspBuf *buf, uint8_t op, struct wireEvent *ev)
+{
+	memset(ev, 0, sizeof(*ev));
+	ev->op = op;
+	switch (op) {
+		case WIRE_OP_MOUSE_MOVE:
+		case WIRE_OP_MOUSE_WHEEL:
+			return sspVar32(buf, &ev->arg[0]) && sspVar32(buf, &ev->arg[1]);
+		case WIRE_OP_MOUSE_ABS:
+			return decode_varu(buf, &ev->arg[0]) && decode_varu(buf, &ev->arg[1]);
+		case WIRE_OP_MOUSE_BUTTON:
+			return decode_u8(buf, &ev->arg[0]) && decode_u8(buf, &ev->arg[1]);
+		case WIRE_OP_KEY:
+			return decode_varu(buf, &ev->arg[0]) &&
+				decode_varu(buf, &ev->arg[1]) &&
+				decode_u8(buf, &ev->arg[2]);
+		case WIRE_OP_KEY_RAW:
+			return decode_varu(buf, &ev->arg[0]) && decode_u8(buf, &ev->arg[1]);
+		case WIRE_OP_KEY_RELEASE_ALL:
+			return true;
+		case WIRE_OP_IDLE_INHIBIT:
+			return decode_u8(buf, &ev->arg[0]);
+	}
+	return false;
+}
+
+int wireDecode(const unsigned char *data, size_t len, int32_t *out)
+{
+	struct sspBuf buf = { .data = data, .pos = 0, .len = len };
+	struct wireHeader hdr;
+	struct wireEvent ev;
+
+	if (!wireHeaderDecode(&buf, &hdr))
+		return -1;
+	if (!wireEventDecode(&buf, hdr.op, &ev))
+		return -1;
+	memcpy(out, ev.arg, sizeof(ev.arg));
+	return hdr.op;
+}
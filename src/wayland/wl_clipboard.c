@@ -0,0 +1,623 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include "memfd.h"
+#include "wayland.h"
+
+/* Native clipboard through data-control: wlr-data-control-unstable-v1, or
+ * ext-data-control-v1 where the compositor only has the standardized copy.
+ * Both are the same protocol under two names, so their objects are handled
+ * as zwlr_* here and only differ in the interfaces new objects are created
+ * with.
+ *
+ * The data-control objects live on an event queue of their own, dispatched
+ * by a thread that reads the display. Selections owned by this context are
+ * sealed memfds handed to it by JS, that thread sends them to pasting
+ * clients straight from the memfd. Changes made by other clients are
+ * reported through on_event. */
+
+#define CLIP_MAX_MIMES 32
+/* pastes served at the same time */
+#define CLIP_MAX_WRITES 16
+
+/* text types offered along with text/plain;charset=utf-8, the ones older
+ * toolkits and XWayland clients ask for */
+static const char *text_aliases[] = {
+	"text/plain",
+	"UTF8_STRING",
+	"STRING",
+	"TEXT",
+};
+
+/* preferred first when receiving, then image/png, then whatever comes
+ * first that looks like a MIME type */
+static const char *text_mimes[] = {
+	"text/plain;charset=utf-8",
+	"text/plain",
+	"UTF8_STRING",
+	"STRING",
+	"TEXT",
+};
+
+struct clip_interfaces {
+	const char *name;
+	const struct wl_interface *source;
+	const struct wl_interface *device;
+};
+
+static const struct clip_interfaces wlr_interfaces = {
+	.name = "wlr-data-control-unstable-v1",
+	.source = &zwlr_data_control_source_v1_interface,
+	.device = &zwlr_data_control_device_v1_interface,
+};
+
+static const struct clip_interfaces ext_interfaces = {
+	.name = "ext-data-control-v1",
+	.source = &ext_data_control_source_v1_interface,
+	.device = &ext_data_control_device_v1_interface,
+};
+
+/* content shared by a selection and the writes serving it, a dup of the
+ * sealed memfd it came in */
+struct clip_data {
+	int refs;
+	int fd;
+	size_t len;
+};
+
+struct clip_offer {
+	struct zwlr_data_control_offer_v1 *offer;
+	char *mimes[CLIP_MAX_MIMES];
+	int mime_count;
+};
+
+struct clip_source {
+	struct zwlr_data_control_source_v1 *source;
+	struct wlClipboard *clip;
+	int primary;
+	uint32_t serial;
+	/* NULL until the content is known */
+	struct clip_data *data;
+	/* pastes waiting for the content */
+	int pending[CLIP_MAX_WRITES];
+	int pending_count;
+};
+
+struct clip_write {
+	int fd;
+	struct clip_data *data;
+	off_t off;
+};
+
+struct wlClipboard {
+	struct wlContext *wl_ctx;
+	const struct clip_interfaces *ifaces;
+	struct wl_event_queue *queue;
+	/* manager wrapper on our queue, objects made from it inherit it */
+	struct zwlr_data_control_manager_v1 *manager;
+	struct zwlr_data_control_device_v1 *device;
+	bool have_primary;
+	wlClipboardFunc on_event;
+	/* guards everything below, taken by the clipboard thread and the
+	 * callers of the wlClipboard* functions */
+	pthread_mutex_t lock;
+	/* current selection and primary selection */
+	struct clip_offer *offer[2];
+	/* selections owned by this context */
+	struct clip_source *source[2];
+	/* MIME type of the last receive of each selection */
+	char *received[2];
+	struct clip_write writes[CLIP_MAX_WRITES];
+	int write_count;
+	uint32_t serial;
+	pthread_t thread;
+	int wake[2];
+	bool running;
+};
+
+/* NULL if fd cannot be had */
+static struct clip_data *clip_data_new(int fd, size_t len)
+{
+	struct clip_data *data;
+
+	if ((fd = fcntl(fd, F_DUPFD_CLOEXEC, 0)) == -1) {
+		LOG(stderr, "clipboard: could not dup content: %s\n", strerror(errno));
+		return NULL;
+	}
+	data = xmalloc(sizeof(*data));
+	data->refs = 1;
+	data->fd = fd;
+	data->len = len;
+	return data;
+}
+
+static void clip_data_unref(struct clip_data *data)
+{
+	if (data && --data->refs == 0) {
+		close(data->fd);
+		free(data);
+	}
+}
+
+static void wake(struct wlClipboard *clip)
+{
+	char c = 0;
+
+	if (write(clip->wake[1], &c, 1) == -1 && errno != EAGAIN) {
+		LOG(stderr, "clipboard: could not wake thread\n");
+	}
+}
+
+/* call with the lock held, takes over fd */
+static void write_add(struct wlClipboard *clip, int fd, struct clip_data *data)
+{
+	struct clip_write *w;
+
+	if (clip->write_count == CLIP_MAX_WRITES) {
+		LOG(stderr, "clipboard: too many pastes at once, dropping one\n");
+		close(fd);
+		return;
+	}
+	w = &clip->writes[clip->write_count++];
+	w->fd = fd;
+	w->data = data;
+	w->off = 0;
+	data->refs++;
+}
+
+/* call with the lock held, write_count may grow meanwhile but only the
+ * thread ever removes writes */
+static void write_some(struct wlClipboard *clip, struct pollfd *pfd, int count)
+{
+	struct clip_write *w;
+	sigset_t pipe_set;
+	struct timespec zero = {0};
+	ssize_t n;
+	int i;
+
+	for (i = count - 1; i >= 0; --i) {
+		w = &clip->writes[i];
+		if (!pfd[i].revents)
+			continue;
+		n = memfdSend(w->fd, w->data->fd, &w->off, w->data->len - w->off);
+		if (n == -1 && (errno == EAGAIN || errno == EINTR))
+			continue;
+		if (n == -1 && errno == EPIPE) {
+			/* SIGPIPE is blocked on this thread, take it off the queue */
+			sigemptyset(&pipe_set);
+			sigaddset(&pipe_set, SIGPIPE);
+			sigtimedwait(&pipe_set, NULL, &zero);
+		}
+		if (n > 0 && (size_t)w->off < w->data->len)
+			continue;
+		close(w->fd);
+		clip_data_unref(w->data);
+		*w = clip->writes[--clip->write_count];
+	}
+}
+
+static void offer_free(struct clip_offer *offer)
+{
+	int i;
+
+	if (!offer)
+		return;
+	zwlr_data_control_offer_v1_destroy(offer->offer);
+	for (i = 0; i < offer->mime_count; ++i)
+		free(offer->mimes[i]);
+	free(offer);
+}
+
+static void source_free(struct clip_source *src)
+{
+	int i;
+
+	for (i = 0; i < src->pending_count; ++i)
+		close(src->pending[i]);
+	clip_data_unref(src->data);
+	zwlr_data_control_source_v1_destroy(src->source);
+	free(src);
+}
+
+static void offer_mime(void *data, struct zwlr_data_control_offer_v1 *offer, const char *mime)
+{
+	struct clip_offer *o = data;
+
+	if (o->mime_count == CLIP_MAX_MIMES)
+		return;
+	o->mimes[o->mime_count++] = xstrdup(mime);
+}
+
+static const struct zwlr_data_control_offer_v1_listener offer_listener = {
+	.offer = offer_mime,
+};
+
+static void device_data_offer(void *data, struct zwlr_data_control_device_v1 *device, struct zwlr_data_control_offer_v1 *offer)
+{
+	struct clip_offer *o = xcalloc(1, sizeof(*o));
+
+	o->offer = offer;
+	zwlr_data_control_offer_v1_add_listener(offer, &offer_listener, o);
+}
+
+static void set_offer(struct wlClipboard *clip, int primary, struct zwlr_data_control_offer_v1 *offer)
+{
+	bool ours;
+
+	pthread_mutex_lock(&clip->lock);
+	offer_free(clip->offer[primary]);
+	clip->offer[primary] = offer ? zwlr_data_control_offer_v1_get_user_data(offer) : NULL;
+	/* setting a selection echoes it back, only report the ones we lost */
+	ours = clip->source[primary] != NULL;
+	pthread_mutex_unlock(&clip->lock);
+	if (!ours && clip->on_event)
+		clip->on_event(WL_CLIPBOARD_CHANGED, primary, 0);
+}
+
+static void device_selection(void *data, struct zwlr_data_control_device_v1 *device, struct zwlr_data_control_offer_v1 *offer)
+{
+	set_offer(data, 0, offer);
+}
+
+static void device_primary_selection(void *data, struct zwlr_data_control_device_v1 *device, struct zwlr_data_control_offer_v1 *offer)
+{
+	set_offer(data, 1, offer);
+}
+
+static void device_finished(void *data, struct zwlr_data_control_device_v1 *device)
+{
+	struct wlClipboard *clip = data;
+
+	LOG(stderr, "clipboard: data control device finished\n");
+	pthread_mutex_lock(&clip->lock);
+	zwlr_data_control_device_v1_destroy(clip->device);
+	clip->device = NULL;
+	pthread_mutex_unlock(&clip->lock);
+}
+
+static const struct zwlr_data_control_device_v1_listener device_listener = {
+	.data_offer = device_data_offer,
+	.selection = device_selection,
+	.finished = device_finished,
+	.primary_selection = device_primary_selection,
+};
+
+static void source_send(void *data, struct zwlr_data_control_source_v1 *source, const char *mime, int32_t fd)
+{
+	struct clip_source *src = data;
+	struct wlClipboard *clip = src->clip;
+	bool request = false;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+	pthread_mutex_lock(&clip->lock);
+	if (src->data) {
+		write_add(clip, fd, src->data);
+	} else if (src->pending_count < CLIP_MAX_WRITES) {
+		src->pending[src->pending_count++] = fd;
+		request = src->pending_count == 1;
+	} else {
+		close(fd);
+	}
+	pthread_mutex_unlock(&clip->lock);
+	if (request && clip->on_event)
+		clip->on_event(WL_CLIPBOARD_REQUEST, src->primary, src->serial);
+}
+
+static void source_cancelled(void *data, struct zwlr_data_control_source_v1 *source)
+{
+	struct clip_source *src = data;
+	struct wlClipboard *clip = src->clip;
+
+	pthread_mutex_lock(&clip->lock);
+	if (clip->source[src->primary] == src)
+		clip->source[src->primary] = NULL;
+	source_free(src);
+	pthread_mutex_unlock(&clip->lock);
+}
+
+static const struct zwlr_data_control_source_v1_listener source_listener = {
+	.send = source_send,
+	.cancelled = source_cancelled,
+};
+
+static void *clip_thread(void *data)
+{
+	struct wlClipboard *clip = data;
+	struct wl_display *display = clip->wl_ctx->display;
+	struct pollfd pfd[2 + CLIP_MAX_WRITES];
+	sigset_t pipe_set;
+	char buf[64];
+	int i, count;
+
+	/* a paste target closing early fails the write with EPIPE instead */
+	sigemptyset(&pipe_set);
+	sigaddset(&pipe_set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipe_set, NULL);
+
+	LOG(stderr, "clipboard: thread running\n");
+	while (clip->running) {
+		while (wl_display_prepare_read_queue(display, clip->queue) != 0) {
+			if (wl_display_dispatch_queue_pending(display, clip->queue) == -1)
+				goto lost;
+		}
+		wl_display_flush(display);
+
+		pfd[0] = (struct pollfd) { .fd = wl_display_get_fd(display), .events = POLLIN };
+		pfd[1] = (struct pollfd) { .fd = clip->wake[0], .events = POLLIN };
+		pthread_mutex_lock(&clip->lock);
+		count = clip->write_count;
+		for (i = 0; i < count; ++i)
+			pfd[2 + i] = (struct pollfd) { .fd = clip->writes[i].fd, .events = POLLOUT };
+		pthread_mutex_unlock(&clip->lock);
+
+		if (poll(pfd, 2 + count, -1) == -1) {
+			wl_display_cancel_read(display);
+			if (errno == EINTR)
+				continue;
+			LOG(stderr, "clipboard: poll() failed: %s\n", strerror(errno));
+			break;
+		}
+		if (pfd[0].revents & POLLIN) {
+			if (wl_display_read_events(display) == -1)
+				goto lost;
+		} else {
+			wl_display_cancel_read(display);
+			if (pfd[0].revents & (POLLHUP | POLLERR))
+				goto lost;
+		}
+		if (pfd[1].revents)
+			while (read(clip->wake[0], buf, sizeof(buf)) > 0);
+		if (wl_display_dispatch_queue_pending(display, clip->queue) == -1)
+			goto lost;
+
+		pthread_mutex_lock(&clip->lock);
+		write_some(clip, pfd + 2, count);
+		pthread_mutex_unlock(&clip->lock);
+	}
+	LOG(stderr, "clipboard: thread exiting\n");
+	return NULL;
+lost:
+	LOG(stderr, "clipboard: lost wayland connection\n");
+	return NULL;
+}
+
+bool wlClipboardInit(struct wlContext *ctx, wlClipboardFunc on_event)
+{
+	struct wlClipboard *clip;
+	struct wl_proxy *manager;
+	const struct clip_interfaces *ifaces;
+
+	if (ctx->clipboard)
+		return true;
+	if (!ctx->display || !ctx->seat) {
+		LOG(stderr, "clipboard: no display or seat\n");
+		return false;
+	}
+	if (ctx->data_control) {
+		manager = (struct wl_proxy *)ctx->data_control;
+		ifaces = &wlr_interfaces;
+	} else if (ctx->ext_data_control) {
+		manager = (struct wl_proxy *)ctx->ext_data_control;
+		ifaces = &ext_interfaces;
+	} else {
+		LOG(stderr, "clipboard: compositor has no data control protocol\n");
+		return false;
+	}
+	LOG(stderr, "clipboard: using %s\n", ifaces->name);
+
+	clip = xcalloc(1, sizeof(*clip));
+	clip->wl_ctx = ctx;
+	clip->ifaces = ifaces;
+	clip->on_event = on_event;
+	/* version 1 of the wlr protocol predates the primary selection */
+	clip->have_primary = ifaces == &ext_interfaces || ctx->data_control_version >= 2;
+	pthread_mutex_init(&clip->lock, NULL);
+	if (pipe2(clip->wake, O_CLOEXEC | O_NONBLOCK) == -1) {
+		LOG(stderr, "clipboard: pipe() failed: %s\n", strerror(errno));
+		pthread_mutex_destroy(&clip->lock);
+		free(clip);
+		return false;
+	}
+	clip->queue = wl_display_create_queue(ctx->display);
+	clip->manager = wl_proxy_create_wrapper(manager);
+	wl_proxy_set_queue((struct wl_proxy *)clip->manager, clip->queue);
+	clip->device = (struct zwlr_data_control_device_v1 *)wl_proxy_marshal_flags((struct wl_proxy *)clip->manager,
+			ZWLR_DATA_CONTROL_MANAGER_V1_GET_DATA_DEVICE, ifaces->device,
+			wl_proxy_get_version(manager), 0, NULL, ctx->seat);
+	zwlr_data_control_device_v1_add_listener(clip->device, &device_listener, clip);
+	wlDisplayFlush(ctx);
+
+	ctx->clipboard = clip;
+	clip->running = true;
+	if (pthread_create(&clip->thread, NULL, clip_thread, clip)) {
+		clip->running = false;
+		wlClipboardFree(ctx);
+		return false;
+	}
+	return true;
+}
+
+void wlClipboardFree(struct wlContext *ctx)
+{
+	struct wlClipboard *clip = ctx->clipboard;
+	int i;
+
+	if (!clip)
+		return;
+	if (clip->running) {
+		clip->running = false;
+		wake(clip);
+		pthread_join(clip->thread, NULL);
+	}
+	for (i = 0; i < 2; ++i) {
+		offer_free(clip->offer[i]);
+		if (clip->source[i])
+			source_free(clip->source[i]);
+		free(clip->received[i]);
+	}
+	for (i = 0; i < clip->write_count; ++i) {
+		close(clip->writes[i].fd);
+		clip_data_unref(clip->writes[i].data);
+	}
+	if (clip->device)
+		zwlr_data_control_device_v1_destroy(clip->device);
+	wl_proxy_wrapper_destroy(clip->manager);
+	wlDisplayFlush(ctx);
+	wl_event_queue_destroy(clip->queue);
+	close(clip->wake[0]);
+	close(clip->wake[1]);
+	pthread_mutex_destroy(&clip->lock);
+	free(clip);
+	ctx->clipboard = NULL;
+}
+
+uint32_t wlClipboardSet(struct wlContext *ctx, int primary, const char *mimes, int fd, int len)
+{
+	struct wlClipboard *clip = ctx->clipboard;
+	struct clip_source *src;
+	char *list, *mime, *save;
+	bool text = false;
+	size_t i;
+
+	primary = !!primary;
+	if (!clip || (primary && !clip->have_primary))
+		return 0;
+	pthread_mutex_lock(&clip->lock);
+	if (!clip->device) {
+		pthread_mutex_unlock(&clip->lock);
+		return 0;
+	}
+
+	src = xcalloc(1, sizeof(*src));
+	src->clip = clip;
+	src->primary = primary;
+	src->data = fd >= 0 && len >= 0 ? clip_data_new(fd, len) : NULL;
+	src->serial = ++clip->serial;
+	src->source = (struct zwlr_data_control_source_v1 *)wl_proxy_marshal_flags((struct wl_proxy *)clip->manager,
+			ZWLR_DATA_CONTROL_MANAGER_V1_CREATE_DATA_SOURCE, clip->ifaces->source,
+			wl_proxy_get_version((struct wl_proxy *)clip->manager), 0, NULL);
+	zwlr_data_control_source_v1_add_listener(src->source, &source_listener, src);
+	list = xstrdup(mimes);
+	for (mime = strtok_r(list, "\n", &save); mime; mime = strtok_r(NULL, "\n", &save)) {
+		zwlr_data_control_source_v1_offer(src->source, mime);
+		text |= !strcmp(mime, text_mimes[0]);
+	}
+	free(list);
+	if (text) {
+		for (i = 0; i < sizeof(text_aliases) / sizeof(*text_aliases); ++i)
+			zwlr_data_control_source_v1_offer(src->source, text_aliases[i]);
+	}
+	if (primary)
+		zwlr_data_control_device_v1_set_primary_selection(clip->device, src->source);
+	else
+		zwlr_data_control_device_v1_set_selection(clip->device, src->source);
+	/* the previous source is cancelled by the compositor and freed then */
+	clip->source[primary] = src;
+	pthread_mutex_unlock(&clip->lock);
+	wlDisplayFlush(ctx);
+	return src->serial;
+}
+
+bool wlClipboardFill(struct wlContext *ctx, uint32_t serial, int fd, int len)
+{
+	struct wlClipboard *clip = ctx->clipboard;
+	struct clip_source *src = NULL;
+	int i;
+
+	if (!clip)
+		return false;
+	pthread_mutex_lock(&clip->lock);
+	for (i = 0; i < 2; ++i) {
+		if (clip->source[i] && clip->source[i]->serial == serial)
+			src = clip->source[i];
+	}
+	if (!src || src->data) {
+		pthread_mutex_unlock(&clip->lock);
+		return false;
+	}
+	if (fd >= 0 && len >= 0 && (src->data = clip_data_new(fd, len))) {
+		for (i = 0; i < src->pending_count; ++i)
+			write_add(clip, src->pending[i], src->data);
+	} else {
+		/* nothing to paste, the next paste asks again */
+		for (i = 0; i < src->pending_count; ++i)
+			close(src->pending[i]);
+	}
+	src->pending_count = 0;
+	pthread_mutex_unlock(&clip->lock);
+	wake(clip);
+	return true;
+}
+
+/* call with the lock held, the type offer is read in */
+static const char *receive_type(struct clip_offer *offer)
+{
+	size_t i;
+	int j;
+
+	for (i = 0; i < sizeof(text_mimes) / sizeof(*text_mimes); ++i) {
+		for (j = 0; j < offer->mime_count; ++j) {
+			if (!strcmp(offer->mimes[j], text_mimes[i]))
+				return text_mimes[i];
+		}
+	}
+	for (j = 0; j < offer->mime_count; ++j) {
+		if (!strcmp(offer->mimes[j], "image/png"))
+			return offer->mimes[j];
+	}
+	/* X11 targets like TARGETS or SAVE_TARGETS are no content */
+	for (j = 0; j < offer->mime_count; ++j) {
+		if (strchr(offer->mimes[j], '/'))
+			return offer->mimes[j];
+	}
+	return NULL;
+}
+
+int wlClipboardReceive(struct wlContext *ctx, int primary)
+{
+	struct wlClipboard *clip = ctx->clipboard;
+	struct clip_offer *offer;
+	const char *mime = NULL;
+	size_t i;
+	int fds[2];
+
+	if (!clip)
+		return -1;
+	primary = !!primary;
+	pthread_mutex_lock(&clip->lock);
+	offer = clip->offer[primary];
+	if (offer)
+		mime = receive_type(offer);
+	if (!mime || pipe2(fds, O_CLOEXEC) == -1) {
+		pthread_mutex_unlock(&clip->lock);
+		return -1;
+	}
+	zwlr_data_control_offer_v1_receive(offer->offer, mime, fds[1]);
+	/* all text arrives as UTF-8, whichever name it was asked for by */
+	for (i = 0; i < sizeof(text_mimes) / sizeof(*text_mimes); ++i) {
+		if (mime == text_mimes[i])
+			mime = text_mimes[0];
+	}
+	free(clip->received[primary]);
+	clip->received[primary] = xstrdup(mime);
+	pthread_mutex_unlock(&clip->lock);
+	wlDisplayFlush(ctx);
+	close(fds[1]);
+	return fds[0];
+}
+
+const char *wlClipboardType(struct wlContext *ctx, int primary)
+{
+	struct wlClipboard *clip = ctx->clipboard;
+	const char *mime;
+
+	if (!clip)
+		return NULL;
+	pthread_mutex_lock(&clip->lock);
+	mime = clip->received[!!primary];
+	pthread_mutex_unlock(&clip->lock);
+	return mime;
+}
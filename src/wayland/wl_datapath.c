@@ -0,0 +1,79 @@
+#include "wayland.h"
+#include "datapath.h"
+
+/* datapath sink for the wayland backends, these run on the datapath thread */
+
+static void mouse_rel_motion(void *ctx, int dx, int dy)
+{
+	wlMouseRelativeMotion(ctx, dx, dy);
+}
+
+static void mouse_motion(void *ctx, int x, int y)
+{
+	wlMouseMotion(ctx, x, y);
+}
+
+static void mouse_button(void *ctx, int button, int state)
+{
+	wlMouseButton(ctx, button, state);
+}
+
+static void mouse_wheel(void *ctx, signed short dx, signed short dy)
+{
+	wlMouseWheel(ctx, dx, dy);
+}
+
+static void key(void *ctx, int key, int modifiers, int state)
+{
+	/* xkb tracks modifiers from the key events themselves, and the wire
+	 * format carries no synergy id, so the raw keymap applies */
+	wlKey(ctx, key, 0, state);
+}
+
+static void key_raw(void *ctx, int key, int state)
+{
+	wlKeyRaw(ctx, key, state);
+}
+
+static void key_release_all(void *ctx)
+{
+	wlKeyReleaseAll(ctx);
+}
+
+static void idle_inhibit(void *ctx, bool on)
+{
+	wlIdleInhibit(ctx, on);
+}
+
+static void begin(void *ctx)
+{
+	wlInputBegin(ctx);
+}
+
+static void commit(void *ctx)
+{
+	wlInputCommit(ctx);
+}
+
+bool wlDatapathAttach(struct wlContext *ctx, struct dpContext *dp)
+{
+	if (!ctx->input.mouse_rel_motion) {
+		LOG(stderr, "No virtual input backend set up, cannot attach datapath\n");
+		return false;
+	}
+	dpSetSink(dp, &(struct dpSink) {
+		.ctx = ctx,
+		.mouse_rel_motion = mouse_rel_motion,
+		.mouse_motion = mouse_motion,
+		.mouse_button = mouse_button,
+		.mouse_wheel = mouse_wheel,
+		.key = key,
+		.key_raw = key_raw,
+		.key_release_all = key_release_all,
+		.idle_inhibit = idle_inhibit,
+		/* a receive batch is injected as one wlInputBegin batch */
+		.begin = begin,
+		.flush = commit,
+	});
+	return true;
+}
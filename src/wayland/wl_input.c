@@ -2,6 +2,9 @@
 #include <assert.h>
 #include <stdbool.h>
 #include "fdio_full.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
 #include <xkbcommon/xkbcommon.h>
 
 
@@ -31,12 +34,237 @@ void wlLoadButtonMap(struct wlContext *ctx)
 };
 
 
+/* batching, see wlInputBegin */
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void batch_flush(struct wlInput *input)
+{
+	if (input->frame_pending && input->mouse_frame)
+		input->mouse_frame(input);
+	input->frame_pending = false;
+	input->batch_dirty = false;
+	wlDisplayFlush(input->wl_ctx);
+}
+
+void wlInputQueued(struct wlInput *input, bool pointer)
+{
+	uint64_t now;
+
+	input->frame_pending |= pointer;
+	if (!__atomic_load_n(&input->batch_depth, __ATOMIC_ACQUIRE)) {
+		batch_flush(input);
+		return;
+	}
+	now = now_ns();
+	if (!input->batch_dirty) {
+		input->batch_dirty = true;
+		input->batch_start = now;
+	} else if (now - input->batch_start >= WL_INPUT_BATCH_MAX_NS) {
+		batch_flush(input);
+	}
+}
+
+/* the datapath thread batches too, the depth is shared with it and the
+ * rest of the batch state is under the outbound lock */
+void wlInputBegin(struct wlContext *ctx)
+{
+	__atomic_add_fetch(&ctx->input.batch_depth, 1, __ATOMIC_ACQ_REL);
+}
+
+void wlInputCommit(struct wlContext *ctx)
+{
+	if (__atomic_sub_fetch(&ctx->input.batch_depth, 1, __ATOMIC_ACQ_REL))
+		return;
+	pthread_mutex_lock(&ctx->outbound.lock);
+	if (ctx->input.batch_dirty || ctx->input.frame_pending)
+		batch_flush(&ctx->input);
+	pthread_mutex_unlock(&ctx->outbound.lock);
+}
+
+
+/* outbound queue, see wlDisplayFlush. injection goes straight to the backend
+ * until a flush hits EAGAIN, then into ops until the connection drains */
+
+static void replay(struct wlContext *ctx, const struct wlOutboundOp *op)
+{
+	struct wlInput *input = &ctx->input;
+
+	switch (op->type) {
+	case WL_OUT_REL_MOTION:
+		input->mouse_rel_motion(input, op->a, op->b);
+		break;
+	case WL_OUT_MOTION:
+		input->mouse_motion(input, op->a, op->b);
+		break;
+	case WL_OUT_BUTTON:
+		input->mouse_button(input, op->a, op->b);
+		break;
+	case WL_OUT_WHEEL:
+		input->mouse_wheel(input, op->a, op->b);
+		break;
+	case WL_OUT_KEY:
+		/* the modifiers the backend sends along are those of this key, not
+		 * of the keys queued after it */
+		if (op->a <= (int)xkb_keymap_max_keycode(input->xkb_map))
+			xkb_state_update_key(input->xkb_state, op->a, op->b);
+		input->key(input, op->a, op->b);
+		break;
+	}
+}
+
+static void outbound_remove(struct wlOutbound *out, int i, int count)
+{
+	out->len -= count;
+	memmove(out->ops + i, out->ops + i + count, (out->len - i) * sizeof(*out->ops));
+}
+
+static bool is_motion(const struct wlOutboundOp *op)
+{
+	return op->type == WL_OUT_REL_MOTION || op->type == WL_OUT_MOTION;
+}
+
+/* the lock is held */
+static void outbound_push(struct wlContext *ctx, const struct wlOutboundOp *op)
+{
+	struct wlOutbound *out = &ctx->outbound;
+	struct wlOutboundOp *tail = out->len ? &out->ops[out->len - 1] : NULL;
+	int i;
+
+	/* motion merges into motion right before it, never across a button or key */
+	if (tail && tail->type == op->type && op->type == WL_OUT_REL_MOTION) {
+		tail->a += op->a;
+		tail->b += op->b;
+		out->coalesced++;
+		return;
+	}
+	if (tail && tail->type == op->type && op->type == WL_OUT_MOTION) {
+		*tail = *op;
+		out->coalesced++;
+		return;
+	}
+	if (out->len == WL_OUTBOUND_LEN) {
+		/* the oldest motion goes first, then the oldest wheel event */
+		for (i = 0; i < out->len && !is_motion(&out->ops[i]); ++i);
+		if (i == out->len)
+			for (i = 0; i < out->len && out->ops[i].type != WL_OUT_WHEEL; ++i);
+		if (i < out->len) {
+			TRACE(TRACE_INPUT_DROP, TRACE_INPUT_STALE, out->ops[i].type, out->ops[i].a, out->ops[i].b);
+			outbound_remove(out, i, 1);
+			out->dropped++;
+		} else {
+			/* keys and buttons are never dropped, the oldest goes to
+			 * the libwayland buffer ahead of the drain */
+			replay(ctx, &out->ops[0]);
+			outbound_remove(out, 0, 1);
+			out->spilled++;
+		}
+	}
+	out->ops[out->len++] = *op;
+}
+
+/* the lock is held */
+static void outbound_drain(struct wlContext *ctx)
+{
+	struct wlOutbound *out = &ctx->outbound;
+	int i;
+
+	while (__atomic_load_n(&out->queued, __ATOMIC_ACQUIRE)) {
+		if (wl_display_flush(ctx->display) == -1) {
+			if (errno != EAGAIN)
+				LOG(stderr, "Outbound queue flush failed: %s\n", strerror(errno));
+			return;
+		}
+		if (!out->len) {
+			__atomic_store_n(&out->queued, false, __ATOMIC_RELEASE);
+			LOG(stderr, "Display connection drained\n");
+			return;
+		}
+		/* a chunk at a time, so the libwayland buffer never has to hold
+		 * much more than one */
+		__atomic_store_n(&out->stalled, false, __ATOMIC_RELEASE);
+		for (i = 0; i < out->len && i < WL_OUTBOUND_CHUNK;) {
+			replay(ctx, &out->ops[i++]);
+			if (__atomic_load_n(&out->stalled, __ATOMIC_ACQUIRE))
+				break;
+		}
+		outbound_remove(out, 0, i);
+		if (__atomic_load_n(&out->stalled, __ATOMIC_ACQUIRE))
+			return;
+		/* inside an open batch the chunk is still unflushed */
+		if (ctx->input.batch_dirty || ctx->input.frame_pending)
+			batch_flush(&ctx->input);
+	}
+}
+
+/* every path takes the lock: the datapath and the JS thread both inject,
+ * and an op sent straight to the backend must not pass one being queued or
+ * drained by the other */
+static void outbound_send(struct wlContext *ctx, const struct wlOutboundOp *op)
+{
+	struct wlOutbound *out = &ctx->outbound;
+
+	pthread_mutex_lock(&out->lock);
+	outbound_drain(ctx);
+	if (__atomic_load_n(&out->queued, __ATOMIC_ACQUIRE))
+		outbound_push(ctx, op);
+	else
+		replay(ctx, op);
+	pthread_mutex_unlock(&out->lock);
+}
+
+void wlInputStall(struct wlContext *ctx)
+{
+	struct wlOutbound *out = &ctx->outbound;
+
+	__atomic_store_n(&out->stalled, true, __ATOMIC_RELEASE);
+	if (__atomic_exchange_n(&out->queued, true, __ATOMIC_ACQ_REL))
+		return;
+	__atomic_add_fetch(&out->stalls, 1, __ATOMIC_RELAXED);
+	LOG(stderr, "Display connection backed up, queueing input\n");
+	/* to poll for POLLOUT */
+	wlDispatchWake(ctx);
+}
+
+void wlInputDrain(struct wlContext *ctx)
+{
+	pthread_mutex_lock(&ctx->outbound.lock);
+	outbound_drain(ctx);
+	pthread_mutex_unlock(&ctx->outbound.lock);
+}
+
+void wlInputGetStats(struct wlContext *ctx, uint64_t *out)
+{
+	struct wlOutbound *ob = &ctx->outbound;
+
+	pthread_mutex_lock(&ob->lock);
+	out[0] = __atomic_load_n(&ob->stalls, __ATOMIC_RELAXED);
+	out[1] = ob->coalesced;
+	out[2] = ob->dropped;
+	out[3] = ob->spilled;
+	out[4] = ob->len;
+	pthread_mutex_unlock(&ob->lock);
+}
+
+
 /* Code to track keyboard state for modifier masks
  * because the synergy protocol is less than ideal at sending us modifiers
 */
 
 
 static bool local_mod_init(struct wlContext *wl_ctx, char *keymap_str) {
+	/* a layout switch replaces the state of the keymap before it */
+	xkb_state_unref(wl_ctx->input.xkb_state);
+	xkb_keymap_unref(wl_ctx->input.xkb_map);
+	xkb_context_unref(wl_ctx->input.xkb_ctx);
+	wl_ctx->input.xkb_state = NULL;
+	wl_ctx->input.xkb_map = NULL;
 	wl_ctx->input.xkb_ctx = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
 	if (!wl_ctx->input.xkb_ctx) {
 		return false;
@@ -110,22 +338,29 @@ int wlKeySetConfigLayout(struct wlContext *ctx)
 {
 	int ret = 0;
 
-	/* ensure that we've given everything a chance to give us a proper
-	   default */
-	if (!ctx->kb_map) {
-		wl_display_dispatch(ctx->display);
-		wl_display_roundtrip(ctx->display);
-	}
-
+	/* the keymap listener replaces kb_map on the dispatch thread, and the
+	 * xkb state and key tables rebuilt here are what injection reads */
+	pthread_mutex_lock(&ctx->outbound.lock);
+	/* wlSetup has waited for the keymap, a seat without keyboard has none */
 	char *default_map = ctx->kb_map;
 	LOG(stderr, "Will default to map %s", default_map);
 	char *keymap_str = default_map ? xstrdup(default_map) : NULL;
 	local_mod_init(ctx, keymap_str);
 	ret = !ctx->input.key_map(&ctx->input, keymap_str);
-	ctx->input.key_press_state_len = 0;
 	load_raw_keymap(ctx);
 	load_id_keymap(ctx);
-	ctx->input.key_press_state = xcalloc(ctx->input.key_press_state_len, sizeof(*ctx->input.key_press_state));
+	if (!ctx->input.key_press_state) {
+		ctx->input.key_press_state_len = 0;
+		ctx->input.key_press_state = xcalloc(ctx->input.key_press_state_len, sizeof(*ctx->input.key_press_state));
+	} else if (ctx->input.xkb_state) {
+		/* keys held across a layout switch stay held, their modifiers
+		 * with them */
+		for (size_t i = 0; i < ctx->input.key_press_state_len; ++i) {
+			if (ctx->input.key_press_state[i] > 0 && i <= xkb_keymap_max_keycode(ctx->input.xkb_map))
+				xkb_state_update_key(ctx->input.xkb_state, i, XKB_KEY_DOWN);
+		}
+	}
+	pthread_mutex_unlock(&ctx->outbound.lock);
 	free(keymap_str);
 	return ret;
 }
@@ -134,6 +369,8 @@ void wlKeyRaw(struct wlContext *ctx, int key, int state)
 {
 	size_t i;
 
+	pthread_mutex_lock(&ctx->outbound.lock);
+
 	/* keep track of raw keystate size */
 	if (key >= ctx->input.key_press_state_len) {
 		LOG(stderr, "Resizing key press state array from %zu to %zu", ctx->input.key_press_state_len, key + 1);
@@ -145,24 +382,16 @@ void wlKeyRaw(struct wlContext *ctx, int key, int state)
 	}
 
 	if (!ctx->input.key_press_state[key] && !state) {
-		LOG(stderr, "Superfluous release of raw key %d", key);
-		return;
+		TRACE(TRACE_INPUT_DROP, TRACE_INPUT_SUPERFLUOUS_RELEASE, key, 0, 0);
+		goto unlock;
 	}
 
-	if (key > xkb_keymap_max_keycode(ctx->input.xkb_map)) {
-		LOG(stderr, "keycode greater than xkb maximum, mod not tracked");
-	} else {
-		xkb_state_update_key(ctx->input.xkb_state, key, state);
-		xkb_mod_mask_t depressed = xkb_state_serialize_mods(ctx->input.xkb_state, XKB_STATE_MODS_DEPRESSED);
-		xkb_mod_mask_t latched = xkb_state_serialize_mods(ctx->input.xkb_state, XKB_STATE_MODS_LATCHED);
-		xkb_mod_mask_t locked = xkb_state_serialize_mods(ctx->input.xkb_state, XKB_STATE_MODS_LOCKED);
-		xkb_layout_index_t group = xkb_state_serialize_layout(ctx->input.xkb_state, XKB_STATE_LAYOUT_EFFECTIVE);
-		LOG(stderr, "Modifiers: depressed: %x latched: %x locked: %x group: %x", depressed, latched, locked, group);
-	}
-
-	LOG(stderr, "Keycode: %d, state %d", key, state);
+	/* keycodes past the xkb maximum are injected but their mods not tracked,
+	 * see replay */
 	ctx->input.key_press_state[key] += state ? 1 : -1;
-	ctx->input.key(&ctx->input, key, state);
+	outbound_send(ctx, &(struct wlOutboundOp) { WL_OUT_KEY, key, state });
+unlock:
+	pthread_mutex_unlock(&ctx->outbound.lock);
 }
 
 
@@ -172,54 +401,137 @@ void wlKey(struct wlContext *ctx, int key, int id, int state)
 
 	if ((id < ctx->input.id_count) && ctx->input.id_keymap_valid[id]) {
 		key = ctx->input.id_keymap[id];
-		LOG(stderr, "Key %d remapped to %d by id %d", oldkey, key, id);
 	} else {
 		if (key >= ctx->input.key_count) {
-			LOG(stderr, "Key %d outside configured keymap, dropping", key);
+			TRACE(TRACE_INPUT_DROP, TRACE_INPUT_OUTSIDE_KEYMAP, key, 0, 0);
 			return;
 		}
 		key = ctx->input.raw_keymap[key];
-		if (key != oldkey) {
-			LOG(stderr, "Key %d remapped to %d", oldkey, key);
-		}
 	}
 	if (key == -1) {
-		LOG(stderr, "Dropping key mapped to -1");
+		TRACE(TRACE_INPUT_DROP, TRACE_INPUT_UNMAPPED, oldkey, 0, 0);
 		return;
 	}
+	TRACE(TRACE_KEY, oldkey, state, key, id);
 	wlKeyRaw(ctx, key, state);
 }
 
 void wlKeyReleaseAll(struct wlContext *ctx)
 {
 	size_t i;
+	wlInputBegin(ctx);
+	pthread_mutex_lock(&ctx->outbound.lock);
 	for (i = 0; i < ctx->input.key_press_state_len; ++i) {
 		while (ctx->input.key_press_state[i]) {
 			LOG(stderr, "Release all: key %zd, pressed %d times", i, ctx->input.key_press_state[i]);
 			wlKeyRaw(ctx, i, 0);
 		}
 	}
+	pthread_mutex_unlock(&ctx->outbound.lock);
+	wlInputCommit(ctx);
 }
 
+/* synergy modifier mask bits for the locks, see snapshot.js */
+#define SYNC_CAPS_LOCK 0x1000
+#define SYNC_NUM_LOCK 0x2000
+
+#define BIT_SET(bits, len, i) ((size_t)(i) < (size_t)(len) * 8 && ((bits)[(i) >> 3] & (1 << ((i) & 7))))
+
+/* tap a lock key if its locked state differs from the snapshot */
+static void sync_lock(struct wlContext *ctx, const char *mod, const char *key, bool on)
+{
+	xkb_keycode_t code;
+
+	if ((xkb_state_mod_name_is_active(ctx->input.xkb_state, mod, XKB_STATE_MODS_LOCKED) > 0) == on)
+		return;
+	if ((code = xkb_keymap_key_by_name(ctx->input.xkb_map, key)) == XKB_KEYCODE_INVALID)
+		return;
+	TRACE(TRACE_SYNC, TRACE_SYNC_LOCK, code, on, 0);
+	wlKeyRaw(ctx, code, 1);
+	wlKeyRaw(ctx, code, 0);
+}
+
+void wlInputSync(struct wlContext *ctx, const unsigned char *keys, int keys_len,
+		const unsigned char *raw, int raw_len, unsigned buttons, unsigned modifiers)
+{
+	size_t i, len;
+	bool *want;
+	int key;
+
+	/* the whole reconciliation goes out in one flush, and compares against
+	 * state the other injecting thread cannot change halfway */
+	wlInputBegin(ctx);
+	pthread_mutex_lock(&ctx->outbound.lock);
+	/* the raw keycodes the snapshot wants held, keys mapped like wlKey */
+	len = ctx->input.key_press_state_len;
+	if ((size_t)raw_len * 8 > len)
+		len = raw_len * 8;
+	for (i = 0; i < (size_t)keys_len * 8 && i < ctx->input.key_count; ++i) {
+		if (BIT_SET(keys, keys_len, i) && ctx->input.raw_keymap[i] >= (int)len)
+			len = ctx->input.raw_keymap[i] + 1;
+	}
+	want = xcalloc(len ? len : 1, sizeof(*want));
+	for (i = 0; i < (size_t)raw_len * 8; ++i)
+		want[i] = BIT_SET(raw, raw_len, i);
+	for (i = 0; i < (size_t)keys_len * 8 && i < ctx->input.key_count; ++i) {
+		if (BIT_SET(keys, keys_len, i) && (key = ctx->input.raw_keymap[i]) != -1)
+			want[key] = true;
+	}
+
+	/* releases first, so modifiers do not apply to keys pressed after */
+	for (i = 0; i < ctx->input.key_press_state_len; ++i) {
+		if (want[i] || !ctx->input.key_press_state[i])
+			continue;
+		TRACE(TRACE_SYNC, TRACE_SYNC_KEY, i, 0, ctx->input.key_press_state[i]);
+		while (ctx->input.key_press_state[i])
+			wlKeyRaw(ctx, i, 0);
+	}
+	for (i = 0; i < len; ++i) {
+		if (!want[i] || (i < ctx->input.key_press_state_len && ctx->input.key_press_state[i]))
+			continue;
+		TRACE(TRACE_SYNC, TRACE_SYNC_KEY, i, 1, 0);
+		wlKeyRaw(ctx, i, 1);
+	}
+	free(want);
+
+	for (i = 0; i < WL_INPUT_BUTTON_COUNT; ++i) {
+		bool on = buttons & (1u << i);
+		if (on == !!(ctx->input.button_state & (1u << i)))
+			continue;
+		TRACE(TRACE_SYNC, TRACE_SYNC_BUTTON, i, on, 0);
+		wlMouseButton(ctx, i, on);
+	}
+
+	sync_lock(ctx, XKB_MOD_NAME_CAPS, "CAPS", modifiers & SYNC_CAPS_LOCK);
+	sync_lock(ctx, XKB_MOD_NAME_NUM, "NMLK", modifiers & SYNC_NUM_LOCK);
+	pthread_mutex_unlock(&ctx->outbound.lock);
+	wlInputCommit(ctx);
+}
 
 void wlMouseRelativeMotion(struct wlContext *ctx, int dx, int dy)
 {
-	ctx->input.mouse_rel_motion(&ctx->input, dx, dy);
+	outbound_send(ctx, &(struct wlOutboundOp) { WL_OUT_REL_MOTION, dx, dy });
 }
 void wlMouseMotion(struct wlContext *ctx, int x, int y)
 {
-	ctx->input.mouse_motion(&ctx->input, x, y);
+	outbound_send(ctx, &(struct wlOutboundOp) { WL_OUT_MOTION, x, y });
 }
 void wlMouseButton(struct wlContext *ctx, int button, int state)
 {
 	if (button >= WL_INPUT_BUTTON_COUNT) {
-		LOG(stderr, "Mouse button %d exceeds maximum %d, dropping", button, WL_INPUT_BUTTON_COUNT);
+		TRACE(TRACE_INPUT_DROP, TRACE_INPUT_BUTTON_RANGE, button, 0, 0);
 		return;
 	}
-	LOG(stderr, "Mouse button: %d (mapped to %d), state: %d", button, ctx->input.button_map[button], state);
-	ctx->input.mouse_button(&ctx->input, ctx->input.button_map[button], state);
+	TRACE(TRACE_BUTTON, button, ctx->input.button_map[button], state, 0);
+	pthread_mutex_lock(&ctx->outbound.lock);
+	if (state)
+		ctx->input.button_state |= 1u << button;
+	else
+		ctx->input.button_state &= ~(1u << button);
+	outbound_send(ctx, &(struct wlOutboundOp) { WL_OUT_BUTTON, ctx->input.button_map[button], state });
+	pthread_mutex_unlock(&ctx->outbound.lock);
 }
 void wlMouseWheel(struct wlContext *ctx, signed short dx, signed short dy)
 {
-	ctx->input.mouse_wheel(&ctx->input, dx, dy);
+	outbound_send(ctx, &(struct wlOutboundOp) { WL_OUT_WHEEL, dx, dy });
 }
@@ -86,7 +86,7 @@ static void key(struct wlInput *input, int code, int state)
 
 	code -= 8;
 	if (code > UINPUT_KEY_MAX) {
-		LOG(stderr, "Keycode %d is unsupported by uinput (max %d), dropping", code, UINPUT_KEY_MAX);
+		TRACE(TRACE_INPUT_DROP, TRACE_INPUT_UNSUPPORTED, code, 0, 0);
 		return;
 	}
 
@@ -39,29 +39,44 @@ static void key(struct wlInput *input, int key, int state)
 	xkb_layout_index_t group = xkb_state_serialize_layout(input->xkb_state, XKB_STATE_LAYOUT_EFFECTIVE);
 	zwp_virtual_keyboard_v1_key(wlr->keyboard, wlTS(input->wl_ctx), key - 8, state);
 	zwp_virtual_keyboard_v1_modifiers(wlr->keyboard, depressed, latched, locked, group);
-	wlDisplayFlush(input->wl_ctx);
+	wlInputQueued(input, false);
+}
+
+static void mouse_frame(struct wlInput *input)
+{
+	struct state_wlr *wlr = input->state;
+	zwlr_virtual_pointer_v1_frame(wlr->pointer);
 }
 
 static void mouse_rel_motion(struct wlInput *input, int dx, int dy)
 {
 	struct state_wlr *wlr = input->state;
 	zwlr_virtual_pointer_v1_motion(wlr->pointer, wlTS(input->wl_ctx), wl_fixed_from_int(dx), wl_fixed_from_int(dy));
-	zwlr_virtual_pointer_v1_frame(wlr->pointer);
-	wlDisplayFlush(input->wl_ctx);
+	wlInputQueued(input, true);
 }
 static void mouse_motion(struct wlInput *input, int x, int y)
 {
 	struct state_wlr *wlr = input->state;
-	zwlr_virtual_pointer_v1_motion_absolute(wlr->pointer, wlTS(input->wl_ctx), x, y, input->wl_ctx->width, input->wl_ctx->height);
-	zwlr_virtual_pointer_v1_frame(wlr->pointer);
-	wlDisplayFlush(input->wl_ctx);
+	int width = input->wl_ctx->width, height = input->wl_ctx->height;
+
+	/* x and y are relative to the layout's corner, the extent is its size */
+	if (width <= 0 || height <= 0)
+		return;
+	x = x < 0 ? 0 : x >= width ? width - 1 : x;
+	y = y < 0 ? 0 : y >= height ? height - 1 : y;
+	zwlr_virtual_pointer_v1_motion_absolute(wlr->pointer, wlTS(input->wl_ctx), x, y, width, height);
+	wlInputQueued(input, true);
 }
 static void mouse_button(struct wlInput *input, int button, int state)
 {
 	struct state_wlr *wlr = input->state;
+	/* a button is a frame of its own, motion queued before it stays before */
+	if (input->frame_pending)
+		zwlr_virtual_pointer_v1_frame(wlr->pointer);
 	zwlr_virtual_pointer_v1_button(wlr->pointer, wlTS(input->wl_ctx), button, state);
 	zwlr_virtual_pointer_v1_frame(wlr->pointer);
-	wlDisplayFlush(input->wl_ctx);
+	input->frame_pending = false;
+	wlInputQueued(input, false);
 }
 static void mouse_wheel(struct wlInput *input, signed short dx, signed short dy)
 {
@@ -78,8 +93,7 @@ static void mouse_wheel(struct wlInput *input, signed short dx, signed short dy)
 	} else if (dy > 0) {
 		zwlr_virtual_pointer_v1_axis_discrete(wlr->pointer, wlTS(input->wl_ctx), 0, wl_fixed_from_int(-15), -1 * wlr->wheel_mult);
 	}
-	zwlr_virtual_pointer_v1_frame(wlr->pointer);
-	wlDisplayFlush(input->wl_ctx);
+	wlInputQueued(input, true);
 }
 
 bool wlInputInitWlr(struct wlContext *ctx)
@@ -110,6 +124,7 @@ bool wlInputInitWlr(struct wlContext *ctx)
 		.mouse_wheel = mouse_wheel,
 		.key = key,
 		.key_map = key_map,
+		.mouse_frame = mouse_frame,
 	};
 	wlLoadButtonMap(ctx);
 	LOG(stderr, "Using wlroots virtual input protocols");
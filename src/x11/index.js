@@ -1,17 +1,37 @@
-import { dlopen, FFIType, suffix } from 'bun:ffi';
-import { cc } from 'bun:ffi';
+import { dlopen, FFIType, JSCallback, suffix } from 'bun:ffi';
+import { createReadStream } from 'node:fs';
+import { capabilities } from '../capabilities.js';
 import source from './x11.c' with { type: 'file' };
 import { DisplayServer } from '../display.js';
+import { ClipboardBody, NativeSelections, TEXT_MIME, readHashed, withMemfd } from '../network/clipboard.js';
+import { DATAPATH_SYMBOLS, Datapath } from '../network/datapath.js';
+import { nativeLibrary } from '../native.js';
+import { TRACE_SYMBOLS, trace } from '../trace.js';
 
 const DEBUG = process.env.DEBUG ? { __DEBUG__: '1' } : {};
 
-const { symbols } = cc({
-  source,
-  includes: ['/usr/include'],
-  libs: ['dl', 'X11', 'Xfixes', 'Xtst', 'Xext'],
-  cflags: ['-ldl'],
+const library = nativeLibrary('x11', {
+  source: [
+    source,
+    './src/wayland/ssp.c',
+    './src/wayland/wire.c',
+    './src/wayland/aead.c',
+    './src/wayland/udp.c',
+    './src/wayland/datapath.c',
+    './src/wayland/trace.c',
+    './src/wayland/memfd.c',
+  ],
+  include: ['src/wayland/include'],
+  // x11.c opens the X libraries itself with dlopen
+  library: ['crypto', 'dl'],
   define: { ...DEBUG },
   symbols: {
+    ...DATAPATH_SYMBOLS,
+    ...TRACE_SYMBOLS,
+    x11_datapath_attach: {
+      args: ['ptr'],
+      returns: 'i32',
+    },
     x11_hide_cursor: {
       args: [],
       returns: 'i32',
@@ -60,10 +80,38 @@ const { symbols } = cc({
       args: [],
       returns: 'i32',
     },
+    x11_input_sync: {
+      args: ['ptr', 'i32', 'ptr', 'i32', 'u32', 'u32'],
+      returns: 'i32',
+    },
     x11_idle_inhibit: {
       args: ['i32'],
       returns: 'i32',
     },
+    x11_clipboard_init: {
+      args: ['function'],
+      returns: 'i32',
+    },
+    x11_clipboard_set: {
+      args: ['i32', 'ptr', 'i32', 'i32'],
+      returns: 'u32',
+    },
+    x11_clipboard_fill: {
+      args: ['u32', 'i32', 'i32'],
+      returns: 'i32',
+    },
+    x11_clipboard_receive: {
+      args: ['i32'],
+      returns: 'i32',
+    },
+    x11_clipboard_type: {
+      args: ['i32'],
+      returns: 'cstring',
+    },
+    x11_server_pid: {
+      args: [],
+      returns: 'i32',
+    },
     x11_set_env: {
       args: ['ptr', 'ptr'],
       returns: 'i32',
@@ -75,7 +123,7 @@ const { symbols } = cc({
   },
 });
 
-const lib = dlopen(`libX11.${suffix}`, {
+const X11_SYMBOLS = {
   XOpenDisplay: {
     args: ['ptr'],
     returns: FFIType.ptr,
@@ -104,7 +152,22 @@ const lib = dlopen(`libX11.${suffix}`, {
     args: ['ptr'],
     returns: FFIType.i32,
   },
-}).symbols;
+};
+
+let symbols = null;
+let lib = null;
+
+// built or loaded with the first context, importing costs nothing
+function load() {
+  if (symbols) return;
+  symbols = library.symbols;
+  // this unit has its own copy of the ring pointer
+  trace.attach(symbols);
+  lib = dlopen(`libX11.${suffix}`, X11_SYMBOLS).symbols;
+}
+
+// an empty array cannot be passed as a pointer, the length says it is empty
+const nonEmpty = (bits) => (bits.length ? bits : new Uint8Array(1));
 
 const Button1Mask = 1 << 8;
 const Button2Mask = 1 << 9;
@@ -113,6 +176,7 @@ const Button3Mask = 1 << 10;
 export class X11 extends DisplayServer {
   constructor() {
     super();
+    load();
     this.initialized = true;
     this.contextNew();
   }
@@ -135,6 +199,9 @@ export class X11 extends DisplayServer {
       this.display = null;
     }
     symbols.x11_cleanup();
+    this.clipboardCallback?.close();
+    this.clipboardCallback = null;
+    this.nativeClipboard = undefined;
   }
 
   setup(width, height) {
@@ -145,6 +212,8 @@ export class X11 extends DisplayServer {
     this.width = width || lib.XDisplayWidth(this.display, this.screen);
     this.height = height || lib.XDisplayHeight(this.display, this.screen);
 
+    const pid = symbols.x11_server_pid();
+    if (pid > 0) capabilities.update({ compositor: { pid } });
     return true;
   }
 
@@ -192,20 +261,49 @@ export class X11 extends DisplayServer {
     return symbols.x11_key_release_all() === 0;
   }
 
+  inputSync(keys, raw, buttons, modifiers) {
+    return symbols.x11_input_sync(nonEmpty(keys), keys.length, nonEmpty(raw), raw.length, buttons, modifiers) === 0;
+  }
+
   idleInhibit(inhibit) {
     return symbols.x11_idle_inhibit(inhibit ? 1 : 0) === 0;
   }
 
+  // selections owned by x11.c itself where the server has XFixes, xclip
+  // otherwise
   haveClipboard() {
-    try {
-      return Bun.spawnSync(['xclip', '-version']).exitCode === 0;
-    } catch (error) {
-      console.error('Error checking xclip:', error);
+    if (this.nativeClipboard ?? this.clipboardInit()) return true;
+    return capabilities.has('xclip');
+  }
+
+  clipboardInit() {
+    const selections = new NativeSelections((serial, data) =>
+      data
+        ? withMemfd(data, (fd, length) => symbols.x11_clipboard_fill(serial, fd, length))
+        : symbols.x11_clipboard_fill(serial, -1, -1),
+    );
+    const callback = new JSCallback(selections.onEvent, {
+      args: ['i32', 'i32', 'u32'],
+      returns: 'void',
+      threadsafe: true,
+    });
+    if (symbols.x11_clipboard_init(callback) !== 0) {
+      callback.close();
+      this.nativeClipboard = false;
       return false;
     }
+    this.clipboardCallback = callback;
+    this.selections = selections;
+    this.nativeClipboard = true;
+    return true;
   }
 
-  clipboardCopy(isPrimary, data, length) {
+  clipboardCopy(isPrimary, data, length, mimes = [data.mime ?? TEXT_MIME]) {
+    const content = data instanceof ClipboardBody ? data : data.subarray(0, length);
+    if (this.nativeClipboard) {
+      const list = Buffer.from(`${mimes.join('\n')}\0`);
+      return withMemfd(content, (fd, size) => symbols.x11_clipboard_set(isPrimary ? 1 : 0, list, fd, size) !== 0);
+    }
     try {
       const args = ['xclip', '-i'];
       if (isPrimary) {
@@ -213,9 +311,10 @@ export class X11 extends DisplayServer {
       } else {
         args.push('-selection', 'clipboard');
       }
+      if (mimes[0] !== TEXT_MIME) args.push('-t', mimes[0]);
 
       const proc = Bun.spawn({ cmd: args, stdin: 'pipe' });
-      proc.stdin.write(data.slice(0, length));
+      proc.stdin.write(content instanceof ClipboardBody ? content.read() : content);
       proc.stdin.end();
       return true;
     } catch (error) {
@@ -224,26 +323,53 @@ export class X11 extends DisplayServer {
     }
   }
 
-  clipboardPaste(isPrimary) {
-    try {
-      const args = ['xclip', '-o'];
-      if (isPrimary) {
-        args.push('-selection', 'primary');
-      } else {
-        args.push('-selection', 'clipboard');
-      }
+  // the content is only fetched once something asks for the selection
+  clipboardOffer(isPrimary, mimes, fetch) {
+    if (!this.nativeClipboard) return super.clipboardOffer(isPrimary, mimes, fetch);
+    const primary = isPrimary ? 1 : 0;
+    const serial = symbols.x11_clipboard_set(primary, Buffer.from(`${mimes.join('\n')}\0`), -1, -1);
+    if (!serial) return false;
+    this.selections.offer(primary, serial, fetch);
+    return true;
+  }
 
-      const result = Bun.spawnSync(args);
-      if (result.exitCode === 0) {
-        return result.stdout.toString();
-      }
-      return '';
+  // XFixes reports new selection owners to the clipboard thread, nothing
+  // to watch without it
+  clipboardWatch(isPrimary, onChange) {
+    if (!this.nativeClipboard) return null;
+    return this.selections.watch(isPrimary ? 1 : 0, onChange);
+  }
+
+  clipboardStream(isPrimary) {
+    if (this.nativeClipboard) {
+      const fd = symbols.x11_clipboard_receive(isPrimary ? 1 : 0);
+      return fd < 0 ? [] : createReadStream(null, { fd });
+    }
+    const args = ['xclip', '-o', '-selection', isPrimary ? 'primary' : 'clipboard'];
+    return Bun.spawn({ cmd: args, stdout: 'pipe', stderr: 'ignore' }).stdout;
+  }
+
+  // known once the stream of the read ended
+  clipboardType(isPrimary) {
+    if (!this.nativeClipboard) return TEXT_MIME;
+    return String(symbols.x11_clipboard_type(isPrimary ? 1 : 0) ?? '') || TEXT_MIME;
+  }
+
+  // resolves to the selection as text, never waits on the owner synchronously
+  async clipboardPaste(isPrimary) {
+    try {
+      const content = await readHashed(this.clipboardStream(isPrimary));
+      return content ? content.data.toString() : '';
     } catch (error) {
-      console.error('Error using xclip -o:', error);
+      console.error('Error reading the selection:', error);
       return '';
     }
   }
 
+  datapath(port) {
+    return new Datapath(symbols, port, (dp) => symbols.x11_datapath_attach(dp) === 0);
+  }
+
   setEnv(key, value) {
     return symbols.x11_set_env(Buffer.from(`${key}\0`), Buffer.from(`${value}\0`)) === 0;
   }
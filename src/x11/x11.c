@@ -1,12 +1,25 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <stdio.h>
 #include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/socket.h>
 #include <X11/Xlib.h>
+#include <X11/Xatom.h>
 #include <X11/extensions/Xfixes.h>
 #include <X11/extensions/XTest.h>
 #include <X11/extensions/dpms.h>
+#include "datapath.h"
+#include "memfd.h"
 
 #ifdef __DEBUG__
 #define LOG(file, fmt, ...) fprintf(file, fmt, ##__VA_ARGS__)
@@ -14,6 +27,7 @@
 #define LOG(file, fmt, ...)
 #endif
 
+typedef Status (*XInitThreadsFunc)(void);
 typedef Display *(*XOpenDisplayFunc)(const char *);
 typedef Window (*XDefaultRootWindowFunc)(Display *);
 typedef int (*XCloseDisplayFunc)(Display *);
@@ -30,6 +44,25 @@ typedef Bool (*XTestFakeMotionEventFunc)(Display *, int, int, int, Time);
 typedef Bool (*XTestFakeRelativeMotionEventFunc)(Display *, int, int, Time);
 typedef Bool (*XTestFakeButtonEventFunc)(Display *, unsigned int, Bool, Time);
 typedef Bool (*XTestFakeKeyEventFunc)(Display *, unsigned int, Bool, Time);
+typedef Bool (*XFixesQueryExtensionFunc)(Display *, int *, int *);
+typedef void (*XFixesSelectSelectionInputFunc)(Display *, Window, Atom, unsigned long);
+typedef Atom (*XInternAtomFunc)(Display *, const char *, Bool);
+typedef int (*XPendingFunc)(Display *);
+typedef int (*XNextEventFunc)(Display *, XEvent *);
+typedef Window (*XCreateSimpleWindowFunc)(Display *, Window, int, int, unsigned int, unsigned int, unsigned int, unsigned long, unsigned long);
+typedef int (*XDestroyWindowFunc)(Display *, Window);
+typedef int (*XSelectInputFunc)(Display *, Window, long);
+typedef int (*XSetSelectionOwnerFunc)(Display *, Atom, Window, Time);
+typedef Window (*XGetSelectionOwnerFunc)(Display *, Atom);
+typedef int (*XConvertSelectionFunc)(Display *, Atom, Atom, Atom, Window, Time);
+typedef int (*XChangePropertyFunc)(Display *, Window, Atom, Atom, int, int, const unsigned char *, int);
+typedef int (*XGetWindowPropertyFunc)(Display *, Window, Atom, long, long, Bool, Atom, Atom *, int *, unsigned long *, unsigned long *, unsigned char **);
+typedef Status (*XSendEventFunc)(Display *, Window, Bool, long, XEvent *);
+typedef int (*XFreeFunc)(void *);
+typedef char *(*XGetAtomNameFunc)(Display *, Atom);
+typedef int (*XConnectionNumberFunc)(Display *);
+typedef XErrorHandler (*XSetErrorHandlerFunc)(XErrorHandler);
+typedef Bool (*XQueryPointerFunc)(Display *, Window, Window *, Window *, int *, int *, int *, int *, unsigned int *);
 typedef Status (*DPMSEnableFunc)(Display *);
 typedef Status (*DPMSDisableFunc)(Display *);
 typedef Bool (*DPMSSetTimeoutsFunc)(Display *, CARD16, CARD16, CARD16);
@@ -44,7 +77,12 @@ static int screen = 0;
 static Bool dpms_was_enabled = False;
 static Bool dpms_available = False;
 static Bool xfixes_available = False;
+/* keys and buttons we hold down, so releasing everything and input state
+ * snapshots only touch what is actually pressed */
+static unsigned char key_state[256];
+static unsigned int button_state = 0;
 
+static XInitThreadsFunc xInitThreads = NULL;
 static XOpenDisplayFunc xOpenDisplay = NULL;
 static XDefaultScreenFunc xDefaultScreen = NULL;
 static XRootWindowFunc xRootWindow = NULL;
@@ -60,6 +98,25 @@ static XTestFakeMotionEventFunc xTestFakeMotionEvent = NULL;
 static XTestFakeRelativeMotionEventFunc xTestFakeRelativeMotionEvent = NULL;
 static XTestFakeButtonEventFunc xTestFakeButtonEvent = NULL;
 static XTestFakeKeyEventFunc xTestFakeKeyEvent = NULL;
+static XQueryPointerFunc xQueryPointer = NULL;
+static XFixesQueryExtensionFunc xFixesQueryExtension = NULL;
+static XFixesSelectSelectionInputFunc xFixesSelectSelectionInput = NULL;
+static XInternAtomFunc xInternAtom = NULL;
+static XPendingFunc xPending = NULL;
+static XNextEventFunc xNextEvent = NULL;
+static XCreateSimpleWindowFunc xCreateSimpleWindow = NULL;
+static XDestroyWindowFunc xDestroyWindow = NULL;
+static XSelectInputFunc xSelectInput = NULL;
+static XSetSelectionOwnerFunc xSetSelectionOwner = NULL;
+static XGetSelectionOwnerFunc xGetSelectionOwner = NULL;
+static XConvertSelectionFunc xConvertSelection = NULL;
+static XChangePropertyFunc xChangeProperty = NULL;
+static XGetWindowPropertyFunc xGetWindowProperty = NULL;
+static XSendEventFunc xSendEvent = NULL;
+static XFreeFunc xFree = NULL;
+static XGetAtomNameFunc xGetAtomName = NULL;
+static XConnectionNumberFunc xConnectionNumber = NULL;
+static XSetErrorHandlerFunc xSetErrorHandler = NULL;
 static DPMSEnableFunc dpmsEnable = NULL;
 static DPMSDisableFunc dpmsDisable = NULL;
 static DPMSSetTimeoutsFunc dpmsSetTimeouts = NULL;
@@ -106,6 +163,7 @@ static int ensure_x11()
         dpms_available = True;
     }
 
+    xInitThreads = (XInitThreadsFunc)dlsym(x11_handle, "XInitThreads");
     xOpenDisplay = (XOpenDisplayFunc)dlsym(x11_handle, "XOpenDisplay");
     xDefaultScreen = (XDefaultScreenFunc)dlsym(x11_handle, "XDefaultScreen");
     xRootWindow = (XRootWindowFunc)dlsym(x11_handle, "XRootWindow");
@@ -115,10 +173,29 @@ static int ensure_x11()
     xGrabKeyboard = (XGrabKeyboardFunc)dlsym(x11_handle, "XGrabKeyboard");
     xUngrabPointer = (XUngrabPointerFunc)dlsym(x11_handle, "XUngrabPointer");
     xUngrabKeyboard = (XUngrabKeyboardFunc)dlsym(x11_handle, "XUngrabKeyboard");
+    xQueryPointer = (XQueryPointerFunc)dlsym(x11_handle, "XQueryPointer");
+    xInternAtom = (XInternAtomFunc)dlsym(x11_handle, "XInternAtom");
+    xPending = (XPendingFunc)dlsym(x11_handle, "XPending");
+    xNextEvent = (XNextEventFunc)dlsym(x11_handle, "XNextEvent");
+    xCreateSimpleWindow = (XCreateSimpleWindowFunc)dlsym(x11_handle, "XCreateSimpleWindow");
+    xDestroyWindow = (XDestroyWindowFunc)dlsym(x11_handle, "XDestroyWindow");
+    xSelectInput = (XSelectInputFunc)dlsym(x11_handle, "XSelectInput");
+    xSetSelectionOwner = (XSetSelectionOwnerFunc)dlsym(x11_handle, "XSetSelectionOwner");
+    xGetSelectionOwner = (XGetSelectionOwnerFunc)dlsym(x11_handle, "XGetSelectionOwner");
+    xConvertSelection = (XConvertSelectionFunc)dlsym(x11_handle, "XConvertSelection");
+    xChangeProperty = (XChangePropertyFunc)dlsym(x11_handle, "XChangeProperty");
+    xGetWindowProperty = (XGetWindowPropertyFunc)dlsym(x11_handle, "XGetWindowProperty");
+    xSendEvent = (XSendEventFunc)dlsym(x11_handle, "XSendEvent");
+    xFree = (XFreeFunc)dlsym(x11_handle, "XFree");
+    xGetAtomName = (XGetAtomNameFunc)dlsym(x11_handle, "XGetAtomName");
+    xConnectionNumber = (XConnectionNumberFunc)dlsym(x11_handle, "XConnectionNumber");
+    xSetErrorHandler = (XSetErrorHandlerFunc)dlsym(x11_handle, "XSetErrorHandler");
 
     xFixesHideCursor = (XFixesHideCursorFunc)dlsym(xfixes_handle, "XFixesHideCursor");
     xFixesShowCursor = (XFixesShowCursorFunc)dlsym(xfixes_handle, "XFixesShowCursor");
     xfixes_available = xFixesHideCursor && xFixesShowCursor;
+    xFixesQueryExtension = (XFixesQueryExtensionFunc)dlsym(xfixes_handle, "XFixesQueryExtension");
+    xFixesSelectSelectionInput = (XFixesSelectSelectionInputFunc)dlsym(xfixes_handle, "XFixesSelectSelectionInput");
 
     xTestFakeMotionEvent = (XTestFakeMotionEventFunc)dlsym(xtest_handle, "XTestFakeMotionEvent");
     xTestFakeRelativeMotionEvent = (XTestFakeRelativeMotionEventFunc)dlsym(xtest_handle, "XTestFakeRelativeMotionEvent");
@@ -158,6 +235,10 @@ static int ensure_x11()
         LOG(stderr, "Warning: DPMS extension not available. Idle inhibition will be disabled.\n");
     }
 
+    /* the native datapath injects from its own thread */
+    if (xInitThreads)
+        xInitThreads();
+
     display = xOpenDisplay(NULL);
     if (!display)
     {
@@ -260,10 +341,24 @@ __attribute__((export_name("x11_mouse_relative_motion"))) int x11_mouse_relative
     return 0;
 }
 
+static void fake_key(unsigned int keycode, Bool pressed)
+{
+    if (keycode < 256)
+        key_state[keycode] = pressed;
+    xTestFakeKeyEvent(display, keycode, pressed, CurrentTime);
+}
+
 __attribute__((export_name("x11_mouse_button"))) int x11_mouse_button(int button, int pressed)
 {
     if (ensure_x11() < 0)
         return -1;
+    if (button >= 0 && button < 32)
+    {
+        if (pressed)
+            button_state |= 1u << button;
+        else
+            button_state &= ~(1u << button);
+    }
     xTestFakeButtonEvent(display, button, pressed ? True : False, CurrentTime);
     xFlush(display);
     return 0;
@@ -304,7 +399,7 @@ __attribute__((export_name("x11_key_raw"))) int x11_key_raw(int keycode, int pre
 {
     if (ensure_x11() < 0)
         return -1;
-    xTestFakeKeyEvent(display, keycode, pressed ? True : False, CurrentTime);
+    fake_key(keycode, pressed ? True : False);
     xFlush(display);
     return 0;
 }
@@ -316,18 +411,18 @@ __attribute__((export_name("x11_key"))) int x11_key(int keycode, int modifiers,
 
     if (modifiers & 0x01)
     {
-        xTestFakeKeyEvent(display, 50, pressed ? True : False, CurrentTime);
+        fake_key(50, pressed ? True : False);
     }
     if (modifiers & 0x02)
     {
-        xTestFakeKeyEvent(display, 37, pressed ? True : False, CurrentTime);
+        fake_key(37, pressed ? True : False);
     }
     if (modifiers & 0x04)
     {
-        xTestFakeKeyEvent(display, 64, pressed ? True : False, CurrentTime);
+        fake_key(64, pressed ? True : False);
     }
 
-    xTestFakeKeyEvent(display, keycode, pressed ? True : False, CurrentTime);
+    fake_key(keycode, pressed ? True : False);
     xFlush(display);
     return 0;
 }
@@ -337,19 +432,92 @@ __attribute__((export_name("x11_key_release_all"))) int x11_key_release_all()
     if (ensure_x11() < 0)
         return -1;
 
-    xTestFakeKeyEvent(display, 50, False, CurrentTime);
-    xTestFakeKeyEvent(display, 37, False, CurrentTime);
-    xTestFakeKeyEvent(display, 64, False, CurrentTime);
-    xTestFakeKeyEvent(display, 133, False, CurrentTime);
+    for (int i = 0; i < 256; i++)
+    {
+        if (key_state[i])
+            fake_key(i, False);
+    }
+
+    xFlush(display);
+    return 0;
+}
+
+#define BIT_SET(bits, len, i) ((i) < (len) * 8 && ((bits)[(i) >> 3] & (1 << ((i) & 7))))
+
+/* reconcile the keys and buttons we hold with a sender's input state
+ * snapshot (src/network/snapshot.js), injecting only the differences. keys
+ * and raw are keycode bitmaps, both are X keycodes here */
+__attribute__((export_name("x11_input_sync"))) int x11_input_sync(const unsigned char *keys, int keys_len,
+                                                                  const unsigned char *raw, int raw_len,
+                                                                  unsigned int buttons, unsigned int modifiers)
+{
+    unsigned char want[256] = {0};
+    unsigned int mask = 0;
+    Window window;
+    int i, held = 0, pos;
+
+    if (ensure_x11() < 0)
+        return -1;
+
+    for (i = 0; i < 256; i++)
+    {
+        if (BIT_SET(keys, keys_len, i))
+            want[i] = held = 1;
+        if (BIT_SET(raw, raw_len, i))
+            want[i] = 1;
+    }
+    /* x11_key holds the modifier keys along with the key */
+    if (held)
+    {
+        if (modifiers & 0x01)
+            want[50] = 1;
+        if (modifiers & 0x02)
+            want[37] = 1;
+        if (modifiers & 0x04)
+            want[64] = 1;
+    }
+
+    for (i = 0; i < 256; i++)
+    {
+        if (key_state[i] && !want[i])
+        {
+            TRACE(TRACE_SYNC, TRACE_SYNC_KEY, i, 0, 1);
+            fake_key(i, False);
+        }
+    }
+    for (i = 0; i < 256; i++)
+    {
+        if (want[i] && !key_state[i])
+        {
+            TRACE(TRACE_SYNC, TRACE_SYNC_KEY, i, 1, 0);
+            fake_key(i, True);
+        }
+    }
 
-    for (int i = 24; i <= 47; i++)
+    /* 4 to 7 are the wheel, only ever clicked */
+    for (i = 1; i < 32; i++)
     {
-        xTestFakeKeyEvent(display, i, False, CurrentTime);
+        if ((i >= 4 && i <= 7) || !(buttons & (1u << i)) == !(button_state & (1u << i)))
+            continue;
+        TRACE(TRACE_SYNC, TRACE_SYNC_BUTTON, i, !!(buttons & (1u << i)), 0);
+        x11_mouse_button(i, !!(buttons & (1u << i)));
     }
 
-    for (int i = 10; i <= 19; i++)
+    /* caps lock and num lock, tapped if the server disagrees */
+    if (xQueryPointer && xQueryPointer(display, root, &window, &window, &pos, &pos, &pos, &pos, &mask))
     {
-        xTestFakeKeyEvent(display, i, False, CurrentTime);
+        if (!(mask & LockMask) != !(modifiers & 0x1000))
+        {
+            TRACE(TRACE_SYNC, TRACE_SYNC_LOCK, 66, !!(modifiers & 0x1000), 0);
+            xTestFakeKeyEvent(display, 66, True, CurrentTime);
+            xTestFakeKeyEvent(display, 66, False, CurrentTime);
+        }
+        if (!(mask & Mod2Mask) != !(modifiers & 0x2000))
+        {
+            TRACE(TRACE_SYNC, TRACE_SYNC_LOCK, 77, !!(modifiers & 0x2000), 0);
+            xTestFakeKeyEvent(display, 77, True, CurrentTime);
+            xTestFakeKeyEvent(display, 77, False, CurrentTime);
+        }
     }
 
     xFlush(display);
@@ -383,8 +551,1197 @@ __attribute__((export_name("x11_idle_inhibit"))) int x11_idle_inhibit(int inhibi
     return 0;
 }
 
+/* pid of the X server on a local connection, -1 when it cannot be told */
+__attribute__((export_name("x11_server_pid"))) int x11_server_pid()
+{
+    if (ensure_x11() < 0)
+        return -1;
+
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    if (getsockopt(xConnectionNumber(display), SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.pid > 0)
+        return cred.pid;
+#endif
+    return -1;
+}
+
+/* Native clipboard. A thread with a display connection of its own owns
+ * CLIPBOARD and PRIMARY on a hidden window and answers SelectionRequest from
+ * the sealed memfd the content was handed over in (memfd.h), a chunk at a
+ * time, INCR for content bigger than a property should carry. Owner changes
+ * come in as XFixes selection events and are reported through the callback
+ * given to x11_clipboard_init. Reading a selection asks for its TARGETS and
+ * converts it into a property of the window as text, or the first other
+ * MIME type it has. The bytes are collected in a memfd and handed out
+ * through a pipe. The display the input is injected on is never touched, so
+ * a slow paste cannot hold up input. */
+
+#define CLIP_MAX_MIMES 32
+/* pastes served, INCR transfers and readers waiting at the same time */
+#define CLIP_MAX_WRITES 16
+/* content above this goes out INCR, far below the maximum request size of
+ * any server */
+#define CLIP_INCR_CHUNK (64 * 1024)
+/* milliseconds a transfer may go without progress */
+#define CLIP_TIMEOUT 5000
+/* largest selection read, MAX_BULK in src/network/bulk.js */
+#define CLIP_MAX_SIZE (64 << 20)
+
+/* events reported to the x11_clipboard_init callback, the same as
+ * wlClipboardEvent in src/wayland/include/wayland.h */
+enum
+{
+    CLIP_CHANGED = 0,
+    CLIP_REQUEST = 1,
+};
+
+typedef void (*ClipboardEventFunc)(int event, int primary, unsigned int serial);
+
+/* content shared by a selection and the transfers serving it, a memfd of
+ * its own */
+struct clip_data
+{
+    int refs;
+    int fd;
+    size_t len;
+};
+
+/* a selection owned by the window */
+struct clip_owned
+{
+    Bool active;
+    /* XSetSelectionOwner done for this serial */
+    Bool claimed;
+    unsigned int serial;
+    /* newline separated MIME types, interned into targets when claiming */
+    char *mimes;
+    Atom targets[CLIP_MAX_MIMES];
+    int target_count;
+    Bool text;
+    /* NULL until the content is known */
+    struct clip_data *data;
+    /* the content could not be had, the waiting requests are refused */
+    Bool failed;
+    /* requests waiting for the content */
+    XSelectionRequestEvent waiting[CLIP_MAX_WRITES];
+    int waiting_count;
+    long deadline;
+};
+
+/* content going out INCR, a chunk for every property the requestor deleted */
+struct clip_incr
+{
+    Window requestor;
+    Atom property;
+    Atom type;
+    struct clip_data *data;
+    size_t off;
+    long deadline;
+};
+
+/* a conversion of another client's selection, the result goes to fds */
+struct clip_read
+{
+    Bool active;
+    Bool incr;
+    /* what is converted, TARGETS first and then the target chosen */
+    Atom target;
+    /* index into text_targets while trying them in turn, for owners that
+     * have no TARGETS. -1 otherwise */
+    int text;
+    int fds[CLIP_MAX_WRITES];
+    int fd_count;
+    /* memfd the content is collected in */
+    int fd;
+    size_t len;
+    long deadline;
+};
+
+struct clip_write
+{
+    int fd;
+    struct clip_data *data;
+    off_t off;
+};
+
+struct clip_event
+{
+    int event;
+    int primary;
+    unsigned int serial;
+};
+
+/* text targets, preferred first when reading. TEXT is offered as well */
+static const char *text_target_names[] = {
+    "UTF8_STRING",
+    "text/plain;charset=utf-8",
+    "text/plain",
+    "STRING",
+};
+#define CLIP_TEXT_TARGETS (sizeof(text_target_names) / sizeof(text_target_names[0]))
+
+static struct
+{
+    Display *display;
+    Window window;
+    int event_base;
+    ClipboardEventFunc on_event;
+    XErrorHandler previous_error;
+    pthread_t thread;
+    int wake[2];
+    /* CLIPBOARD and PRIMARY, and the properties of the window they are
+     * read into */
+    Atom selections[2];
+    Atom properties[2];
+    Atom targets_atom;
+    Atom incr_atom;
+    Atom text_atom;
+    Atom png_atom;
+    Atom text_targets[CLIP_TEXT_TARGETS];
+    /* events raised while handling, reported once the lock is dropped.
+     * only the thread touches them */
+    struct clip_event events[8];
+    int event_count;
+    /* guards everything below, taken by the thread and the
+     * x11_clipboard_* calls */
+    pthread_mutex_t lock;
+    Bool running;
+    unsigned int serial;
+    struct clip_owned owned[2];
+    struct clip_read reads[2];
+    struct clip_incr incrs[CLIP_MAX_WRITES];
+    int incr_count;
+    struct clip_write writes[CLIP_MAX_WRITES];
+    int write_count;
+    /* MIME type of the last read of each selection */
+    char *read_types[2];
+    /* a property worth of content read for serving, only the thread
+     * touches it */
+    unsigned char chunk[CLIP_INCR_CHUNK];
+} clip = {
+    .wake = {-1, -1},
+    .reads = {{.fd = -1}, {.fd = -1}},
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static long clip_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* takes over fd, NULL and closed if it cannot be had */
+static struct clip_data *clip_data_new(int fd, size_t len)
+{
+    struct clip_data *data;
+
+    if (fd < 0 || !(data = malloc(sizeof(*data))))
+    {
+        if (fd >= 0)
+            close(fd);
+        return NULL;
+    }
+    data->refs = 1;
+    data->fd = fd;
+    data->len = len;
+    return data;
+}
+
+static void clip_data_unref(struct clip_data *data)
+{
+    if (data && --data->refs == 0)
+    {
+        close(data->fd);
+        free(data);
+    }
+}
+
+/* len bytes of data from off into clip.chunk, False if they cannot be read */
+static Bool clip_data_read(struct clip_data *data, size_t off, size_t len)
+{
+    size_t got = 0;
+    ssize_t n;
+
+    while (got < len)
+    {
+        n = pread(data->fd, clip.chunk + got, len - got, (off_t)(off + got));
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return False;
+        got += n;
+    }
+    return True;
+}
+
+static void clip_wake()
+{
+    char c = 0;
+
+    if (write(clip.wake[1], &c, 1) == -1 && errno != EAGAIN)
+    {
+        LOG(stderr, "clipboard: could not wake thread\n");
+    }
+}
+
+static void clip_emit(int event, int primary, unsigned int serial)
+{
+    if (clip.event_count == sizeof(clip.events) / sizeof(clip.events[0]))
+        return;
+    clip.events[clip.event_count++] = (struct clip_event){event, primary, serial};
+}
+
+/* a requestor may be gone by the time it is answered, which is no reason to
+ * end the process the way the default handler does */
+static int clip_error(Display *dpy, XErrorEvent *error)
+{
+    if (dpy != clip.display && clip.previous_error)
+        return clip.previous_error(dpy, error);
+    LOG(stderr, "clipboard: X error %d for request %d\n", error->error_code, error->request_code);
+    return 0;
+}
+
+static int clip_index(Atom selection)
+{
+    if (selection == clip.selections[0])
+        return 0;
+    if (selection == clip.selections[1])
+        return 1;
+    return -1;
+}
+
+/* takes over fd */
+static void clip_write_add(int fd, struct clip_data *data)
+{
+    struct clip_write *w;
+
+    if (clip.write_count == CLIP_MAX_WRITES)
+    {
+        LOG(stderr, "clipboard: too many pastes at once, dropping one\n");
+        close(fd);
+        return;
+    }
+    w = &clip.writes[clip.write_count++];
+    w->fd = fd;
+    w->data = data;
+    w->off = 0;
+    data->refs++;
+}
+
+static void clip_write_some(struct pollfd *pfd, int count)
+{
+    struct clip_write *w;
+    sigset_t pipe_set;
+    struct timespec zero = {0};
+    ssize_t n;
+    int i;
+
+    for (i = count - 1; i >= 0; --i)
+    {
+        w = &clip.writes[i];
+        if (!pfd[i].revents)
+            continue;
+        n = memfdSend(w->fd, w->data->fd, &w->off, w->data->len - (size_t)w->off);
+        if (n == -1 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (n == -1 && errno == EPIPE)
+        {
+            /* SIGPIPE is blocked on this thread, take it off the queue */
+            sigemptyset(&pipe_set);
+            sigaddset(&pipe_set, SIGPIPE);
+            sigtimedwait(&pipe_set, NULL, &zero);
+        }
+        if (n > 0 && (size_t)w->off < w->data->len)
+            continue;
+        close(w->fd);
+        clip_data_unref(w->data);
+        *w = clip.writes[--clip.write_count];
+    }
+}
+
+static void clip_notify(XSelectionRequestEvent *req, Atom property)
+{
+    XEvent event;
+
+    memset(&event, 0, sizeof(event));
+    event.xselection.type = SelectionNotify;
+    event.xselection.display = req->display;
+    event.xselection.requestor = req->requestor;
+    event.xselection.selection = req->selection;
+    event.xselection.target = req->target;
+    event.xselection.property = property;
+    event.xselection.time = req->time;
+    xSendEvent(clip.display, req->requestor, False, NoEventMask, &event);
+}
+
+/* obsolete clients leave the property to the owner */
+static Atom clip_property(XSelectionRequestEvent *req)
+{
+    return req->property != None ? req->property : req->target;
+}
+
+static Bool clip_offers(struct clip_owned *owned, Atom target)
+{
+    unsigned int i;
+
+    if (owned->text)
+    {
+        if (target == clip.text_atom)
+            return True;
+        for (i = 0; i < CLIP_TEXT_TARGETS; i++)
+        {
+            if (target == clip.text_targets[i])
+                return True;
+        }
+    }
+    for (i = 0; i < (unsigned int)owned->target_count; i++)
+    {
+        if (target == owned->targets[i])
+            return True;
+    }
+    return False;
+}
+
+static void clip_answer_targets(XSelectionRequestEvent *req, struct clip_owned *owned)
+{
+    Atom targets[CLIP_MAX_MIMES + CLIP_TEXT_TARGETS + 2];
+    unsigned int i;
+    int n = 0;
+
+    targets[n++] = clip.targets_atom;
+    if (owned->text)
+    {
+        for (i = 0; i < CLIP_TEXT_TARGETS; i++)
+            targets[n++] = clip.text_targets[i];
+        targets[n++] = clip.text_atom;
+    }
+    for (i = 0; i < (unsigned int)owned->target_count; i++)
+        targets[n++] = owned->targets[i];
+    xChangeProperty(clip.display, req->requestor, clip_property(req), XA_ATOM, 32, PropModeReplace,
+                    (unsigned char *)targets, n);
+    clip_notify(req, clip_property(req));
+}
+
+static void clip_serve(XSelectionRequestEvent *req, struct clip_data *data)
+{
+    Atom property = clip_property(req);
+    /* TEXT leaves the encoding to the owner */
+    Atom type = req->target == clip.text_atom ? clip.text_targets[0] : req->target;
+    struct clip_incr *incr;
+    long size;
+
+    if (data->len <= CLIP_INCR_CHUNK)
+    {
+        if (!clip_data_read(data, 0, data->len))
+        {
+            clip_notify(req, None);
+            return;
+        }
+        xChangeProperty(clip.display, req->requestor, property, type, 8, PropModeReplace, clip.chunk, (int)data->len);
+        clip_notify(req, property);
+        return;
+    }
+    if (clip.incr_count == CLIP_MAX_WRITES)
+    {
+        LOG(stderr, "clipboard: too many pastes at once, refusing one\n");
+        clip_notify(req, None);
+        return;
+    }
+    /* the requestor deletes the property for each chunk it took */
+    xSelectInput(clip.display, req->requestor, PropertyChangeMask);
+    size = (long)data->len;
+    xChangeProperty(clip.display, req->requestor, property, clip.incr_atom, 32, PropModeReplace,
+                    (unsigned char *)&size, 1);
+    incr = &clip.incrs[clip.incr_count++];
+    incr->requestor = req->requestor;
+    incr->property = property;
+    incr->type = type;
+    incr->data = data;
+    incr->off = 0;
+    incr->deadline = clip_now() + CLIP_TIMEOUT;
+    data->refs++;
+    clip_notify(req, property);
+}
+
+static void clip_incr_done(int i)
+{
+    Window requestor = clip.incrs[i].requestor;
+    int j;
+
+    clip_data_unref(clip.incrs[i].data);
+    clip.incrs[i] = clip.incrs[--clip.incr_count];
+    /* the window itself reads through its property events */
+    if (requestor == clip.window)
+        return;
+    for (j = 0; j < clip.incr_count; j++)
+    {
+        if (clip.incrs[j].requestor == requestor)
+            return;
+    }
+    xSelectInput(clip.display, requestor, NoEventMask);
+}
+
+/* a requestor deleted the property, it took the last chunk */
+static void clip_incr_next(XPropertyEvent *event)
+{
+    struct clip_incr *incr;
+    size_t n;
+    int i;
+
+    if (event->state != PropertyDelete)
+        return;
+    for (i = 0; i < clip.incr_count; i++)
+    {
+        incr = &clip.incrs[i];
+        if (incr->requestor != event->window || incr->property != event->atom)
+            continue;
+        n = incr->data->len - incr->off;
+        if (n > CLIP_INCR_CHUNK)
+            n = CLIP_INCR_CHUNK;
+        /* a requestor that never gets the empty chunk gives up on its own */
+        if (!clip_data_read(incr->data, incr->off, n))
+        {
+            clip_incr_done(i);
+            return;
+        }
+        xChangeProperty(clip.display, incr->requestor, incr->property, incr->type, 8, PropModeReplace,
+                        clip.chunk, (int)n);
+        /* the empty chunk ends the transfer */
+        if (n == 0)
+        {
+            clip_incr_done(i);
+            return;
+        }
+        incr->off += n;
+        incr->deadline = clip_now() + CLIP_TIMEOUT;
+        return;
+    }
+}
+
+static void clip_request(XSelectionRequestEvent *req)
+{
+    int primary = clip_index(req->selection);
+    struct clip_owned *owned;
+
+    if (primary < 0 || !clip.owned[primary].active || !clip.owned[primary].claimed)
+    {
+        clip_notify(req, None);
+        return;
+    }
+    owned = &clip.owned[primary];
+    if (req->target == clip.targets_atom)
+    {
+        clip_answer_targets(req, owned);
+    }
+    else if (!clip_offers(owned, req->target))
+    {
+        clip_notify(req, None);
+    }
+    else if (owned->data)
+    {
+        clip_serve(req, owned->data);
+    }
+    else if (owned->waiting_count == CLIP_MAX_WRITES)
+    {
+        LOG(stderr, "clipboard: too many pastes at once, refusing one\n");
+        clip_notify(req, None);
+    }
+    else
+    {
+        owned->waiting[owned->waiting_count++] = *req;
+        /* the first paste of content not known yet asks for it */
+        if (owned->waiting_count == 1)
+        {
+            owned->deadline = clip_now() + CLIP_TIMEOUT;
+            clip_emit(CLIP_REQUEST, primary, owned->serial);
+        }
+    }
+}
+
+static void clip_answer_waiting(struct clip_owned *owned)
+{
+    int i;
+
+    for (i = 0; i < owned->waiting_count; i++)
+    {
+        if (owned->data)
+            clip_serve(&owned->waiting[i], owned->data);
+        else
+            clip_notify(&owned->waiting[i], None);
+    }
+    owned->waiting_count = 0;
+    owned->failed = False;
+}
+
+static void clip_drop(int primary)
+{
+    struct clip_owned *owned = &clip.owned[primary];
+
+    clip_data_unref(owned->data);
+    owned->data = NULL;
+    clip_answer_waiting(owned);
+    free(owned->mimes);
+    owned->mimes = NULL;
+    owned->target_count = 0;
+    owned->text = False;
+    owned->active = False;
+    owned->claimed = False;
+}
+
+static void clip_claim(int primary)
+{
+    struct clip_owned *owned = &clip.owned[primary];
+    char *mime, *save = NULL;
+
+    owned->target_count = 0;
+    owned->text = False;
+    mime = owned->mimes ? strtok_r(owned->mimes, "\n", &save) : NULL;
+    for (; mime; mime = strtok_r(NULL, "\n", &save))
+    {
+        if (!strcmp(mime, "text/plain;charset=utf-8") || !strcmp(mime, "text/plain"))
+            owned->text = True;
+        else if (owned->target_count < CLIP_MAX_MIMES)
+            owned->targets[owned->target_count++] = xInternAtom(clip.display, mime, False);
+    }
+    owned->claimed = True;
+    xSetSelectionOwner(clip.display, clip.selections[primary], clip.window, CurrentTime);
+    if (xGetSelectionOwner(clip.display, clip.selections[primary]) != clip.window)
+    {
+        LOG(stderr, "clipboard: could not take the selection\n");
+        clip_drop(primary);
+        return;
+    }
+    /* pastes that came in while a new selection was set ask for it */
+    if (owned->waiting_count && !owned->data)
+    {
+        owned->deadline = clip_now() + CLIP_TIMEOUT;
+        clip_emit(CLIP_REQUEST, primary, owned->serial);
+    }
+}
+
+static void clip_selection_clear(XSelectionClearEvent *event)
+{
+    int primary = clip_index(event->selection);
+
+    /* a clear may be older than a claim that followed it */
+    if (primary < 0 || !clip.owned[primary].claimed)
+        return;
+    if (xGetSelectionOwner(clip.display, event->selection) != clip.window)
+        clip_drop(primary);
+}
+
+/* the MIME type a read of target comes out as */
+static char *clip_type_name(Atom target)
+{
+    char *name, *type;
+    unsigned int i;
+
+    /* text arrives as UTF-8 whichever target it was asked for by */
+    for (i = 0; i < CLIP_TEXT_TARGETS; i++)
+    {
+        if (target == clip.text_targets[i])
+            return strdup(text_target_names[1]);
+    }
+    if (!(name = xGetAtomName(clip.display, target)))
+        return NULL;
+    type = strdup(name);
+    xFree(name);
+    return type;
+}
+
+static void clip_read_finish(int primary, Bool ok)
+{
+    struct clip_read *rd = &clip.reads[primary];
+    struct clip_data *data = NULL;
+    int i;
+
+    if (ok && rd->fd >= 0)
+    {
+        memfdSeal(rd->fd);
+        data = clip_data_new(rd->fd, rd->len);
+        free(clip.read_types[primary]);
+        clip.read_types[primary] = clip_type_name(rd->target);
+    }
+    else if (rd->fd >= 0)
+    {
+        close(rd->fd);
+    }
+    /* readers get nothing but the end of the pipe if it failed */
+    for (i = 0; i < rd->fd_count; i++)
+    {
+        if (data)
+            clip_write_add(rd->fds[i], data);
+        else
+            close(rd->fds[i]);
+    }
+    clip_data_unref(data);
+    memset(rd, 0, sizeof(*rd));
+    rd->fd = -1;
+}
+
+static void clip_read_convert(int primary, Atom target)
+{
+    clip.reads[primary].target = target;
+    xConvertSelection(clip.display, clip.selections[primary], target, clip.properties[primary], clip.window,
+                      CurrentTime);
+}
+
+static void clip_read_start(int primary)
+{
+    struct clip_read *rd = &clip.reads[primary];
+
+    if ((rd->fd = memfdCreate()) == -1)
+    {
+        LOG(stderr, "clipboard: no memfd to read into: %s\n", strerror(errno));
+        clip_read_finish(primary, False);
+        return;
+    }
+    rd->active = True;
+    rd->incr = False;
+    rd->text = -1;
+    rd->len = 0;
+    rd->deadline = clip_now() + CLIP_TIMEOUT;
+    clip_read_convert(primary, clip.targets_atom);
+}
+
+/* what to read of the targets a selection has: text first, then image/png,
+ * then the first that looks like a MIME type. None if nothing does */
+static Atom clip_read_choose(const Atom *targets, unsigned long count)
+{
+    unsigned long j;
+    unsigned int i;
+    char *name;
+    Atom chosen = None;
+
+    for (i = 0; i < CLIP_TEXT_TARGETS; i++)
+    {
+        for (j = 0; j < count; j++)
+        {
+            if (targets[j] == clip.text_targets[i])
+                return targets[j];
+        }
+    }
+    for (j = 0; j < count; j++)
+    {
+        if (targets[j] == clip.png_atom)
+            return targets[j];
+    }
+    /* TARGETS, TIMESTAMP, MULTIPLE and the like are no content */
+    for (j = 0; j < count && chosen == None; j++)
+    {
+        if (!(name = xGetAtomName(clip.display, targets[j])))
+            continue;
+        if (strchr(name, '/'))
+            chosen = targets[j];
+        xFree(name);
+    }
+    return chosen;
+}
+
+/* the owner answered TARGETS, convert what it has that we want */
+static void clip_read_targets(int primary)
+{
+    unsigned char *value = NULL;
+    unsigned long count, after;
+    Atom type, target = None;
+    int format;
+
+    if (xGetWindowProperty(clip.display, clip.window, clip.properties[primary], 0, CLIP_MAX_MIMES * 4, True,
+                           XA_ATOM, &type, &format, &count, &after, &value) == Success &&
+        type == XA_ATOM && format == 32)
+        target = clip_read_choose((const Atom *)value, count);
+    if (value)
+        xFree(value);
+    if (target == None)
+    {
+        clip_read_finish(primary, False);
+        return;
+    }
+    clip_read_convert(primary, target);
+}
+
+/* append the property a selection was converted into to its read and
+ * delete it. the number of bytes, -1 if it cannot be had */
+static long clip_read_property(int primary, Atom *type)
+{
+    struct clip_read *rd = &clip.reads[primary];
+    unsigned char *value = NULL;
+    unsigned long count, after, off;
+    ssize_t n;
+    int format;
+
+    if (xGetWindowProperty(clip.display, clip.window, clip.properties[primary], 0, 0x1fffffff, True,
+                           AnyPropertyType, type, &format, &count, &after, &value) != Success)
+        return -1;
+    if (*type == clip.incr_atom || format != 8)
+        count = 0;
+    if (rd->len + count > CLIP_MAX_SIZE)
+    {
+        LOG(stderr, "clipboard: selection too big\n");
+        xFree(value);
+        return -1;
+    }
+    for (off = 0; off < count; off += n)
+    {
+        n = write(rd->fd, value + off, count - off);
+        if (n == -1 && errno == EINTR)
+            n = 0;
+        else if (n <= 0)
+            break;
+    }
+    if (value)
+        xFree(value);
+    if (off < count)
+        return -1;
+    rd->len += count;
+    return (long)count;
+}
+
+static void clip_selection_notify(XSelectionEvent *event)
+{
+    int primary = clip_index(event->selection);
+    struct clip_read *rd;
+    Atom type = None;
+    long n;
+
+    if (primary < 0 || event->requestor != clip.window)
+        return;
+    rd = &clip.reads[primary];
+    if (!rd->active || rd->incr || event->target != rd->target)
+        return;
+    if (event->property == None)
+    {
+        /* an owner without TARGETS, try the text targets in turn */
+        if (rd->target == clip.targets_atom || (rd->text >= 0 && rd->text + 1 < (int)CLIP_TEXT_TARGETS))
+        {
+            rd->text++;
+            clip_read_convert(primary, clip.text_targets[rd->text]);
+            return;
+        }
+        clip_read_finish(primary, False);
+        return;
+    }
+    if (rd->target == clip.targets_atom)
+    {
+        clip_read_targets(primary);
+        return;
+    }
+    n = clip_read_property(primary, &type);
+    if (n >= 0 && type == clip.incr_atom)
+    {
+        /* deleting the property asked for the first chunk */
+        rd->incr = True;
+        rd->deadline = clip_now() + CLIP_TIMEOUT;
+        return;
+    }
+    clip_read_finish(primary, n >= 0);
+}
+
+static void clip_property_notify(XPropertyEvent *event)
+{
+    Atom type;
+    long n;
+    int i;
+
+    /* reading a selection of our own makes the window a requestor too */
+    clip_incr_next(event);
+    if (event->window != clip.window || event->state != PropertyNewValue)
+        return;
+    for (i = 0; i < 2; i++)
+    {
+        if (event->atom != clip.properties[i] || !clip.reads[i].active || !clip.reads[i].incr)
+            continue;
+        n = clip_read_property(i, &type);
+        /* the empty chunk ends the transfer */
+        if (n > 0)
+            clip.reads[i].deadline = clip_now() + CLIP_TIMEOUT;
+        else
+            clip_read_finish(i, n == 0);
+    }
+}
+
+static void clip_handle(XEvent *event)
+{
+    XFixesSelectionNotifyEvent *notify;
+    int primary;
+
+    switch (event->type)
+    {
+    case SelectionRequest:
+        clip_request(&event->xselectionrequest);
+        break;
+    case SelectionNotify:
+        clip_selection_notify(&event->xselection);
+        break;
+    case SelectionClear:
+        clip_selection_clear(&event->xselectionclear);
+        break;
+    case PropertyNotify:
+        clip_property_notify(&event->xproperty);
+        break;
+    default:
+        if (event->type != clip.event_base + XFixesSelectionNotify)
+            break;
+        notify = (XFixesSelectionNotifyEvent *)event;
+        primary = clip_index(notify->selection);
+        /* taking a selection is reported too, only others taking it counts */
+        if (primary >= 0 && notify->owner != clip.window)
+            clip_emit(CLIP_CHANGED, primary, 0);
+        break;
+    }
+}
+
+/* whether deadline passed, the earliest one still ahead is kept in next */
+static Bool clip_due(long deadline, long now, long *next)
+{
+    if (deadline <= now)
+        return True;
+    if (*next < 0 || deadline < *next)
+        *next = deadline;
+    return False;
+}
+
+/* gives up transfers that stalled, the poll timeout until the next one is due */
+static int clip_expire()
+{
+    long now = clip_now(), next = -1;
+    int i;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (clip.reads[i].active && clip_due(clip.reads[i].deadline, now, &next))
+        {
+            LOG(stderr, "clipboard: the selection owner did not answer\n");
+            clip_read_finish(i, False);
+        }
+        if (clip.owned[i].waiting_count && clip_due(clip.owned[i].deadline, now, &next))
+        {
+            LOG(stderr, "clipboard: no content for the selection\n");
+            clip_answer_waiting(&clip.owned[i]);
+        }
+    }
+    for (i = clip.incr_count - 1; i >= 0; --i)
+    {
+        if (clip_due(clip.incrs[i].deadline, now, &next))
+        {
+            LOG(stderr, "clipboard: a requestor stopped taking chunks\n");
+            clip_incr_done(i);
+        }
+    }
+    return next < 0 ? -1 : (int)(next - now);
+}
+
+static void *clip_thread(void *arg)
+{
+    struct pollfd pfd[2 + CLIP_MAX_WRITES];
+    struct clip_event events[8];
+    sigset_t pipe_set;
+    XEvent event;
+    char buf[64];
+    int i, count, timeout, event_count;
+
+    /* a paste closing its end early must not take the process down */
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, NULL);
+
+    pfd[0].fd = xConnectionNumber(clip.display);
+    pfd[0].events = POLLIN;
+    pfd[1].fd = clip.wake[0];
+    pfd[1].events = POLLIN;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&clip.lock);
+        if (!clip.running)
+        {
+            pthread_mutex_unlock(&clip.lock);
+            break;
+        }
+        for (i = 0; i < 2; i++)
+        {
+            if (clip.owned[i].active && !clip.owned[i].claimed)
+                clip_claim(i);
+            if (clip.owned[i].waiting_count && (clip.owned[i].data || clip.owned[i].failed))
+                clip_answer_waiting(&clip.owned[i]);
+            if (clip.reads[i].fd_count && !clip.reads[i].active)
+                clip_read_start(i);
+        }
+        while (xPending(clip.display))
+        {
+            xNextEvent(clip.display, &event);
+            clip_handle(&event);
+        }
+        timeout = clip_expire();
+        xFlush(clip.display);
+        count = clip.write_count;
+        for (i = 0; i < count; i++)
+        {
+            pfd[2 + i].fd = clip.writes[i].fd;
+            pfd[2 + i].events = POLLOUT;
+        }
+        event_count = clip.event_count;
+        memcpy(events, clip.events, sizeof(events[0]) * event_count);
+        clip.event_count = 0;
+        pthread_mutex_unlock(&clip.lock);
+
+        for (i = 0; i < event_count; i++)
+        {
+            if (clip.on_event)
+                clip.on_event(events[i].event, events[i].primary, events[i].serial);
+        }
+
+        for (i = 0; i < 2 + count; i++)
+            pfd[i].revents = 0;
+        if (poll(pfd, 2 + count, timeout) == -1 && errno != EINTR)
+        {
+            LOG(stderr, "clipboard: poll() failed: %s\n", strerror(errno));
+            break;
+        }
+        if (pfd[1].revents & POLLIN)
+        {
+            while (read(clip.wake[0], buf, sizeof(buf)) > 0)
+                ;
+        }
+        if (count)
+        {
+            pthread_mutex_lock(&clip.lock);
+            clip_write_some(pfd + 2, count);
+            pthread_mutex_unlock(&clip.lock);
+        }
+    }
+    return NULL;
+}
+
+static void clip_stop()
+{
+    int i;
+
+    if (!clip.display)
+        return;
+
+    pthread_mutex_lock(&clip.lock);
+    clip.running = False;
+    pthread_mutex_unlock(&clip.lock);
+    clip_wake();
+    pthread_join(clip.thread, NULL);
+
+    for (i = 0; i < 2; i++)
+    {
+        clip_drop(i);
+        clip_read_finish(i, False);
+        free(clip.read_types[i]);
+        clip.read_types[i] = NULL;
+    }
+    while (clip.incr_count)
+        clip_incr_done(clip.incr_count - 1);
+    for (i = 0; i < clip.write_count; i++)
+    {
+        close(clip.writes[i].fd);
+        clip_data_unref(clip.writes[i].data);
+    }
+    clip.write_count = 0;
+    clip.event_count = 0;
+
+    xDestroyWindow(clip.display, clip.window);
+    xCloseDisplay(clip.display);
+    clip.display = NULL;
+    clip.window = None;
+    clip.on_event = NULL;
+    close(clip.wake[0]);
+    close(clip.wake[1]);
+    clip.wake[0] = clip.wake[1] = -1;
+}
+
+/* start owning and watching selections, on_event(event, primary, serial)
+ * is called from the clipboard thread. 0, or -1 without a display or
+ * XFixes */
+__attribute__((export_name("x11_clipboard_init"))) int x11_clipboard_init(ClipboardEventFunc on_event)
+{
+    Window clip_root;
+    int error_base;
+    unsigned int i;
+
+    if (clip.display)
+    {
+        clip.on_event = on_event;
+        return 0;
+    }
+    if (ensure_x11() < 0)
+        return -1;
+    if (!xFixesQueryExtension || !xFixesSelectSelectionInput || !xCreateSimpleWindow || !xDestroyWindow ||
+        !xSelectInput || !xSetSelectionOwner || !xGetSelectionOwner || !xConvertSelection || !xChangeProperty ||
+        !xGetWindowProperty || !xSendEvent || !xFree || !xGetAtomName || !xConnectionNumber || !xSetErrorHandler)
+    {
+        LOG(stderr, "clipboard: X11 functions missing\n");
+        return -1;
+    }
+
+    clip.display = xOpenDisplay(NULL);
+    if (!clip.display)
+        return -1;
+    if (!xFixesQueryExtension(clip.display, &clip.event_base, &error_base))
+    {
+        LOG(stderr, "clipboard: XFixes extension not available\n");
+        xCloseDisplay(clip.display);
+        clip.display = NULL;
+        return -1;
+    }
+    if (pipe2(clip.wake, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        xCloseDisplay(clip.display);
+        clip.display = NULL;
+        return -1;
+    }
+
+    /* never mapped */
+    clip_root = xRootWindow(clip.display, xDefaultScreen(clip.display));
+    clip.window = xCreateSimpleWindow(clip.display, clip_root, -10, -10, 1, 1, 0, 0, 0);
+    xSelectInput(clip.display, clip.window, PropertyChangeMask);
+
+    clip.selections[0] = xInternAtom(clip.display, "CLIPBOARD", False);
+    clip.selections[1] = XA_PRIMARY;
+    clip.properties[0] = xInternAtom(clip.display, "BZZ_CLIPBOARD", False);
+    clip.properties[1] = xInternAtom(clip.display, "BZZ_PRIMARY", False);
+    clip.targets_atom = xInternAtom(clip.display, "TARGETS", False);
+    clip.incr_atom = xInternAtom(clip.display, "INCR", False);
+    clip.text_atom = xInternAtom(clip.display, "TEXT", False);
+    clip.png_atom = xInternAtom(clip.display, "image/png", False);
+    for (i = 0; i < CLIP_TEXT_TARGETS; i++)
+        clip.text_targets[i] = xInternAtom(clip.display, text_target_names[i], False);
+    for (i = 0; i < 2; i++)
+    {
+        xFixesSelectSelectionInput(clip.display, clip_root, clip.selections[i],
+                                   XFixesSetSelectionOwnerNotifyMask | XFixesSelectionWindowDestroyNotifyMask |
+                                       XFixesSelectionClientCloseNotifyMask);
+    }
+    xFlush(clip.display);
+
+    if (!clip.previous_error)
+        clip.previous_error = xSetErrorHandler(clip_error);
+    clip.on_event = on_event;
+    clip.running = True;
+    if (pthread_create(&clip.thread, NULL, clip_thread, NULL) != 0)
+    {
+        clip.running = False;
+        xDestroyWindow(clip.display, clip.window);
+        xCloseDisplay(clip.display);
+        clip.display = NULL;
+        close(clip.wake[0]);
+        close(clip.wake[1]);
+        clip.wake[0] = clip.wake[1] = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/* own PRIMARY (primary != 0) or CLIPBOARD with content of the given newline
+ * separated MIME types, fd a sealed memfd of len bytes a dup of is kept.
+ * fd -1 with len -1 leaves the content to be fetched on the first paste,
+ * through a CLIP_REQUEST and x11_clipboard_fill. the serial of the
+ * selection, 0 on failure */
+__attribute__((export_name("x11_clipboard_set"))) unsigned int x11_clipboard_set(int primary, const char *mimes, int fd,
+                                                                                 int len)
+{
+    struct clip_owned *owned;
+    struct clip_data *content = NULL;
+    unsigned int serial;
+
+    if (!clip.display)
+        return 0;
+    if (fd >= 0 && len >= 0 && !(content = clip_data_new(fcntl(fd, F_DUPFD_CLOEXEC, 0), len)))
+        return 0;
+
+    pthread_mutex_lock(&clip.lock);
+    owned = &clip.owned[primary ? 1 : 0];
+    clip_data_unref(owned->data);
+    free(owned->mimes);
+    owned->data = content;
+    owned->mimes = strdup(mimes);
+    owned->failed = False;
+    owned->active = True;
+    owned->claimed = False;
+    if (++clip.serial == 0)
+        ++clip.serial;
+    serial = owned->serial = clip.serial;
+    pthread_mutex_unlock(&clip.lock);
+
+    clip_wake();
+    return serial;
+}
+
+/* content for a selection set without as for x11_clipboard_set, fd -1 if
+ * it cannot be had. 0, or -1 if the selection is gone */
+__attribute__((export_name("x11_clipboard_fill"))) int x11_clipboard_fill(unsigned int serial, int fd, int len)
+{
+    struct clip_owned *owned;
+    int i, result = -1;
+
+    pthread_mutex_lock(&clip.lock);
+    for (i = 0; i < 2; i++)
+    {
+        owned = &clip.owned[i];
+        if (!owned->active || owned->serial != serial || owned->data)
+            continue;
+        if (fd >= 0 && len >= 0)
+            owned->data = clip_data_new(fcntl(fd, F_DUPFD_CLOEXEC, 0), len);
+        owned->failed = !owned->data;
+        result = 0;
+    }
+    pthread_mutex_unlock(&clip.lock);
+
+    clip_wake();
+    return result;
+}
+
+/* read PRIMARY (primary != 0) or CLIPBOARD, as text if it has text and in
+ * the first other MIME type it has otherwise. the read end of a pipe the
+ * content comes out of, or -1. x11_clipboard_type says what it was once the
+ * pipe is at its end */
+__attribute__((export_name("x11_clipboard_receive"))) int x11_clipboard_receive(int primary)
+{
+    struct clip_read *rd;
+    int fds[2];
+
+    if (!clip.display || pipe2(fds, O_CLOEXEC) == -1)
+        return -1;
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    pthread_mutex_lock(&clip.lock);
+    rd = &clip.reads[primary ? 1 : 0];
+    if (rd->fd_count == CLIP_MAX_WRITES)
+    {
+        pthread_mutex_unlock(&clip.lock);
+        LOG(stderr, "clipboard: too many pastes at once\n");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    rd->fds[rd->fd_count++] = fds[1];
+    pthread_mutex_unlock(&clip.lock);
+
+    clip_wake();
+    return fds[0];
+}
+
+/* MIME type of the last read of PRIMARY (primary != 0) or CLIPBOARD, NULL
+ * before the first */
+__attribute__((export_name("x11_clipboard_type"))) const char *x11_clipboard_type(int primary)
+{
+    const char *type;
+
+    pthread_mutex_lock(&clip.lock);
+    type = clip.read_types[primary ? 1 : 0];
+    pthread_mutex_unlock(&clip.lock);
+    return type;
+}
+
 __attribute__((export_name("x11_cleanup"))) void x11_cleanup()
 {
+    clip_stop();
     if (display)
     {
 
@@ -426,4 +1783,67 @@ void x11_set_env(const char *key, const char *value)
 void x11_unset_env(const char *key)
 {
     unsetenv(key);
-}
\ No newline at end of file
+}
+
+/* datapath sink, these run on the datapath thread */
+
+static void dp_mouse_rel_motion(void *ctx, int dx, int dy)
+{
+    x11_mouse_relative_motion(dx, dy);
+}
+
+static void dp_mouse_motion(void *ctx, int x, int y)
+{
+    x11_mouse_motion(x, y);
+}
+
+static void dp_mouse_button(void *ctx, int button, int state)
+{
+    x11_mouse_button(button, state);
+}
+
+static void dp_mouse_wheel(void *ctx, signed short dx, signed short dy)
+{
+    x11_mouse_wheel(dx, dy);
+}
+
+static void dp_key(void *ctx, int key, int modifiers, int state)
+{
+    x11_key(key, modifiers, state);
+}
+
+static void dp_key_raw(void *ctx, int key, int state)
+{
+    x11_key_raw(key, state);
+}
+
+static void dp_key_release_all(void *ctx)
+{
+    x11_key_release_all();
+}
+
+static void dp_idle_inhibit(void *ctx, bool on)
+{
+    x11_idle_inhibit(on);
+}
+
+__attribute__((export_name("x11_datapath_attach"))) int x11_datapath_attach(struct dpContext *dp)
+{
+    if (ensure_x11() < 0)
+        return -1;
+
+    dpSetSink(dp, &(struct dpSink){
+                      .ctx = display,
+                      .mouse_rel_motion = dp_mouse_rel_motion,
+                      .mouse_motion = dp_mouse_motion,
+                      .mouse_button = dp_mouse_button,
+                      .mouse_wheel = dp_mouse_wheel,
+                      .key = dp_key,
+                      .key_raw = dp_key_raw,
+                      .key_release_all = dp_key_release_all,
+                      .idle_inhibit = dp_idle_inhibit,
+                      /* every x11_* entry point flushes already */
+                      .flush = NULL,
+                  });
+    return 0;
+}
@@ -0,0 +1,134 @@
+import { describe, expect, test } from 'bun:test';
+import { BULK_WINDOW, BulkInbox, BulkSend, CHUNK_SIZE, CODEC, bulkPool, pack, unpack } from '../src/network/bulk.js';
+import { hashOf } from '../src/network/clipboard.js';
+import { ManualClock } from './clock.js';
+
+function text(length) {
+  const words = ['clip', 'board', 'bzz', 'wayland', 'paste', 'x11', 'peer'];
+  let s = '';
+  for (let i = 0; s.length < length; i++) s += `${words[(i * 7) % words.length]}${i % 97} `;
+  return new TextEncoder().encode(s.slice(0, length));
+}
+
+// a sender and an inbox wired back to back, `lose(chunk)` drops chunks
+function link(data, { lose = () => false, codec = CODEC.NONE, size = data.length } = {}) {
+  const inbox = new BulkInbox();
+  let sender;
+  const received = [];
+  sender = new BulkSend(
+    (chunk) => {
+      if (lose(chunk)) return;
+      const copy = { ...chunk, data: chunk.data.slice() };
+      queueMicrotask(() => {
+        const transfer = inbox.accept(copy);
+        received.push(copy.index);
+        sender.ack(transfer.next, transfer.bits());
+      });
+    },
+    { id: 7, op: 0x06, codec, size, data },
+  );
+  return { inbox, sender, received };
+}
+
+describe('bulk channel', () => {
+  test('compresses text and leaves incompressible data alone', async () => {
+    const body = text(100_000);
+    // a body this big is moved to a worker
+    const packed = await pack(body.slice());
+    expect(packed.codec).not.toBe(CODEC.NONE);
+    expect(packed.data.length).toBeLessThan(body.length / 2);
+    expect(Buffer.from(await unpack(packed.codec, packed.data, body.length)).equals(Buffer.from(body))).toBe(true);
+
+    const noise = new Uint8Array(100_000).map(() => (Math.random() * 256) | 0);
+    expect((await pack(noise)).codec).toBe(CODEC.NONE);
+    expect((await pack(text(100))).codec).toBe(CODEC.NONE);
+  });
+
+  test('a transfer is reassembled in place', async () => {
+    const body = text(CHUNK_SIZE * 200 + 17);
+    const { inbox, sender } = link(body);
+    expect(await sender.start()).toBe(true);
+    const transfer = [...inbox.transfers.values()][0];
+    expect(transfer.complete).toBe(true);
+    expect(Buffer.from(inbox.take(transfer)).equals(Buffer.from(body))).toBe(true);
+    expect(sender.stats.retransmits).toBe(0);
+  });
+
+  test('lost chunks are retransmitted', async () => {
+    const body = text(CHUNK_SIZE * BULK_WINDOW * 3);
+    const lost = new Set();
+    const { inbox, sender } = link(body, {
+      lose: (chunk) => chunk.index % 10 === 3 && !lost.has(chunk.index) && lost.add(chunk.index),
+    });
+    expect(await sender.start()).toBe(true);
+    const transfer = [...inbox.transfers.values()][0];
+    expect(Buffer.from(transfer.buf).equals(Buffer.from(body))).toBe(true);
+    expect(sender.stats.retransmits).toBeGreaterThanOrEqual(lost.size);
+  });
+
+  test('never more than a window in flight', async () => {
+    const body = text(CHUNK_SIZE * BULK_WINDOW * 2);
+    const sent = [];
+    const clock = new ManualClock();
+    const sender = new BulkSend((chunk) => sent.push(chunk.index), {
+      id: 1,
+      op: 6,
+      codec: 0,
+      size: body.length,
+      data: body,
+      clock,
+    });
+    const result = sender.start();
+    // the first burst goes out at once, the rest on later turns
+    expect(sent.length).toBeLessThan(BULK_WINDOW);
+    clock.settle();
+    expect(sent.length).toBe(BULK_WINDOW);
+    sender.ack(4, new Uint8Array(8));
+    clock.settle();
+    expect(sent.length).toBe(BULK_WINDOW + 4);
+    sender.stop();
+    expect(await result).toBe(false);
+  });
+
+  test('the inbox refuses chunks that do not fit the transfer', () => {
+    const inbox = new BulkInbox();
+    const chunk = { id: 1, index: 0, op: 6, codec: 0, length: CHUNK_SIZE + 1, size: CHUNK_SIZE + 1 };
+    const transfer = inbox.accept({ ...chunk, data: new Uint8Array(CHUNK_SIZE) });
+    expect(transfer.next).toBe(1);
+    expect(inbox.accept({ ...chunk, size: 5, data: new Uint8Array(1) })).toBeNull();
+    expect(inbox.accept({ ...chunk, index: 1, data: new Uint8Array(2) }).complete).toBe(false);
+    expect(inbox.accept({ ...chunk, length: 1 << 30, id: 2, data: new Uint8Array(1) })).toBeNull();
+  });
+
+  test('input stays on time while a large transfer is packed, sent and unpacked', async () => {
+    const body = text(8 << 20);
+    const copy = body.slice();
+    const edited = body.slice();
+    edited.set(text(1000), 4 << 20);
+
+    // input events every 2 ms, each one's lateness is its latency
+    const latencies = [];
+    let due = performance.now() + 2;
+    const input = setInterval(() => {
+      const now = performance.now();
+      latencies.push(Math.max(0, now - due));
+      due = now + 2;
+    }, 2);
+
+    const { codec, data } = await pack(body);
+    const { inbox, sender } = link(data, { codec, size: copy.length });
+    expect(await sender.start()).toBe(true);
+    const transfer = [...inbox.transfers.values()][0];
+    const received = await unpack(codec, inbox.take(transfer), copy.length);
+    const { delta } = await bulkPool.run('delta', [Buffer.from(copy), Buffer.from(edited)]);
+    const patched = await bulkPool.run('patch', [Buffer.from(copy), delta]);
+    clearInterval(input);
+
+    expect(Buffer.from(received).equals(Buffer.from(copy))).toBe(true);
+    expect(patched.hash.equals(hashOf(edited))).toBe(true);
+    latencies.sort((a, b) => a - b);
+    const p99 = latencies[Math.floor(latencies.length * 0.99)];
+    console.log(`input p99 ${p99.toFixed(2)} ms over ${latencies.length} events during the transfer`);
+    if (bulkPool.size) expect(p99).toBeLessThan(50);
+  });
+});
@@ -0,0 +1,82 @@
+import { afterAll, describe, expect, test } from 'bun:test';
+import { spawnSync } from 'node:child_process';
+import { chmodSync, mkdirSync, mkdtempSync, readFileSync, rmSync, writeFileSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { Capabilities } from '../src/capabilities.js';
+
+const dir = mkdtempSync(join(tmpdir(), 'bzz-capabilities-'));
+const bin = join(dir, 'bin');
+mkdirSync(bin);
+writeFileSync(join(bin, 'wl-copy'), '#!/bin/sh\n');
+chmodSync(join(bin, 'wl-copy'), 0o755);
+const socket = join(dir, 'wayland-1');
+writeFileSync(socket, '');
+
+const env = (overrides = {}) => ({
+  PATH: bin,
+  XDG_SESSION_TYPE: 'wayland',
+  XDG_CURRENT_DESKTOP: 'sway',
+  XDG_SESSION_ID: '3',
+  XDG_RUNTIME_DIR: dir,
+  WAYLAND_DISPLAY: 'wayland-1',
+  ...overrides,
+});
+
+afterAll(() => rmSync(dir, { recursive: true, force: true }));
+
+describe('capabilities', () => {
+  test('a probe finds the session and its helpers', () => {
+    const caps = new Capabilities({ file: join(dir, 'probe.json'), env: env() });
+    expect(caps.current.displayServer).toBe('wayland-wlroots');
+    expect(caps.current.compositor.family).toBe('wlroots');
+    expect(caps.binary('wl-copy')).toBe(join(bin, 'wl-copy'));
+    expect(caps.has('wl-paste')).toBe(false);
+    expect(caps.has('not-a-helper')).toBe(false);
+    expect('not-a-helper' in caps.read().sessions[caps.key].binaries).toBe(true);
+  });
+
+  test('the same session on the same compositor reuses the probe', () => {
+    const file = join(dir, 'reuse.json');
+    const first = new Capabilities({ file, env: env() });
+    first.update({ compositor: { pid: process.pid }, backends: { wayland: 'wlr/ext' } });
+
+    const second = new Capabilities({ file, env: env() });
+    expect(second.current.probed).toBe(first.current.probed);
+    expect(second.current.backends.wayland).toBe('wlr/ext');
+    expect(second.current.compositor).toEqual({ family: 'wlroots', name: null, pid: process.pid });
+  });
+
+  test('another session or a gone compositor probes again', () => {
+    const file = join(dir, 'invalidate.json');
+    const first = new Capabilities({ file, env: env() });
+    first.update({ backends: { wayland: 'wlr/ext' } });
+
+    const session = new Capabilities({ file, env: env({ XDG_SESSION_ID: '4' }) });
+    expect(session.current.backends.wayland).toBeUndefined();
+
+    // a compositor that exited, the socket is still there
+    const { pid } = spawnSync('true');
+    first.update({ compositor: { pid } });
+    const restarted = new Capabilities({ file, env: env() });
+    expect(restarted.current.backends.wayland).toBeUndefined();
+    expect(restarted.current.compositor.pid).toBeNull();
+
+    // sessions of compositors that are gone are not kept
+    const sessions = JSON.parse(readFileSync(file, 'utf8')).sessions;
+    expect(Object.values(sessions).some((entry) => entry.compositor.pid === pid)).toBe(false);
+  });
+
+  test('a recreated display socket probes again', () => {
+    const file = join(dir, 'socket.json');
+    const first = new Capabilities({ file, env: env() });
+    first.update({ backends: { wayland: 'kde/kde' } });
+
+    rmSync(socket);
+    writeFileSync(join(dir, 'other'), '');
+    writeFileSync(socket, '');
+    const second = new Capabilities({ file, env: env() });
+    expect(second.key).not.toBe(first.key);
+    expect(second.current.backends.wayland).toBeUndefined();
+  });
+});
@@ -0,0 +1,109 @@
+import { describe, expect, test } from 'bun:test';
+import { writeSync } from 'node:fs';
+import {
+  CLIPBOARD_CHANGED,
+  CLIPBOARD_REQUEST,
+  ClipboardBody,
+  ClipboardCache,
+  NativeSelections,
+  SelectionWatch,
+  hashKey,
+  hashOf,
+  readBody,
+  readHashed,
+} from '../src/network/clipboard.js';
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+async function* chunks(...parts) {
+  for (const part of parts) yield Buffer.from(part);
+}
+
+describe('clipboard sync', () => {
+  test('a streamed selection hashes like the whole', async () => {
+    const { hash, data } = await readHashed(chunks('hello ', 'clip', 'board'));
+    expect(data.toString()).toBe('hello clipboard');
+    expect(hashKey(hash)).toBe(hashKey(hashOf(Buffer.from('hello clipboard'))));
+    expect(hash.length).toBe(16);
+  });
+
+  test('the cache drops the least recently used content', () => {
+    const cache = new ClipboardCache({ bytes: 10 });
+    cache.set('a', Buffer.alloc(4));
+    cache.set('b', Buffer.alloc(4));
+    cache.get('a');
+    cache.set('c', Buffer.alloc(4));
+    expect(cache.has('a')).toBe(true);
+    expect(cache.has('b')).toBe(false);
+    expect(cache.bytes).toBe(8);
+    cache.set('huge', Buffer.alloc(11));
+    expect(cache.has('huge')).toBe(false);
+  });
+
+  test('contents are read into sealed bodies with the type the read had', async () => {
+    const png = Buffer.from([0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a]);
+    const { hash, body } = await readBody(chunks(png.subarray(0, 3), png.subarray(3)), () => 'image/png');
+    expect(hashKey(hash)).toBe(hashKey(hashOf(png)));
+    expect(body.mime).toBe('image/png');
+    expect(body.length).toBe(png.length);
+    expect(body.read()).toEqual(png);
+    // where there is a memfd it cannot be written to any more
+    if (body.fd >= 0) expect(() => writeSync(body.fd, png)).toThrow();
+
+    const cache = new ClipboardCache({ bytes: 10 });
+    cache.set('png', body);
+    cache.set('text', ClipboardBody.from(Buffer.from('clipboard')));
+    expect(cache.has('png')).toBe(false);
+    expect(body.fd).toBe(-1);
+    expect(cache.get('text').read().toString()).toBe('clipboard');
+  });
+
+  test('a selection that keeps changing is read once it settles', async () => {
+    let change = null;
+    let reads = 0;
+    const seen = [];
+    const watch = new SelectionWatch({
+      watch: (onChange) => {
+        change = onChange;
+        return () => {
+          change = null;
+        };
+      },
+      read: () => chunks(`drag ${++reads}`),
+      onContent: ({ body }) => seen.push(body.read().toString()),
+      debounce: 20,
+    });
+    for (let i = 0; i < 10; i++) {
+      change();
+      await sleep(5);
+    }
+    await sleep(40);
+    expect(reads).toBe(1);
+    expect(seen).toEqual(['drag 1']);
+    watch.stop();
+    expect(change).toBeNull();
+  });
+
+  test('native selections fetch lazily and only for the current offer', async () => {
+    const filled = [];
+    const selections = new NativeSelections((serial, data) => filled.push([serial, data && data.toString()]));
+    let changes = 0;
+    const stop = selections.watch(1, () => changes++);
+    selections.offer(0, 7, async () => Buffer.from('lazy'));
+    selections.onEvent(CLIPBOARD_REQUEST, 0, 7);
+    selections.onEvent(CLIPBOARD_REQUEST, 0, 6);
+    await sleep(0);
+    expect(filled).toEqual([
+      [6, null],
+      [7, 'lazy'],
+    ]);
+
+    selections.onEvent(CLIPBOARD_CHANGED, 1, 0);
+    stop();
+    selections.onEvent(CLIPBOARD_CHANGED, 1, 0);
+    expect(changes).toBe(1);
+    selections.onEvent(CLIPBOARD_CHANGED, 0, 0);
+    selections.onEvent(CLIPBOARD_REQUEST, 0, 7);
+    expect(filled.at(-1)).toEqual([7, null]);
+  });
+});
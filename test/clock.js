@@ -0,0 +1,52 @@
+/**
+ * A clock for src/network/clock.js that only moves when told to. Deferred
+ * callbacks run on `settle()`, timers as `advance(ms)` passes their time.
+ */
+export class ManualClock {
+  constructor() {
+    this.time = 0;
+    this.timers = new Set();
+    this.deferred = new Set();
+  }
+
+  now = () => this.time;
+
+  setTimeout = (fn, ms) => {
+    const timer = { at: this.time + Math.max(0, ms), fn };
+    this.timers.add(timer);
+    return timer;
+  };
+
+  clearTimeout = (timer) => this.timers.delete(timer);
+
+  defer = (fn) => {
+    const handle = { fn };
+    this.deferred.add(handle);
+    return handle;
+  };
+
+  cancel = (handle) => this.deferred.delete(handle);
+
+  /** Run deferred callbacks, and those they defer, until none are left. */
+  settle() {
+    for (const handle of this.deferred) {
+      this.deferred.delete(handle);
+      handle.fn();
+    }
+  }
+
+  /** Move time forward by `ms`, firing timers in order as they come due. */
+  advance(ms) {
+    const end = this.time + ms;
+    for (;;) {
+      this.settle();
+      let due = null;
+      for (const timer of this.timers) if (timer.at <= end && (!due || timer.at < due.at)) due = timer;
+      if (!due) break;
+      this.timers.delete(due);
+      this.time = due.at;
+      due.fn();
+    }
+    this.time = end;
+  }
+}
@@ -0,0 +1,45 @@
+import { test, expect, describe } from 'bun:test';
+import { MotionCoalescer } from '../src/network/coalesce.js';
+import { ManualClock } from './clock.js';
+
+describe('motion coalescing', () => {
+  test('first sample goes out immediately, the rest are merged', () => {
+    const sent = [];
+    const clock = new ManualClock();
+    const motion = new MotionCoalescer((dx, dy) => sent.push([dx, dy]), { deadline: 4, clock });
+    for (let i = 0; i < 10; i++) motion.push(1, 2);
+    expect(sent).toEqual([[1, 2]]);
+    clock.advance(3);
+    expect(sent).toEqual([[1, 2]]);
+    clock.advance(1);
+    expect(sent).toEqual([
+      [1, 2],
+      [9, 18],
+    ]);
+    expect(motion.stats).toMatchObject({ samples: 10, sent: 2, merged: 8 });
+  });
+
+  test('flush sends pending motion before other events', () => {
+    const sent = [];
+    const motion = new MotionCoalescer((dx, dy) => sent.push([dx, dy]), { deadline: 1000 });
+    motion.push(1, 1);
+    motion.push(2, 2);
+    motion.push(3, 3);
+    motion.flush();
+    sent.push('button');
+    expect(sent).toEqual([[1, 1], [5, 5], 'button']);
+    expect(motion.stats.flushes).toBe(1);
+    motion.stop();
+  });
+
+  test('movements that cancel out are not sent', () => {
+    const sent = [];
+    const motion = new MotionCoalescer((dx, dy) => sent.push([dx, dy]), { deadline: 1000 });
+    motion.push(1, 0);
+    motion.push(5, 5);
+    motion.push(-5, -5);
+    motion.flush();
+    expect(sent).toEqual([[1, 0]]);
+    expect(motion.stats.merged).toBe(2);
+  });
+});
@@ -0,0 +1,44 @@
+import { describe, expect, test } from 'bun:test';
+import { applyDelta, blockSize, encodeDelta, jsKernel, kernel } from '../src/network/delta.js';
+
+// text with little repetition, like a log
+function text(bytes, seed = 1) {
+  const out = Buffer.alloc(bytes);
+  for (let i = 0; i < bytes; i++) {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    out[i] = 32 + (seed % 95);
+  }
+  return out;
+}
+
+describe('clipboard deltas', () => {
+  test('a small edit costs about a block', () => {
+    const basis = text(1 << 20);
+    const edited = Buffer.concat([basis.subarray(0, 500000), text(1024, 7), basis.subarray(500000)]);
+    const delta = encodeDelta(basis, edited);
+    expect(applyDelta(basis, delta).equals(edited)).toBe(true);
+    expect(delta.length).toBeLessThan(1024 + 2 * blockSize(basis.length) + 64);
+  });
+
+  test('moved, cut and appended content rebuilds', () => {
+    const basis = text(200000);
+    const edited = Buffer.concat([basis.subarray(150000), text(3000, 3), basis.subarray(1000, 90000), Buffer.from('tail')]);
+    expect(applyDelta(basis, encodeDelta(basis, edited)).equals(edited)).toBe(true);
+    expect(applyDelta(basis, encodeDelta(basis, Buffer.alloc(0))).length).toBe(0);
+    const unrelated = text(50000, 9);
+    expect(applyDelta(basis, encodeDelta(basis, unrelated)).equals(unrelated)).toBe(true);
+  });
+
+  test('the native kernel and the JS one agree', () => {
+    const basis = text(300000);
+    const edited = Buffer.concat([basis.subarray(0, 100001), text(777, 5), basis.subarray(100000)]);
+    expect(encodeDelta(basis, edited, { kernel }).equals(encodeDelta(basis, edited, { kernel: jsKernel }))).toBe(true);
+  });
+
+  test('a delta against another basis is refused', () => {
+    const basis = text(100000);
+    const delta = encodeDelta(basis, Buffer.concat([basis, Buffer.from('more')]));
+    expect(() => applyDelta(basis.subarray(0, 50000), delta)).toThrow(RangeError);
+    expect(() => applyDelta(basis, delta.subarray(0, delta.length - 1))).toThrow(RangeError);
+  });
+});
@@ -0,0 +1,68 @@
+import { afterAll, describe, expect, test } from 'bun:test';
+import { mkdtempSync, rmSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { loadIdentity } from '../src/network/certs.js';
+import { complete, initiate, respond } from '../src/network/handshake.js';
+
+const dir = mkdtempSync(join(tmpdir(), 'bzz-handshake-'));
+afterAll(() => rmSync(dir, { recursive: true, force: true }));
+
+describe('handshake', () => {
+  test('identity is generated once and cached', async () => {
+    const first = await loadIdentity(join(dir, 'cached'));
+    const second = await loadIdentity(join(dir, 'cached'));
+    expect(second.raw).toEqual(first.raw);
+    expect(first.raw.length).toBe(32);
+  });
+
+  test('both sides derive matching directional keys', async () => {
+    const a = await loadIdentity(join(dir, 'a'));
+    const b = await loadIdentity(join(dir, 'b'));
+    const offer = initiate(a, 1);
+    const { session: responder, message } = respond(b, 2, offer.message, 1);
+    const initiator = complete(offer, a, message, 2);
+
+    expect(initiator.fingerprint).toBe(b.fingerprint);
+    expect(responder.fingerprint).toBe(a.fingerprint);
+
+    const header = Buffer.alloc(12);
+    const packet = initiator.tx.seal(header, Buffer.from('ping'), 1, 0);
+    expect(responder.rx.open(packet, 12, 1, 0).toString()).toBe('ping');
+    // keys differ per direction
+    expect(initiator.rx.open(packet, 12, 1, 0)).toBeNull();
+  });
+
+  test('rejects offers and responses that do not verify', async () => {
+    const a = await loadIdentity(join(dir, 'a'));
+    const b = await loadIdentity(join(dir, 'b'));
+    const offer = initiate(a, 1);
+    // signature is bound to the sender tag
+    expect(respond(b, 2, offer.message, 7)).toBeNull();
+    expect(respond(b, 2, { ...offer.message, ephemeral: Buffer.alloc(32, 1) }, 1)).toBeNull();
+
+    const { message } = respond(b, 2, offer.message, 1);
+    expect(complete(offer, a, { ...message, identity: a.raw }, 2)).toBeNull();
+  });
+
+  test('auth proofs check only within the session they were made for', async () => {
+    const a = await loadIdentity(join(dir, 'a'));
+    const b = await loadIdentity(join(dir, 'b'));
+    const m = await loadIdentity(join(dir, 'm'));
+    const offer = initiate(a, 1);
+    const { session: responder, message } = respond(b, 2, offer.message, 1);
+    const initiator = complete(offer, a, message, 2);
+
+    expect(responder.checkProof('token', initiator.proof('token'))).toBe(true);
+    expect(initiator.checkProof('token', responder.proof('token'))).toBe(true);
+    expect(responder.checkProof('token', initiator.proof('other'))).toBe(false);
+    // not reflected back to its sender
+    expect(initiator.checkProof('token', initiator.proof('token'))).toBe(false);
+
+    // a man in the middle holds one session with each side, a proof it
+    // relays from one does not check on the other
+    const relay = initiate(m, 3);
+    const { session: toB } = respond(b, 2, relay.message, 3);
+    expect(toB.checkProof('token', initiator.proof('token'))).toBe(false);
+  });
+});
@@ -0,0 +1,69 @@
+import { afterEach, describe, expect, test } from 'bun:test';
+import { existsSync, mkdtempSync, rmSync, statSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { ClipboardBody, hashOf } from '../src/network/clipboard.js';
+import { ClipboardHistory, INDEX_FILE, dataFile, readHistory, readHistoryBody } from '../src/network/history.js';
+
+const dirs = [];
+const tempDir = () => {
+  const dir = mkdtempSync(join(tmpdir(), 'bzz-history-'));
+  dirs.push(dir);
+  return dir;
+};
+
+afterEach(() => {
+  for (const dir of dirs.splice(0)) rmSync(dir, { recursive: true, force: true });
+});
+
+const add = (history, text, mime) => {
+  const data = Buffer.from(text);
+  return history.add(hashOf(data), ClipboardBody.from(data, mime));
+};
+
+describe('clipboard history', () => {
+  test('entries are deduplicated by hash and listed from the index alone', () => {
+    const dir = tempDir();
+    const history = new ClipboardHistory({ dir });
+    add(history, 'first');
+    add(history, 'png bytes', 'image/png');
+    add(history, 'first');
+    expect(history.size).toBe(2);
+    history.close();
+
+    const { generation, entries } = readHistory(dir);
+    expect(entries.map((e) => e.mime)).toEqual(['image/png', 'text/plain;charset=utf-8']);
+    expect(readHistoryBody(dir, generation, entries[1]).toString()).toBe('first');
+
+    const reopened = new ClipboardHistory({ dir });
+    expect(reopened.list().map((e) => reopened.read(e).toString())).toEqual(['first', 'png bytes']);
+    reopened.close();
+  });
+
+  test('the least recently used entries go past the budget', () => {
+    const history = new ClipboardHistory({ dir: tempDir(), bytes: 10, entries: 3 });
+    add(history, 'aaaa');
+    add(history, 'bbbb');
+    add(history, 'aaaa');
+    add(history, 'cccc');
+    expect(history.list().map((e) => history.read(e).toString())).toEqual(['cccc', 'aaaa']);
+    for (const c of 'defg') add(history, c);
+    expect(history.size).toBe(3);
+    expect(add(history, 'far too large')).toBeNull();
+    history.close();
+  });
+
+  test('dead bytes are compacted away under the next generation', () => {
+    const dir = tempDir();
+    const history = new ClipboardHistory({ dir, bytes: 3 << 20, entries: 2 });
+    const big = (c) => c.repeat(1 << 20);
+    for (const c of 'abcde') add(history, big(c));
+    expect(history.generation).toBe(1);
+    expect(existsSync(join(dir, dataFile(0)))).toBe(false);
+    expect(statSync(join(dir, dataFile(1))).size).toBe(2 << 20);
+    expect(history.list().map((e) => history.read(e)[0])).toEqual([0x65, 0x64]);
+    history.close();
+    expect(statSync(join(dir, INDEX_FILE)).size).toBeLessThan(1024);
+    expect(readHistory(dir).entries.length).toBe(2);
+  });
+});
@@ -1,6 +1,7 @@
 import { expect, test, describe, beforeAll, afterAll } from "bun:test";
 import { Peer } from "../src/network/peer.js";
 import { DisplayServer } from "../src/display.js";
+import { readHashed, TEXT_MIME } from "../src/network/clipboard.js";
 import "../src/x11/index.js";
 import "../src/wayland/index.js";
 import { Sway, Gnome, KDE, X11 } from "./headless.js";
@@ -235,4 +236,92 @@ describe("Integrated Network and Display Server", () => {
     // Restore original function
     peer1.displayServer.clipboardCopy = originalClipboardCopy;
   });
-}); 
\ No newline at end of file
+
+  test("native clipboard serves selections and reports changes", async () => {
+    // Skip unless the compositor has data-control (sway does)
+    if (!displayServer || displayServer.constructor.name !== "Wayland" || !displayServer.haveClipboard() || !displayServer.nativeClipboard) {
+      console.log("Skipping test - no data-control clipboard available");
+      return;
+    }
+
+    // A second client owns the selection, the first one watches it
+    const other = new DisplayServer.Wayland();
+    expect(other.setup(1920, 1080)).toBe(true);
+    expect(other.haveClipboard()).toBe(true);
+    const nextChange = () =>
+      new Promise((resolve) => {
+        const stop = displayServer.clipboardWatch(0, () => {
+          stop();
+          resolve();
+        });
+      });
+    const paste = async () => (await readHashed(displayServer.clipboardStream(0))).data.toString();
+
+    let changed = nextChange();
+    const text = new TextEncoder().encode("native clipboard text");
+    expect(other.clipboardCopy(0, text, text.length)).toBe(true);
+    await changed;
+    expect(await paste()).toBe("native clipboard text");
+
+    // Offered content is fetched on the first paste and served from memory after
+    let fetches = 0;
+    changed = nextChange();
+    expect(other.clipboardOffer(0, [TEXT_MIME], async () => {
+      fetches++;
+      return Buffer.from("fetched on paste");
+    })).toBe(true);
+    await changed;
+    expect(fetches).toBe(0);
+    expect(await paste()).toBe("fetched on paste");
+    expect(await paste()).toBe("fetched on paste");
+    expect(fetches).toBe(1);
+
+    other.close();
+    other.contextFree();
+  });
+
+  test("X11 clipboard owns selections and answers from memory", async () => {
+    // Skip unless x11.c owns selections itself, xclip is the other client
+    if (!displayServer || displayServer.constructor.name !== "X11" || !displayServer.haveClipboard() || !displayServer.nativeClipboard || !X11.which("xclip")) {
+      console.log("Skipping test - no native X11 clipboard or xclip available");
+      return;
+    }
+
+    const nextChange = () =>
+      new Promise((resolve) => {
+        const stop = displayServer.clipboardWatch(0, () => {
+          stop();
+          resolve();
+        });
+      });
+    const paste = async () => (await readHashed(displayServer.clipboardStream(0))).data.toString();
+    const xclipOut = () => new Response(Bun.spawn({ cmd: ["xclip", "-o", "-selection", "clipboard"], stdout: "pipe" }).stdout).text();
+
+    // Another client taking the selection is reported and read
+    let changed = nextChange();
+    const xclip = Bun.spawn({ cmd: ["xclip", "-i", "-selection", "clipboard"], stdin: "pipe" });
+    xclip.stdin.write("owned by xclip");
+    xclip.stdin.end();
+    await changed;
+    expect(await paste()).toBe("owned by xclip");
+
+    // Content bigger than a property goes out INCR, to others and to ourselves
+    const big = Buffer.alloc(1 << 20, "bzz ");
+    expect(displayServer.clipboardCopy(0, big, big.length)).toBe(true);
+    await new Promise(resolve => setTimeout(resolve, 100));
+    expect(await xclipOut()).toBe(big.toString());
+    expect(await paste()).toBe(big.toString());
+
+    // Offered content is fetched on the first paste and served from memory after
+    let fetches = 0;
+    expect(displayServer.clipboardOffer(0, [TEXT_MIME], async () => {
+      fetches++;
+      return Buffer.from("fetched on paste");
+    })).toBe(true);
+    await new Promise(resolve => setTimeout(resolve, 100));
+    expect(fetches).toBe(0);
+    expect(await xclipOut()).toBe("fetched on paste");
+    expect(await xclipOut()).toBe("fetched on paste");
+    expect(fetches).toBe(1);
+  });
+});
@@ -0,0 +1,89 @@
+import { afterAll, afterEach, describe, expect, test } from 'bun:test';
+import { existsSync, mkdtempSync, readFileSync, readdirSync, rmSync, statSync, writeFileSync } from 'node:fs';
+import { tmpdir } from 'node:os';
+import { join } from 'node:path';
+import { nativeLibrary } from '../src/native.js';
+
+const dir = mkdtempSync(join(tmpdir(), 'bzz-native-'));
+const cache = join(dir, 'lib');
+const source = join(dir, 'add.c');
+const mode = process.env.BZZ_NATIVE;
+
+const declare = () =>
+  nativeLibrary(
+    'add',
+    {
+      source: [source],
+      define: { BIAS: '1' },
+      symbols: { add: { args: ['i32', 'i32'], returns: 'i32' } },
+    },
+    cache,
+  );
+
+afterEach(() => {
+  if (mode === undefined) delete process.env.BZZ_NATIVE;
+  else process.env.BZZ_NATIVE = mode;
+});
+afterAll(() => rmSync(dir, { recursive: true, force: true }));
+
+describe('native libraries', () => {
+  test('a library is built once and loaded from the cache after', () => {
+    writeFileSync(source, 'int add(int a, int b) { return a + b + BIAS; }\n');
+    process.env.BZZ_NATIVE = 'build';
+    const first = declare();
+    expect(first.symbols.add(2, 3)).toBe(6);
+    expect(first.via).toBe('dlopen');
+    const built = statSync(first.path).mtimeMs;
+
+    delete process.env.BZZ_NATIVE;
+    const second = declare();
+    expect(second.symbols.add(2, 3)).toBe(6);
+    expect(second.via).toBe('dlopen');
+    expect(statSync(second.path).mtimeMs).toBe(built);
+  });
+
+  test('an edited source is a new build and the old one goes', () => {
+    writeFileSync(source, 'int add(int a, int b) { return a + b + BIAS; }\n');
+    const old = declare().path;
+    writeFileSync(source, 'int add(int a, int b) { return a + b + 2 * BIAS; }\n');
+    process.env.BZZ_NATIVE = 'build';
+    const library = declare();
+    expect(library.path).not.toBe(old);
+    expect(library.symbols.add(2, 3)).toBe(7);
+    expect(existsSync(old)).toBe(false);
+    expect(readdirSync(cache)).toEqual([library.path.slice(cache.length + 1)]);
+  });
+
+  test('a build that does not load is recorded and not built again', () => {
+    writeFileSync(source, 'int add(int a, int b) { return a + b + BIAS; }\n');
+    const path = declare().path;
+    writeFileSync(path, 'not a shared object');
+    const library = declare();
+    expect(library.symbols.add(2, 3)).toBe(6);
+    expect(library.via).toBe('tcc');
+    expect(existsSync(path)).toBe(false);
+    expect(existsSync(`${path}.failed`)).toBe(true);
+
+    const again = declare();
+    expect(again.symbols.add(2, 3)).toBe(6);
+    expect(existsSync(`${path}.building`)).toBe(false);
+  });
+
+  test('BZZ_NATIVE=tcc leaves the cache alone', () => {
+    process.env.BZZ_NATIVE = 'tcc';
+    const library = declare();
+    expect(library.symbols.add(2, 3)).toBe(7);
+    expect(library.via).toBe('tcc');
+  });
+
+  test('a build that fails with BZZ_NATIVE=build is recorded and TinyCC runs instead', () => {
+    const guard = '#ifndef __TINYC__\n#error not for this compiler\n#endif\n';
+    writeFileSync(source, `${guard}int add(int a, int b) { return a + b; }\n`);
+    process.env.BZZ_NATIVE = 'build';
+    const library = declare();
+    expect(library.symbols.add(2, 3)).toBe(5);
+    expect(library.via).toBe('tcc');
+    expect(existsSync(library.path)).toBe(false);
+    expect(readFileSync(`${library.path}.failed`, 'utf8')).toContain('not for this compiler');
+  });
+});
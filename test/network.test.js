@@ -11,6 +11,8 @@ mock.module("../src/display.js", () => {
     key: mock(() => {}),
     keyReleaseAll: mock(() => {}),
     displayFlush: mock(() => {}),
+    inputBegin: mock(() => {}),
+    inputCommit: mock(() => {}),
     contextNew: mock(() => ({})),
     contextFree: mock(() => {}),
     setup: mock(() => true),
@@ -33,6 +35,8 @@ mock.module("../src/display.js", () => {
     close() {}
     prepareFd() {}
     displayFlush() {}
+    inputBegin() {}
+    inputCommit() {}
     mouseMotion() {}
     mouseRelativeMotion() {}
     mouseButton() {}
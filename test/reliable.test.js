@@ -0,0 +1,77 @@
+import { describe, expect, test } from 'bun:test';
+import { LANE_WINDOW, RTO_INITIAL, RecvLane, RttEstimator, SendLane } from '../src/network/reliable.js';
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+describe('reliable lane', () => {
+  test('receiver applies in lane order and acks what it holds back', () => {
+    const lane = new RecvLane();
+    const applied = [];
+    const deliver = (item) => applied.push(item);
+
+    expect(lane.accept(0, 'a', deliver)).toBe(true);
+    lane.accept(2, 'c', deliver);
+    lane.accept(3, 'd', deliver);
+    expect(applied).toEqual(['a']);
+    expect(lane.next).toBe(1);
+    expect(lane.bits()).toBe(0b11);
+
+    lane.accept(1, 'b', deliver);
+    expect(applied).toEqual(['a', 'b', 'c', 'd']);
+    expect(lane.bits()).toBe(0);
+
+    expect(lane.accept(2, 'c', deliver)).toBe(false);
+    expect(lane.accept(4 + LANE_WINDOW + 1, 'z', deliver)).toBe(false);
+    expect(lane.stats).toMatchObject({ delivered: 4, reordered: 2, duplicates: 1, outside: 1 });
+  });
+
+  test('a hole acked past is retransmitted without waiting for the timeout', () => {
+    const sent = [];
+    const lane = new SendLane((seq, type, data) => sent.push([seq, data.keycode]));
+    for (let i = 0; i < 5; i++) lane.push('key_raw', { keycode: i, pressed: 1 });
+    expect(sent.map(([seq]) => seq)).toEqual([0, 1, 2, 3, 4]);
+
+    // 1 got lost, 2..4 are buffered on the other side
+    lane.ack(1, 0b111);
+    expect(lane.base).toBe(1);
+    expect([...lane.inflight.keys()]).toEqual([1]);
+    expect(sent.at(-1)).toEqual([1, 1]);
+    expect(lane.stats).toMatchObject({ acked: 4, retransmits: 1, fast: 1 });
+
+    lane.ack(5, 0);
+    expect(lane.inflight.size).toBe(0);
+    expect(lane.timer).toBeNull();
+  });
+
+  test('unacked frames are retransmitted after the rto', async () => {
+    const sent = [];
+    const lane = new SendLane((seq) => sent.push(seq));
+    lane.push('mouse_button', { button: 1, pressed: 1 });
+    await sleep(RTO_INITIAL * 1.5);
+    expect(sent).toEqual([0, 0]);
+    expect(lane.inflight.get(0).attempts).toBe(2);
+    lane.stop();
+  });
+
+  test('a full window queues until acks make room', () => {
+    const sent = [];
+    const lane = new SendLane((seq) => sent.push(seq));
+    for (let i = 0; i < LANE_WINDOW + 3; i++) lane.push('key_raw', { keycode: i, pressed: 0 });
+    expect(sent.length).toBe(LANE_WINDOW);
+    expect(lane.queue.length).toBe(3);
+
+    lane.ack(2, 0);
+    expect(sent.slice(LANE_WINDOW)).toEqual([LANE_WINDOW, LANE_WINDOW + 1]);
+    expect(lane.queue.length).toBe(1);
+    lane.stop();
+  });
+
+  test('rtt samples converge and bound the rto', () => {
+    const rtt = new RttEstimator();
+    expect(rtt.rto).toBe(RTO_INITIAL);
+    for (let i = 0; i < 50; i++) rtt.sample(2);
+    expect(rtt.srtt).toBeCloseTo(2, 3);
+    expect(rtt.rto).toBeGreaterThanOrEqual(10);
+    expect(rtt.rto).toBeLessThan(20);
+  });
+});
@@ -0,0 +1,69 @@
+import { describe, expect, test } from 'bun:test';
+import { SlotTable } from '../src/network/slots.js';
+import { HEADER_CONN, decodeHeader, encodeFrame } from '../src/network/wire.js';
+
+describe('peer slots', () => {
+  test('connection IDs index the table, 0 is never handed out', () => {
+    const peers = new SlotTable(4);
+    const a = peers.alloc('10.0.0.1', 1000);
+    const b = peers.alloc('10.0.0.2', 1000);
+    expect(a.id).toBe(1);
+    expect(b.id).toBe(2);
+    expect(peers.get(a.id)).toBe(a);
+    expect(peers.get(0)).toBeUndefined();
+    expect(peers.get(3)).toBeUndefined();
+    expect(peers.find('10.0.0.2', 1000)).toBe(b);
+    expect(peers.size).toBe(2);
+  });
+
+  test('a full table evicts the unauthenticated peer seen least recently', () => {
+    const peers = new SlotTable(4);
+    const a = peers.alloc('10.0.0.1', 1);
+    const b = peers.alloc('10.0.0.2', 2);
+    const c = peers.alloc('10.0.0.3', 3);
+    a.lastSeen = 3;
+    b.lastSeen = 1;
+    c.lastSeen = 2;
+    peers.setAuthenticated(b, true);
+    const evicted = [];
+    const d = peers.alloc('10.0.0.4', 4, (slot) => evicted.push(slot.port));
+    expect(evicted).toEqual([3]);
+    expect(d.id).toBe(c.id);
+    expect(d.authenticated).toBe(false);
+    expect(peers.authenticated).toBe(1);
+    expect(peers.size).toBe(3);
+  });
+
+  test('authenticated peers are never evicted', () => {
+    const peers = new SlotTable(3);
+    const a = peers.alloc('10.0.0.1', 1);
+    const b = peers.alloc('10.0.0.2', 2);
+    peers.setAuthenticated(a, true);
+    peers.setAuthenticated(b, true);
+    const evicted = [];
+    expect(peers.alloc('10.0.0.3', 3, (slot) => evicted.push(slot.port))).toBeNull();
+    expect(evicted).toEqual([]);
+    expect(peers.size).toBe(2);
+  });
+
+  test('unauthenticated peers share a capped number of slots', () => {
+    const peers = new SlotTable(8, 2);
+    const a = peers.alloc('10.0.0.1', 1);
+    peers.setAuthenticated(a, true);
+    const b = peers.alloc('10.0.0.2', 2);
+    const c = peers.alloc('10.0.0.3', 3);
+    b.lastSeen = 1;
+    c.lastSeen = 2;
+    const evicted = [];
+    const d = peers.alloc('10.0.0.4', 4, (slot) => evicted.push(slot.port));
+    expect(evicted).toEqual([2]);
+    expect(d.id).toBe(b.id);
+    expect(peers.size).toBe(3);
+  });
+
+  test('the connection ID travels in the header', () => {
+    const frame = encodeFrame('mouse_move', { dx: 1, dy: 1 }, 7, 0, 0, 5);
+    expect(frame[HEADER_CONN]).toBe(5);
+    expect(decodeHeader(frame).conn).toBe(5);
+  });
+});
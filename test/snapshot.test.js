@@ -0,0 +1,55 @@
+import { describe, expect, test } from 'bun:test';
+import { InputState } from '../src/network/snapshot.js';
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+describe('input state snapshots', () => {
+  test('tracks held keys and buttons from outgoing events', () => {
+    const state = new InputState(() => {}, { interval: 0 });
+    state.update('key', { keycode: 38, modifiers: 0x1001, pressed: 1 });
+    state.update('key_raw', { keycode: 9, pressed: 1 });
+    state.update('mouse_button', { button: 1, pressed: 1 });
+    expect(state.held).toBe(2);
+    expect(state.snapshot()).toEqual({
+      modifiers: 0x1001,
+      buttons: 0b10,
+      keys: new Uint8Array([0, 0, 0, 0, 0b1000000]),
+      raw: new Uint8Array([0, 0b10]),
+    });
+
+    // repeats do not count twice
+    state.update('key_raw', { keycode: 9, pressed: 1 });
+    state.update('key', { keycode: 38, modifiers: 0x1000, pressed: 0 });
+    state.update('mouse_button', { button: 1, pressed: 0 });
+    expect(state.held).toBe(1);
+    expect(state.snapshot()).toMatchObject({ modifiers: 0x1000, buttons: 0, keys: new Uint8Array(0) });
+  });
+
+  test('release all clears every key', () => {
+    const state = new InputState(() => {}, { interval: 0 });
+    state.update('key_raw', { keycode: 300, pressed: 1 });
+    state.update('key', { keycode: 10, modifiers: 0, pressed: 1 });
+    state.update('key_release_all', {});
+    expect(state.held).toBe(0);
+    expect(state.snapshot().keys.length).toBe(0);
+    expect(state.snapshot().raw.length).toBe(0);
+  });
+
+  test('snapshots keep coming while a key is held and stop once idle', async () => {
+    const sent = [];
+    const state = new InputState((snapshot) => sent.push(snapshot), { interval: 10 });
+    state.update('key_raw', { keycode: 30, pressed: 1 });
+    await sleep(45);
+    expect(sent.length).toBeGreaterThanOrEqual(2);
+    expect(sent.at(-1).raw.length).toBe(4);
+
+    state.update('key_raw', { keycode: 30, pressed: 0 });
+    state.lastInput = -Infinity;
+    await sleep(25);
+    const count = sent.length;
+    expect(state.timer).toBeNull();
+    await sleep(25);
+    expect(sent.length).toBe(count);
+    expect(sent.at(-1).raw.length).toBe(0);
+  });
+});
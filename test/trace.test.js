@@ -0,0 +1,80 @@
+import { describe, expect, test } from 'bun:test';
+import {
+  DROP,
+  EV,
+  HEADER_SIZE,
+  RECORD_SIZE,
+  TRACE_MAGIC,
+  TRACE_VERSION,
+  decodeTrace,
+  formatRecord,
+} from '../src/trace.js';
+import { OP_MOUSE_MOVE } from '../src/network/wire.js';
+
+// a ring image laid out like traceOpen/traceEmit in trace.c
+function ring(capacity) {
+  const buf = Buffer.alloc(HEADER_SIZE + capacity * RECORD_SIZE);
+  buf.writeUInt32LE(TRACE_MAGIC, 0);
+  buf.writeUInt32LE(TRACE_VERSION, 4);
+  buf.writeUInt32LE(capacity, 8);
+  buf.writeUInt32LE(RECORD_SIZE, 12);
+  buf.writeBigUInt64LE(1000n, 24);
+  buf.writeUInt32LE(42, 32);
+  let head = 0;
+  const emit = (event, source, ...args) => {
+    const i = head++;
+    const off = HEADER_SIZE + (i & (capacity - 1)) * RECORD_SIZE;
+    buf.writeBigUInt64LE(BigInt(1000 + i * 1000), off);
+    buf.writeUInt32LE((i + 1) >>> 0, off + 8);
+    buf.writeUInt16LE(event, off + 12);
+    buf.writeUInt16LE(source, off + 14);
+    for (let a = 0; a < 4; a++) buf.writeInt32LE(args[a] ?? 0, off + 16 + a * 4);
+    buf.writeBigUInt64LE(BigInt(head), 16);
+    return off;
+  };
+  return { buf, emit };
+}
+
+describe('trace ring', () => {
+  test('decodes records in order with their arguments', () => {
+    const { buf, emit } = ring(8);
+    emit(EV.RX, 0, OP_MOUSE_MOVE, 1, 28, 7);
+    emit(EV.DROP, 1, DROP.REPLAY, OP_MOUSE_MOVE, 1, 7);
+
+    const { pid, head, lost, records } = decodeTrace(buf);
+    expect(pid).toBe(42);
+    expect(head).toBe(2);
+    expect(lost).toBe(0);
+    expect(records.map((r) => r.event)).toEqual([EV.RX, EV.DROP]);
+    expect(records[1].args).toEqual([DROP.REPLAY, OP_MOUSE_MOVE, 1, 7]);
+    expect(records[1].time).toBe(1);
+    expect(formatRecord(records[1])).toContain('drop');
+    expect(formatRecord(records[1])).toContain('reason=replay op=mouse_move');
+  });
+
+  test('keeps the newest capacity records once it wrapped', () => {
+    const { buf, emit } = ring(4);
+    for (let i = 0; i < 10; i++) emit(EV.TX, 0, OP_MOUSE_MOVE, 1, 40, i);
+
+    const { lost, records } = decodeTrace(buf);
+    expect(lost).toBe(6);
+    expect(records.map((r) => r.args[3])).toEqual([6, 7, 8, 9]);
+  });
+
+  test('skips records whose stamp does not match their position', () => {
+    const { buf, emit } = ring(4);
+    emit(EV.RX, 0, 1);
+    const off = emit(EV.RX, 0, 2);
+    emit(EV.RX, 0, 3);
+    // a writer invalidated the slot and has not finished yet
+    buf.writeUInt32LE(0, off + 8);
+
+    expect(decodeTrace(buf).records.map((r) => r.args[0])).toEqual([1, 3]);
+  });
+
+  test('rejects files that are not a ring', () => {
+    expect(() => decodeTrace(Buffer.alloc(HEADER_SIZE))).toThrow('not a trace ring');
+    const { buf } = ring(4);
+    expect(() => decodeTrace(buf.subarray(0, HEADER_SIZE + RECORD_SIZE))).toThrow('truncated');
+  });
+});
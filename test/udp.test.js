@@ -0,0 +1,51 @@
+import { describe, expect, test } from 'bun:test';
+import { BATCH, SendBatch } from '../src/network/udp.js';
+
+// stands in for udpAddr: the port in the first two bytes, fails for 'bad'
+function resolver() {
+  const calls = [];
+  const resolve = (out, address, port) => {
+    const host = address.toString('latin1', 0, address.length - 1);
+    calls.push(host);
+    if (host === 'bad') return false;
+    out.writeUInt16BE(port, 0);
+    return true;
+  };
+  return { calls, resolve };
+}
+
+describe('send batch', () => {
+  test('packs payloads back to back with a length and address each', () => {
+    const { resolve } = resolver();
+    const batch = new SendBatch(resolve);
+    const count = batch.pack([Buffer.from('abc'), 1000, '10.0.0.1', Buffer.from('de'), 2000, '10.0.0.2']);
+
+    expect(count).toBe(2);
+    expect(batch.data.toString('latin1', 0, 5)).toBe('abcde');
+    expect([...batch.lens.subarray(0, 2)]).toEqual([3, 2]);
+    expect(batch.addrs.readUInt16BE(0)).toBe(1000);
+    expect(batch.addrs.readUInt16BE(28)).toBe(2000);
+  });
+
+  test('leaves out destinations that do not resolve', () => {
+    const { resolve } = resolver();
+    const batch = new SendBatch(resolve);
+    const count = batch.pack([Buffer.from('x'), 1, 'bad', Buffer.from('y'), 2, '10.0.0.2']);
+
+    expect(count).toBe(1);
+    expect(batch.data[0]).toBe('y'.charCodeAt(0));
+    expect(batch.addrs.readUInt16BE(0)).toBe(2);
+  });
+
+  test('resolves each address once and grows past a full batch', () => {
+    const { calls, resolve } = resolver();
+    const batch = new SendBatch(resolve);
+    const packets = [];
+    for (let i = 0; i < BATCH * 2; i++) packets.push(Buffer.alloc(200, i), 3000, '10.0.0.1');
+
+    expect(batch.pack(packets)).toBe(BATCH * 2);
+    expect(batch.pack(packets)).toBe(BATCH * 2);
+    expect(calls).toEqual(['10.0.0.1']);
+    expect(batch.data[200 * (BATCH * 2 - 1)]).toBe(BATCH * 2 - 1);
+  });
+});
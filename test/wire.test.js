@@ -0,0 +1,108 @@
+import { test, expect, describe } from 'bun:test';
+import {
+  FLAG_RELIABLE,
+  HEADER_LENGTH,
+  OP_CLIPBOARD_DELTA,
+  OP_EXT,
+  OP_KEY_RAW,
+  OP_MOUSE_MOVE,
+  SspBuf,
+  decodeBody,
+  decodeHeader,
+  encodeFrame,
+} from '../src/network/wire.js';
+
+function roundtrip(type, data) {
+  const frame = Buffer.from(encodeFrame(type, data, 0xcafebabe, 42));
+  const header = decodeHeader(frame);
+  return { frame, header, ...decodeBody(header.op, frame.subarray(HEADER_LENGTH)) };
+}
+
+describe('wire format', () => {
+  test('header carries opcode, sender and sequence', () => {
+    const { header } = roundtrip('mouse_move', { dx: 1, dy: 1 });
+    expect(header.op).toBe(OP_MOUSE_MOVE);
+    expect(header.sender).toBe(0xcafebabe);
+    expect(header.seq).toBe(42);
+  });
+
+  test('small mouse deltas pack into a few bytes', () => {
+    const { frame, data } = roundtrip('mouse_move', { dx: -3, dy: 60 });
+    expect(frame.length).toBe(HEADER_LENGTH + 2);
+    expect(data).toEqual({ dx: -3, dy: 60 });
+  });
+
+  test('extreme deltas survive zigzag encoding', () => {
+    const { data } = roundtrip('mouse_move', { dx: -2147483648, dy: 2147483647 });
+    expect(data).toEqual({ dx: -2147483648, dy: 2147483647 });
+  });
+
+  test('reliable frames carry their lane sequence before the fields', () => {
+    const frame = Buffer.from(encodeFrame('key_raw', { keycode: 30, pressed: 1 }, 1, 2, FLAG_RELIABLE, 0, 0xfffffffe));
+    const header = decodeHeader(frame);
+    expect(header.op).toBe(OP_KEY_RAW);
+    expect(header.flags & FLAG_RELIABLE).toBe(FLAG_RELIABLE);
+    expect(frame.readUInt32BE(HEADER_LENGTH)).toBe(0xfffffffe);
+    expect(decodeBody(header.op, frame.subarray(HEADER_LENGTH + 4)).data).toEqual({ keycode: 30, pressed: 1 });
+  });
+
+  test('input events roundtrip', () => {
+    expect(roundtrip('key', { keycode: 300, modifiers: 5, pressed: 1 }).data).toEqual({
+      keycode: 300,
+      modifiers: 5,
+      pressed: 1,
+    });
+    expect(roundtrip('mouse_button', { button: 3, pressed: 0 }).data).toEqual({ button: 3, pressed: 0 });
+    expect(roundtrip('mouse_wheel', { horizontal: 0, vertical: -120 }).data).toEqual({
+      horizontal: 0,
+      vertical: -120,
+    });
+  });
+
+  test('input state snapshots carry their lane position and bitmaps', () => {
+    const state = { lane: 7, modifiers: 0x1001, buttons: 0b10, keys: new Uint8Array([0, 4]), raw: new Uint8Array(0) };
+    const { data } = roundtrip('input_state', state);
+    expect(data.lane).toBe(7);
+    expect(data.modifiers).toBe(0x1001);
+    expect(data.buttons).toBe(0b10);
+    expect([...data.keys]).toEqual([0, 4]);
+    expect(data.raw.length).toBe(0);
+  });
+
+  test('clipboard offers carry the hash and mime types', () => {
+    const offer = { primary: true, hash: new Uint8Array(16).fill(7), size: 123456, mimes: ['text/plain', 'image/png'] };
+    const { data } = roundtrip('clipboard_offer', offer);
+    expect(data.primary).toBe(true);
+    expect([...data.hash]).toEqual([...offer.hash]);
+    expect(data.size).toBe(123456);
+    expect(data.mimes).toEqual(['text/plain', 'image/png']);
+  });
+
+  test('clipboard fetches name the bases a delta may use', () => {
+    const hash = new Uint8Array(16).fill(1);
+    const bases = [new Uint8Array(16).fill(2), new Uint8Array(16).fill(3)];
+    const { data } = roundtrip('clipboard_fetch', { hash, mime: 'text/plain', bases });
+    expect(data.bases.map((basis) => [...basis])).toEqual(bases.map((basis) => [...basis]));
+    expect(roundtrip('clipboard_fetch', { hash, mime: 'text/plain' }).data.bases).toEqual([]);
+
+    const delta = { hash, mime: 'text/plain', basis: bases[0], delta: new Uint8Array([8, 4, 1, 1, 65]) };
+    const { header, data: decoded } = roundtrip('clipboard_delta', delta);
+    expect(header.op).toBe(OP_CLIPBOARD_DELTA);
+    expect([...decoded.basis]).toEqual([...bases[0]]);
+    expect([...decoded.delta]).toEqual([...delta.delta]);
+  });
+
+  test('unknown types fall back to json ext frames', () => {
+    const { header, type, data } = roundtrip('test', { text: 'Hello from peer1!' });
+    expect(header.op).toBe(OP_EXT);
+    expect(type).toBe('test');
+    expect(data).toEqual({ text: 'Hello from peer1!' });
+  });
+
+  test('truncated frames are rejected', () => {
+    const frame = Buffer.from(encodeFrame('key', { keycode: 300, modifiers: 0, pressed: 1 }, 1, 1));
+    expect(decodeHeader(frame.subarray(0, HEADER_LENGTH - 1))).toBeNull();
+    expect(() => decodeBody(frame[1], frame.subarray(HEADER_LENGTH, frame.length - 1))).toThrow(RangeError);
+    expect(() => new SspBuf(new Uint8Array([0x80, 0x80])).varu()).toThrow(RangeError);
+  });
+});
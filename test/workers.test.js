@@ -0,0 +1,34 @@
+import { describe, expect, test } from 'bun:test';
+import { WorkerPool } from '../src/network/workers.js';
+
+const url = new URL('../src/network/bulk-worker.js', import.meta.url);
+const inline = async () => (await import('../src/network/bulk-worker.js')).jobs;
+
+describe('worker pool', () => {
+  test('jobs past the queue wait in run, buffers move to the worker and back', async () => {
+    const pool = new WorkerPool(url, { size: 1, queue: 1, inline });
+    const bodies = [0, 1, 2].map((i) => Buffer.alloc(1 << 20, `body ${i} `));
+    const queued = [];
+    const results = bodies.map((body) => {
+      const result = pool.run('hash', [body]);
+      queued.push(pool.queue.length);
+      return result;
+    });
+    expect(Math.max(...queued)).toBeLessThanOrEqual(1);
+    const hashed = await Promise.all(results);
+    expect(hashed.map(({ data }) => data.toString('latin1', 0, 7))).toEqual(['body 0 ', 'body 1 ', 'body 2 ']);
+    expect(hashed.every(({ hash }) => Buffer.isBuffer(hash) && hash.length === 16)).toBe(true);
+    // transferred rather than copied where there are workers
+    if (pool.size) expect(bodies[0].length).toBe(0);
+    pool.close();
+  });
+
+  test('a failing job rejects and the pool goes on', async () => {
+    const pool = new WorkerPool(url, { size: 1, inline });
+    const failed = await pool.run('unpack', [99, Buffer.alloc(1), 1]).catch((err) => err);
+    expect(failed.message).toBe('unsupported bulk codec 99');
+    const { data } = await pool.run('hash', [Buffer.from('still here')]);
+    expect(data.toString()).toBe('still here');
+    pool.close();
+  });
+});